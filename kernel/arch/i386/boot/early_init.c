@@ -21,6 +21,7 @@
 #include <sys/kthread.h>
 #include <arch/boot/early.h>
 #include <dev/hpet.h>
+#include <lime/vdata.h>
 #include <dev/bio.h>
 #include <video/lfbterm.h>
 
@@ -49,6 +50,9 @@ int early_init(void)
 
     if ((err = hpet_enumerate()))
         return err;
+
+    if ((err = vdata_init()))
+        return err;
     
     lapic_init();
 
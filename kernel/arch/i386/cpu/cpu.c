@@ -45,12 +45,31 @@ void setupsegs(void)
     fpu_ctx = fpus[cpuid()];
 }
 
+/**
+ * point SYSENTER at sysenter_entry. the cpu loads esp from the MSR and
+ * not from the tss, so it is given this cpu's tss and sysenter_entry
+ * picks the running thread's kernel stack (tss.esp0) out of it.
+ */
+static void sysenter_init(void)
+{
+    uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+    if ((edx & CPUID_SEP) == 0)
+        return;
+
+    wrmsr(MSR_SYSENTER_CS, SEG_KCODE << 3);
+    wrmsr(MSR_SYSENTER_ESP, (uintptr_t)&cpu->tss);
+    wrmsr(MSR_SYSENTER_EIP, (uintptr_t)sysenter_entry);
+}
+
 int cpu_init(void)
 {
     cli();          //ensure interrupts are disabled
     setupsegs();    //initialize segement registers
     idt_init();     //load interrupt descriptor
     lapic_init();   //initialize the local interrupt controller
+    sysenter_init();//fast system call entry
 
     cpu->ncli = 0;
     cpu->intena = 0;
@@ -59,6 +78,10 @@ int cpu_init(void)
     fpu_enable();
     fpu_init();
     fpu_disable();
+
+    // make kernel stores honour read-only ptes, so writing to a
+    // copy-on-write or page-cache page faults instead of writing through.
+    write_cr0(read_cr0() | CR0_WP);
     return 0;
 }
 
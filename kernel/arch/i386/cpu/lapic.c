@@ -8,6 +8,9 @@
 #include <locks/atomic.h>
 #include <sys/thread.h>
 #include <arch/i386/cpu.h>
+#include <dev/hpet.h>
+#include <lime/jiffies.h>
+#include <sys/sched.h>
 
 volatile uint32_t *lapic = (uint32_t *)0xFEC00000;
 
@@ -83,14 +86,71 @@ static void microdelay(int us)
     }
 }
 
-void lapic_init(void)
+#define LAPIC_CALIBRATE_JIFFIES 10
+#define LAPIC_DEFAULT_JIFFY     1000000 // the old guess, used until the HPET is up.
+
+/* timer count for one jiffy, measured against the HPET. the same on all cpus. */
+static uint32_t lapic_ticks_per_jiffy = 0;
+
+static inline uint32_t lapic_jiffy(void)
 {
-    SIR = ENABLE | (IRQ_OFFSET + IRQ_SPURIOUS);
+    return lapic_ticks_per_jiffy ? lapic_ticks_per_jiffy : LAPIC_DEFAULT_JIFFY;
+}
+
+/**
+ * the bootstrap cpu first gets here from cpu_init(), before hpet_enumerate().
+ * nothing is latched then, so its second lapic_init() from early_init() calibrates.
+ */
+static void lapic_timer_calibrate(void)
+{
+    uint32_t start = 0, ticks = 0;
+
+    if (lapic_ticks_per_jiffy)
+        return;
+
+    if ((ticks = hpet_jiffy_ticks()) == 0)
+        return;
 
     LVT_TR = MASKED;
     TDCR = X1;
-    TICR = 1000000;
+
+    // start on a fresh HPET tick.
+    start = hpet_counter();
+    while (hpet_counter() == start)
+        CPU_RELAX();
+
+    TICR = 0xFFFFFFFF;
+    start = hpet_counter();
+    while ((hpet_counter() - start) < ticks * LAPIC_CALIBRATE_JIFFIES)
+        CPU_RELAX();
+    lapic_ticks_per_jiffy = (0xFFFFFFFF - TCCR) / LAPIC_CALIBRATE_JIFFIES;
+    TICR = 0;
+}
+
+void lapic_timer_periodic(void)
+{
+    LVT_TR = MASKED;
+    TDCR = X1;
+    TICR = lapic_jiffy();
     LVT_TR = PERIODIC | (IRQ_OFFSET + IRQ_TIMER);
+}
+
+void lapic_timer_oneshot(unsigned long jiffies)
+{
+    unsigned long max = 0xFFFFFFFF / lapic_jiffy();
+
+    LVT_TR = MASKED;
+    TDCR = X1;
+    LVT_TR = IRQ_OFFSET + IRQ_TIMER; // one-shot.
+    TICR = MAX(MIN(jiffies, max), 1UL) * lapic_jiffy();
+}
+
+void lapic_init(void)
+{
+    SIR = ENABLE | (IRQ_OFFSET + IRQ_SPURIOUS);
+
+    lapic_timer_calibrate();
+    lapic_timer_periodic();
 
     LVT_LINT0 = MASKED;
     LVT_LINT1 = MASKED;
@@ -135,6 +195,14 @@ void lapic_startup(int id, uint16_t addr)
     }
 }
 
+void lapic_send_ipi(int id, int ipi)
+{
+    ICRHI = (id << 24);
+    ICR = (ASSERT | LEVEL) | LAPIC_SHORTHAND_NO | (ipi & 0xff);
+    while (ICR & DELIVS)
+        ;
+}
+
 void lapic_send_ipi_to_all_not_self(int ipi)
 {
     ICR = (ASSERT | LEVEL) | LAPIC_SHORTHAND_EXCEPT_SELF | (ipi & 0xff);
@@ -145,6 +213,12 @@ void lapic_send_ipi_to_all_not_self(int ipi)
 void lapic_timerintr(void)
 {
     atomic_incr(&cpu->timer_ticks);
+    jiffies_update();
+    sched_tick();
     if (current)
-        atomic_decr(&current->t_sched_attr.t_timeslice);
+    {
+        atomic_incr(&current->t_sched_attr.age);
+        if (atomic_read(&current->t_sched_attr.t_timeslice))
+            atomic_decr(&current->t_sched_attr.t_timeslice);
+    }
 }
\ No newline at end of file
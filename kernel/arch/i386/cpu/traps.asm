@@ -38,8 +38,13 @@ irq%1:
 %endmacro
 
 SEG_KDATA   equ 2
+SEG_UCODE   equ 3
+SEG_UDATA   equ 4
 SEG_KCPU    equ 6
 
+T_SYSENTER  equ 0x81
+TSS_ESP0    equ 4
+
 %macro pushcontext 0
     pushsegs
     pushad
@@ -114,13 +119,16 @@ IRQ   0,    32
 IRQ  40,    72
 
 extern trap
+extern sysenter_dispatch
 
 extern printk
 global trapret
 global forkret
+global sysenter_entry
 
 common_stub:
     pushcontext
+    cld             ;gates don't clear DF, the interrupted code may have it set (e.g. memmove)
     push    dword esp
     call    trap
     add esp, 4
@@ -129,6 +137,38 @@ trapret:
     add     esp, 8 ;pop-off err and intno
     iret
 
+; SYSENTER from user space: eax = syscall number, ebx, esi, edi, ebp = arguments,
+; ecx = user esp and edx = user eip to return to. the MSR points esp at this
+; cpu's tss, load the thread's kernel stack from it and build a trapframe
+; so everything past here (fork, signals, exec) sees an ordinary syscall.
+sysenter_entry:
+    mov esp, [esp + TSS_ESP0]
+    push dword (SEG_UDATA << 3) | 3 ;ss
+    push ecx                        ;esp
+    pushfd
+    or dword [esp], 0x200           ;user runs with interrupts on
+    push dword (SEG_UCODE << 3) | 3 ;cs
+    push edx                        ;eip
+    push dword 0
+    push dword T_SYSENTER
+    cld                             ;user DF is in the saved eflags, C code expects it clear
+    pushcontext
+    sti
+    push    dword esp
+    call    sysenter_dispatch
+    add esp, 4
+    test eax, eax
+    jnz trapret ;the frame was redirected (signal delivery), leave through iret.
+    cli
+    popcontext
+    add esp, 8  ;pop-off err and intno
+    pop edx     ;eip
+    add esp, 8  ;cs, eflags
+    pop ecx     ;esp
+    add esp, 4  ;ss
+    sti         ;takes effect after sysexit
+    sysexit
+
 forkret:
     popcontext
     add esp, 8
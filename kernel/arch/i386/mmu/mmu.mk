@@ -1,4 +1,6 @@
 mmuobjs=\
 $(mmudir)/pagefault.o\
 $(mmudir)/page.o\
-$(mmudir)/table.o
\ No newline at end of file
+$(mmudir)/table.o\
+$(mmudir)/tlb.o\
+$(mmudir)/uaccess.o
\ No newline at end of file
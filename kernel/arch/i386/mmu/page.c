@@ -9,6 +9,7 @@
 #include <lib/string.h>
 #include <arch/i386/traps.h>
 #include <mm/mm_zone.h>
+#include <arch/i386/cpu.h>
 
 /*flush the tlb*/
 void tlb_flush(void)
@@ -47,6 +48,116 @@ static int _32bit_unmaptable(int t)
     return 0;
 }
 
+/**
+ * User page tables are shared copy-on-write between a parent and its child
+ * after fork(). Sharing is marked by clearing the W bit of the page directory
+ * entry (user tables are otherwise always mapped writable), which also makes
+ * every page behind it read-only. A page's reference count is the number of
+ * page tables mapping it, so pages behind a shared table are counted once.
+ *
+ * ptshare_lock serializes unsharing and dropping of shared tables so
+ * a table's reference count can't change between check and act.
+ */
+static spinlock_t *ptshare_lock = SPINLOCK_NEW("ptshare");
+
+#define _32bit_table_shared(t) (((t) < 768) && PDE(t)->structure.p && !PDE(t)->structure.w)
+
+/*give this address space a private copy of a shared pagetable*/
+static int _32bit_unshare(int t)
+{
+    int err = 0;
+    pte_t *pt = NULL, *spt = NULL;
+    uintptr_t frame = 0, shared = 0;
+
+    if (!_32bit_table_shared(t))
+        return 0;
+
+    spin_lock(ptshare_lock);
+    shared = PGROUND(PDE(t)->raw);
+
+    if (__page_count(shared) > 1)
+    {
+        err = -ENOMEM;
+        if (!(frame = pmman.alloc()))
+            goto error;
+
+        if (!(pt = (pte_t *)paging_mount(frame)))
+            goto error;
+
+        if (!(spt = (pte_t *)paging_mount(shared)))
+            goto error;
+
+        /**
+         * both copies lose write access to the pages, each page is now
+         * mapped by two tables and is copied on the next write.
+         * whoever still shares 'spt' has it mapped read-only already,
+         * so no other tlb can hold a writable entry from it.
+         */
+        for (int i = 0; i < 1024; ++i)
+        {
+            if (!spt[i].structure.p)
+            {
+                pt[i].raw = 0;
+                continue;
+            }
+            spt[i].raw &= ~VM_W;
+            pt[i].raw = spt[i].raw;
+            __page_incr(PGROUND(spt[i].raw));
+        }
+
+        paging_unmount((uintptr_t)spt);
+        paging_unmount((uintptr_t)pt);
+        PDE(t)->raw = frame | PGOFFSET(PDE(t)->raw) | VM_W;
+    }
+    else
+    {
+        PDE(t)->raw |= VM_W; // everyone else has let go of it.
+        shared = 0;
+    }
+
+    spin_unlock(ptshare_lock);
+    // threads of this address space on other cpus may still walk the old table.
+    tlb_shootdown_all();
+    if (shared)
+        tlb_free_frame(shared);
+    return 0;
+error:
+    if (pt)
+        paging_unmount((uintptr_t)pt);
+    if (frame)
+        pmman.free(frame);
+    spin_unlock(ptshare_lock);
+    return err;
+}
+
+/**
+ * drop this address space's reference to a shared pagetable.
+ * returns 1 if the table is still in use elsewhere and was let go,
+ * or 0 if this address space is the last user and must unmap it.
+ */
+static int _32bit_drop_shared(int t)
+{
+    int dropped = 0;
+
+    if (!_32bit_table_shared(t))
+        return 0;
+
+    spin_lock(ptshare_lock);
+    if ((dropped = (__page_count(PGROUND(PDE(t)->raw)) > 1)))
+    {
+        pmman.free(PGROUND(PDE(t)->raw));
+        PDE(t)->raw = 0;
+        paging_invlpg((uintptr_t)PTE(t, 0));
+    }
+    spin_unlock(ptshare_lock);
+    return dropped;
+}
+
+int paging_unshare(uintptr_t v)
+{
+    return _32bit_unshare(V_PDI(v));
+}
+
 /*map page*/
 static int _32bit_map(uintptr_t frame, int t, int p, int flags)
 {
@@ -58,6 +169,8 @@ static int _32bit_map(uintptr_t frame, int t, int p, int flags)
         if ((err = _32bit_maptable(t, flags)))
             return err;
     }
+    else if ((err = _32bit_unshare(t)))
+        return err;
     if (PTE(t, p)->structure.p)
         panic("%d:%d page [%p], map:%p available\n", t, p, _VADDR(t, p), paging_getmapping(_VADDR(t, p))->raw);
     PTE(t, p)->raw = PGROUND(frame) | flags;
@@ -75,6 +188,8 @@ static int _32bit_map_err(uintptr_t frame, int t, int p, int flags)
         if ((err = _32bit_maptable(t, flags)))
             return err;
     }
+    else if ((err = _32bit_unshare(t)))
+        return err;
     if (PTE(t, p)->structure.p)
         return -EEXIST;
     PTE(t, p)->raw = PGROUND(frame) | flags;
@@ -85,20 +200,36 @@ static int _32bit_map_err(uintptr_t frame, int t, int p, int flags)
 /*unmap page*/
 static int _32bit_unmap(int t, int p)
 {
+    int err = 0;
+    uintptr_t frame = 0;
     VM_CHECKBOUNDS(t, p);
     if (!PDE(t)->structure.p)
         panic("pagetable[%p] unavailable\n", _VADDR(t, p));
     if (!PTE(t, p)->structure.p)
         panic("page %p unavailable, return [%p]\n", _VADDR(t, p), return_address(0));
-    pmman.free(GET_FRAMEADDR(_VADDR(t, p)));
+    if ((err = _32bit_unshare(t)))
+        return err;
+    frame = GET_FRAMEADDR(_VADDR(t, p));
     PTE(t, p)->raw = 0;
-    paging_invlpg(_VADDR(t, p));
+    if (t < 768)
+    {
+        // other cpus may still cache the mapping until they ack the shootdown.
+        tlb_shootdown(_VADDR(t, p));
+        tlb_free_frame(frame);
+    }
+    else
+    {
+        paging_invlpg(_VADDR(t, p));
+        pmman.free(frame);
+    }
     return 0;
 }
 
 /*unmap page if mapped*/
 static int _32bit_unmap_mapped(int t, int p)
 {
+    int err = 0;
+    uintptr_t frame = 0;
     VM_CHECKBOUNDS(t, p);
     if (!PDE(t)->structure.p)
     {
@@ -110,9 +241,21 @@ static int _32bit_unmap_mapped(int t, int p)
         paging_invlpg(_VADDR(t, p));
         return -ENOENT;
     }
-    pmman.free(GET_FRAMEADDR(_VADDR(t, p)));
+    if ((err = _32bit_unshare(t)))
+        return err;
+    frame = GET_FRAMEADDR(_VADDR(t, p));
     PTE(t, p)->raw = 0;
-    paging_invlpg(_VADDR(t, p));
+    if (t < 768)
+    {
+        // other cpus may still cache the mapping until they ack the shootdown.
+        tlb_shootdown(_VADDR(t, p));
+        tlb_free_frame(frame);
+    }
+    else
+    {
+        paging_invlpg(_VADDR(t, p));
+        pmman.free(frame);
+    }
     return 0;
 }
 
@@ -236,10 +379,17 @@ void paging_proc_unmap(uintptr_t pgd)
     {
         if (PDE(pdi)->structure.p)
         {
+            if (_32bit_drop_shared(pdi))
+                continue;
+            /**
+             * no cpu has this address space loaded any more, so pages are
+             * freed without a shootdown each, switching back flushes the tlb.
+             * the table is freed whole, its entries need not be cleared.
+             */
             for (int pte = 0; pte < 1024; ++pte)
             {
                 if (PTE(pdi, pte)->structure.p)
-                    _32bit_unmap(pdi, pte);
+                    pmman.free(PGROUND(PTE(pdi, pte)->raw));
             }
             _32bit_unmaptable(pdi);
         }
@@ -416,53 +566,61 @@ int paging_init(void)
     return 0;
 }
 
+/**
+ * copy-on-write copy of the user half of 'src' into 'dst'.
+ *
+ * page tables themselves are shared, each one gets a single reference
+ * and is write-protected in both page directories. nothing below the
+ * page directory is touched until one side writes, see _32bit_unshare().
+ */
 int paging_lazycopy(uintptr_t dst, uintptr_t src)
 {
     int err = 0;
-    pte_t *srcpt = NULL;
-    pde_t *srcpd = NULL;
-    uintptr_t oldpgdir = 0;
+    int nshared = 0;
+    pde_t *srcpd = NULL, *dstpd = NULL;
 
     if (!(srcpd = __cast_to_type(srcpd) paging_mount(src)))
+        return -ENOMEM;
+
+    if (!(dstpd = __cast_to_type(dstpd) paging_mount(dst)))
     {
-        err = -ENOMEM;
-        goto error;
+        paging_unmount((uintptr_t)srcpd);
+        return -ENOMEM;
     }
 
-    oldpgdir = paging_switch(dst);
-
+    spin_lock(ptshare_lock);
     for (int i = 0; i < 768; ++i)
     {
         if (!srcpd[i].structure.p)
             continue;
 
-        if ((err = _32bit_maptable(i, srcpd[i].raw & PAGEMASK)))
-            goto error;
-
-        if ((srcpt = __cast_to_type(srcpt) paging_mount((uintptr_t)PGROUND(srcpd[i].raw))) == NULL)
+        if (dstpd[i].structure.p)
         {
-            err = -ENOMEM;
-            goto error;
-        }
-
-        for (int j =0; j < 1024; ++j)
-        {
-            if (!srcpt[j].structure.p)
-                continue;
-            PTE(i, j)->raw = srcpt[j].raw & ~VM_W;
-            if (srcpt[j].structure.w)
-                srcpt[j].structure.w = 0;
-            send_tlb_shootdown();
-            __page_incr(PGROUND(srcpt[j].raw));
+            err = -EEXIST;
+            break;
         }
 
-        paging_unmount((uintptr_t)srcpt);
+        srcpd[i].raw &= ~VM_W;
+        dstpd[i].raw = srcpd[i].raw;
+        __page_incr(PGROUND(srcpd[i].raw));
+        nshared++;
     }
+    spin_unlock(ptshare_lock);
 
-    paging_switch(oldpgdir);
+    paging_unmount((uintptr_t)dstpd);
     paging_unmount((uintptr_t)srcpd);
-    
-    return 0;
-error:
+
+    if (nshared == 0)
+        return err;
+
+    /**
+     * 'src' just lost write access, one flush covers the whole copy.
+     * other cpus only need it if they have this address space loaded.
+     */
+    if (src == PGROUND(read_cr3()))
+        tlb_shootdown_all();
+    else
+        send_tlb_shootdown();
+
     return err;
 }
\ No newline at end of file
@@ -20,12 +20,22 @@
 #include <mm/mapping.h>
 #include <fs/inode.h>
 #include <mm/usermap.h>
+#include <arch/i386/uaccess.h>
 
 int default_pgf_handler(vmr_t *region, vm_fault_t *vm);
 
-void paging_tbl_shootdown()
+/**
+ * a kernel-mode fault the address space couldn't resolve,
+ * resume at the fixup if it came from a user access (copy_from_user() & co).
+ */
+static int fault_fixup(trapframe_t *tf, int in_user)
 {
-    write_cr3(read_cr3());
+    uintptr_t fixup = 0;
+
+    if (in_user || (fixup = extable_fixup(tf->eip)) == 0)
+        return 0;
+    tf->eip = fixup;
+    return 1;
 }
 
 void do_page_fault(trapframe_t *tf)
@@ -70,7 +80,7 @@ void do_page_fault(trapframe_t *tf)
     if (!ISKERNEL_ADDR(fault.addr))
     {
         mmap_lock(mmap);
-        if ((region = mmap_find(mmap, fault.addr)) == NULL)
+        if ((region = mmap_find_hinted(mmap, fault.addr, current ? &current->t_vmr_hint : NULL)) == NULL)
         {
             mmap_unlock(mmap);
             goto send_SIGSEGV;
@@ -100,46 +110,139 @@ void do_page_fault(trapframe_t *tf)
 
 
 kernel_fault:
+    if (fault_fixup(tf, in_user))
+        goto done;
+
     if (in_user)
         goto send_SIGSEGV;
 
     panic("%s(%p): %s: %p: eno: %d\n", __func__, fault.addr, in_user ? "user" : "kernel", tf->eip, tf->eno);
-    if (proc)
-        kill(getpid(), SIGSEGV);
-
-    printk("END\n");
 done:
     popcli();
     return;
 
+/**
+ * a kernel-mode fault that is neither resolved nor a user access with a fixup
+ * can't be unwound, signalling the process would only retry the instruction.
+ */
 send_SIGBUS:
-    printk("%s(%p): tid: %d, in %s space: eip: %p\n", __func__, fault.addr, thread_self(), in_user ? "user" : "kernel", tf->eip);
-    
-    if (proc)
-        kill(getpid(), SIGBUS);
-    else
-        panic("%s:%d: Kernel SIGBUS\n", __FILE__, __LINE__);
+    if (fault_fixup(tf, in_user))
+        goto done;
+
+    if (!in_user || !proc)
+        panic("%s(%p): kernel SIGBUS @eip: %p, eno: %d\n", __func__, fault.addr, tf->eip, tf->eno);
+
+    printk("%s(%p): tid: %d, in user space: eip: %p\n", __func__, fault.addr, thread_self(), tf->eip);
+    kill(getpid(), SIGBUS);
+    goto done;
 
-    return;
 send_SIGSEGV:
-    
-    printk("%s(%p): tid: %d, in %s space: eip: %p\n", __func__, fault.addr, thread_self(), in_user ? "user" : "kernel", tf->eip);
-    if (proc)
-        kill(getpid(), SIGSEGV);
-    else
-        panic("%s:%d: Kernel SIGSEGV\n", __FILE__, __LINE__);
+    if (fault_fixup(tf, in_user))
+        goto done;
+
+    if (!in_user || !proc)
+        panic("%s(%p): kernel SIGSEGV @eip: %p, eno: %d\n", __func__, fault.addr, tf->eip, tf->eno);
+
+    printk("%s(%p): tid: %d, in user space: eip: %p\n", __func__, fault.addr, thread_self(), tf->eip);
+    kill(getpid(), SIGSEGV);
+    goto done;
+}
+
+/**
+ * bytes of file data backing the page at 'addr' of a file-backed region,
+ * the rest of the page is zero-filled (e.g. .bss past an ELF segment's filesz).
+ */
+static size_t vmr_file_bytes(vmr_t *region, uintptr_t addr, off_t offset)
+{
+    size_t skip = PGROUND(addr) - region->start;
+
+    if ((skip >= region->filesz) || ((size_t)offset >= region->file->i_size))
+        return 0;
+    return __min(PAGESZ, __min(region->filesz - skip, region->file->i_size - offset));
+}
+
+/**
+ * fault in a page of a private file mapping.
+ *
+ * a page made entirely of file data is taken from where the filesystem
+ * keeps it in memory (initrd files are executed in place), or else from
+ * the inode's page cache. a read fault maps that page itself, read-only,
+ * so a later write takes the copy-on-write path. a write fault copies it.
+ * partial pages (file tail, .bss boundary) always get a private copy.
+ */
+static int vmr_private_fault(vmr_t *region, vm_fault_t *vm, off_t offset, int write)
+{
+    int err = 0;
+    size_t size = 0;
+    uintptr_t frame = 0, copy_frame = 0, vaddr = 0;
+
+    size = vmr_file_bytes(region, vm->addr, offset);
+
+    if ((size == PAGESZ) && !PGOFFSET(offset)) {
+        if (inode_getframe(region->file, offset / PAGESZ, &frame) &&
+            (err = inode_getpage(region->file, offset / PAGESZ, &frame, NULL)))
+            return err;
+
+        if (!write) {
+            if ((err = paging_identity_map(frame, PGROUND(vm->addr), PAGESZ, region->vflags & ~VM_W)))
+                __page_put(frame);
+            return err;
+        }
+
+        if ((copy_frame = pmman.alloc()) == 0) {
+            __page_put(frame);
+            return -ENOMEM;
+        }
+
+        paging_memcpypp(copy_frame, frame, PAGESZ);
+        __page_put(frame);
+    } else {
+        if ((copy_frame = pmman.alloc()) == 0)
+            return -ENOMEM;
+
+        if ((vaddr = paging_mount(copy_frame)) == 0) {
+            pmman.free(copy_frame);
+            return -ENOMEM;
+        }
+
+        memset((void *)vaddr, 0, PAGESZ);
+        if (size)
+            iread(region->file, offset, (void *)vaddr, size);
+        paging_unmount(vaddr);
+    }
+
+    if ((err = paging_identity_map(copy_frame, PGROUND(vm->addr), PAGESZ, region->vflags)))
+        pmman.free(copy_frame);
+    return err;
+}
+
+/**
+ * fault in a page of a shared file mapping, the cached page itself is mapped.
+ * a writable mapping marks the page dirty so the shrinker keeps it.
+ */
+static int vmr_shared_fault(vmr_t *region, vm_fault_t *vm, off_t offset)
+{
+    int err = 0;
+    uintptr_t frame = 0;
+    page_t *page = NULL;
+
+    if ((err = inode_getpage(region->file, offset / PAGESZ, &frame, &page)))
+        return err;
+
+    if (__vmr_write(region))
+        page->flags.dirty = 1;
+
+    if ((err = paging_identity_map(frame, PGROUND(vm->addr), PAGESZ, region->vflags)))
+        __page_put(frame);
+    return err;
 }
 
 int default_pgf_handler(vmr_t *region, vm_fault_t *vm)
 {
     int err = 0;
     int flags = 0;
-    size_t size = 0;
     off_t offset = 0;
-    char buf[PAGESZ];
     int frame_refs = 0;
-    page_t *page = NULL;
-    shared_mapping_t *shared __unused = NULL;
     uintptr_t frame = 0, copy_frame = 0;
 
     if (region == NULL || vm == NULL)
@@ -152,6 +255,19 @@ int default_pgf_handler(vmr_t *region, vm_fault_t *vm)
         if (!__vmr_write(region))
             return -EACCES;
 
+        // the page table may still be shared with a fork()ed address space.
+        if ((err = paging_unshare(PGROUND(vm->addr))))
+            return err;
+        vm->COW = paging_getmapping(vm->addr);
+
+        if (vm->COW && __vmr_shared(region))
+        {
+            // MAP_SHARED pages stay shared across fork(), just restore write access.
+            vm->COW->raw |= VM_W;
+            paging_invlpg(PGROUND(vm->addr));
+            return 0;
+        }
+
         if (vm->COW && !__vmr_shared(region))
         {
             // copy on write
@@ -170,14 +286,14 @@ int default_pgf_handler(vmr_t *region, vm_fault_t *vm)
                 paging_invlpg(vm->addr);
                 paging_memcpypp(copy_frame, frame, PAGESZ);
                 paging_identity_map(copy_frame, PGROUND(vm->addr), PAGESZ, flags);
-                send_tlb_shootdown();
+                // other cpus running this address space may still read the old frame.
+                tlb_shootdown(PGROUND(vm->addr));
                 __page_put(frame);
             }
             else if (frame_refs == 1)
             {
                 vm->COW->raw |= VM_W;
                 paging_invlpg(PGROUND(vm->addr));
-                send_tlb_shootdown();
             }
             else
                 panic("%s:%d: PGF(%p)\n", __FILE__, __LINE__, vm->addr);
@@ -198,31 +314,13 @@ int default_pgf_handler(vmr_t *region, vm_fault_t *vm)
             if (region->file->i_size == 0)
                 return -EFAULT;
 
-            if (!__vmr_shared(region)) {
-                if ((frame = pmman.alloc()) == 0)
-                    return -ENOMEM;
-                size = __min(PAGESZ, __min(region->filesz, region->file->i_size - offset));
-                memset(buf, 0, PAGESZ);
-                iread(region->file, offset, buf, size);
-                paging_memcpyvp(frame, (uintptr_t)buf, PAGESZ);
-                if ((err = paging_identity_map(frame, PGROUND(vm->addr), PAGESZ, region->vflags)))
-                {
-                    pmman.free(frame);
-                    return err;
-                }
-            }
-            else {
-                err = inode_getpage(region->file, offset / PAGESZ, &frame, &page);
-                //printk("offset: %dframe: %p, err: %d\n", offset, frame, err);
-                __page_incr(frame);
-                // if ((err = shared_mapping_alloc(region->mmap, region->file, offset / PAGESZ, PGROUND(vm->addr), &shared)))
-                // return err;
-
-                if ((err = paging_identity_map(frame, PGROUND(vm->addr), PAGESZ, region->vflags)))
-                    return err;
-                // panic("%s: %d: shared page\n", __FILE__, __LINE__);
-            }
-            send_tlb_shootdown();
+            if (!__vmr_shared(region))
+                err = vmr_private_fault(region, vm, offset, 1);
+            else
+                err = vmr_shared_fault(region, vm, offset);
+
+            if (err)
+                return err;
         }
         else
         {
@@ -230,7 +328,6 @@ int default_pgf_handler(vmr_t *region, vm_fault_t *vm)
                 return err;
             if (__vmr_zero(region))
                 memset((void *)PGROUND(vm->addr), 0, PAGESZ);
-            send_tlb_shootdown();
         }
         return 0;
     }
@@ -247,32 +344,13 @@ int default_pgf_handler(vmr_t *region, vm_fault_t *vm)
         if (region->file->i_size == 0)
             return -EFAULT;
 
-        if (!__vmr_shared(region)) {
-            if ((frame = pmman.alloc()) == 0)
-                return -ENOMEM;
-            size = __min(PAGESZ, __min(region->filesz, region->file->i_size - offset));
-            memset(buf, 0, PAGESZ);
-            iread(region->file, offset, buf, size);
-            paging_memcpyvp(frame, (uintptr_t)buf, PAGESZ);
-            if ((err = paging_identity_map(frame, PGROUND(vm->addr), PAGESZ, region->vflags)))
-            {
-                pmman.free(frame);
-                return err;
-            }
-        }
+        if (!__vmr_shared(region))
+            err = vmr_private_fault(region, vm, offset, 0);
         else
-        {
-            err = inode_getpage(region->file, offset / PAGESZ, &frame, &page);
-            // printk("offset: %dframe: %p, err: %d\n", offset, frame, err);
-            __page_incr(frame);
-            // if ((err = shared_mapping_alloc(region->mmap, region->file, offset / PAGESZ, PGROUND(vm->addr), &shared)))
-                // return err;
-            
-            if ((err = paging_identity_map(frame, PGROUND(vm->addr), PAGESZ, region->vflags)))
-                return err;
-            // panic("%s: %d: shared page\n", __FILE__, __LINE__);
-        }
-        send_tlb_shootdown();
+            err = vmr_shared_fault(region, vm, offset);
+
+        if (err)
+            return err;
     }
     else
     {
@@ -280,16 +358,20 @@ int default_pgf_handler(vmr_t *region, vm_fault_t *vm)
             return -ENOMEM;
         if (__vmr_zero(region))
         {
-            memset(buf, 0, PAGESZ);
-            paging_memcpyvp(frame, (uintptr_t)buf, PAGESZ);
+            if ((copy_frame = paging_mount(frame)) == 0)
+            {
+                pmman.free(frame);
+                return -ENOMEM;
+            }
+            memset((void *)copy_frame, 0, PAGESZ);
+            paging_unmount(copy_frame);
         }
         if ((err = paging_identity_map(frame, PGROUND(vm->addr), PAGESZ, region->vflags)))
         {
             pmman.free(frame);
             return err;
         }
-        send_tlb_shootdown();
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,347 @@
+#include <arch/i386/tlb.h>
+#include <arch/i386/cpu.h>
+#include <arch/i386/lapic.h>
+#include <arch/i386/traps.h>
+#include <arch/i386/paging.h>
+#include <arch/system.h>
+#include <lime/preempt.h>
+#include <mm/mmap.h>
+#include <mm/pmm.h>
+#include <mm/kalloc.h>
+
+/**
+ * Targeted TLB shootdowns.
+ *
+ * Every mmap_t carries the mask of cpus that have its page directory
+ * loaded, maintained by tlb_switch(). Invalidations are queued on the
+ * issuing cpu's tlb_batch and posted to the inboxes of the other cpus in
+ * the mask only; a cpu is sent an IPI when its inbox goes from empty to
+ * non-empty, so back-to-back shootdowns ride on a single interrupt.
+ * An address space loaded on one cpu only never causes an IPI.
+ *
+ * Shootdowns are not waited for, but every post bumps the target inbox's
+ * 'seq' and the target acks by publishing the last 'seq' it flushed for
+ * in 'done'. Frames unmapped by a batch (tlb_free_frame()) are put on the
+ * issuing cpu's retire list with a snapshot of every other cpu's 'seq'
+ * and only go back to the allocator once all of those have been acked,
+ * so no stale tlb entry can reach a reused frame. Waiting for acks in
+ * place could deadlock against a cpu spinning with interrupts off on a
+ * lock we hold, so the list is drained lazily on later flushes.
+ */
+
+#define TLB_RETIRE  8   // preallocated retire records per cpu.
+
+/* frames of a sent batch, freed when every other cpu has flushed up to 'seq'. */
+typedef struct tlb_retire
+{
+    struct tlb_retire *next;
+    int         nframe;
+    int         pooled; // from 'pool', not kmalloc()'d.
+    uintptr_t   frame[TLB_BATCH];
+    uintptr_t   seq[NCPU];
+} tlb_retire_t;
+
+static struct tlb_retireq
+{
+    tlb_retire_t *head; // oldest.
+    tlb_retire_t *tail;
+    tlb_retire_t *free;
+    tlb_retire_t pool[TLB_RETIRE];
+} tlb_retireq[NCPU];
+
+static inline void tlb_inbox_lock(tlb_inbox_t *inbox)
+{
+    while (atomic_xchg(&inbox->lock, 1))
+        CPU_RELAX();
+}
+
+static inline void tlb_inbox_unlock(tlb_inbox_t *inbox)
+{
+    atomic_write(&inbox->lock, 0);
+}
+
+/* post a batch to cpu 'id', interrupting it if it has nothing pending yet. */
+static void tlb_post(int id, tlb_batch_t *batch)
+{
+    int idle = 0;
+    tlb_inbox_t *inbox = &cpus[id].tlb_inbox;
+
+    tlb_inbox_lock(inbox);
+    idle = !inbox->count && !inbox->full;
+    inbox->seq++;
+    if (batch->full || (inbox->count + batch->count) > TLB_BATCH)
+        inbox->full = 1;
+    else {
+        for (int i = 0; i < batch->count; ++i)
+            inbox->addr[inbox->count++] = batch->addr[i];
+    }
+    tlb_inbox_unlock(inbox);
+
+    if (idle)
+        lapic_send_ipi(cpus[id].cpuid, T_TLB_SHOOTDOWN);
+}
+
+/* is 'cpu->mmap' the address space actually loaded? temporary switches bypass tlb_switch(). */
+static inline int tlb_mm_loaded(void)
+{
+    return cpu->mmap && (PGROUND(read_cr3()) == PGROUND(cpu->mmap->pgdir));
+}
+
+/* have all cpus but this one flushed for the posts 'r' was retired after? */
+static int tlb_acked(tlb_retire_t *r)
+{
+    for (int i = 0; i < ncpu; ++i) {
+        if (&cpus[i] == cpu)
+            continue;
+        if ((intptr_t)(atomic_read(&cpus[i].tlb_inbox.done) - r->seq[i]) < 0)
+            return 0;
+    }
+    return 1;
+}
+
+static void tlb_retire_free(struct tlb_retireq *q, tlb_retire_t *r)
+{
+    for (int i = 0; i < r->nframe; ++i)
+        pmman.free(r->frame[i]);
+
+    if (r->pooled) {
+        r->next = q->free;
+        q->free = r;
+    } else
+        kfree(r);
+}
+
+/* free the frames of the retired batches that have been acked, oldest first. */
+static void tlb_reclaim(struct tlb_retireq *q)
+{
+    tlb_retire_t *r = NULL;
+
+    while ((r = q->head) && tlb_acked(r)) {
+        if (!(q->head = r->next))
+            q->tail = NULL;
+        tlb_retire_free(q, r);
+    }
+}
+
+static tlb_retire_t *tlb_retire_alloc(struct tlb_retireq *q)
+{
+    tlb_retire_t *r = NULL;
+
+    if (!q->head && !q->free) {
+        for (int i = 0; i < TLB_RETIRE; ++i) {
+            q->pool[i].pooled = 1;
+            q->pool[i].next = q->free;
+            q->free = &q->pool[i];
+        }
+    }
+
+    if ((r = q->free)) {
+        q->free = r->next;
+        return r;
+    }
+
+    if ((r = kmalloc(sizeof *r))) {
+        r->pooled = 0;
+        return r;
+    }
+
+    // out of memory, wait for the oldest batch, acking others so they can't wait on us.
+    while (!tlb_acked(q->head)) {
+        tlb_handle_shootdown();
+        CPU_RELAX();
+    }
+    r = q->head;
+    if (!(q->head = r->next))
+        q->tail = NULL;
+    for (int i = 0; i < r->nframe; ++i)
+        pmman.free(r->frame[i]);
+    return r;
+}
+
+/* pass the frames of a just sent batch on to the retire list. */
+static void tlb_retire(tlb_batch_t *batch)
+{
+    tlb_retire_t *r = NULL;
+    struct tlb_retireq *q = &tlb_retireq[cpu - cpus];
+
+    tlb_reclaim(q);
+    r = tlb_retire_alloc(q);
+
+    r->next = NULL;
+    r->nframe = batch->nframe;
+    for (int i = 0; i < batch->nframe; ++i)
+        r->frame[i] = batch->frame[i];
+    for (int i = 0; i < ncpu; ++i)
+        r->seq[i] = cpus[i].tlb_inbox.seq;
+    batch->nframe = 0;
+
+    if (!q->head && tlb_acked(r)) {
+        tlb_retire_free(q, r);
+        return;
+    }
+
+    if (q->tail)
+        q->tail->next = r;
+    else
+        q->head = r;
+    q->tail = r;
+}
+
+void tlb_flush_pending(void)
+{
+    uintptr_t targets = 0;
+    tlb_batch_t *batch = NULL;
+
+    pushcli();
+    batch = &cpu->tlb_batch;
+    batch->defer = 0;
+
+    if (batch->mmap && (batch->count || batch->full)) {
+        targets = atomic_read(&batch->mmap->cpumask) & ~_BS(cpu->cpuid);
+        for (int i = 0; targets && i < ncpu; ++i) {
+            if (targets & _BS(i))
+                tlb_post(i, batch);
+        }
+    }
+
+    batch->mmap = NULL;
+    batch->count = 0;
+    batch->full = 0;
+
+    if (batch->nframe)
+        tlb_retire(batch);
+    else
+        tlb_reclaim(&tlb_retireq[cpu - cpus]);
+    popcli();
+}
+
+void tlb_defer(void)
+{
+    pushcli();
+    cpu->tlb_batch.defer = 1;
+    popcli();
+}
+
+static void tlb_queue(uintptr_t addr, int all)
+{
+    tlb_batch_t *batch = &cpu->tlb_batch;
+
+    if (batch->mmap != cpu->mmap) {
+        int defer = batch->defer;
+        tlb_flush_pending();
+        batch->defer = defer;
+        batch->mmap = cpu->mmap;
+    }
+
+    if (all || batch->count >= TLB_BATCH)
+        batch->full = 1;
+    else
+        batch->addr[batch->count++] = PGROUND(addr);
+
+    if (!batch->defer)
+        tlb_flush_pending();
+}
+
+void tlb_shootdown(uintptr_t addr)
+{
+    pushcli();
+    paging_invlpg(PGROUND(addr));
+    if (ISKERNEL_ADDR(addr) || !tlb_mm_loaded())
+        send_tlb_shootdown(); // don't know who else has this page directory.
+    else
+        tlb_queue(addr, 0);
+    popcli();
+}
+
+void tlb_shootdown_all(void)
+{
+    pushcli();
+    tlb_flush();
+    if (!tlb_mm_loaded())
+        send_tlb_shootdown();
+    else
+        tlb_queue(0, 1);
+    popcli();
+}
+
+void tlb_free_frame(uintptr_t frame)
+{
+    tlb_batch_t *batch = NULL;
+
+    pushcli();
+    batch = &cpu->tlb_batch;
+    if (batch->nframe >= TLB_BATCH) {
+        int defer = batch->defer;
+        tlb_flush_pending();
+        batch->defer = defer;
+    }
+
+    batch->frame[batch->nframe++] = frame;
+    if (!batch->defer)
+        tlb_flush_pending();
+    popcli();
+}
+
+uintptr_t tlb_switch(struct mmap *mmap, uintptr_t pgdir)
+{
+    uintptr_t oldpgdir = 0;
+    struct mmap *prev = NULL;
+
+    pushcli();
+    tlb_flush_pending();
+
+    prev = cpu->mmap;
+    // set before loading so a shootdown either sees this cpu or precedes the load.
+    if (mmap)
+        atomic_or(&mmap->cpumask, _BS(cpu->cpuid));
+    oldpgdir = paging_switch(pgdir);
+    if (prev && (prev != mmap))
+        atomic_and(&prev->cpumask, ~_BS(cpu->cpuid));
+    cpu->mmap = mmap;
+
+    popcli();
+    return oldpgdir;
+}
+
+void tlb_handle_shootdown(void)
+{
+    uintptr_t seq = 0;
+    int full = 0, count = 0;
+    uintptr_t addr[TLB_BATCH];
+    tlb_inbox_t *inbox = &cpu->tlb_inbox;
+
+    tlb_inbox_lock(inbox);
+    seq = inbox->seq;
+    full = inbox->full;
+    count = inbox->count;
+    for (int i = 0; !full && i < count; ++i)
+        addr[i] = inbox->addr[i];
+    inbox->full = 0;
+    inbox->count = 0;
+    tlb_inbox_unlock(inbox);
+
+    if (full)
+        tlb_flush();
+    else {
+        for (int i = 0; i < count; ++i)
+            paging_invlpg(addr[i]);
+    }
+
+    // ack everything taken out of the inbox above.
+    atomic_write(&inbox->done, seq);
+}
+
+void send_tlb_shootdown(void)
+{
+    pushcli();
+    for (int i = 0; i < ncpu; ++i) {
+        if (&cpus[i] == cpu)
+            continue;
+        tlb_inbox_lock(&cpus[i].tlb_inbox);
+        cpus[i].tlb_inbox.full = 1;
+        cpus[i].tlb_inbox.seq++;
+        tlb_inbox_unlock(&cpus[i].tlb_inbox);
+    }
+    lapic_send_ipi_to_all_not_self(T_TLB_SHOOTDOWN);
+    popcli();
+}
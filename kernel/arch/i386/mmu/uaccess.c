@@ -0,0 +1,91 @@
+#include <arch/i386/uaccess.h>
+#include <bits/errno.h>
+
+extern extable_t __ex_table, __ex_table_end;
+
+// record 'insn' as a user access resuming at 'fixup' if it faults.
+#define EXTABLE(insn, fixup)            \
+    ".section .__ex_table, \"a\"\n"     \
+    ".align 4\n"                        \
+    ".long " #insn ", " #fixup "\n"     \
+    ".previous\n"
+
+uintptr_t extable_fixup(uintptr_t eip)
+{
+    for (extable_t *ex = &__ex_table; ex < &__ex_table_end; ++ex)
+    {
+        if (ex->insn == eip)
+            return ex->fixup;
+    }
+    return 0;
+}
+
+/**
+ * rep movsb, a fault leaves the count of bytes not yet copied in ecx
+ * and resumes right after the copy. returns that count.
+ */
+static size_t __copy_user(void *dst, const void *src, size_t n)
+{
+    asm volatile(
+        "1: rep movsb\n"
+        "2:\n"
+        EXTABLE(1b, 2b)
+        : "+c"(n), "+D"(dst), "+S"(src)
+        :
+        : "memory");
+    return n;
+}
+
+static inline int __get_user_u8(char *c, const char *uaddr)
+{
+    int err = 0;
+    char v = 0;
+
+    asm volatile(
+        "1: movb (%2), %1\n"
+        "   jmp 3f\n"
+        "2: movl %3, %0\n"
+        "3:\n"
+        EXTABLE(1b, 2b)
+        : "+r"(err), "=q"(v)
+        : "r"(uaddr), "i"(-EFAULT));
+    *c = v;
+    return err;
+}
+
+int copy_from_user(void *dst, const void *usrc, size_t n)
+{
+    if (!access_ok(usrc, n))
+        return -EFAULT;
+    return __copy_user(dst, usrc, n) ? -EFAULT : 0;
+}
+
+int copy_to_user(void *udst, const void *src, size_t n)
+{
+    if (!access_ok(udst, n))
+        return -EFAULT;
+    return __copy_user(udst, src, n) ? -EFAULT : 0;
+}
+
+int strncpy_from_user(char *dst, const char *usrc, size_t n)
+{
+    int err = 0;
+    size_t len = 0, max = 0;
+
+    if (!access_ok(usrc, 1))
+        return -EFAULT;
+
+    // never read past the top of user space.
+    max = VMA_BASE - (uintptr_t)usrc;
+    max = n < max ? n : max;
+
+    for (; len < max; ++len)
+    {
+        if ((err = __get_user_u8(&dst[len], &usrc[len])))
+            return err;
+        if (dst[len] == '\0')
+            return len;
+    }
+
+    return max < n ? -EFAULT : -ENAMETOOLONG;
+}
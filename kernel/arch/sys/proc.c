@@ -5,7 +5,5 @@
 uintptr_t arch_proc_init(mmap_t *mmap)
 {
     mmap_assert_locked(mmap);
-    uintptr_t cr3 = PGROUND(read_cr3());
-    paging_switch(mmap->pgdir);
-    return cr3;
+    return PGROUND(tlb_switch(mmap, mmap->pgdir));
 }
\ No newline at end of file
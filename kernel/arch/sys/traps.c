@@ -25,7 +25,6 @@ void kbd_intr(void);
 void ps2mouse_handler(void);
 void paging_pagefault(trapframe_t *tf);
 void do_page_fault(trapframe_t *tf);
-void paging_tbl_shootdown();
 
 void trap(trapframe_t *tf)
 {
@@ -39,7 +38,9 @@ void trap(trapframe_t *tf)
         current_assert();
         current->t_tarch->tf = tf;
         // printk("syscall ");
+        tlb_defer(); // one shootdown for all the unmaps this syscall does.
         syscall_stub(tf);
+        tlb_flush_pending();
         // printk(" sysret\n");
 
         if (__thread_killed(current))
@@ -74,7 +75,10 @@ void trap(trapframe_t *tf)
         lapic_eoi();
         break;
     case T_TLB_SHOOTDOWN: // TLB shootdown
-        paging_tbl_shootdown();
+        tlb_handle_shootdown();
+        lapic_eoi();
+        break;
+    case T_WAKEUP: // work was queued for this idle cpu
         lapic_eoi();
         break;
     default:
@@ -87,8 +91,8 @@ void trap(trapframe_t *tf)
     if (__thread_killed(current))
         thread_exit(-EINTR);
 
-    if (atomic_read(&current->t_sched_attr.t_timeslice))
-        sched_yield();
+    if (atomic_read(&current->t_sched_attr.t_timeslice) == 0)
+        sched_preempt();
 
     if (__thread_killed(current))
         thread_exit(-EINTR);
@@ -102,9 +106,40 @@ void trap(trapframe_t *tf)
     popcli();
 }
 
-void send_tlb_shootdown(void)
+/**
+ * syscalls entered through SYSENTER, called by sysenter_entry.
+ * only the work trap() does after a syscall, without its
+ * vector switch. returns non-zero if the frame no longer returns to
+ * where the syscall was made (a signal handler was set up), in which
+ * case the caller leaves through iret instead of sysexit.
+ */
+int sysenter_dispatch(trapframe_t *tf)
 {
-    lapic_send_ipi_to_all_not_self(T_TLB_SHOOTDOWN);
+    uint32_t eip = tf->eip;
+
+    current_assert();
+    current->t_tarch->tf = tf;
+    tlb_defer();
+    syscall_stub(tf);
+    tlb_flush_pending();
+
+    if (__thread_killed(current))
+        thread_exit(-EINTR);
+
+    if (atomic_read(&current->t_sched_attr.t_timeslice) == 0)
+    {
+        sched_preempt();
+        if (__thread_killed(current))
+            thread_exit(-EINTR);
+    }
+
+    if (proc == NULL)
+        return 0;
+
+    pushcli();
+    handle_signals(tf);
+    popcli();
+    return tf->eip != eip;
 }
 
 void dump_trapframe(trapframe_t *tf)
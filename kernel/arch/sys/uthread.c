@@ -5,6 +5,7 @@
 #include <sys/system.h>
 #include <mm/kalloc.h>
 #include <lib/string.h>
+#include <arch/i386/uaccess.h>
 
 int arch_uthread_execve(uintptr_t *ustack, const char **__argp, const char **__envp)
 {
@@ -114,6 +115,84 @@ char ***arch_execve_cpy(char *_argp[], char *_envp[])
     return ptr;
 }
 
+#define EXEC_MAXARGS    1024    // strings in an argv or envp from user space.
+#define EXEC_MAXARGLEN  4096    // bytes in one of them, nul included.
+
+/* copy the NULL-terminated user vector 'uvec' into a kcalloc()'d vector of strdup()'d strings. */
+static int arch_execve_ucpy_vec(const char *uvec[], char *buf, char ***ref)
+{
+    int err = 0, n = 0;
+    char **vec = NULL;
+    const char *uarg = NULL;
+
+    for (n = 0; uvec; ++n)
+    {
+        if (n == EXEC_MAXARGS)
+            return -E2BIG;
+        if ((err = copy_from_user(&uarg, &uvec[n], sizeof uarg)))
+            return err;
+        if (uarg == NULL)
+            break;
+    }
+
+    if ((vec = kcalloc(n + 1, sizeof(char *))) == NULL)
+        return -ENOMEM;
+    *ref = vec;
+
+    for (int i = 0; i < n; ++i)
+    {
+        // re-read, another thread may have changed it since it was counted.
+        if ((err = copy_from_user(&uarg, &uvec[i], sizeof uarg)))
+            return err;
+        if (uarg == NULL)
+            break;
+        if ((err = strncpy_from_user(buf, uarg, EXEC_MAXARGLEN)) < 0)
+            return err == -ENAMETOOLONG ? -E2BIG : err;
+        if ((vec[i] = strdup(buf)) == NULL)
+            return -ENOMEM;
+    }
+
+    return 0;
+}
+
+int arch_execve_ucpy(const char *uargp[], const char *uenvp[], char ****ref)
+{
+    int err = 0;
+    char *buf = NULL;
+    char ***ptr = NULL;
+
+    if ((ptr = kcalloc(3, sizeof(char **))) == NULL)
+        return -ENOMEM;
+
+    if ((buf = kmalloc(EXEC_MAXARGLEN)) == NULL)
+    {
+        err = -ENOMEM;
+        goto error;
+    }
+
+    if ((err = arch_execve_ucpy_vec(uargp, buf, &ptr[0])))
+        goto error;
+    if ((err = arch_execve_ucpy_vec(uenvp, buf, &ptr[1])))
+        goto error;
+
+    kfree(buf);
+    *ref = ptr;
+    return 0;
+error:
+    if (buf)
+        kfree(buf);
+    for (int i = 0; i < 2; ++i)
+    {
+        if (ptr[i] == NULL)
+            continue;
+        foreach (arg, ptr[i])
+            kfree(arg);
+        kfree(ptr[i]);
+    }
+    kfree(ptr);
+    return err;
+}
+
 void arch_exec_free_cpy(char ***arg_env)
 {
     if (!arg_env) return;
@@ -1,155 +1,293 @@
 #include <bits/errno.h>
 #include <fs/fs.h>
 #include <dev/bio.h>
-#include <ds/queue.h>
 #include <mm/kalloc.h>
+#include <sys/kthread.h>
+#include <sys/sleep.h>
 #include <sys/thread.h>
 #include <arch/i386/cpu.h>
 #include <printk.h>
 
-#define NBUF 1024
+#define NBUF    1024
+#define NBUCKET 256     // must be a power of two.
+
+#define BIO_WRITEBACK_SEC 5 // interval between write-back passes.
+
+/**
+ * The buffer cache.
+ *
+ * Every buffer that holds a block is on the hash chain for its
+ * (devid, blkno, blksz) key. Unreferenced buffers also sit on the LRU
+ * list, most recently used at the head. bget() reassigns buffers
+ * from the tail of the LRU, preferring clean ones. A buffer's data
+ * stays resident across brelse() until it is evicted.
+ *
+ * bcache_lock protects the hash chains, the LRU list, refcnt and the
+ * counters. The buffer mutex protects flags and data. A buffer with
+ * refcnt == 0 has no holder, so its flags may be read under bcache_lock.
+ */
 static iobuf_t *buffs = NULL;
-static queue_t *iobufq = QUEUE_NEW("IO BUFFS");
+static iobuf_t *bhash[NBUCKET];
+static iobuf_t *lru_head = NULL;
+static iobuf_t *lru_tail = NULL;
+static spinlock_t *bcache_lock = SPINLOCK_NEW("bcache");
+
+static size_t bhits = 0;
+static size_t bmisses = 0;
+static size_t bevictions = 0;
+static size_t bwritebacks = 0;
+
+static inline int devid_equal(struct devid *a, struct devid *b)
+{
+    return (a->dev_type == b->dev_type) &&
+           (a->dev_major == b->dev_major) &&
+           (a->dev_minor == b->dev_minor);
+}
+
+static inline size_t bhashfn(struct devid *devid, long blkno)
+{
+    size_t key = ((size_t)devid->dev_type << 16) |
+                 ((size_t)devid->dev_major << 8) | devid->dev_minor;
+    return ((key * 31) + (size_t)blkno) & (NBUCKET - 1);
+}
+
+static iobuf_t *bhash_lookup(struct devid *devid, long blkno, size_t blksz)
+{
+    for (iobuf_t *b = bhash[bhashfn(devid, blkno)]; b; b = b->hnext)
+    {
+        if (b->blkno == blkno && b->blksz == blksz && devid_equal(&b->devid, devid))
+            return b;
+    }
+    return NULL;
+}
+
+static void bhash_insert(iobuf_t *b)
+{
+    iobuf_t **head = &bhash[bhashfn(&b->devid, b->blkno)];
+
+    b->hprev = NULL;
+    if ((b->hnext = *head))
+        (*head)->hprev = b;
+    *head = b;
+}
+
+static void bhash_remove(iobuf_t *b)
+{
+    if (b->hprev)
+        b->hprev->hnext = b->hnext;
+    else if (bhash[bhashfn(&b->devid, b->blkno)] == b)
+        bhash[bhashfn(&b->devid, b->blkno)] = b->hnext;
+    else
+        return; // not hashed.
+
+    if (b->hnext)
+        b->hnext->hprev = b->hprev;
+    b->hnext = b->hprev = NULL;
+}
+
+#define blru_linked(b) ((b)->lprev || lru_head == (b))
+
+static void blru_push(iobuf_t *b)
+{
+    b->lprev = NULL;
+    if ((b->lnext = lru_head))
+        lru_head->lprev = b;
+    else
+        lru_tail = b;
+    lru_head = b;
+}
+
+static void blru_append(iobuf_t *b)
+{
+    b->lnext = NULL;
+    if ((b->lprev = lru_tail))
+        lru_tail->lnext = b;
+    else
+        lru_head = b;
+    lru_tail = b;
+}
+
+static void blru_remove(iobuf_t *b)
+{
+    if (!blru_linked(b))
+        return;
+
+    if (b->lprev)
+        b->lprev->lnext = b->lnext;
+    else
+        lru_head = b->lnext;
+
+    if (b->lnext)
+        b->lnext->lprev = b->lprev;
+    else
+        lru_tail = b->lprev;
+
+    b->lnext = b->lprev = NULL;
+}
+
+/**
+ * pick a buffer to reassign, walking from the least recently used end.
+ * clean buffers are preferred, a dirty one is only returned when no
+ * clean buffer is free. caller must hold bcache_lock.
+ */
+static iobuf_t *blru_victim(void)
+{
+    iobuf_t *dirty = NULL;
+
+    for (iobuf_t *b = lru_tail; b; b = b->lprev)
+    {
+        if (b->refcnt)
+            continue; // held by write-back.
+        if (!__iobuf_dirty(b))
+            return b;
+        if (dirty == NULL)
+            dirty = b;
+    }
+
+    return dirty;
+}
 
 void bfree(void)
 {
-    iobuf_t *b = NULL;
+    if (buffs == NULL)
+        return;
 
-    queue_lock(iobufq);
-    loop()
+    for (int i = 0; i < NBUF; ++i)
     {
-        if ((b = dequeue(iobufq)))
-        {
-            if (b->lock)
-                mutex_free(b->lock);
-        }
-        else
-            break;
+        if (buffs[i].lock)
+            mutex_free(buffs[i].lock);
+        if (buffs[i].buf)
+            kfree(buffs[i].buf);
     }
-    queue_unlock(iobufq);
 
-    if (buffs)
-        kfree(buffs);
+    kfree(buffs);
+    buffs = NULL;
+
+    spin_lock(bcache_lock);
+    for (int i = 0; i < NBUCKET; ++i)
+        bhash[i] = NULL;
+    lru_head = lru_tail = NULL;
+    spin_unlock(bcache_lock);
 }
 
 int binit(void)
 {
     int err = 0;
-    int i_buf = 0;
-    mutex_t *lock = NULL;
 
     klog(KLOG_INIT, "initializing I/O buffers, please wait...\n");
-    return 0;
 
     if ((buffs = kcalloc(NBUF, sizeof *buffs)) == NULL)
         return -ENOMEM;
 
-    loop()
+    for (int i = 0; i < NBUF; ++i)
     {
-        if (i_buf >= NBUF)
-            break;
-
-        if ((err = mutex_init(NULL, &lock)))
+        if ((err = mutex_init(NULL, &buffs[i].lock)))
         {
             bfree();
             return err;
         }
-
-        buffs[i_buf].lock = lock;
-
-        queue_lock(iobufq);
-        if (enqueue(iobufq, &buffs[i_buf]) == NULL)
-        {
-            queue_unlock(iobufq);
-            bfree();
-            return -ENOMEM;
-        }
-        queue_unlock(iobufq);
-
-        i_buf++;
     }
 
-    klog(KLOG_OK, "I/O buffers ready.\n");
+    spin_lock(bcache_lock);
+    for (int i = 0; i < NBUF; ++i)
+        blru_append(&buffs[i]);
+    spin_unlock(bcache_lock);
+
+    klog(KLOG_OK, "I/O buffers ready, %d buffers.\n", NBUF);
     return 0;
 }
 
 iobuf_t *bget(struct devid *devid, long blkno, size_t blksz)
 {
     iobuf_t *b = NULL;
+    size_t oldsz = 0;
+    int locked = 0;
+
     if (current == NULL)
         return NULL; // No running thread CPU can bypass the buffer cache
 
-    queue_lock(iobufq);
-    forlinked(tmp, iobufq->head, tmp->next)
+    if (devid == NULL || blksz == 0 || buffs == NULL)
+        return NULL;
+
+again:
+    spin_lock(bcache_lock);
+    if ((b = bhash_lookup(devid, blkno, blksz)))
     {
-        b = tmp->data;
-        if (b->devid == devid && b->blkno == blkno)
-        {
-            if (b->blksz != blksz)
-            {
-                void *buf = NULL;
-                if (b->buf == NULL)
-                {
-                    queue_unlock(iobufq);
-                    return NULL;
-                }
-
-                if (b->blksz < blksz)
-                {
-                    if ((buf = krealloc(b->buf, blksz)) == NULL)
-                    {
-                        queue_unlock(iobufq);
-                        return NULL;
-                    }
-                }
-                b->buf = buf;
-                b->blksz = blksz;
-            }
-
-            b->refcnt++;
-            queue_unlock(iobufq);
-            iobuf_lock(b);
-            return b;
-        }
+        b->refcnt++;
+        blru_remove(b);
+        bhits++;
+        spin_unlock(bcache_lock);
+        iobuf_lock(b);
+        return b;
+    }
+
+    if ((b = blru_victim()) == NULL)
+    {
+        spin_unlock(bcache_lock);
+        return NULL;
     }
 
-    forlinked(tmp, iobufq->tail, tmp->prev)
+    blru_remove(b);
+    b->refcnt = 1;
+
+    if (__iobuf_dirty(b))
     {
-        b = tmp->data;
-        if (b->refcnt == 0)
+        /**
+         * no clean buffer is free, write this one back first.
+         * it stays hashed meanwhile so its block can still be found.
+         */
+        spin_unlock(bcache_lock);
+        iobuf_lock(b);
+        bwrite(b);
+        if (__iobuf_dirty(b))
         {
-            if (b->blksz != blksz)
-            {
-                if (b->buf && (b->blksz < blksz))
-                {
-                    kfree(b->buf);
-                    b->blksz = 0;
-                    b->buf = NULL;
-                }
-
-                if ((b->buf == NULL))
-                {
-                    if ((b->buf = kcalloc(1, blksz)) == NULL)
-                    {
-                        queue_unlock(iobufq);
-                        return NULL;
-                    }
-                    b->blksz = blksz;
-                }
-            }
-
-            b->devid = devid;
-            b->flags = 0;
-            b->blkno = blkno;
-            b->refcnt = 1;
-            __iobuf_setflag(b, IOBUF_BUSY);
-            queue_unlock(iobufq);
-            iobuf_lock(b);
-            return b;
+            // the device is gone or read-only, nothing can take this data.
+            klog(KLOG_WARN, "bcache: dropping dirty block %d\n", b->blkno);
+            __iobuf_maskflag(b, IOBUF_DIRTY);
         }
+        brelse(b);
+        goto again;
     }
-    queue_unlock(iobufq);
-    return NULL;
+
+    /**
+     * nobody holds the buffer (refcnt was 0), so this cannot fail. taking
+     * the mutex before the new key is hashed keeps others that find it
+     * from seeing the buffer before its data is set up.
+     */
+    locked = mutex_try_lock(b->lock);
+    assert(locked, "bcache: victim buffer is locked");
+
+    bmisses++;
+    if (__iobuf_valid(b))
+        bevictions++;
+
+    oldsz = b->blksz;
+    bhash_remove(b);
+    b->devid = *devid;
+    b->blkno = blkno;
+    b->blksz = blksz;
+    b->flags = IOBUF_BUSY;
+    bhash_insert(b);
+    spin_unlock(bcache_lock);
+
+    if (b->buf && oldsz != blksz)
+    {
+        kfree(b->buf);
+        b->buf = NULL;
+    }
+
+    if (b->buf == NULL && (b->buf = kcalloc(1, blksz)) == NULL)
+    {
+        spin_lock(bcache_lock);
+        bhash_remove(b);
+        spin_unlock(bcache_lock);
+        b->blksz = 0;
+        b->flags = 0;
+        brelse(b);
+        return NULL;
+    }
+
+    return b;
 }
 
 iobuf_t *bread(struct devid *devid, long blkno, size_t blksz)
@@ -160,8 +298,6 @@ iobuf_t *bread(struct devid *devid, long blkno, size_t blksz)
     if (devid == NULL)
         return NULL;
 
-    printk("blkno: %d\n", blkno);
-
     if ((b = bget(devid, blkno, blksz)) == NULL)
         return NULL;
 
@@ -178,8 +314,7 @@ iobuf_t *bread(struct devid *devid, long blkno, size_t blksz)
             brelse(b);
             return NULL;
         }
-        
-        printk("buff: %p: no: %d, sz: %d\n", b->buf, b->blkno, b->blksz);
+
         dev->devops.read(devid, blkno * b->blksz, b->buf, b->blksz);
         __iobuf_setflag(b, IOBUF_VALID);
     }
@@ -187,6 +322,10 @@ iobuf_t *bread(struct devid *devid, long blkno, size_t blksz)
     return b;
 }
 
+/**
+ * write a locked buffer through to its device.
+ * the buffer remains locked and referenced.
+ */
 void bwrite(iobuf_t *buf)
 {
     dev_t *dev = NULL;
@@ -195,45 +334,128 @@ void bwrite(iobuf_t *buf)
     if (!__iobuf_valid(buf))
         return;
 
-    if ((dev = kdev_get(buf->devid)) == NULL)
-    {
-        brelse(buf);
+    if ((dev = kdev_get(&buf->devid)) == NULL)
         return;
-    }
 
     if (dev->devops.write == NULL)
-    {
-        brelse(buf);
         return;
-    }
 
-    dev->devops.write(buf->devid, buf->blkno * buf->blksz, buf->buf, buf->blksz);
-    __iobuf_setflag(buf, IOBUF_VALID);
+    dev->devops.write(&buf->devid, buf->blkno * buf->blksz, buf->buf, buf->blksz);
+    __iobuf_maskflag(buf, IOBUF_DIRTY);
+
+    spin_lock(bcache_lock);
+    bwritebacks++;
+    spin_unlock(bcache_lock);
+}
+
+/**
+ * delayed write, mark a locked buffer dirty and release it.
+ * the write-back thread (or eviction) writes it to the device later.
+ */
+void bdwrite(iobuf_t *buf)
+{
+    iobuf_assert_locked(buf);
+    __iobuf_setflag(buf, IOBUF_VALID | IOBUF_DIRTY);
+    brelse(buf);
 }
 
 void brelse(iobuf_t *buf)
 {
     if (buf == NULL)
         return;
-    
-    iobuf_assert_locked(buf);
 
+    iobuf_assert_locked(buf);
+    __iobuf_maskflag(buf, IOBUF_BUSY);
     iobuf_unlock(buf);
 
-    queue_lock(iobufq);
-    buf->refcnt--;
+    spin_lock(bcache_lock);
+    if (--buf->refcnt == 0 && !blru_linked(buf))
+    {
+        // buffers without valid data are the first to be reused.
+        if (__iobuf_valid(buf))
+            blru_push(buf);
+        else
+            blru_append(buf);
+    }
+    spin_unlock(bcache_lock);
+}
+
+/**
+ * write back every dirty buffer that is not in use.
+ * buffers stay where they are on the LRU list so write-back does
+ * not disturb the eviction order.
+ * returns the number of buffers written.
+ */
+int bsync(void)
+{
+    int nwritten = 0;
+    int locked = 0;
+    iobuf_t *b = NULL;
+
+    if (buffs == NULL || current == NULL)
+        return 0;
 
-    if (buf->refcnt == 0)
+    for (int i = 0; i < NBUF; ++i)
     {
-        if (buf->buf)
-            kfree(buf->buf);
-        buf->blkno = 0;
-        buf->blksz = 0;
-        buf->flags = 0;
-        buf->buf = NULL;
-        buf->devid = NULL;
-        queue_remove(iobufq, buf);
-        enqueue(iobufq, buf);
+        b = &buffs[i];
+        spin_lock(bcache_lock);
+        if (b->refcnt || !__iobuf_dirty(b))
+        {
+            spin_unlock(bcache_lock);
+            continue;
+        }
+
+        b->refcnt = 1;
+        locked = mutex_try_lock(b->lock);
+        assert(locked, "bcache: dirty buffer is locked");
+        spin_unlock(bcache_lock);
+
+        bwrite(b);
+        brelse(b);
+        nwritten++;
     }
-    queue_unlock(iobufq);
-}
\ No newline at end of file
+
+    return nwritten;
+}
+
+void bstat(bstat_t *stat)
+{
+    if (stat == NULL)
+        return;
+
+    spin_lock(bcache_lock);
+    stat->nbuf = buffs ? NBUF : 0;
+    stat->ndirty = 0;
+    for (int i = 0; buffs && i < NBUF; ++i)
+        stat->ndirty += __iobuf_dirty((&buffs[i])) ? 1 : 0;
+    stat->hits = bhits;
+    stat->misses = bmisses;
+    stat->evictions = bevictions;
+    stat->writebacks = bwritebacks;
+    spin_unlock(bcache_lock);
+}
+
+void bdump(void)
+{
+    bstat_t stat;
+
+    bstat(&stat);
+    printk("bcache: %d bufs, %d dirty, hits: %d, misses: %d, evictions: %d, writebacks: %d\n",
+        stat.nbuf, stat.ndirty, stat.hits, stat.misses, stat.evictions, stat.writebacks);
+}
+
+/**
+ * background write-back, periodically flushes dirty buffers
+ * so delayed writes reach the device without waiting for eviction.
+ */
+static void *bio_writeback(void *arg)
+{
+    loop()
+    {
+        sleep(BIO_WRITEBACK_SEC);
+        bsync();
+    }
+    return arg;
+}
+
+BUILTIN_THREAD(bio_writeback, bio_writeback, NULL);
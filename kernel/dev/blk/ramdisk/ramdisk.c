@@ -11,6 +11,7 @@
 #include <lime/module.h>
 #include <fs/devfs.h>
 #include <fs/posix.h>
+#include <dev/ramdisk.h>
 
 struct dev ramdiskdev;
 spinlock_t *ramdisklock = SPINLOCK_NEW("ramdisklock");
@@ -38,6 +39,19 @@ error:
 
 #define ramdisk_unlock() spin_unlock(ramdisklock)
 
+void *ramdisk_data(off_t off, size_t sz)
+{
+    if (!ramdisk_addr || (off > ramdisk_size) || (sz > ramdisk_size - off))
+        return NULL;
+    return ramdisk_addr + off;
+}
+
+uintptr_t ramdisk_phys(off_t off)
+{
+    char *data = ramdisk_data(off, 1);
+    return data ? VMA_LOW(data) : 0;
+}
+
 int ramdisk_probe(void)
 {
     return 0;
@@ -43,6 +43,7 @@ acpi_hpet_t *acpi_hpet = NULL;
 static int ntimer = 0;
 static uintptr_t hpet = 0;
 static uint32_t hpet_clk = 0;
+static uint32_t hpet_ticks_per_jiffy = 0;
 
 static struct
 {
@@ -195,11 +196,33 @@ int hpet_enumerate(void)
     ntimer = ID.timer_count + 1;
     // int p = acpi_hpet->min_clk_tick / ID.clock_period;
 
-    hpet_setup_timer(0, 1000000, 0, 1, HPET_LEVEL_TRIGGERED, IRQ_HPET, 0);
+    /**
+     * the main counter is only used as a clock source, jiffies are
+     * derived from it, see jiffies_update(). no comparator is armed,
+     * so the HPET raises no periodic interrupt. (clock period is in femtoseconds)
+     */
+    hpet_ticks_per_jiffy = (uint32_t)(1000000000000ULL / HZ) / (hpet_clk / 1000);
     hpet_enable();
     return 0;
 }
 
+uint32_t hpet_counter(void)
+{
+    if (hpet == 0)
+        return 0;
+    return hpet_read_lo((uint32_t *)HPET_COUNTER_REG);
+}
+
+uint32_t hpet_jiffy_ticks(void)
+{
+    return hpet_ticks_per_jiffy;
+}
+
+uint32_t hpet_period(void)
+{
+    return hpet_clk;
+}
+
 int hpet_enable(void)
 {
     int prev_state = 0;
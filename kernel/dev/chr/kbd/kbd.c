@@ -88,7 +88,7 @@ static void kbd0_unlock(void)
 
 void __kbdintr(int (*getc)(void))
 {
-    int c, __unused doprocdump = 0;
+    int c, __unused doprocdump = 0, dolockdump = 0;
 
     kbd0_lock();
     while ((c = getc()) >= 0)
@@ -120,6 +120,9 @@ void __kbdintr(int (*getc)(void))
         case C('M'): // memory usage info
             memory_usage();
             break;
+        case C('L'): // lock contention statistics
+            dolockdump = 1; // printing takes locks, the counters would count kbd.lock
+            break;
         default:
             if (c != 0 && input.e - input.r < INPUT_BUF)
             {
@@ -136,6 +139,8 @@ void __kbdintr(int (*getc)(void))
         }
     }
     kbd0_unlock();
+    if (dolockdump)
+        spin_stat_dump();
     // if (doprocdump)
     // proc_dump(); // now call procdump() wo. kbd.lock held
 }
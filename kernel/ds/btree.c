@@ -3,6 +3,10 @@
 #include <lib/string.h>
 #include <bits/errno.h>
 #include <mm/kalloc.h>
+#include <mm/slab.h>
+#include <sys/system.h>
+
+static kmem_cache_t *btree_node_cache = KMEM_CACHE_NEW("btree_node", sizeof(btree_node_t), NULL);
 
 int btree_alloc(btree_t **pbtree)
 {
@@ -38,9 +42,8 @@ void btree_free(btree_t *btree)
 btree_node_t *btree_alloc_node(void)
 {
     btree_node_t *node = NULL;
-    if ((node = kmalloc(sizeof *node)) == NULL)
+    if ((node = kmem_cache_alloc(btree_node_cache, GFP_ZERO)) == NULL)
         return NULL;
-    memset(node, 0, sizeof *node);
     return node;
 }
 
@@ -48,48 +51,149 @@ void btree_free_node(btree_node_t *node)
 {
     if (node == NULL)
         return;
-    memset(node, 0, sizeof *node);
-    kfree(node);
+    kmem_cache_free(btree_node_cache, node);
     //printf("%s()\n", __func__);
 }
 
-static int btree_insert_node(btree_t *btree, btree_node_t *node)
+/**
+ * the tree is kept AVL-balanced so keys inserted in order, like the pages
+ * of a file being appended to, don't degrade it into a list.
+ * rotations keep the parent links right for in-order walks.
+ */
+
+static int node_height(btree_node_t *node)
 {
-    btree_node_t *iter = NULL;
+    return node ? node->height : 0;
+}
 
-    if (btree == NULL || node == NULL)
-        return -EINVAL;
+/* point the children of 'node' back at it and refresh its height. */
+static void node_fixup(btree_node_t *node)
+{
+    if (node->left)
+        node->left->parent = node;
+    if (node->right)
+        node->right->parent = node;
+    node->height = 1 + MAX(node_height(node->left), node_height(node->right));
+}
 
-    btree_assert_locked(btree);
+static btree_node_t *node_rotate_right(btree_node_t *node)
+{
+    btree_node_t *left = node->left;
+
+    node->left = left->right;
+    left->right = node;
+    left->parent = node->parent;
+    node_fixup(node);
+    node_fixup(left);
+    return left;
+}
 
-    node->parent = NULL;
+static btree_node_t *node_rotate_left(btree_node_t *node)
+{
+    btree_node_t *right = node->right;
+
+    node->right = right->left;
+    right->left = node;
+    right->parent = node->parent;
+    node_fixup(node);
+    node_fixup(right);
+    return right;
+}
 
-    if (btree_isempty(btree))
+static btree_node_t *node_balance(btree_node_t *node)
+{
+    int balance = 0;
+
+    node_fixup(node);
+    balance = node_height(node->left) - node_height(node->right);
+
+    if (balance > 1)
+    {
+        if (node_height(node->left->left) < node_height(node->left->right))
+            node->left = node_rotate_left(node->left);
+        return node_rotate_right(node);
+    }
+    else if (balance < -1)
     {
-        btree->root = node;
-        goto done;
+        if (node_height(node->right->right) < node_height(node->right->left))
+            node->right = node_rotate_right(node->right);
+        return node_rotate_left(node);
     }
 
-    forlinked(parent, btree->root, iter)
+    return node;
+}
+
+static btree_node_t *tree_insert(btree_node_t *root, btree_node_t *node)
+{
+    if (root == NULL)
     {
-        if (node->key < parent->key)
-            iter = parent->left;
-        else if (node->key > parent->key)
-            iter = parent->right;
-        else
-            return -EEXIST;
+        node->left = node->right = NULL;
+        node->height = 1;
+        return node;
+    }
+
+    if (node->key < root->key)
+        root->left = tree_insert(root->left, node);
+    else
+        root->right = tree_insert(root->right, node);
+    return node_balance(root);
+}
+
+static btree_node_t *tree_remove_min(btree_node_t *root, btree_node_t **pmin)
+{
+    if (root->left == NULL)
+    {
+        *pmin = root;
+        return root->right;
+    }
+
+    root->left = tree_remove_min(root->left, pmin);
+    return node_balance(root);
+}
+
+static btree_node_t *tree_remove(btree_node_t *root, btree_node_t *node)
+{
+    btree_node_t *min = NULL, *right = NULL;
+
+    if (root == NULL)
+        return NULL;
 
-        if (iter == NULL)
+    if (node->key < root->key)
+        root->left = tree_remove(root->left, node);
+    else if (node->key > root->key)
+        root->right = tree_remove(root->right, node);
+    else
+    {
+        if (root->right == NULL)
         {
-            node->parent = parent;
-            if (node->key < parent->key)
-                parent->left = node;
-            else if (node->key > parent->key)
-                parent->right = node;
+            if (root->left)
+                root->left->parent = root->parent;
+            return root->left;
         }
+
+        right = tree_remove_min(root->right, &min);
+        min->left = root->left;
+        min->right = right;
+        min->parent = root->parent;
+        return node_balance(min);
     }
 
-done:
+    return node_balance(root);
+}
+
+static int btree_insert_node(btree_t *btree, btree_node_t *node)
+{
+    if (btree == NULL || node == NULL)
+        return -EINVAL;
+
+    btree_assert_locked(btree);
+
+    if (btree_lookup(btree, node->key))
+        return -EEXIST;
+
+    node->parent = NULL;
+    btree->root = tree_insert(btree->root, node);
+    btree->root->parent = NULL;
     btree->nr_nodes++;
     node->btree = btree;
     return 0;
@@ -97,8 +201,6 @@ done:
 
 static void btree_delete_node(btree_t *btree, btree_node_t *node)
 {
-    btree_node_t *parent = NULL, *left = NULL, *right = NULL;
-
     if (btree == NULL)
         return;
 
@@ -107,31 +209,11 @@ static void btree_delete_node(btree_t *btree, btree_node_t *node)
     if (node == NULL)
         return;
 
-    left = node->left;
-    right = node->right;
-    parent = node->parent;
-
-    if (node == btree->root)
-        btree->root = NULL;
-    else if (btree_node_isright(node))
-        parent->right = NULL;
-    else if (btree_node_isleft(node))
-        parent->left = NULL;
+    if ((btree->root = tree_remove(btree->root, node)))
+        btree->root->parent = NULL;
 
     btree_free_node(node);
     btree->nr_nodes--;
-
-    if (right)
-    {
-        btree->nr_nodes--;
-        btree_insert_node(btree, right);
-    }
-
-    if (left)
-    {
-        btree->nr_nodes--;
-        btree_insert_node(btree, left);
-    }
 }
 
 btree_node_t *btree_least_node(btree_t *btree)
@@ -1,10 +1,13 @@
 #include <printk.h>
 #include <ds/queue.h>
 #include <mm/kalloc.h>
+#include <mm/slab.h>
 #include <bits/errno.h>
 #include <lib/string.h>
 #include <lime/string.h>
 
+static kmem_cache_t *queue_node_cache = KMEM_CACHE_NEW("queue_node", sizeof(queue_node_t), NULL);
+
 void queue_free(queue_t *q)
 {
     queue_assert_lock(q);
@@ -41,7 +44,7 @@ void *dequeue(queue_t *q)
     data = node->data;
     q->count--;
 
-    kfree(node);
+    kmem_cache_free(queue_node_cache, node);
     return data;
 }
 
@@ -62,9 +65,8 @@ queue_node_t *enqueue(queue_t *q, void *data)
     if (spin_trylock(q->lock))
         panic("caller not holding %s\n", q->lock->name);
 
-    if (!(node = __cast_to_type(node) kmalloc(sizeof *node)))
+    if (!(node = __cast_to_type(node) kmem_cache_alloc(queue_node_cache, GFP_ZERO)))
         return NULL;
-    *node = (queue_node_t){0};
 
     if (!q->head)
         q->head = node;
@@ -177,7 +179,7 @@ int queue_remove_node(queue_t *q, queue_node_t *node)
     node->prev = NULL;
 
     q->count--;
-    kfree(node);
+    kmem_cache_free(queue_node_cache, node);
 
     return 0;
 }
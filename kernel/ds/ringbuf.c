@@ -1,6 +1,8 @@
 #include <ds/ringbuf.h>
 #include <bits/errno.h>
 #include <mm/kalloc.h>
+#include <lib/string.h>
+#include <sys/system.h>
 
 int ringbuf_new(size_t size, ringbuf_t **rref)
 {
@@ -9,6 +11,13 @@ int ringbuf_new(size_t size, ringbuf_t **rref)
     spinlock_t *lk = NULL;
     assert(rref, "no reference");
 
+    if (size == 0)
+        return -EINVAL;
+
+    // round up to a power of two so indices are masked, not divided.
+    while (size & (size - 1))
+        size += size & -size;
+
     if ((err = spinlock_init(NULL, "ringbuff", &lk)))
         return err;
 
@@ -57,47 +66,51 @@ int ringbuf_isfull(ringbuf_t *ring)
     return ring->count == ring->size;
 }
 
+/**
+ * the data is moved in at most two spans, up to the end
+ * of the buffer and then on from its start.
+ */
 size_t ringbuf_read(struct ringbuf *ring, size_t n, char *buf)
 {
-    size_t size = n;
+    size_t head = 0, span = 0;
     ringbuf_assert(ring);
     ringbuf_assert_lock(ring);
-    while (n)
-    {
-        if (ringbuf_isempty(ring))
-            break;
-        *buf++ = ring->buf[RINGBUF_INDEX(ring, ring->head++)];
-        ring->count--;
-        n--;
-    }
-    return size - n;
+
+    n = MIN(n, ring->count);
+    head = RINGBUF_INDEX(ring, ring->head);
+    span = MIN(n, ring->size - head);
+
+    memcpy(buf, ring->buf + head, span);
+    memcpy(buf + span, ring->buf, n - span);
+
+    ring->head += n;
+    ring->count -= n;
+    return n;
 }
 
 size_t ringbuf_write(struct ringbuf *ring, size_t n, char *buf)
 {
-    size_t size = n;
+    size_t tail = 0, span = 0;
     ringbuf_assert(ring);
-    ringbuf_assert_lock(ring);    
-    while (n)
-    {
-        if (ringbuf_isfull(ring))
-            break;
+    ringbuf_assert_lock(ring);
 
-        ring->buf[RINGBUF_INDEX(ring, ring->tail++)] = *buf++;
-        ring->count++;
-        n--;
-    }
-    return size - n;
+    n = MIN(n, ring->size - ring->count);
+    tail = RINGBUF_INDEX(ring, ring->tail);
+    span = MIN(n, ring->size - tail);
+
+    memcpy(ring->buf + tail, buf, span);
+    memcpy(ring->buf, buf + span, n - span);
+
+    ring->tail += n;
+    ring->count += n;
+    return n;
 }
 
 size_t ringbuf_available(struct ringbuf *ring)
 {
     ringbuf_assert(ring);
     ringbuf_assert_lock(ring);
-    if (ring->tail >= ring->head)
-        return ring->tail - ring->head;
-    size_t aval = ring->tail + ring->size - ring->head;
-    return aval;
+    return ring->count;
 }
 
 void ringbuf_debug(ringbuf_t *ring)
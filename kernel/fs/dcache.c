@@ -0,0 +1,306 @@
+#include <fs/fs.h>
+#include <fs/dentry.h>
+#include <bits/errno.h>
+#include <lib/string.h>
+#include <locks/spinlock.h>
+#include <printk.h>
+
+#define DCACHE_NBUCKET  256     // must be a power of two.
+#define DCACHE_MAX      1024    // entries kept on the LRU before old ones are dropped.
+
+/**
+ * dentry cache.
+ * every dentry bound into the tree is also hashed on (parent, name), so
+ * a path component resolves with one bucket walk instead of a scan of
+ * the parent's children under each child's lock. names the filesystem
+ * said don't exist are kept as negative entries, so a miss repeated
+ * over and over (a $PATH search) doesn't go back to ifind().
+ * entries made by lookups sit on an LRU and the oldest ones are dropped
+ * once there are more than DCACHE_MAX of them. a positive entry is only
+ * dropped when the tree's reference is its last and it has no children,
+ * a negative one holds a reference on its parent so the parent outlives it.
+ * mount points aren't on the LRU and stay until they're unbound.
+ */
+
+static dentry_t *dcache_hash[DCACHE_NBUCKET];
+static dentry_t *lru_head = NULL, *lru_tail = NULL;
+static size_t lru_count = 0;
+static dcache_stat_t dcache_stats = {0};
+static spinlock_t *dcache_spinlock = SPINLOCK_NEW("dcache");
+
+void dcache_lock(void)
+{
+    spin_lock(dcache_spinlock);
+}
+
+void dcache_unlock(void)
+{
+    spin_unlock(dcache_spinlock);
+}
+
+static uint32_t dcache_hashname(dentry_t *parent, const char *name, size_t len)
+{
+    uint32_t h = 2166136261u ^ ((uintptr_t)parent >> 4);
+
+    while (len--)
+        h = (h ^ (uint8_t)*name++) * 16777619u;
+    return h;
+}
+
+#define dcache_bucket(h) (&dcache_hash[((h) * 0x9E3779B1u) >> 24 & (DCACHE_NBUCKET - 1)])
+
+static void lru_link(dentry_t *d)
+{
+    d->d_lru_prev = NULL;
+    if ((d->d_lru_next = lru_head))
+        lru_head->d_lru_prev = d;
+    else
+        lru_tail = d;
+    lru_head = d;
+    lru_count++;
+}
+
+static void lru_unlink(dentry_t *d)
+{
+    if (d->d_lru_prev)
+        d->d_lru_prev->d_lru_next = d->d_lru_next;
+    else
+        lru_head = d->d_lru_next;
+
+    if (d->d_lru_next)
+        d->d_lru_next->d_lru_prev = d->d_lru_prev;
+    else
+        lru_tail = d->d_lru_prev;
+
+    d->d_lru_prev = NULL;
+    d->d_lru_next = NULL;
+    lru_count--;
+}
+
+/* caller holds the dcache lock. */
+static dentry_t *__dcache_find(dentry_t *parent, uint32_t h, const char *name, size_t len)
+{
+    for (dentry_t *d = *dcache_bucket(h); d; d = d->d_hnext) {
+        if (d->d_hash == h && d->d_parent == parent &&
+            !memcmp(d->d_name, name, len) && d->d_name[len] == '\0')
+            return d;
+    }
+    return NULL;
+}
+
+/* caller holds the dcache lock. */
+static void __dcache_unhash(dentry_t *d)
+{
+    dentry_t **pp = dcache_bucket(d->d_hash);
+
+    for (; *pp; pp = &(*pp)->d_hnext) {
+        if (*pp == d) {
+            *pp = d->d_hnext;
+            break;
+        }
+    }
+
+    if (d->d_flags & DCACHE_RECLAIM)
+        lru_unlink(d);
+    if (d->d_flags & DCACHE_NEGATIVE)
+        dcache_stats.negatives--;
+    dcache_stats.entries--;
+    d->d_hnext = NULL;
+    d->d_flags &= ~(DCACHE_HASHED | DCACHE_RECLAIM);
+}
+
+/* caller holds the dcache lock. */
+static void __dcache_hash(dentry_t *d, uint32_t h)
+{
+    dentry_t **bucket = dcache_bucket(h);
+
+    d->d_hash = h;
+    d->d_hnext = *bucket;
+    *bucket = d;
+    d->d_flags |= DCACHE_HASHED;
+    if (d->d_flags & DCACHE_RECLAIM)
+        lru_link(d);
+    if (d->d_flags & DCACHE_NEGATIVE)
+        dcache_stats.negatives++;
+    dcache_stats.entries++;
+}
+
+/* drop a negative entry and its hold on the parent. caller holds the dcache lock. */
+static void dcache_drop_negative(dentry_t *d)
+{
+    dentry_t *parent = d->d_parent;
+
+    __dcache_unhash(d);
+    d->d_parent = NULL;
+    dentry_close(parent);
+    dentry_free(d);
+}
+
+static int dcache_evictable(dentry_t *d)
+{
+    int busy = 0;
+
+    if (d->d_flags & DCACHE_NEGATIVE)
+        return 1;
+
+    dlock(d);
+    busy = d->d_ref > 1 || d->d_children;
+    dunlock(d);
+    return !busy;
+}
+
+/* caller holds the dcache lock. */
+static void dcache_evict(dentry_t *d)
+{
+    dentry_t *parent = d->d_parent;
+
+    dcache_stats.evictions++;
+
+    if (d->d_flags & DCACHE_NEGATIVE) {
+        dcache_drop_negative(d);
+        return;
+    }
+
+    __dcache_unhash(d);
+    vfs_dentry_unbind(parent, d);
+    dentry_close(parent);
+    d->d_prev = NULL;
+    d->d_next = NULL;
+    dentry_free(d);
+}
+
+/* drop the least recently used entries nobody holds. caller holds the dcache lock. */
+static void dcache_trim(void)
+{
+    dentry_t *d = lru_tail, *prev = NULL;
+    size_t scan = lru_count;
+
+    for (; d && lru_count > DCACHE_MAX && scan; d = prev, --scan) {
+        prev = d->d_lru_prev;
+        if (dcache_evictable(d))
+            dcache_evict(d);
+    }
+}
+
+dentry_t *dcache_lookup(dentry_t *parent, const char *name, size_t len)
+{
+    dentry_t *d = NULL;
+
+    if ((d = __dcache_find(parent, dcache_hashname(parent, name, len), name, len)) == NULL) {
+        dcache_stats.misses++;
+        return NULL;
+    }
+
+    dcache_stats.hits++;
+    if (d->d_flags & DCACHE_NEGATIVE)
+        dcache_stats.neg_hits++;
+
+    if ((d->d_flags & DCACHE_RECLAIM) && d != lru_head) {
+        lru_unlink(d);
+        lru_link(d);
+    }
+    return d;
+}
+
+dentry_t *dcache_get(dentry_t *parent, const char *name)
+{
+    dentry_t *d = NULL;
+    size_t len = strlen(name);
+
+    dcache_lock();
+    d = __dcache_find(parent, dcache_hashname(parent, name, len), name, len);
+    if (d && (d->d_flags & DCACHE_NEGATIVE))
+        d = NULL;
+    if (d)
+        dentry_dup(d);
+    dcache_unlock();
+    return d;
+}
+
+int dcache_insert(dentry_t *dentry)
+{
+    uint32_t h = 0;
+    size_t len = 0;
+    dentry_t *old = NULL;
+
+    if (dentry == NULL || dentry->d_parent == NULL || dentry->d_name == NULL)
+        return -EINVAL;
+
+    len = strlen(dentry->d_name);
+    h = dcache_hashname(dentry->d_parent, dentry->d_name, len);
+
+    dcache_lock();
+    if (dentry->d_flags & DCACHE_HASHED)
+        __dcache_unhash(dentry);
+
+    if ((old = __dcache_find(dentry->d_parent, h, dentry->d_name, len)) &&
+        (old->d_flags & DCACHE_NEGATIVE))
+        dcache_drop_negative(old);
+
+    __dcache_hash(dentry, h);
+    dcache_trim();
+    dcache_unlock();
+    return 0;
+}
+
+void dcache_remove(dentry_t *dentry)
+{
+    if (dentry == NULL || !(dentry->d_flags & DCACHE_HASHED))
+        return;
+
+    dcache_lock();
+    if (dentry->d_flags & DCACHE_HASHED)
+        __dcache_unhash(dentry);
+    dcache_unlock();
+}
+
+int dcache_negative(dentry_t *parent, const char *name)
+{
+    int err = 0;
+    uint32_t h = 0;
+    size_t len = 0;
+    dentry_t *d = NULL;
+
+    if (parent == NULL || name == NULL)
+        return -EINVAL;
+
+    if ((err = dentry_alloc((char *)name, &d)))
+        return err;
+
+    len = strlen(name);
+    h = dcache_hashname(parent, name, len);
+
+    dcache_lock();
+    if (__dcache_find(parent, h, name, len)) { // someone beat us to it.
+        dcache_unlock();
+        dentry_free(d);
+        return 0;
+    }
+
+    dentry_dup(parent);
+    d->d_parent = parent;
+    d->d_flags = DCACHE_NEGATIVE | DCACHE_RECLAIM;
+    __dcache_hash(d, h);
+    dcache_trim();
+    dcache_unlock();
+    return 0;
+}
+
+void dcache_stat(dcache_stat_t *stat)
+{
+    if (stat == NULL)
+        return;
+
+    dcache_lock();
+    *stat = dcache_stats;
+    dcache_unlock();
+}
+
+void dcache_dump(void)
+{
+    dcache_stat_t stat;
+
+    dcache_stat(&stat);
+    printk("dcache: hits: %d (negative %d), misses: %d, evictions: %d, entries: %d (negative %d)\n",
+        stat.hits, stat.neg_hits, stat.misses, stat.evictions, stat.entries, stat.negatives);
+}
@@ -3,10 +3,12 @@
 #include <bits/errno.h>
 #include <lib/string.h>
 #include <mm/kalloc.h>
+#include <mm/slab.h>
 #include <lime/string.h>
 #include <printk.h>
 
 static dops_t dops;
+static kmem_cache_t *dentry_cache = KMEM_CACHE_NEW("dentry", sizeof(dentry_t), NULL);
 
 int dentry_alloc(char *name, dentry_t **ref)
 {
@@ -18,7 +20,7 @@ int dentry_alloc(char *name, dentry_t **ref)
     if (!name || !ref)
         return -EINVAL;
 
-    if (!(dentry = __cast_to_type(dentry)kmalloc(sizeof *dentry)))
+    if (!(dentry = __cast_to_type(dentry)kmem_cache_alloc(dentry_cache, 0)))
     {
         err = -ENOMEM;
         goto error;
@@ -46,7 +48,7 @@ int dentry_alloc(char *name, dentry_t **ref)
 
 error:
     if (dentry)
-        kfree(dentry);
+        kmem_cache_free(dentry_cache, dentry);
     if (tmp_name)
         kfree(tmp_name);
     if (lock)
@@ -55,11 +57,13 @@ error:
     return err;
 }
 
-static int dentry_free(dentry_t *dentry)
+int dentry_free(dentry_t *dentry)
 {
     if (!dentry)
         return -EINVAL;
-    
+
+    dcache_remove(dentry);
+
     dlock(dentry);
     
     if (dentry->d_prev)
@@ -78,8 +82,6 @@ static int dentry_free(dentry_t *dentry)
     
     dunlock(dentry);
 
-    printk("dentry_free(%s)\n", dentry->d_name);
-
     if (dentry->d_name)
     {
         kfree(dentry->d_name);
@@ -87,7 +89,7 @@ static int dentry_free(dentry_t *dentry)
     if (dentry->d_lock)
         spinlock_free(dentry->d_lock);
     *dentry = (dentry_t){0};
-    kfree(dentry);
+    kmem_cache_free(dentry_cache, dentry);
     return 0;
 }
 
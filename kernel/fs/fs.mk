@@ -16,6 +16,7 @@ $(pipefsobjs)\
 $(posixobjs)\
 $(ramfsobjs)\
 $(tmpfsobjs)\
+$(fsdir)/dcache.o\
 $(fsdir)/dentry.o\
 $(fsdir)/dirent.o\
 $(fsdir)/file.o\
@@ -3,8 +3,11 @@
 #include <lib/string.h>
 #include <lime/string.h>
 #include <mm/kalloc.h>
+#include <mm/slab.h>
 #include <printk.h>
 
+static kmem_cache_t *inode_cache = KMEM_CACHE_NEW("inode", sizeof(inode_t), NULL);
+
 int ialloc(inode_t **ref)
 {
     int err =0;
@@ -16,7 +19,7 @@ int ialloc(inode_t **ref)
     if (!ref)
         return -EINVAL;
     
-    if (!(ip = __cast_to_type(ip)kmalloc(sizeof *ip)))
+    if (!(ip = __cast_to_type(ip)kmem_cache_alloc(inode_cache, 0)))
     {
         err = -ENOMEM;
         goto error;
@@ -50,7 +53,7 @@ int ialloc(inode_t **ref)
     *ref = ip;
     return 0;
 error:
-    if (ip) kfree(ip);
+    if (ip) kmem_cache_free(inode_cache, ip);
     if (lock) spinlock_free(lock);
     if (mapping) mapping_free(mapping);
 
@@ -94,7 +97,7 @@ int irelease(inode_t *ip)
     spinlock_free(ip->i_lock);
     cond_free(ip->i_readers);
     cond_free(ip->i_writers);
-    kfree(ip);
+    kmem_cache_free(inode_cache, ip);
 
     return 0;
 error:
@@ -4,6 +4,7 @@
 #include <lib/string.h>
 #include <lime/string.h>
 #include <mm/kalloc.h>
+#include <mm/mm_zone.h>
 #include <arch/i386/paging.h>
 #include <printk.h>
 
@@ -74,21 +75,29 @@ size_t iread(inode_t *ip, off_t pos, void *buf, size_t sz)
     if (!ip->ifs->fsuper->iops->read)
         return -ENOSYS;
 
+    /**
+     * pipes have no pages to cache, and for a MAPPING_MEMORY file
+     * the page index is the file itself, the filesystem reads it directly.
+     */
+    if ((ip->i_type == FS_PIPE) || (ip->mapping->flags & MAPPING_MEMORY))
+        return ip->ifs->fsuper->iops->read(ip, pos, buf, sz);
+
     if (!(holding = mapping_holding(ip->mapping)))
         mapping_lock(ip->mapping);
 
-    for (size_t i = 0; i < NPAGE(sz); ++i, ++pgno) {
+    // served from the inode's page cache, pages are read in on a miss.
+    for (; dest_buff < dest_end; pgno = pos / PAGESZ) {
         if ((pos >= ip->i_size))
         {
-            data_size = -1;
+            if (data_size == 0)
+                data_size = -1;
             break;
         }
 
-        if ((retval = mapping_get_page(ip->mapping, pgno, &page_addr, &page))) {
+        if ((retval = mapping_get_page(ip->mapping, pgno, &page_addr, &page)) || page == NULL) {
             if (!holding)
                 mapping_unlock(ip->mapping);
-            printk("error: %d\n", data_size);
-            return data_size;
+            return data_size ? data_size : retval;
         }
 
         virt_addr = (char *)page->virtual;
@@ -96,7 +105,6 @@ size_t iread(inode_t *ip, off_t pos, void *buf, size_t sz)
         size = MIN(size, (ip->i_size - pos));
         size = MIN((PAGESZ - PGOFFSET(pos)), size);
         memcpy((void *)dest_buff, (void *)(virt_addr + PGOFFSET(pos)), size);
-        // printk("req: %d, read: %d, pos: %d, isize: %d\n", sz, size, pos, ip->i_size);
         pos += size;
         dest_buff += size;
         data_size += size;
@@ -105,7 +113,6 @@ size_t iread(inode_t *ip, off_t pos, void *buf, size_t sz)
     if (!holding)
         mapping_unlock(ip->mapping);
 
-    // printk("req: %d, read: %d, pos: %d, isize: %d\n", sz, data_size, pos, ip->i_size);
     return data_size;
     // data_size = ip->ifs->fsuper->iops->read(ip, pos, buf, sz);
 }
@@ -136,6 +143,9 @@ size_t iwrite(inode_t *ip, off_t pos, void *buf, size_t sz)
     if (!ip->ifs->fsuper->iops->write)
         return -ENOSYS;
 
+    if ((ip->i_type == FS_PIPE) || (ip->mapping->flags & MAPPING_MEMORY))
+        return ip->ifs->fsuper->iops->write(ip, pos, buf, sz);
+
     if (!(holding = mapping_holding(ip->mapping)))
         mapping_lock(ip->mapping);
 
@@ -168,7 +178,7 @@ size_t iwrite(inode_t *ip, off_t pos, void *buf, size_t sz)
         size = MIN(size, (ip->i_size - pos));
         size = MIN((PAGESZ - PGOFFSET(pos)), size);
         memcpy((void *)(virt_addr + PGOFFSET(pos)), (void *)src_buff, size);
-        printk("req: %d, written: %d, pos: %d, isize: %d\n", sz, size, pos, ip->i_size);
+        page->flags.dirty = 1; // keeps the shrinker from dropping it.
         pos += size;
         src_buff += size;
         data_size += size;
@@ -343,6 +353,25 @@ done:
     return 0;
 }
 
+/* cut the file down (or extend it with a hole) to 'size' bytes. */
+int itruncate(inode_t *ip, off_t size)
+{
+    if (!ip)
+        return -EINVAL;
+    if (ISDEV(ip))
+        return -EINVAL;
+
+    if (INODE_ISDIR(ip))
+        return -EISDIR;
+
+    CHK_IPTR(ip);
+
+    if (!ip->ifs->fsuper->iops->truncate)
+        return -ENOSYS;
+
+    return ip->ifs->fsuper->iops->truncate(ip, size);
+}
+
 int ilseek(inode_t *ip, off_t off, int whence)
 {
     if (!ip)
@@ -402,17 +431,64 @@ int ichown(inode_t *ip, uid_t uid, gid_t gid)
     return ip->ifs->fsuper->iops->chown(ip, uid, gid);
 }
 
+/**
+ * get page 'pgno' of the inode's page cache.
+ * the page is returned with a reference held for the caller,
+ * taken under the mapping lock so the shrinker cannot free it first.
+ */
 int inode_getpage(inode_t *ip, ssize_t pgno, uintptr_t *ppaddr, page_t **ppage) {
     int err = 0;
-    
+    page_t *page = NULL;
+
     if (!ip)
         return -EINVAL;
-    
+
     mapping_lock(ip->mapping);
-    err = mapping_get_page(ip->mapping, pgno, ppaddr, ppage);
+    if ((err = mapping_get_page(ip->mapping, pgno, NULL, &page)) == 0) {
+        if (page == NULL)
+            err = -ENXIO;
+        else
+            __page_incr(page_address(page));
+    }
     mapping_unlock(ip->mapping);
-    
-    return err;
+
+    if (err)
+        return err;
+
+    if (ppaddr) *ppaddr = page_address(page);
+    if (ppage) *ppage = page;
+    return 0;
+}
+
+/**
+ * get the frame holding page 'pgno' of the file where it already lies
+ * in memory (the initrd), so it can be mapped without a copy.
+ * the frame is returned with a reference held for the caller.
+ * fails if the filesystem has no such frame, use inode_getpage() then.
+ */
+int inode_getframe(inode_t *ip, ssize_t pgno, uintptr_t *ppaddr)
+{
+    int err = 0;
+    uintptr_t paddr = 0;
+
+    if (!ip || !ppaddr || (pgno < 0))
+        return -EINVAL;
+    if (ISDEV(ip))
+        return -ENOSYS;
+
+    CHK_IPTR(ip);
+
+    if (!ip->ifs->fsuper->iops->getframe)
+        return -ENOSYS;
+
+    if ((err = ip->ifs->fsuper->iops->getframe(ip, pgno * PAGESZ, &paddr)))
+        return err;
+
+    if ((err = __page_incr(paddr)) < 0)
+        return err;
+
+    *ppaddr = paddr;
+    return 0;
 }
 
 int icreate(inode_t *dir, dentry_t *dentry, mode_t mode)
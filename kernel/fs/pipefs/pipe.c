@@ -11,10 +11,28 @@
 #include <fs/posix.h>
 #include <sys/thread.h>
 #include <sys/proc.h>
+#include <sys/sched.h>
 #include <arch/i386/cpu.h>
+#include <arch/i386/paging.h>
+#include <fs/ioctl.h>
+
+/**
+ * pipe data is kept in a chain of pages, written at the tail
+ * and read from the head. pages are allocated as the pipe fills
+ * and freed as it drains, keeping one spare so a steady stream
+ * doesn't allocate at all. writers block only once 'capacity'
+ * bytes are queued.
+ *
+ * readers and writers sleep with the pipe lock released atomically,
+ * so a wakeup can't slip in between the check and the sleep. data
+ * is copied at most PIPE_COPY bytes per hold of the lock.
+ */
+
+#define PIPE_COPY   PAGESZ  /*most bytes copied with the pipe lock held*/
 
 static iops_t pipefs_iops;
 static filesystem_t pipefs;
+static struct fops pipefs_fops;
 static struct super_block pipefs_sb;
 
 int pipefs_init(void)
@@ -26,19 +44,15 @@ static int pipefs_mkpipe(pipe_t **rpipe)
 {
     int err = 0;
     pipe_t *pipe = NULL;
-    ringbuf_t *ring = NULL;
     spinlock_t *lock = NULL;
-    cond_t *readers = NULL, *writers = NULL;
+    queue_t *readers = NULL, *writers = NULL;
 
     assert(rpipe, "no pipe reference");
 
-    if ((err = cond_init(NULL, "pipe_readers", &readers)))
+    if ((err = queue_new("pipe_readers", &readers)))
         goto error;
 
-    if ((err = cond_init(NULL, "pipe_writers", &writers)))
-        goto error;
-
-    if ((err = ringbuf_new(PIPESZ, &ring)))
+    if ((err = queue_new("pipe_writers", &writers)))
         goto error;
 
     if ((err = spinlock_init(NULL, "pipe", &lock)))
@@ -53,8 +67,8 @@ static int pipefs_mkpipe(pipe_t **rpipe)
     *pipe = (pipe_t){
         .ropen = 0,
         .wopen = 0,
-        .ringbuf = ring,
         .lock = lock,
+        .capacity = PIPESZ,
         .readers = readers,
         .writers = writers,
     };
@@ -63,22 +77,43 @@ static int pipefs_mkpipe(pipe_t **rpipe)
     return 0;
 error:
     if (readers)
-        cond_free(readers);
+    {
+        queue_lock(readers);
+        queue_free(readers);
+    }
     if (writers)
-        cond_free(writers);
-    if (pipe)
-        kfree(pipe);
-    if (ring)
-        ringbuf_free(ring);
+    {
+        queue_lock(writers);
+        queue_free(writers);
+    }
+    if (lock)
+        spinlock_free(lock);
     return err;
 }
 
 static void pipefs_free(pipe_t *pipe)
 {
+    pipebuf_t *pb = NULL, *next = NULL;
+
     assert(pipe, "no pipe");
 
-    if (pipe->ringbuf)
-        ringbuf_free(pipe->ringbuf);
+    for (pb = pipe->head; pb; pb = next)
+    {
+        next = pb->next;
+        paging_free((uintptr_t)pb, PAGESZ);
+    }
+    if (pipe->spare)
+        paging_free((uintptr_t)pipe->spare, PAGESZ);
+    if (pipe->readers)
+    {
+        queue_lock(pipe->readers);
+        queue_free(pipe->readers);
+    }
+    if (pipe->writers)
+    {
+        queue_lock(pipe->writers);
+        queue_free(pipe->writers);
+    }
     if (pipe->lock)
         spinlock_free(pipe->lock);
     kfree(pipe);
@@ -102,10 +137,12 @@ int pipefs_pipe_raw(inode_t **read, inode_t **write)
         goto error;
 
     iread->i_mask = 0444;
+    iread->i_type = FS_PIPE;
     iread->i_priv = pipe;
     iread->ifs = &pipefs;
 
     iwrite->i_mask = 0222;
+    iwrite->i_type = FS_PIPE;
     iwrite->i_priv = pipe;
     iwrite->ifs = &pipefs;
 
@@ -144,10 +181,12 @@ int pipefs_pipe(file_t *read, file_t *write)
         goto error;
 
     iread->i_mask = 0444;
+    iread->i_type = FS_PIPE;
     iread->i_priv = pipe;
     iread->ifs = &pipefs;
 
     iwrite->i_mask = 0222;
+    iwrite->i_type = FS_PIPE;
     iwrite->i_priv = pipe;
     iwrite->ifs = &pipefs;
 
@@ -180,13 +219,13 @@ static int pipefs_close(pipe_t *pipe, int writable)
     {
         //klog(KLOG_OK, "write pipe end\n");
         pipe->wopen = 0;
-        cond_signal(pipe->readers);
+        xched_wakeall(pipe->readers);
     }
     else
     {
         //klog(KLOG_OK, "read pipe end\n");
         pipe->ropen = 0;
-        cond_signal(pipe->writers);
+        xched_wakeall(pipe->writers);
     }
 
     if (!pipe->ropen && !pipe->wopen)
@@ -201,123 +240,363 @@ static int pipefs_close(pipe_t *pipe, int writable)
     return 0;
 }
 
-static size_t pipe_iread(inode_t *inode, off_t off __unused, void *buf __unused, size_t size)
+static pipebuf_t *pipebuf_alloc(pipe_t *pipe)
 {
-    size_t read = 0, pos __unused = 0;
-    pipe_t *pipe = NULL;
+    pipebuf_t *pb = NULL;
 
-    ilock(inode);
-    pipe = inode->i_priv;
-    spin_lock(pipe->lock);
+    if ((pb = pipe->spare))
+        pipe->spare = NULL;
+    else if ((pb = (pipebuf_t *)paging_alloc(PAGESZ)) == NULL)
+        return NULL;
+
+    pb->next = NULL;
+    pb->head = 0;
+    pb->tail = 0;
+    return pb;
+}
+
+static void pipebuf_free(pipe_t *pipe, pipebuf_t *pb)
+{
+    if (pipe->spare == NULL)
+        pipe->spare = pb;
+    else
+        paging_free((uintptr_t)pb, PAGESZ);
+}
+
+/* queue up to 'n' bytes, as many as fit. caller holds the pipe lock. */
+static size_t pipe_put(pipe_t *pipe, const char *buf, size_t n)
+{
+    size_t done = 0, span = 0;
+    pipebuf_t *pb = NULL;
+
+    n = MIN(n, pipe->capacity - pipe->count);
+
+    while (done < n)
+    {
+        if ((pb = pipe->tail) == NULL || pb->tail == PIPEBUF_SIZE)
+        {
+            if ((pb = pipebuf_alloc(pipe)) == NULL)
+                break;
+            if (pipe->tail)
+                pipe->tail->next = pb;
+            else
+                pipe->head = pb;
+            pipe->tail = pb;
+        }
+
+        span = MIN(n - done, PIPEBUF_SIZE - pb->tail);
+        memcpy(PIPEBUF_DATA(pb) + pb->tail, buf + done, span);
+        pb->tail += span;
+        done += span;
+    }
+
+    pipe->count += done;
+    return done;
+}
+
+/* take up to 'n' bytes off the pipe. caller holds the pipe lock. */
+static size_t pipe_get(pipe_t *pipe, char *buf, size_t n)
+{
+    size_t done = 0, span = 0;
+    pipebuf_t *pb = NULL;
+
+    n = MIN(n, pipe->count);
+
+    while (done < n)
+    {
+        pb = pipe->head;
+        span = MIN(n - done, pb->tail - pb->head);
+        memcpy(buf + done, PIPEBUF_DATA(pb) + pb->head, span);
+        pb->head += span;
+        done += span;
+
+        if (pb->head < pb->tail)
+            continue;
+
+        if (pb == pipe->tail) // the last page, start it over.
+        {
+            pb->head = 0;
+            pb->tail = 0;
+        }
+        else
+        {
+            pipe->head = pb->next;
+            pipebuf_free(pipe, pb);
+        }
+    }
+
+    pipe->count -= done;
+    return done;
+}
+
+/* sleep on 'queue', dropping the pipe lock only once asleep. */
+static int pipe_sleep(pipe_t *pipe, queue_t *queue)
+{
+    int err = 0;
+
+    current_lock();
+    err = xched_sleep(queue, pipe->lock);
+    current_unlock();
+    return err;
+}
+
+/**
+ * wait for data, called and returns with the pipe lock held.
+ * returns 1 once there's data, 0 at end-of-file or an error.
+ */
+static int pipe_wait_data(pipe_t *pipe)
+{
+    int err = 0;
+
+    while (pipe->count == 0)
+    {
+        if (pipe->wopen == 0) // write end of pipe is closed
+            return 0;
+
+        if ((err = pipe_sleep(pipe, pipe->readers)))
+            return err;
+    }
+
+    return 1;
+}
+
+/**
+ * wait for room, called and returns with the pipe lock held.
+ * returns 1 once there's room, -EPIPE if the read end is closed.
+ */
+static int pipe_wait_room(pipe_t *pipe)
+{
+    int err = 0;
+
+    for (;;)
+    {
+        if (pipe->ropen == 0) // read end of pipe is closed
+            return -EPIPE;
+
+        if (pipe->count < pipe->capacity)
+            return 1;
+
+        if ((err = pipe_sleep(pipe, pipe->writers)))
+            return err;
+    }
+}
+
+static size_t pipe_iread(inode_t *inode, off_t off __unused, void *buf, size_t size)
+{
+    int err = 0;
+    int full = 0;
+    size_t read = 0;
+    pipe_t *pipe = inode->i_priv;
 
     if ((inode->i_mask & S_IREAD) == 0) // pipe not open for read
+        return -1;
+
+    if (size == 0)
+        return 0;
+
+    // block until there's something to read, then take what's there.
+    spin_lock(pipe->lock);
+    if ((err = pipe_wait_data(pipe)) <= 0)
     {
-        printk("pipe not open for reading\n");
         spin_unlock(pipe->lock);
-        iunlock(inode);
-        return -1;
+        return err;
+    }
+
+    for (;;)
+    {
+        full = pipe->count >= pipe->capacity;
+        read += pipe_get(pipe, (char *)buf + read, MIN(size - read, PIPE_COPY));
+
+        if (full)
+            xched_wakeall(pipe->writers);
+
+        if ((read == size) || (pipe->count == 0))
+            break;
+
+        // let interrupts in between copies.
+        spin_unlock(pipe->lock);
+        spin_lock(pipe->lock);
     }
 
-    //printk("pipe read\n");
+    spin_unlock(pipe->lock);
+    return read;
+}
+
+static size_t pipe_iwrite(inode_t *inode, off_t off __unused, void *buf, size_t size)
+{
+    int err = 0;
+    int empty = 0;
+    size_t written = 0, n = 0;
+    pipe_t *pipe = inode->i_priv;
+
+    if ((inode->i_mask & S_IWRITE) == 0) // pipe not open for writing
+        return -1;
+
+    spin_lock(pipe->lock);
 
-    while (read < size)
+    while (written < size)
     {
-        ringbuf_lock(pipe->ringbuf);
-        if (ringbuf_isempty(pipe->ringbuf)) //pipe is empty
+        if ((err = pipe_wait_room(pipe)) < 0)
+            break;
+
+        empty = pipe->count == 0;
+        if ((n = pipe_put(pipe, (char *)buf + written, MIN(size - written, PIPE_COPY))) == 0)
         {
-            //printk("pipe is empty\n");
-            if (pipe->wopen == 0) // write end of pipe is closed
-            {
-                //printk("broken pipe, no write end\n");
-                ringbuf_unlock(pipe->ringbuf);
-                spin_unlock(pipe->lock);
-                iunlock(inode);
-                if (!read)
-                    return -EPIPE;
-                else
-                    return read;
-            }
-
-            cond_signal(pipe->writers);
-            
-            ringbuf_unlock(pipe->ringbuf);
+            err = -ENOMEM;
+            break;
+        }
+
+        written += n;
+        if (empty)
+            xched_wakeall(pipe->readers);
+
+        if (written < size)
+        {
+            // let interrupts in between copies.
             spin_unlock(pipe->lock);
-            iunlock(inode);
-            
-            cond_wait(pipe->readers);
-            
-            ilock(inode);
             spin_lock(pipe->lock);
-            ringbuf_lock(pipe->ringbuf);
         }
-
-        read += ringbuf_read(pipe->ringbuf, size - read, buf + read);
-        ringbuf_unlock(pipe->ringbuf);
     }
 
-    cond_signal(pipe->writers);
     spin_unlock(pipe->lock);
-    iunlock(inode);
-    return read;
+    return written ? written : (size_t)err;
 }
 
-static size_t pipe_iwrite(inode_t *inode, off_t off __unused, void *buf __unused, size_t size)
+/**
+ * fill pipe pages straight from 'src', starting at *ppos, and link them
+ * onto the chain. the read happens without the pipe lock, it may sleep.
+ */
+ssize_t pipefs_splice_in(inode_t *ip, inode_t *src, off_t *ppos, size_t len)
 {
-    size_t written = 0, pos __unused = 0;
-    pipe_t *pipe = NULL;
+    int err = 0;
+    int empty = 0;
+    ssize_t n = 0;
+    size_t done = 0, size = 0;
+    pipebuf_t *pb = NULL;
+    pipe_t *pipe = ip->i_priv;
 
-    ilock(inode);
-    pipe = inode->i_priv;
+    if ((ip->i_type != FS_PIPE) || (ip->i_mask & S_IWRITE) == 0)
+        return -EBADF;
 
     spin_lock(pipe->lock);
-    if ((inode->i_mask & S_IWRITE) == 0) // pipe not open for writing
+
+    while ((done < len) && (*ppos < src->i_size))
     {
-        printk("pipe not open for writing\n");
+        if ((err = pipe_wait_room(pipe)) < 0)
+            break;
+
+        size = MIN(MIN(len - done, pipe->capacity - pipe->count), PIPEBUF_SIZE);
+        if ((pb = pipebuf_alloc(pipe)) == NULL)
+        {
+            err = -ENOMEM;
+            break;
+        }
         spin_unlock(pipe->lock);
-        iunlock(inode);
-        return -1;
+
+        n = iread(src, *ppos, PIPEBUF_DATA(pb), size);
+
+        spin_lock(pipe->lock);
+        if (n <= 0)
+        {
+            pipebuf_free(pipe, pb);
+            err = n;
+            break;
+        }
+
+        // a drained pipe is down to one empty page, don't leave it ahead of this one.
+        if ((empty = pipe->count == 0) && pipe->head)
+        {
+            pipebuf_free(pipe, pipe->head);
+            pipe->head = pipe->tail = NULL;
+        }
+
+        pb->tail = n;
+        if (pipe->tail)
+            pipe->tail->next = pb;
+        else
+            pipe->head = pb;
+        pipe->tail = pb;
+        pipe->count += n;
+
+        if (empty)
+            xched_wakeall(pipe->readers);
+
+        *ppos += n;
+        done += n;
     }
 
-    //printk("pipe write\n");
+    spin_unlock(pipe->lock);
+    return done ? (ssize_t)done : err;
+}
 
-    while (written < size)
+/**
+ * write up to 'len' bytes from the pipe to 'out'. whole pages are taken
+ * off the chain and written from where they lie, only a last partial
+ * page is copied out. blocks for the first byte only, like read().
+ */
+ssize_t pipefs_splice_out(inode_t *ip, file_t *out, size_t len)
+{
+    int err = 0;
+    int full = 0;
+    ssize_t n = 0;
+    size_t done = 0, size = 0;
+    pipebuf_t *pb = NULL;
+    pipe_t *pipe = ip->i_priv;
+
+    if ((ip->i_type != FS_PIPE) || (ip->i_mask & S_IREAD) == 0)
+        return -EBADF;
+
+    spin_lock(pipe->lock);
+
+    while (done < len)
     {
-        ringbuf_lock(pipe->ringbuf);
-        if (ringbuf_available(pipe->ringbuf) == PIPESZ)
+        if (done && pipe->count == 0)
+            break;
+
+        if ((err = pipe_wait_data(pipe)) <= 0)
+            break;
+
+        full = pipe->count >= pipe->capacity;
+        pb = pipe->head;
+
+        if ((pb->tail - pb->head) <= (len - done))
         {
-            //printk("pipe is full\n");
-            if (pipe->ropen == 0) // read end of pipe is closed
-            {
-                //printk("broken pipe, no read end\n");
-                ringbuf_unlock(pipe->ringbuf);
-                spin_unlock(pipe->lock);
-                iunlock(inode);
-                if (!written)
-                    return -EPIPE;
-                else return written;
-            }
-
-            cond_signal(pipe->readers);
-            
-            ringbuf_unlock(pipe->ringbuf);
-            spin_unlock(pipe->lock);
-            iunlock(inode);
-            
-            cond_wait(pipe->writers);
+            if ((pipe->head = pb->next) == NULL)
+                pipe->tail = NULL;
+            pb->next = NULL;
+            pipe->count -= pb->tail - pb->head;
+        }
+        else if ((pb = pipebuf_alloc(pipe)))
+            pb->tail = pipe_get(pipe, PIPEBUF_DATA(pb), len - done);
+        else
+        {
+            err = -ENOMEM;
+            break;
+        }
 
-            ilock(inode);
-            spin_lock(pipe->lock);
-            ringbuf_lock(pipe->ringbuf);
+        if (full)
+            xched_wakeall(pipe->writers);
+        spin_unlock(pipe->lock);
+
+        size = pb->tail - pb->head;
+        n = fwrite(out, PIPEBUF_DATA(pb) + pb->head, size);
+
+        spin_lock(pipe->lock);
+        pipebuf_free(pipe, pb);
+
+        if (n < 0)
+        {
+            err = n;
+            break;
         }
 
-        written += ringbuf_write(pipe->ringbuf, size - written, buf + written);
-        ringbuf_unlock(pipe->ringbuf);
+        done += n;
+        if ((size_t)n < size) // the sink took less, the rest is lost like a failed write.
+            break;
     }
-    
-    cond_signal(pipe->readers);
+
     spin_unlock(pipe->lock);
-    iunlock(inode);
-    return written;
+    return done ? (ssize_t)done : err;
 }
 
 static int pipe_icreat(inode_t *inode __unused, dentry_t *dentry __unused, int mode __unused)
@@ -340,8 +619,34 @@ static int pipe_iopen(inode_t *inode __unused, int oflags __unused, ...)
     return -EINVAL;
 }
 
-static int pipe_iioctl(inode_t *inode __unused, int req __unused, void *p __unused)
+static int pipe_iioctl(inode_t *inode, int req, void *argp)
 {
+    int err = 0;
+    pipe_t *pipe = inode->i_priv;
+    size_t size = PGROUNDUP((uintptr_t)argp);
+
+    switch (req)
+    {
+    case PIPEGETSZ:
+        return pipe->capacity;
+    case PIPESETSZ:
+        if (size == 0 || size > PIPE_MAXSZ)
+            return -EINVAL;
+
+        spin_lock(pipe->lock);
+        if (size < pipe->count) // won't drop queued data.
+            err = -EBUSY;
+        else
+        {
+            if (size > pipe->capacity)
+                xched_wakeall(pipe->writers);
+            pipe->capacity = size;
+            err = size;
+        }
+        spin_unlock(pipe->lock);
+        return err;
+    }
+
     return -ENOTTY;
 }
 
@@ -366,24 +671,31 @@ static int pipefs_iclose(inode_t *inode __unused)
 
 static size_t pipefs_can_read(struct file *file, size_t size)
 {
-    struct inode *node = file->f_inode;
-    struct pipe *pipe = node->i_priv;
-    ringbuf_lock(pipe->ringbuf);
-    size_t can = size <= ringbuf_available(pipe->ringbuf);
-    ringbuf_unlock(pipe->ringbuf);
+    struct pipe *pipe = file->f_inode->i_priv;
+    spin_lock(pipe->lock);
+    size_t can = size <= pipe->count;
+    spin_unlock(pipe->lock);
     return can;
 }
 
 static size_t pipefs_can_write(struct file *file, size_t size)
 {
-    struct inode *node = file->f_inode;
-    struct pipe *pipe = node->i_priv;
-    ringbuf_lock(pipe->ringbuf);
-    size_t can = size >= pipe->ringbuf->size - ringbuf_available(pipe->ringbuf);
-    ringbuf_unlock(pipe->ringbuf);
+    struct pipe *pipe = file->f_inode->i_priv;
+    spin_lock(pipe->lock);
+    size_t can = (pipe->count < pipe->capacity) && (size <= pipe->capacity - pipe->count);
+    spin_unlock(pipe->lock);
     return can;
 }
 
+static size_t pipefs_eof(struct file *file)
+{
+    struct pipe *pipe = file->f_inode->i_priv;
+    spin_lock(pipe->lock);
+    size_t eof = !pipe->count && !pipe->wopen;
+    spin_unlock(pipe->lock);
+    return eof;
+}
+
 int pipefs_mount()
 {
     int err = 0;
@@ -410,9 +722,6 @@ error:
 
 int pipefs_load()
 {
-    pipefs_sb.fops->can_read = pipefs_can_read;
-    pipefs_sb.fops->can_write = pipefs_can_write;
-    pipefs_sb.fops->eof = (size_t(*)(struct file *))__never;
     return 0;
 }
 
@@ -428,8 +737,22 @@ static iops_t pipefs_iops = {
     .sync = pipe_isync,
 };
 
+static struct fops pipefs_fops = {
+    .close = posix_file_close,
+    .open = posix_file_open,
+    .ioctl = posix_file_ioctl,
+    .lseek = posix_file_lseek,
+    .read = posix_file_read,
+    .write = posix_file_write,
+    .readdir = posix_file_readdir,
+    .stat = posix_file_ffstat,
+    .eof = pipefs_eof,
+    .can_read = pipefs_can_read,
+    .can_write = pipefs_can_write,
+};
+
 static super_block_t pipefs_sb = {
-    .fops = &posix_fops,
+    .fops = &pipefs_fops,
     .iops = &pipefs_iops,
     .s_blocksz = PIPESZ,
     .s_magic = 0xc0de,
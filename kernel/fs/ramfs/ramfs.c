@@ -10,11 +10,14 @@
 #include <sys/_stat.h>
 #include <sys/mman/mman.h>
 #include <fs/ramfs2.h>
+#include <dev/ramdisk.h>
 
 static iops_t ramfs_iops;
 static inode_t *iroot = NULL;
 static inode_t *iramdisk = NULL;
 static ramfs_superblock_t ramfs_super = {0};
+static inode_t *ramfs_inodes[NELEM(ramfs_super.inode)]; // one inode per file, so every open shares its page cache.
+static spinlock_t *ramfs_lock = SPINLOCK_NEW("ramfs");
 static filesystem_t ramfs;
 static super_block_t ramfs_sb;
 static vmr_ops_t ramfs_vmr_ops __unused;
@@ -83,8 +86,16 @@ static int ramfs_find(inode_t *dir, const char *name, inode_t **ref)
             if (compare_strings(ramfs_super.inode[i].name, name))
                 continue;
 
-            if ((err = ramfs_ialloc(&ip)))
+            spin_lock(ramfs_lock);
+            if ((ip = ramfs_inodes[i])) {
+                spin_unlock(ramfs_lock);
+                goto found;
+            }
+
+            if ((err = ramfs_ialloc(&ip))) {
+                spin_unlock(ramfs_lock);
                 goto error;
+            }
 
             ip->i_mask = 0555;
             ip->i_gid = ramfs_super.inode[i].gid;
@@ -94,6 +105,8 @@ static int ramfs_find(inode_t *dir, const char *name, inode_t **ref)
             ip->i_type = (int[]){
                 [0] = FS_INV, [1] = FS_DIR, [2] = FS_RGL,
             }[ramfs_super.inode[i].type];
+            ramfs_inodes[i] = ip;
+            spin_unlock(ramfs_lock);
             goto found;
         default:
             err = -EBADF;
@@ -127,6 +140,7 @@ static int ramfs_ioctl(inode_t *ip __unused, int req __unused, void *argp __unus
 static size_t ramfs_read(inode_t *ip, off_t off, void *buf, size_t sz)
 {
     size_t size = 0;
+    void *data = NULL;
     ramfs_inode_t *ramfs_inode = NULL;
     if (!ip)
         return -EINVAL;
@@ -140,7 +154,31 @@ static size_t ramfs_read(inode_t *ip, off_t off, void *buf, size_t sz)
         sz = ramfs_inode->size - off;
 
     size = MIN(ramfs_inode->size - off, sz);
-    return iread(iramdisk, ramfs_inode->offset + off, buf, size);
+    if ((data = ramdisk_data(ramfs_inode->offset + off, size)) == NULL)
+        return -EIO;
+    memcpy(buf, data, size); // the ramdisk is in memory for good, read it directly.
+    return size;
+}
+
+// a whole page of a file whose data starts on a page boundary maps straight from the ramdisk.
+static int ramfs_getframe(inode_t *ip, off_t off, uintptr_t *pframe)
+{
+    uintptr_t paddr = 0;
+    ramfs_inode_t *ramfs_inode = NULL;
+
+    if (!ip || !pframe)
+        return -EINVAL;
+    if (!(ramfs_inode = ramfs_convert(ip)) || ramfs_inode->type != INITRD_FILE)
+        return -EINVAL;
+    if (PGOFFSET(off) || ((int)off >= ramfs_inode->size) || (ramfs_inode->size - (int)off < PAGESZ))
+        return -ERANGE;
+
+    paddr = ramdisk_phys(ramfs_inode->offset + off);
+    if (paddr == 0 || PGOFFSET(paddr))
+        return -ENOTSUP;
+
+    *pframe = paddr;
+    return 0;
 }
 
 static size_t ramfs_write(inode_t *ip __unused, off_t off __unused, void *buf __unused, size_t sz __unused)
@@ -340,6 +378,7 @@ static iops_t ramfs_iops ={
     .sync = ramfs_sync,
     .write = ramfs_write,
     .readdir = ramfs_readdir,
+    .getframe = ramfs_getframe,
 };
 
 static struct fops ramfs_fops = (struct fops){
@@ -2,8 +2,10 @@
 #include <printk.h>
 #include <fs/posix.h>
 #include <fs/ramfs2.h>
+#include <dev/ramdisk.h>
 #include <mm/kalloc.h>
 #include <bits/errno.h>
+#include <lib/string.h>
 #include <lime/string.h>
 
 static iops_t ramfs2_iops;
@@ -12,6 +14,8 @@ static inode_t *iroot = NULL;
 static super_block_t ramfs2_sb;
 static inode_t *iramdisk = NULL;
 static ramfs2_super_t *ramfs2_super = NULL;
+static inode_t **ramfs2_inodes = NULL; // one inode per node, so every open shares its page cache.
+static spinlock_t *ramfs2_lock = SPINLOCK_NEW("ramfs2");
 static vmr_ops_t ramfs2_vmr_ops __unused;
 
 int ramfs2_validate(ramfs2_super_t *super)
@@ -74,8 +78,14 @@ static int ramfs2_ifind(inode_t *dir, const char *name, inode_t **ref)
     if ((err = ramfs2_find(ramfs2_super, name, &node)))
         return err;
 
-    if ((err = ialloc(&ip)))
+    spin_lock(ramfs2_lock);
+    if ((ip = ramfs2_inodes[node - ramfs2_super->nodes]))
+        goto found;
+
+    if ((err = ialloc(&ip))) {
+        spin_unlock(ramfs2_lock);
         return err;
+    }
 
     ip->ifs = &ramfs2;
     ip->i_priv = node;
@@ -89,7 +99,9 @@ static int ramfs2_ifind(inode_t *dir, const char *name, inode_t **ref)
         [RAMFS2_DIR] = FS_DIR,
     }[node->type];
     ip->i_ino = node - ramfs2_super->nodes;
-
+    ramfs2_inodes[ip->i_ino] = ip;
+found:
+    spin_unlock(ramfs2_lock);
     *ref = ip;
     return 0;
 };
@@ -99,8 +111,10 @@ static int ramfs2_open(inode_t *ip __unused, int mode __unused, ...)
     return 0;
 }
 
+// the ramdisk is in memory for good, read it directly.
 static size_t ramfs2_read(inode_t *ip, off_t off, void *buf, size_t sz)
 {
+    void *data = NULL;
     ramfs2_node_t *node = NULL;
 
     if (!ip || !buf)
@@ -111,7 +125,36 @@ static size_t ramfs2_read(inode_t *ip, off_t off, void *buf, size_t sz)
         return -1;
     sz = MIN((node->size - off), sz);
     off += node->offset + ramfs2_super->header.data_offset;
-    return iread(iramdisk, off, buf, sz);
+    if ((data = ramdisk_data(off, sz)) == NULL)
+        return -EIO;
+    memcpy(buf, data, sz);
+    return sz;
+}
+
+/**
+ * a whole page of a regular file maps straight from the ramdisk,
+ * as long as the file's data starts on a page boundary in memory.
+ * the partial page at the end of a file is not handed out, what
+ * follows it in the ramdisk isn't zero.
+ */
+static int ramfs2_getframe(inode_t *ip, off_t off, uintptr_t *pframe)
+{
+    uintptr_t paddr = 0;
+    ramfs2_node_t *node = NULL;
+
+    if (!ip || !pframe)
+        return -EINVAL;
+    if ((node = ramfs2_convert_inode(ip)) == NULL || node->type != RAMFS2_REG)
+        return -EINVAL;
+    if (PGOFFSET(off) || (off >= node->size) || (node->size - off < PAGESZ))
+        return -ERANGE;
+
+    paddr = ramdisk_phys(ramfs2_super->header.data_offset + node->offset + off);
+    if (paddr == 0 || PGOFFSET(paddr))
+        return -ENOTSUP;
+
+    *pframe = paddr;
+    return 0;
 }
 
 static size_t ramfs2_write(inode_t *ip __unused, off_t off __unused, void *buf __unused, size_t sz __unused)
@@ -185,9 +228,15 @@ static int ramfs2_read_super()
     if ((err = ramfs2_validate(ramfs2_super)))
         goto error;
 
+    if ((ramfs2_inodes = kcalloc(ramfs2_super->header.nfile, sizeof *ramfs2_inodes)) == NULL) {
+        err = -ENOMEM;
+        goto error;
+    }
+
     return 0;
 error:
     if (ramfs2_super) kfree(ramfs2_super);
+    ramfs2_super = NULL;
     printk("%s(): called @ 0x%p, error=%d\n", __func__, return_address(0), err);
     return err;
 }
@@ -260,6 +309,7 @@ static iops_t ramfs2_iops = {
     .sync = ramfs2_sync,
     .write = ramfs2_write,
     .readdir = ramfs2_readdir,
+    .getframe = ramfs2_getframe,
 };
 
 static struct fops ramfs2_fops = (struct fops){
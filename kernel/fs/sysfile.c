@@ -2,11 +2,17 @@
 #include <lib/string.h>
 #include <lime/string.h>
 #include <mm/kalloc.h>
+#include <mm/slab.h>
+#include <mm/mm_zone.h>
 #include <printk.h>
 #include <fs/fs.h>
 #include <sys/thread.h>
 #include <fs/pipefs.h>
+#include <fs/inode.h>
 #include <bits/errno.h>
+#include <arch/i386/paging.h>
+
+static kmem_cache_t *file_cache = KMEM_CACHE_NEW("file", sizeof(file_t), NULL);
 
 int check_fd(int fd)
 {
@@ -56,12 +62,11 @@ static int file_alloc(file_t **ref)
         return -EINVAL;
     if ((err = spinlock_init(NULL, "file", &lock)))
         return err;
-    if (!(file = kmalloc(sizeof *file)))
+    if (!(file = kmem_cache_alloc(file_cache, GFP_ZERO)))
     {
         spinlock_free(lock);
         return -ENOMEM;
     }
-    memset(file, 0, sizeof *file);
     file->f_lock = lock;
     file->f_ref = 1;
     *ref = file;
@@ -72,7 +77,7 @@ void file_free(file_t *file)
 {
     if (file->f_lock)
         spinlock_free(file->f_lock);
-    kfree(file);
+    kmem_cache_free(file_cache, file);
 }
 
 file_t *fileget(struct file_table *table, int fd)
@@ -109,6 +114,16 @@ int open(const char *fn, int oflags, mode_t mode)
     file->f_flags = oflags;
     file->f_dentry = dentry;
 
+    if ((oflags & O_TRUNC) && ((oflags & O_ACCMODE) != O_RDONLY) && (inode->i_type == FS_RGL))
+    {
+        // filesystems that can't truncate keep the old contents.
+        if ((err = itruncate(inode, 0)) && (err != -ENOSYS))
+        {
+            file_table_unlock(table);
+            goto error;
+        }
+    }
+
     if ((err = fopen(file, oflags)))
     {
         file_table_unlock(table);
@@ -229,6 +244,127 @@ error:
     return err;
 }
 
+static file_t *fdfile(int fd)
+{
+    file_t *file = NULL;
+    struct file_table *table = current->t_file_table;
+
+    file_table_assert(table);
+    file_table_lock(table);
+    if (check_fildes(fd, table) == 0)
+        file = fileget(table, fd);
+    file_table_unlock(table);
+    return file;
+}
+
+// only regular files are read in place, devices have no pages to hand out.
+#define splice_source(ip) (!ISDEV(ip) && ((ip)->i_type == FS_RGL))
+
+/**
+ * write 'count' bytes of 'ip' from *ppos to 'out' straight from the
+ * page cache, holding a reference on each page while it's written.
+ * pages of a MAPPING_MEMORY file (tmpfs) can be dropped under us by a
+ * truncate, those go through a page of our own instead.
+ */
+static ssize_t file_send(file_t *out, inode_t *ip, off_t *ppos, size_t count)
+{
+    ssize_t n = 0;
+    char *buf = NULL;
+    page_t *page = NULL;
+    size_t done = 0, size = 0;
+    int cached = !(ip->mapping->flags & MAPPING_MEMORY);
+
+    if (!cached && (buf = (char *)paging_alloc(PAGESZ)) == NULL)
+        return -ENOMEM;
+
+    while ((done < count) && (*ppos < ip->i_size))
+    {
+        size = MIN(MIN(count - done, PAGESZ - PGOFFSET(*ppos)), ip->i_size - *ppos);
+
+        if (cached)
+        {
+            if ((n = inode_getpage(ip, *ppos / PAGESZ, NULL, &page)))
+                break;
+            n = fwrite(out, (char *)page->virtual + PGOFFSET(*ppos), size);
+            page_put(page);
+        }
+        else if ((n = iread(ip, *ppos, buf, size)) > 0)
+            n = fwrite(out, buf, n);
+
+        if (n <= 0)
+            break;
+
+        *ppos += n;
+        done += n;
+        if ((size_t)n < size)
+            break;
+    }
+
+    if (buf)
+        paging_free((uintptr_t)buf, PAGESZ);
+    return done ? (ssize_t)done : n;
+}
+
+/**
+ * move up to 'len' bytes from fd_in to fd_out, one of which must be a
+ * pipe and the other a regular file or, as the sink, a device. file
+ * positions advance as with read() and write(). no flags are defined yet.
+ */
+ssize_t splice(int fd_in, int fd_out, size_t len, int flags)
+{
+    file_t *in = NULL, *out = NULL;
+    inode_t *iin = NULL, *iout = NULL;
+
+    if (flags)
+        return -EINVAL;
+
+    if ((in = fdfile(fd_in)) == NULL || (out = fdfile(fd_out)) == NULL)
+        return -EBADF;
+
+    if ((in->f_flags & O_WRONLY) || !(out->f_flags & (O_WRONLY | O_RDWR)))
+        return -EBADF;
+
+    iin = in->f_inode;
+    iout = out->f_inode;
+
+    if ((iin->i_type == FS_PIPE) && (iout->i_type != FS_PIPE))
+        return pipefs_splice_out(iin, out, len);
+
+    if ((iout->i_type == FS_PIPE) && splice_source(iin))
+        return pipefs_splice_in(iout, iin, &in->f_pos, len);
+
+    return -EINVAL;
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+    off_t pos = 0;
+    ssize_t retval = 0;
+    file_t *in = NULL, *out = NULL;
+
+    if ((in = fdfile(in_fd)) == NULL || (out = fdfile(out_fd)) == NULL)
+        return -EBADF;
+
+    if ((in->f_flags & O_WRONLY) || !(out->f_flags & (O_WRONLY | O_RDWR)))
+        return -EBADF;
+
+    if (!splice_source(in->f_inode))
+        return -EINVAL;
+
+    pos = offset ? *offset : in->f_pos;
+
+    if (out->f_inode->i_type == FS_PIPE)
+        retval = pipefs_splice_in(out->f_inode, in->f_inode, &pos, count);
+    else
+        retval = file_send(out, in->f_inode, &pos, count);
+
+    if (offset)
+        *offset = pos;
+    else
+        in->f_pos = pos;
+    return retval;
+}
+
 off_t lseek(int fd, off_t offset, int whence)
 {
     size_t retval = 0;
@@ -9,16 +9,26 @@
 #include <fs/fs.h>
 #include <fs/posix.h>
 
+#define TMPFS_NBUCKET   32  // name hash chains per directory, a power of two.
+
 struct tmpfs_dirent
 {
     char *name;
     inode_t *inode;
+    uint32_t hash;
+    int next;   // next entry on the same hash chain, -1 ends it.
 };
 
+/**
+ * a directory is an array of entries, indexed by readdir() offset,
+ * with the names hashed into chains so find() doesn't scan it all.
+ */
 struct tmpfsdir
 {
     struct tmpfs_dirent *table;
     int ndirent;
+    int nalloc;
+    int bucket[TMPFS_NBUCKET];
 };
 
 static iops_t tmpfs_iops;
@@ -40,16 +50,26 @@ static int tmpfs_close(inode_t *ip __unused)
     return -EINVAL;
 }
 
+static uint32_t tmpfs_hashname(const char *name)
+{
+    uint32_t h = 2166136261u;
+
+    while (*name)
+        h = (h ^ (uint8_t)*name++) * 16777619u;
+    return h;
+}
+
 static int tmpfs_find(inode_t *dir, const char *name, inode_t **ref)
 {
-    int err = 0;
-    inode_t *inode = 0;
+    uint32_t hash = 0;
     struct tmpfsdir *tmpfs_dir = NULL;
     struct tmpfs_dirent *table = NULL;
 
     if (!dir || !name || !ref)
         return -EINVAL;
 
+    hash = tmpfs_hashname(name);
+
     ilock(dir);
 
     if (!INODE_ISDIR(dir))
@@ -70,119 +90,80 @@ static int tmpfs_find(inode_t *dir, const char *name, inode_t **ref)
 
     assert(table, "how doesn't directory have no table?\n");
 
-    for (int i = 0; i < tmpfs_dir->ndirent; ++i)
+    for (int i = tmpfs_dir->bucket[hash & (TMPFS_NBUCKET - 1)]; i >= 0; i = table[i].next)
     {
-        inode = table[i].inode;
-        if (table[i].name == NULL)
-            continue;
-
-        if (inode == NULL)
+        if (table[i].hash == hash && !compare_strings(table[i].name, name))
         {
-            iunlock(inode);
-            iunlock(dir);
-            return -EINVAL;
-        }
-
-        ilock(inode);
-        if (!compare_strings(table[i].name, name))
-        {
-            *ref = inode;
-            iunlock(inode);
+            *ref = table[i].inode;
             iunlock(dir);
             return 0;
         }
-        iunlock(inode);
     }
 
     iunlock(dir);
     return -ENOENT;
-    goto error;
-error:
-    printk("tmpfs_find(): called @ 0x%p, error=%d\n", return_address(0), err);
-    return err;
 }
 
 static int tmpfs_mount(inode_t *dir, const char *name, inode_t *child)
 {
-    int bound = 0;
-    __unused dentry_t *dentry = NULL;
+    int i = 0;
+    char *dname = NULL;
     struct tmpfsdir *tmpfs_dir = NULL;
     struct tmpfs_dirent *table = NULL;
 
-    if (!dir || !child)
+    if (!dir || !name || !child)
         return -EINVAL;
 
+    if ((dname = strdup(name)) == NULL)
+        return -ENOMEM;
+
     ilock(dir);
 
     tmpfs_dir = dir->i_priv;
 
     if (tmpfs_dir == NULL)
     {
-        tmpfs_dir = kmalloc(sizeof *tmpfs_dir);
-        if (tmpfs_dir == NULL)
+        if ((tmpfs_dir = kcalloc(1, sizeof *tmpfs_dir)) == NULL)
         {
             iunlock(dir);
+            kfree(dname);
             return -ENOMEM;
         }
 
-        table = kcalloc(1, sizeof(struct tmpfs_dirent));
+        for (i = 0; i < TMPFS_NBUCKET; ++i)
+            tmpfs_dir->bucket[i] = -1;
+        dir->i_priv = tmpfs_dir;
+    }
 
-        if (table == NULL)
+    if (tmpfs_dir->ndirent == tmpfs_dir->nalloc)
+    {
+        // double the table so binding n entries costs O(n) copies overall.
+        i = tmpfs_dir->nalloc ? tmpfs_dir->nalloc * 2 : 8;
+        if ((table = krealloc(tmpfs_dir->table, i * sizeof *table)) == NULL)
         {
             iunlock(dir);
-            kfree(tmpfs_dir);
+            kfree(dname);
             return -ENOMEM;
         }
-
         tmpfs_dir->table = table;
-        tmpfs_dir->ndirent = 1;
-        dir->i_priv = tmpfs_dir;
+        tmpfs_dir->nalloc = i;
     }
 
     table = tmpfs_dir->table;
+    i = tmpfs_dir->ndirent++;
+    table[i].name = dname;
+    table[i].inode = child;
+    table[i].hash = tmpfs_hashname(dname);
+    table[i].next = tmpfs_dir->bucket[table[i].hash & (TMPFS_NBUCKET - 1)];
+    tmpfs_dir->bucket[table[i].hash & (TMPFS_NBUCKET - 1)] = i;
+
+    ilock(child);
+    if ((child->ifs == NULL))
+        child->ifs = &tmpfs;
+    iunlock(child);
 
-    assert(table, "how doesn't directory have no table?\n");
-
-try_bind:
-    // TODO: speed up binding by starting from suitable index
-    for (int i = 0; i < tmpfs_dir->ndirent; ++i)
-    {
-        if (table[i].inode == NULL)
-        {
-            if ((table[i].name = strdup(name)) == NULL)
-            {
-                iunlock(dir);
-                return -ENOMEM;
-            }
-
-            table[i].inode = child;
-            ilock(child);
-            if ((child->ifs == NULL))
-                child->ifs = &tmpfs;
-            iunlock(child);
-            bound = 1;
-            break;
-        }
-    }
-
-    if (bound){
-        iunlock(dir);
-        return 0;
-    }
-
-    table = krealloc(table, (tmpfs_dir->ndirent + 1) * sizeof(struct tmpfs_dirent));
-
-    if (table == NULL)
-    {
-        iunlock(dir);
-        return -ENOMEM;
-    }
-
-    tmpfs_dir->table = table;
-    table[tmpfs_dir->ndirent].inode = NULL;
-    table[tmpfs_dir->ndirent++].name = NULL;
-
-    goto try_bind;
+    iunlock(dir);
+    return 0;
 }
 
 static int tmpfs_create(inode_t *dir, dentry_t *dentry, int mode)
@@ -199,6 +180,8 @@ static int tmpfs_create(inode_t *dir, dentry_t *dentry, int mode)
     inode->i_dentry = dentry;
     inode->i_gid = dir->i_gid;
     inode->i_uid = dir->i_uid;
+    // file data lives only in the page index.
+    inode->mapping->flags |= MAPPING_MEMORY;
 
     if ((err = tmpfs_mount(dir, dentry->d_name, inode)))
         goto error;
@@ -220,19 +203,46 @@ static int tmpfs_lseek(inode_t *ip __unused, off_t off __unused, int whence __un
     return -EINVAL;
 }
 
+/**
+ * file data is kept a page at a time in the inode's mapping, keyed by
+ * page number. a page that was never written is a hole and reads back
+ * as zeros, appending only ever touches the last page or adds a new one.
+ */
 static size_t tmpfs_read(inode_t *ip, off_t off, void *buf, size_t sz)
 {
-    char *data __unused = NULL;
+    size_t size = 0;
+    int holding = 0;
+    size_t nread = 0;
+    page_t *page = NULL;
+    char *dst = buf;
+
     if (!ip || !buf)
         return -EINVAL;
 
-    if (off >= ip->i_size || (!ip->i_priv))
+    if (!(holding = mapping_holding(ip->mapping)))
+        mapping_lock(ip->mapping);
+
+    if (off >= ip->i_size)
+    {
+        if (!holding)
+            mapping_unlock(ip->mapping);
         return -1;
+    }
+
+    sz = MIN((ip->i_size - off), sz);
+
+    for (; nread < sz; nread += size, off += size)
+    {
+        size = MIN((PAGESZ - PGOFFSET(off)), (sz - nread));
+        if (mapping_find_page(ip->mapping, off / PAGESZ, &page) == 0)
+            memcpy(dst + nread, (void *)(page->virtual + PGOFFSET(off)), size);
+        else
+            memset(dst + nread, 0, size);
+    }
 
-    size_t size = MIN((ip->i_size - off), sz);
-    data = ip->i_priv;
-    memcpy(buf, data + off, size);
-    return size;
+    if (!holding)
+        mapping_unlock(ip->mapping);
+    return nread;
 }
 
 static int tmpfs_sync(inode_t *ip __unused)
@@ -242,8 +252,13 @@ static int tmpfs_sync(inode_t *ip __unused)
 
 static size_t tmpfs_write(inode_t *ip, off_t off, void *buf, size_t sz)
 {
+    int err = 0;
     size_t size = 0;
-    void *data = NULL;
+    int holding = 0;
+    size_t nwrite = 0;
+    size_t old_size = 0;
+    page_t *page = NULL;
+    char *src = buf;
 
     if (!ip || !buf)
         return -EINVAL;
@@ -251,24 +266,62 @@ static size_t tmpfs_write(inode_t *ip, off_t off, void *buf, size_t sz)
     if (INODE_ISDIR(ip))
         return -EISDIR;
 
-    if ((off + sz) > ip->i_size) {
-        if (!ip->i_priv) {
-            data = kcalloc(1, off + sz);
-            if (!data)
-                return -EAGAIN;
-        } else {
-            data = krealloc(ip->i_priv, off + sz);
-            if (!data)
-                return -EAGAIN;
-        }
+    if ((off + sz) < off)
+        return -EFBIG;
+
+    if (!(holding = mapping_holding(ip->mapping)))
+        mapping_lock(ip->mapping);
+
+    // grow the file first, the mapping won't hand out pages past its end.
+    old_size = ip->i_size;
+    if ((off + sz) > ip->i_size)
         ip->i_size = off + sz;
-        ip->i_priv = data;
+
+    for (; nwrite < sz; nwrite += size, off += size)
+    {
+        size = MIN((PAGESZ - PGOFFSET(off)), (sz - nwrite));
+        if ((err = mapping_get_page(ip->mapping, off / PAGESZ, NULL, &page)) || page == NULL)
+            break;
+        memcpy((void *)(page->virtual + PGOFFSET(off)), src + nwrite, size);
+        page->flags.dirty = 1;
     }
 
-    size = MIN((ip->i_size - off), sz);
-    memcpy(data + off, buf, size);
+    if (nwrite < sz) // don't leave the file claiming bytes that weren't written.
+        ip->i_size = MAX(old_size, off);
+
+    if (!holding)
+        mapping_unlock(ip->mapping);
+
+    if (nwrite == 0 && sz)
+        return err ? err : -ENOSPC;
+    return nwrite;
+}
+
+static int tmpfs_truncate(inode_t *ip, off_t size)
+{
+    int holding = 0;
+    page_t *page = NULL;
+
+    if (!ip)
+        return -EINVAL;
+
+    if (INODE_ISDIR(ip))
+        return -EISDIR;
+
+    if (!(holding = mapping_holding(ip->mapping)))
+        mapping_lock(ip->mapping);
 
-    return size;
+    mapping_truncate(ip->mapping, PGROUNDUP(size) / PAGESZ);
+
+    // the tail of the last page must read back as zeros if the file grows again.
+    if (PGOFFSET(size) && mapping_find_page(ip->mapping, size / PAGESZ, &page) == 0)
+        memset((void *)(page->virtual + PGOFFSET(size)), 0, PAGESZ - PGOFFSET(size));
+
+    ip->i_size = size;
+
+    if (!holding)
+        mapping_unlock(ip->mapping);
+    return 0;
 }
 
 static int tmpfs_readdir(inode_t *dir, off_t offset, struct dirent *dirent)
@@ -403,6 +456,7 @@ static iops_t tmpfs_iops = {
     .write = tmpfs_write,
     .readdir = tmpfs_readdir,
     .mount = tmpfs_mount,
+    .truncate = tmpfs_truncate,
 };
 
 __unused static struct fops tmpfs_fops = (struct fops){
@@ -377,7 +377,7 @@ int vfs_dentry_bind(dentry_t *parent, dentry_t *child)
     dentry_dup(parent);
     dentry_dup(child);
 
-    return 0;
+    return dcache_insert(child);
 }
 
 int vfs_dentry_unbind(dentry_t *parent, dentry_t *child)
@@ -386,6 +386,8 @@ int vfs_dentry_unbind(dentry_t *parent, dentry_t *child)
     if (parent == NULL || child == NULL)
         return -EINVAL;
 
+    dcache_remove(child);
+
     dlock(parent);
     if ((err = dentry_contains(parent, child)) < 0)
     {
@@ -537,128 +539,199 @@ int vfs_mount(const char *dir, const char *name, inode_t *ip)
     return vfs_mountat(name, dir, NULL, MS_BIND, NULL, ip, NULL);
 }
 
-int vfs_lookup(const char *fn, uio_t *uio, int oflags, mode_t mode __unused, inode_t **iref, dentry_t **dref)
+// next component of '*path', skipping slashes, returns its length, 0 at the end.
+static size_t vfs_next_name(const char **path, const char **name)
+{
+    size_t len = 0;
+    const char *p = *path;
+
+    while (*p == '/')
+        p++;
+    *name = p;
+    while (p[len] && p[len] != '/')
+        len++;
+    *path = p + len;
+    return len;
+}
+
+/**
+ * resolve 'name' in 'dir' through the filesystem after a dcache miss.
+ * called without the dcache lock, the caller holds a reference on 'dir'.
+ * on success '*ref' is a referenced dentry, hashed and bound under 'dir'.
+ * a name that doesn't exist is remembered as a negative entry, unless
+ * '*creat' is set, in which case it's created. '*creat' is left set
+ * only if the name was created.
+ */
+static int vfs_lookup_miss(dentry_t *dir, char *name, mode_t mode, int *creat, dentry_t **ref)
 {
     int err = 0;
-    path_t *path = NULL;
-    dentry_t *dentry = NULL, *dir = NULL;
-    inode_t *iparent = NULL, *ichild = NULL;
-    char **tokens = NULL, *cwd = NULL, *abs_path = NULL, *last_token = NULL;
+    inode_t *inode = NULL;
+    dentry_t *dentry = NULL;
 
-    if (!fn || (!dref && !iref))
-    {
-        err = -EINVAL;
-        goto error;
+    if ((err = ifind(dir->d_inode, name, &inode))) {
+        if (err != -ENOENT)
+            return err;
+        if (!*creat) {
+            dcache_negative(dir, name);
+            return err;
+        }
+    } else {
+        *creat = 0;
+        if ((*ref = dcache_get(dir, name))) // devfs binds what it finds itself.
+            return 0;
     }
 
-    if (!uio)
-        cwd = "/";
-    else if (!uio->u_cwd)
-        cwd = "/";
-    else
-        cwd = uio->u_cwd;
+    if ((err = dentry_alloc(name, &dentry)))
+        return err;
 
-    if ((err = vfs_parse_path((char *)fn, cwd, &abs_path)))
+    dentry->d_flags = DCACHE_RECLAIM;
+    if (inode)
+        dentry->d_inode = inode;
+    else if ((err = icreate(dir->d_inode, dentry, mode)))
         goto error;
 
-    // printk("%s(%s): uio: 0x%p, oflags: %x, iref: 0x%p, dref: 0x%p\n", __func__, fn, uio, oflags, iref, dref);
+    if ((err = vfs_dentry_bind(dir, dentry)))
+        goto error;
 
-    // printk("VFS ROOT: \e[017;0m%s\e[0m: %p\n", droot->d_name, droot->d_inode);
+    *ref = dentry; // the allocation's reference is the caller's, the tree holds its own.
+    return 0;
+error:
+    dentry_close(dentry);
+    return err;
+}
 
-    if ((err = vfs_canonicalize_path((char *)abs_path, cwd, &tokens)))
-        goto error;
+/**
+ * walk 'fn' from the root, or from 'cwd' if it's relative, a component
+ * at a time in place. each component is looked up in the dcache and only
+ * a miss goes to the filesystem. "." is skipped and ".." is the parent
+ * of the dentry reached so far. '*created' is set if O_CREAT made the
+ * last component. returns a referenced dentry in '*ref'.
+ */
+static int vfs_walk(const char *fn, const char *cwd, int oflags, mode_t mode, dentry_t **ref, int *created)
+{
+    int err = 0, in_fn = 0, creat = 0;
+    size_t len = 0;
+    char name[FNAME_MAX + 1];
+    const char *path = NULL, *comp = NULL, *p = NULL;
+    dentry_t *dir = droot, *child = NULL;
+
+    in_fn = (*fn == '/');
+    path = in_fn ? fn : cwd;
+
+    dcache_lock();
+    for (;;) {
+        if ((len = vfs_next_name(&path, &comp)) == 0) {
+            if (in_fn)
+                break;
+            in_fn = 1; // done with cwd, carry on with 'fn'.
+            path = fn;
+            continue;
+        }
 
-    foreach(tok, tokens)
-        last_token = tok;
+        if (len == 1 && comp[0] == '.')
+            continue;
 
-    switch ((err = vfs_get_mountpoint(tokens, &path)))
-    {
-    case 0:
-        dentry = path->dentry;
-        ichild = dentry->d_inode;
-        // printk("%s(): \'%s\' \e[0;12mfound\e[0m\n", __func__, dentry->d_name);
-        // dentry_dump(dentry);
-        if ((err = iperm(ichild, uio, oflags)))
-            goto error;
-        // printk("found THIS FILE\n");
-        goto found;
-    case -ENOENT:
-        dir = path->mnt.root;
-        iparent = dir->d_inode;
-        // printk("\e[0;04mENOENT\e[0m: \e[0;11m");
-        // foreach(tok, path->tokens) printk("/%s", tok);
-        // printk("\e[0m\n");
-        break;
-    default:
-        // printk("\e[0;04mlookup error\e[0m");
-        goto error;
-    }
+        if (len == 2 && comp[0] == '.' && comp[1] == '.') {
+            if (dir->d_parent)
+                dir = dir->d_parent;
+            continue;
+        }
 
-    foreach (token, path->tokens)
-    {
-        dentry = NULL;
-        ichild = NULL;
-        if ((err = dentry_alloc(token, &dentry)))
+        if (len > FNAME_MAX) {
+            err = -ENAMETOOLONG;
             goto error;
+        }
 
-        if ((err = ifind(iparent, token, &ichild))) {
-            if ((oflags & O_CREAT) && (token == last_token))
-                goto creat;
-            goto error;
+        for (p = path; *p == '/'; ++p)
+            ;
+        creat = in_fn && !*p && (oflags & O_CREAT); // only the last component is created.
+
+        if ((child = dcache_lookup(dir, comp, len))) {
+            if (!(child->d_flags & DCACHE_NEGATIVE)) {
+                dir = child;
+                continue;
+            }
+            if (!creat) {
+                err = -ENOENT;
+                goto error;
+            }
         }
 
-        dentry->d_inode = ichild;
+        memcpy(name, comp, len);
+        name[len] = '\0';
 
-        if ((err = vfs_dentry_bind(dir, dentry)))
+        dentry_dup(dir);
+        dcache_unlock();
+        err = vfs_lookup_miss(dir, name, mode, &creat, &child);
+        dcache_lock();
+        dentry_close(dir);
+        if (err)
             goto error;
 
-        if ((err = iperm(ichild, uio, oflags)))
-            dir = dentry;
-        iparent = ichild;
+        *created = creat;
+        dir = child;
+        dentry_close(child); // the tree's reference keeps it while the lock is held.
     }
 
-found:
-    kfree(path);
-    tokens_free(tokens);
-    kfree(abs_path);
+    dentry_dup(dir);
+    dcache_unlock();
+    *ref = dir;
+    return 0;
+error:
+    dcache_unlock();
+    return err;
+}
 
-    if (iref)
-    {
-        iincrement(ichild);
-        *iref = ichild;
-    }
+int vfs_lookup(const char *fn, uio_t *uio, int oflags, mode_t mode, inode_t **iref, dentry_t **dref)
+{
+    int err = 0, created = 0;
+    dentry_t *dentry = NULL;
+    inode_t *ichild = NULL;
+    char *cwd = NULL;
 
-    if (dref)
+    if (!fn || (!dref && !iref))
     {
-        dentry_dup(dentry);
-        *dref = dentry;
+        err = -EINVAL;
+        goto error;
     }
-    return 0;
 
-creat:
-    if ((err = icreate(iparent, dentry, mode)))
+    if (!uio)
+        cwd = "/";
+    else if (!uio->u_cwd)
+        cwd = "/";
+    else
+        cwd = uio->u_cwd;
+
+    if ((err = vfs_path_syntax((char *)fn)) || (err = vfs_path_syntax(cwd)))
+        goto error;
+
+    if ((err = vfs_walk(fn, cwd, oflags, mode, &dentry, &created)))
         goto error;
 
     ichild = dentry->d_inode;
 
-    if ((err = vfs_dentry_bind(dir, dentry)))
+    if (!created && (err = iperm(ichild, uio, oflags)))
         goto error;
 
-    goto found;
+    if (iref)
+    {
+        iincrement(ichild);
+        *iref = ichild;
+    }
+
+    if (dref)
+        *dref = dentry;
+    else
+        dentry_close(dentry);
+    return 0;
 
 error:
     if (dentry)
         dentry_close(dentry);
-    if (path)
-        kfree(path);
-    if (tokens)
-        tokens_free(tokens);
-    if (abs_path)
-        kfree(abs_path);
-    printk("%s(%s), called @ 0x%p, error=%d\n", __func__, fn, return_address(0), err);
+    if (err != -ENOENT) // a missing name is an answer, not a failure.
+        printk("%s(%s), called @ 0x%p, error=%d\n", __func__, fn, return_address(0), err);
     return err;
 }
-
 int vfs_open(const char *fn, uio_t *uio, int oflags, mode_t mode, inode_t **iref)
 {
     return vfs_lookup(fn, uio, oflags, mode, iref, NULL);
@@ -57,6 +57,14 @@ void lapic_init(void);
 void lapic_eoi(void);
 void lapic_startup(int id, uint32_t addr);
 void lapic_ipi(int id, int vect);
+void lapic_send_ipi(int id, int ipi);
+
+// tick every jiffy, while the cpu is busy.
+void lapic_timer_periodic(void);
+
+// a single interrupt 'jiffies' from now, while the cpu idles.
+void lapic_timer_oneshot(unsigned long jiffies);
+
 void lapic_send_ipi_to_all_not_self(int ipi);
 
 #endif //LAPIC_H
\ No newline at end of file
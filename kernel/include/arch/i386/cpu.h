@@ -7,6 +7,8 @@
 #include <arch/context.h>
 #include <arch/i386/lapic.h>
 #include <sys/system.h>
+#include <mm/pcp.h>
+#include <arch/i386/tlb.h>
 
 #define NCPU    8
 #define MPSTACK 0x8000
@@ -19,6 +21,7 @@ typedef struct cpu
     int         enabled;
     atomic_t    online;
     atomic_t    timer_ticks;
+    atomic_t    idle;       // halted, waiting for work (see sched_idle()).
     uint64_t    feartures;
     context_t   *context;
 
@@ -32,6 +35,12 @@ typedef struct cpu
     thread_t    *current;
     thread_t    *fpu_thread;
     sched_queue_t*ready_queue;
+
+    mm_pcp_t    pcp;        // per-CPU page frame cache.
+
+    struct mmap *mmap;      // user address space loaded on this cpu.
+    tlb_batch_t tlb_batch;  // shootdowns queued by this cpu.
+    tlb_inbox_t tlb_inbox;  // shootdowns posted to this cpu.
 } cpu_t;
 
 extern cpu_t cpus[NCPU];
@@ -59,6 +68,16 @@ void setupsegs(void);
 #define CR0_MP  (_BS(1))
 #define CR0_EM  (_BS(2))
 #define CR0_TS  (_BS(3))
+#define CR0_WP  (_BS(16))
+
+#define CPUID_SEP   (_BS(11))   // cpuid(1).edx: SYSENTER/SYSEXIT.
+
+#define MSR_SYSENTER_CS     0x174
+#define MSR_SYSENTER_ESP    0x175
+#define MSR_SYSENTER_EIP    0x176
+
+// SYSENTER lands here, see traps.asm.
+extern void sysenter_entry(void);
 
 extern void fpu_enable(void);
 extern void fpu_disable(void);
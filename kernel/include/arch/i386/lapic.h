@@ -12,5 +12,13 @@ void lapic_eoi(void);
 void lapic_init(void);
 void lapic_timerintr(void);
 void lapic_startup(int id, uint16_t addr);
+void lapic_send_ipi(int id, int ipi);
+
+// tick every jiffy, while the cpu is busy.
+void lapic_timer_periodic(void);
+
+// a single interrupt 'jiffies' from now, while the cpu idles.
+void lapic_timer_oneshot(unsigned long jiffies);
+
 void lapic_send_ipi_to_all_not_self(int ipi);
 #endif //LAPIC_H
\ No newline at end of file
@@ -75,4 +75,8 @@ void paging_free(uintptr_t addr, size_t sz);
 
 uintptr_t paging_getpgdir(void);
 
-int paging_lazycopy(uintptr_t dst, uintptr_t src);
\ No newline at end of file
+int paging_lazycopy(uintptr_t dst, uintptr_t src);
+
+// give the current address space its own copy of the page table mapping 'vaddr'
+// if it is still shared copy-on-write after fork().
+int paging_unshare(uintptr_t vaddr);
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <lib/stdint.h>
+#include <lib/stddef.h>
+#include <locks/atomic.h>
+
+#define TLB_BATCH   16  // addresses carried by one shootdown before falling back to a cr3 reload.
+
+struct mmap;
+
+/* invalidations other cpus have posted to this cpu, drained by the shootdown IPI. */
+typedef struct tlb_inbox
+{
+    atomic_t    lock;
+    int         count;
+    int         full;   // overflowed (or a broadcast), reload cr3 instead.
+    uintptr_t   seq;    // posts made to this inbox so far.
+    atomic_t    done;   // last post this cpu has flushed its tlb for.
+    uintptr_t   addr[TLB_BATCH];
+} tlb_inbox_t;
+
+/* invalidations queued on this cpu, not yet sent to the other cpus. */
+typedef struct tlb_batch
+{
+    struct mmap *mmap;  // address space the queued addresses belong to.
+    int         count;
+    int         full;
+    int         defer;  // coalescing (e.g. for a syscall), only sent by tlb_flush_pending().
+    int         nframe;
+    uintptr_t   addr[TLB_BATCH];
+    uintptr_t   frame[TLB_BATCH];   // unmapped frames, freed once the shootdown is acked.
+} tlb_batch_t;
+
+/**
+ * load 'pgdir' as the page directory of 'mmap' (NULL for none) on this cpu,
+ * keeping the address spaces' cpu masks in step. returns the old pgdir.
+ */
+uintptr_t tlb_switch(struct mmap *mmap, uintptr_t pgdir);
+
+// invalidate a user page of the current address space, here and wherever else it is loaded.
+void tlb_shootdown(uintptr_t addr);
+
+// same, for the whole of the current address space.
+void tlb_shootdown_all(void);
+
+/**
+ * free user page 'frame' once no other cpu can still hold a tlb entry for it.
+ * call after the page has been unmapped and shot down.
+ */
+void tlb_free_frame(uintptr_t frame);
+
+// hold shootdowns queued on this cpu until tlb_flush_pending().
+void tlb_defer(void);
+
+// send queued shootdowns to the cpus that have the address space loaded.
+void tlb_flush_pending(void);
+
+// T_TLB_SHOOTDOWN handler.
+void tlb_handle_shootdown(void);
+
+// make every other cpu reload cr3.
+void send_tlb_shootdown(void);
@@ -7,6 +7,7 @@
 #define IRQ_HPET    2
 #define IRQ_RTC     8
 #define IRQ_MOUSE   12
+#define IRQ_WAKEUP  13  // legacy FPU line, unused; kicks a halted cpu.
 #define IRQ_ERROR   19
 #define IRQ_SPURIOUS 31
 #define IRQ_TLB_SHOOT 40
@@ -17,11 +18,13 @@
 #define T_RTC_TIMER   (IRQ_OFFSET + IRQ_RTC)
 #define T_PS2MOUSE (IRQ_OFFSET + IRQ_MOUSE)
 #define T_TLB_SHOOTDOWN  (IRQ_TLB_SHOOT + IRQ_OFFSET)
+#define T_WAKEUP    (IRQ_OFFSET + IRQ_WAKEUP)
 
 
 #define T_FPU       0x07
 #define T_PGFAULT   0x0E
 #define T_SYSCALL   0x80
+#define T_SYSENTER  0x81    // not a vector, marks the frames built by sysenter_entry.
 
 void tvinit(void);
 void idt_init(void);
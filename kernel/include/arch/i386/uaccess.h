@@ -0,0 +1,42 @@
+#pragma once
+
+#include <lib/stdint.h>
+#include <lib/stddef.h>
+#include <sys/system.h>
+
+/**
+ * kernel accesses to user memory.
+ *
+ * the copy loops are not preceded by a walk of the address space,
+ * a bad user address simply faults. every instruction that may touch
+ * user memory has an entry in the exception table giving the address
+ * to resume at, do_page_fault() consults it before killing anything
+ * and the copy returns -EFAULT instead.
+ */
+
+// one exception table entry, emitted into .__ex_table next to the faulting instruction.
+typedef struct extable
+{
+    uintptr_t   insn;   // instruction that may fault on a user address.
+    uintptr_t   fixup;  // where to resume if it does.
+} extable_t;
+
+// [addr, addr + size) lies wholly below the kernel and doesn't wrap.
+#define access_ok(addr, size) \
+    (((uintptr_t)(addr) < VMA_BASE) && ((size_t)(size) <= VMA_BASE - (uintptr_t)(addr)))
+
+// fixup address for a fault at 'eip', or 0 if 'eip' isn't a user access.
+uintptr_t extable_fixup(uintptr_t eip);
+
+// copy 'n' bytes in from user space, returns 0 or -EFAULT.
+int copy_from_user(void *dst, const void *usrc, size_t n);
+
+// copy 'n' bytes out to user space, returns 0 or -EFAULT.
+int copy_to_user(void *udst, const void *src, size_t n);
+
+/**
+ * copy the nul-terminated user string at 'usrc' into 'dst', at most 'n' bytes
+ * including the nul. returns the length of the string, -EFAULT, or
+ * -ENAMETOOLONG if it doesn't fit ('dst' is then not terminated).
+ */
+int strncpy_from_user(char *dst, const char *usrc, size_t n);
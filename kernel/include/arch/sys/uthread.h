@@ -7,4 +7,6 @@ int arch_uthread_init(x86_thread_t *thread, void *(*entry)(void *), const char *
 
 int arch_uthread_execve(uintptr_t *, const char **, const char **);
 char ***arch_execve_cpy(char *_argp[], char *_envp[]);
+// same as arch_execve_cpy() for user space vectors, returns 0, -EFAULT, -E2BIG or -ENOMEM.
+int arch_execve_ucpy(const char *uargp[], const char *uenvp[], char ****ref);
 void arch_exec_free_cpy(char ***arg_env);
\ No newline at end of file
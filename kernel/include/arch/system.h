@@ -6,6 +6,35 @@ static inline void hlt(void){
     asm __volatile__("hlt");
 }
 
+/* enable interrupts and halt. no interrupt can slip in between the two. */
+static inline void sti_hlt(void){
+    asm __volatile__("sti; hlt");
+}
+
+static inline uint64_t rdmsr(uint32_t msr){
+    uint32_t lo, hi;
+    asm __volatile__("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t val){
+    asm __volatile__("wrmsr" :: "c"(msr), "a"((uint32_t)val), "d"((uint32_t)(val >> 32)));
+}
+
+/* index of the lowest set bit in 'x', 'x' must not be 0. */
+static inline int bsf(uint32_t x){
+    int i;
+    asm("bsf %1, %0" : "=r"(i) : "rm"(x));
+    return i;
+}
+
+/* index of the highest set bit in 'x', 'x' must not be 0. */
+static inline int bsr(uint32_t x){
+    int i;
+    asm("bsr %1, %0" : "=r"(i) : "rm"(x));
+    return i;
+}
+
 static inline void cli(void)
 {
     asm __volatile__("cli");
@@ -57,7 +86,7 @@ idt_flush(struct systable *);
 void
 tss_flush(uint32_t);
 
-uint32_t read_tsc(void);
+uint64_t read_tsc(void);
 
 void _kstart(void);
 void _ustart(void);
@@ -17,16 +17,34 @@ typedef struct iobuf
     void *buf;        // Pointer to I/O buffer.
     int refcnt;       // Reference count.
     size_t blksz;     // Size of I/O buffer pointer to by 'iobuf'.
-    struct devid *devid;// device associated with this buffer.
+    struct devid devid;// device associated with this buffer.
     mutex_t *lock;    // Lock.
+
+    /* links, protected by the buffer cache lock. */
+    struct iobuf *hnext;    // next buffer on the same hash chain.
+    struct iobuf *hprev;    // previous buffer on the same hash chain.
+    struct iobuf *lnext;    // next (less recently used) buffer on the LRU list.
+    struct iobuf *lprev;    // previous (more recently used) buffer on the LRU list.
 } iobuf_t;
 
+/* buffer cache statistics, see bstat(). */
+typedef struct bstat
+{
+    size_t nbuf;        // buffers in the cache.
+    size_t ndirty;      // buffers waiting for write-back.
+    size_t hits;        // bget() found the block cached.
+    size_t misses;      // bget() had to (re)assign a buffer.
+    size_t evictions;   // valid buffers reassigned to another block.
+    size_t writebacks;  // dirty buffers written to their device.
+} bstat_t;
+
 #define iobuf_assert(b) assert(b, "No I/O buffer")
 #define iobuf_lock(b)  {iobuf_assert(b); mutex_lock(b->lock);}
 #define iobuf_unlock(b)    {iobuf_assert(b); mutex_unlock(b->lock);}
 #define iobuf_assert_locked(b)  {iobuf_assert(b); mutex_assert_lock(b->lock);}
 
 #define __iobuf_setflag(b, f) (b->flags |= (f))
+#define __iobuf_maskflag(b, f) (b->flags &= ~(f))
 #define __iobuf_valid(b) (b->flags & IOBUF_VALID)
 #define __iobuf_dirty(b) (b->flags & IOBUF_DIRTY)
 #define __iobuf_busy(b)  (b->flags & IOBUF_BUSY)
@@ -35,6 +53,10 @@ typedef struct iobuf
 int binit(void);
 void bfree(void);
 void bwrite(iobuf_t *buf);
+void bdwrite(iobuf_t *buf);
 void brelse(iobuf_t *buf);
 iobuf_t *bget(struct devid *dd, long blkno, size_t size);
-iobuf_t *bread(struct devid *devid, long blkno, size_t blksz);
\ No newline at end of file
+iobuf_t *bread(struct devid *devid, long blkno, size_t blksz);
+int bsync(void);
+void bstat(bstat_t *stat);
+void bdump(void);
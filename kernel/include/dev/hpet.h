@@ -87,6 +87,15 @@ typedef struct hpet_timerblock
 
 int hpet_enumerate(void);
 void hpet_intr(void);
+
+// low 32 bits of the main counter.
+uint32_t hpet_counter(void);
+
+// main counter ticks in a jiffy, 0 if there is no HPET.
+uint32_t hpet_jiffy_ticks(void);
+
+// main counter period in femtoseconds, 0 if there is no HPET.
+uint32_t hpet_period(void);
 void hpet_timer0_wait(void);
 
 #endif // DEV_HPET_H
\ No newline at end of file
@@ -1,6 +1,14 @@
 #ifndef RAMDISK_H
 #define RAMDISK_H
 
+#include <lib/types.h>
+
 int ramdisk_init(void);
 
+// the 'sz' bytes at 'off', mapped for good, NULL if they're not all on the ramdisk.
+void *ramdisk_data(off_t off, size_t sz);
+
+// physical address of the byte at 'off', 0 past the end of the ramdisk.
+uintptr_t ramdisk_phys(off_t off);
+
 #endif //RAMDISK_H
\ No newline at end of file
@@ -27,6 +27,7 @@ typedef struct btree_node
     struct btree_node   *parent;
     struct btree_node   *right;
     struct btree        *btree;
+    int                 height;     // of the subtree rooted here, for balancing.
 } btree_node_t;
 
 typedef struct btree
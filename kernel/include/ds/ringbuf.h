@@ -2,7 +2,8 @@
 
 #include <locks/spinlock.h>
 
-#define RINGBUF_INDEX(ring, i) ((i) % ((ring)->size))
+// size is a power of two, head and tail run freely and are masked on use.
+#define RINGBUF_INDEX(ring, i) ((i) & ((ring)->size - 1))
 
 typedef struct ringbuf {
     char *buf;
@@ -13,6 +14,7 @@ typedef struct ringbuf {
     spinlock_t *lock;
 }ringbuf_t;
 
+// 'sz' must be a power of two.
 #define RINGBUF_NEW(nam, sz) (&(struct ringbuf){.buf = (char[sz]){0}, .size = sz, .head = 0, .tail = 0, .lock = SPINLOCK_NEW(nam)})
 
 #define ringbuf_assert(r)   assert(r, "no ringbuf")
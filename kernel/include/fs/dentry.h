@@ -24,8 +24,27 @@ typedef struct dentry
     dentry_t *d_children;
     spinlock_t *d_lock;
     dops_t   dops;
+    int      d_flags;       // DCACHE_* bits, owned by the dcache.
+    uint32_t d_hash;        // hash of (d_parent, d_name) while hashed.
+    dentry_t *d_hnext;      // dcache hash chain.
+    dentry_t *d_lru_prev;   // dcache reclaim order, most recent first.
+    dentry_t *d_lru_next;
 } dentry_t;
 
+#define DCACHE_HASHED   0x1 // on a dcache hash chain.
+#define DCACHE_NEGATIVE 0x2 // the name doesn't exist, no inode and not a child of d_parent.
+#define DCACHE_RECLAIM  0x4 // made by a lookup, on the LRU and may be dropped.
+
+typedef struct dcache_stat
+{
+    size_t  hits;       // components resolved from the cache.
+    size_t  neg_hits;   // of those, names known not to exist.
+    size_t  misses;     // components that went to the filesystem.
+    size_t  evictions;  // entries dropped off the LRU.
+    size_t  entries;    // entries hashed now.
+    size_t  negatives;  // of those, negative.
+} dcache_stat_t;
+
 
 int dentry_open(dentry_t *);
 int dentry_close(dentry_t *);
@@ -36,8 +55,38 @@ int dentry_contains(dentry_t *parent, dentry_t *child);
 void dlock(dentry_t *dentry);
 void dunlock(dentry_t *dentry);
 int dentry_alloc(char *name, dentry_t **ref);
+int dentry_free(dentry_t *dentry);
 
 
 void dentry_dump(dentry_t *dentry);
 
+/**
+ * dentry cache, every bound dentry is hashed on (d_parent, d_name).
+ * dcache_lookup() is called with the dcache lock held, a dentry it
+ * returns stays put until the lock is dropped, take a reference to keep
+ * it longer. lock order is the dcache lock, then d_lock.
+ */
+
+void dcache_lock(void);
+void dcache_unlock(void);
+
+// the entry for 'name' (not NUL terminated) in 'parent', may be negative. NULL on a miss.
+dentry_t *dcache_lookup(dentry_t *parent, const char *name, size_t len);
+
+// a reference to the positive entry for 'name' in 'parent', NULL if there's none.
+dentry_t *dcache_get(dentry_t *parent, const char *name);
+
+// hash a dentry just bound under its d_parent, replaces a negative entry for the name.
+int dcache_insert(dentry_t *dentry);
+
+// unhash 'dentry', called when it's unbound or freed.
+void dcache_remove(dentry_t *dentry);
+
+// remember that 'parent' has no 'name'.
+int dcache_negative(dentry_t *parent, const char *name);
+
+void dcache_stat(dcache_stat_t *stat);
+
+void dcache_dump(void);
+
 #endif // FS_DENTRY_H
\ No newline at end of file
@@ -27,6 +27,8 @@ typedef enum
 
 #define FNAME_MAX 255
 
+#define PATH_MAX 1024 // longest pathname taken from user space, nul included.
+
 #ifndef SEEK_SET
 #define SEEK_SET 0
 #endif
@@ -58,6 +60,11 @@ typedef struct iops
     int (*readdir)(inode_t *, off_t, struct dirent *);
     
     int (*chown)(inode_t *, uid_t, gid_t); 
+
+    // physical frame holding the file's page at a page-aligned offset, for data already in memory.
+    int (*getframe)(inode_t *, off_t, uintptr_t *);
+
+    int (*truncate)(inode_t *, off_t);
     
 
 } iops_t;
@@ -265,6 +272,7 @@ int iioctl(inode_t *, int, void *);
 int ifind(inode_t *dir, const char *name, inode_t **ref);
 size_t iread(inode_t *, off_t, void *, size_t);
 size_t iwrite(inode_t *, off_t, void *, size_t);
+int itruncate(inode_t *, off_t);
 int iperm(inode_t *, uio_t *, int);
 int isleek(inode_t *, off_t, int);
 int istat(inode_t *, struct stat *buf);
@@ -1,4 +1,5 @@
 #pragma once
 #include <fs/fs.h>
 
-int inode_getpage(inode_t *, ssize_t pgno, uintptr_t *ppaddr, page_t **ppage);
\ No newline at end of file
+int inode_getpage(inode_t *, ssize_t pgno, uintptr_t *ppaddr, page_t **ppage);
+int inode_getframe(inode_t *, ssize_t pgno, uintptr_t *ppaddr);
\ No newline at end of file
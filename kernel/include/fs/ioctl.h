@@ -78,6 +78,8 @@
 #define TIOCGHAYESESP   0x545E
 #define TIOCSHAYESESP   0x545F
 #define FIOQSIZE	0x5460
+#define PIPEGETSZ	0x5470	/* returns the pipe capacity in bytes */
+#define PIPESETSZ	0x5471	/* capacity from the argument, rounded up to pages */
 
 #define TIOCPKT_DATA		 0
 #define TIOCPKT_FLUSHREAD	 1
@@ -1,22 +1,42 @@
 #pragma once
 
 #include <fs/fs.h>
-#include <locks/cond.h>
-#include <ds/ringbuf.h>
+#include <ds/queue.h>
+#include <sys/system.h>
+
+/*one page of pipe data, the bytes follow the header*/
+typedef struct pipebuf
+{
+    struct pipebuf *next; /*next (newer) page in the chain*/
+    size_t head; /*offset of the first unread byte*/
+    size_t tail; /*offset just past the last written byte*/
+} pipebuf_t;
+
+#define PIPEBUF_DATA(pb)    ((char *)((pb) + 1))
+#define PIPEBUF_SIZE        (PAGESZ - sizeof(pipebuf_t))
 
 typedef struct pipe
 {
     int ropen; /*read end is open?*/
     int wopen; /*write end is open?*/
-    cond_t *readers; /*readers wait queue*/
-    cond_t *writers; /*writers queue*/
+    queue_t *readers; /*readers wait queue, slept on with the pipe lock*/
+    queue_t *writers; /*writers wait queue, slept on with the pipe lock*/
     spinlock_t *lock; /*pipe lock*/
-    ringbuf_t *ringbuf; /*pipe circular buffer*/
+    pipebuf_t *head; /*oldest page, read from*/
+    pipebuf_t *tail; /*newest page, written to*/
+    pipebuf_t *spare; /*drained page kept for the next write*/
+    size_t count; /*bytes in the pipe*/
+    size_t capacity; /*bytes a writer may queue before it blocks*/
 } pipe_t;
 
 
-#define PIPESZ  512 /*max allowed buffer size*/
+#define PIPESZ      (16 * PAGESZ)   /*default capacity*/
+#define PIPE_MAXSZ  (256 * PAGESZ)  /*largest capacity PIPESETSZ accepts*/
 
 int pipefs_init(void);
 int pipefs_pipe(file_t *f0, file_t *f1);
-int pipefs_pipe_raw(inode_t **read, inode_t **write);
\ No newline at end of file
+int pipefs_pipe_raw(inode_t **read, inode_t **write);
+
+// splice() halves, file pages into the pipe and pipe pages out to a file.
+ssize_t pipefs_splice_in(inode_t *ip, inode_t *src, off_t *ppos, size_t len);
+ssize_t pipefs_splice_out(inode_t *ip, file_t *out, size_t len);
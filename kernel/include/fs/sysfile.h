@@ -23,6 +23,12 @@ int fstat(int fd, struct stat *buf);
 /* file stats using filename*/
 int stat(const char *fn, struct stat *buf);
 
+/* move data between a pipe and a file without a user buffer */
+ssize_t splice(int fd_in, int fd_out, size_t len, int flags);
+
+/* write a file's data to out_fd from its pages, from *offset if given */
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+
 /* io control */
 int ioctl(int fd, int request, ... /* args */);
 
@@ -12,6 +12,7 @@ int strncmp(const char *p, const char *q, unsigned int n);
 
 
 void *memset(void *dst, int c, unsigned int n);
+int memcmp(const void *v1, const void *v2, unsigned int n);
 void *memcpyd(void *restrict dstptr, const void *restrict srcptr, unsigned int size);
 void *memsetw(void *dst, int c, unsigned int n);
 void *memsetd(void *dst, int c, unsigned int n);
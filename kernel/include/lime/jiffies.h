@@ -9,6 +9,11 @@
 typedef size_t jiffies_t;
 typedef uint64_t jiffies64_t;
 
+#define HZ 1000 // jiffies per second, one tick per millisecond.
+
+#define ms_to_jiffies(ms) ((jiffies_t)(ms) * HZ / 1000)
+#define sec_to_jiffies(s) ((jiffies_t)(s) * HZ)
+
 void jiffies_update(void);
 jiffies_t jiffies_get(void);
 jiffies64_t jiffies64_get(void);
@@ -0,0 +1,57 @@
+#ifndef LIME_TIMER_H
+
+#define LIME_TIMER_H 1
+
+#include <lib/stdint.h>
+#include <lib/stddef.h>
+#include <lime/jiffies.h>
+
+/**
+ * kernel timers, kept on a hierarchical timing wheel driven by jiffies_update().
+ * a timer fires once, in interrupt context, on the first tick at or after
+ * 'expires'. the callback must not sleep.
+ */
+typedef struct ktimer
+{
+    jiffies_t       expires;            // absolute jiffies.
+    void            (*fn)(struct ktimer *);
+    void            *arg;
+    int             pending;            // on the wheel, not yet fired or cancelled.
+    struct ktimer   *next, **pprev;
+} ktimer_t;
+
+#define KTIMER_INIT(__fn, __arg) ((ktimer_t){.fn = (__fn), .arg = (__arg)})
+
+typedef struct timer_stat
+{
+    size_t  added;      // timers armed.
+    size_t  cancelled;  // timers removed before firing.
+    size_t  fired;      // callbacks run.
+    size_t  cascaded;   // times a timer moved down a level of the wheel.
+    size_t  slack;      // total ticks callbacks ran after their deadline.
+    size_t  max_slack;  // worst single lateness, in ticks.
+} timer_stat_t;
+
+#define timer_pending(t) ((t)->pending)
+
+// arm 't' to fire at t->expires. re-arming a pending timer moves it.
+void timer_add(ktimer_t *t);
+
+/**
+ * disarm 't'. returns 1 if it was still pending.
+ * if the callback is running on another cpu, waits for it to finish,
+ * so 't' may be freed once this returns.
+ */
+int timer_del(ktimer_t *t);
+
+// run every timer that is due, called on each tick.
+void timer_run(jiffies_t now);
+
+// earliest jiffy at which a timer may be due, for programming one-shot ticks.
+jiffies_t timer_next(void);
+
+void timer_stat(timer_stat_t *stat);
+
+void timer_dump(void);
+
+#endif // LIME_TIMER_H
@@ -0,0 +1,32 @@
+#ifndef LIME_VDATA_H
+
+#define LIME_VDATA_H 1
+
+#include <lib/stdint.h>
+#include <lib/types.h>
+#include <lime/jiffies.h>
+#include <mm/mmap.h>
+#include <sys/_vdata.h>
+
+/**
+ * read-only data mapped into every address space at VDATA_ADDR so user
+ * space can read the clock and its own pid without a system call.
+ * the clock page is one frame shared by everyone, published under a
+ * seqlock on every jiffy. the pid page is one frame per address space
+ * (mmap_t::vdata), written once when the process gets its pid.
+ */
+
+int vdata_init(void);
+
+// publish the clock, called from jiffies_update() with jiffies_lock held.
+void vdata_update(jiffies64_t jiffies, uint32_t clock);
+
+// a zeroed frame for an address space's per-process page, 0 on failure.
+uintptr_t vdata_proc_alloc(void);
+
+// add the vdata region to 'mmap', pages are faulted in on first read.
+int vdata_map(mmap_t *mmap);
+
+void vdata_setproc(mmap_t *mmap, pid_t pid);
+
+#endif // LIME_VDATA_H
@@ -8,9 +8,14 @@
 #include <lime/assert.h>
 #include <lib/stddef.h>
 
+/**
+ * a sleeping lock. contended lockers spin while the owner is running on
+ * another cpu, sleep once it is not, and the unlocker passes the mutex
+ * directly to the first sleeper.
+ */
 typedef struct mutex
 {
-    atomic_t lock;
+    atomic_t lock;      // 1 while owned, stays 1 across a hand-off.
     queue_t *waiters;
     thread_t *thread;
     spinlock_t *guard;
@@ -18,6 +23,8 @@ typedef struct mutex
 
 extern tid_t thread_self(void);
 
+#define MUTEX_SPIN_MAX  4096 // most pause iterations to wait on a running owner.
+
 #define mutex_holding(mutex) (mutex->thread == current)
 #define mutex_assert(mutex) assert(mutex, "no mutex");
 #define mutex_assert_lock(mutex)                                                                                                    \
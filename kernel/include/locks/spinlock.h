@@ -8,22 +8,48 @@
 #include <lime/assert.h>
 #include <locks/barrier.h>
 
+/**
+ * build with -DSPINLOCK_STATS=1 (make cppflags=...) to count acquisitions, contention and hold
+ * times per lock name, see spin_stat_dump(). off, it costs nothing.
+ */
+#ifndef SPINLOCK_STATS
+#define SPINLOCK_STATS 0
+#endif
+
+typedef struct lockstat
+{
+    atomic_t state;     // 0: free slot, 1: being claimed, 2: in use.
+    char     name[32];
+    atomic_t acquired;  // acquisitions, including successful trylocks.
+    atomic_t contended; // acquisitions that had to wait.
+    atomic_t spins;     // total iterations spent waiting.
+    atomic_t max_hold;  // longest hold, in TSC cycles.
+} lockstat_t;
+
 /**
  * @brief spinlock object
  *
+ * a ticket lock, waiters take a ticket from 'next' and spin until 'owner'
+ * comes around to it, so the lock is handed out in arrival order and
+ * waiters only read the line while they spin.
  */
 typedef struct spinlock
 {
-    atomic_t lock;
+    atomic_t next;      // next ticket to hand out.
+    atomic_t owner;     // ticket now holding the lock.
     cpu_t *cpu;
     char *name;
     int flags;
+#if SPINLOCK_STATS
+    lockstat_t *stat;
+    uint32_t tsc;       // when the lock was taken.
+#endif
 } spinlock_t;
 
-#define SPINLOCK_NEW(s)                               \
-    &(spinlock_t)                                     \
-    {                                                 \
-        .cpu = NULL, .flags = 0, .name = s, .lock = 0 \
+#define SPINLOCK_NEW(s)                                           \
+    &(spinlock_t)                                                 \
+    {                                                             \
+        .cpu = NULL, .flags = 0, .name = s, .next = 0, .owner = 0 \
     }
 
 /**
@@ -43,8 +69,53 @@ int spinlock_init(const spinlock_t *__lock, const char *__name, spinlock_t **__r
  */
 void spinlock_free(spinlock_t *__lock);
 
+static inline int spin_locked(spinlock_t *__lock)
+{
+    return atomic_read(&__lock->next) != atomic_read(&__lock->owner);
+}
+
 #define spin_holding(__lock) \
-    ((__lock->cpu == cpu) && atomic_read(&__lock->lock))
+    ((__lock->cpu == cpu) && spin_locked(__lock))
+
+void spin_stat_acquire(spinlock_t *__lock, size_t __spins);
+void spin_stat_release(spinlock_t *__lock);
+
+/*print the contention counters of every lock name seen so far*/
+void spin_stat_dump(void);
+
+/*zero all contention counters*/
+void spin_stat_reset(void);
+
+/**
+ * take a ticket and wait for it to come up.
+ * interrupts stay off while waiting, an interrupt taking the
+ * same lock on this cpu would otherwise wait behind our ticket forever.
+ */
+static inline void __spin_acquire(spinlock_t *__lock)
+{
+    size_t spins = 0;
+    uintptr_t ticket = atomic_incr(&__lock->next);
+
+    while (atomic_read(&__lock->owner) != ticket)
+    {
+        CPU_RELAX();
+        spins++;
+    }
+#if SPINLOCK_STATS
+    spin_stat_acquire(__lock, spins);
+#else
+    (void)spins;
+#endif
+}
+
+static inline void __spin_release(spinlock_t *__lock)
+{
+#if SPINLOCK_STATS
+    spin_stat_release(__lock);
+#endif
+    __lock->cpu = NULL;
+    atomic_incr(&__lock->owner);
+}
 
 /**
  * @brief acquire a spinlock
@@ -59,12 +130,7 @@ void spinlock_free(spinlock_t *__lock);
             panic("cpu%d: %s:%d: in %s() : holding '%s' return [\e[0;013m%p\e[0m]\n",      \
                   cpu->cpuid, __FILE__, __LINE__, __func__, __lock->name, return_address(0)); \
         barrier();                                                                         \
-        while (atomic_xchg(&__lock->lock, 1) == 1)                                         \
-        {                                                                                  \
-            popcli();                                                                      \
-            CPU_RELAX();                                                                   \
-            pushcli();                                                                     \
-        }                                                                                  \
+        __spin_acquire(__lock);                                                            \
         __lock->cpu = cpu;                                                                 \
     }
 
@@ -80,8 +146,7 @@ void spinlock_free(spinlock_t *__lock);
             panic("cpu%d: %s:%d: in %s() : not holding '%s' return [\e[0;013m%p\e[0m]\n",  \
                   cpu->cpuid, __FILE__, __LINE__, __func__, __lock->name, return_address(0)); \
         barrier();                                                                         \
-        __lock->cpu = NULL;                                                                \
-        atomic_write(&__lock->lock, 0);                                                    \
+        __spin_release(__lock);                                                            \
         popcli();                                                                          \
     }
 
@@ -96,9 +161,17 @@ static inline int spin_trylock(spinlock_t *__lock)
     assert(__lock, "no spinlock");
     pushcli();
     barrier();
-    long held = !atomic_xchg(&__lock->lock, 1);
+    // the lock is free when the next ticket is the owner's, take that ticket.
+    uintptr_t ticket = atomic_read(&__lock->owner);
+    long held = __atomic_compare_exchange_n(&__lock->next, &ticket, ticket + 1, 0,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
     if (held)
+    {
         __lock->cpu = cpu;
+#if SPINLOCK_STATS
+        spin_stat_acquire(__lock, 0);
+#endif
+    }
     else
         popcli();
     return held; // not the one's who locked it?
@@ -6,6 +6,16 @@
 #include <ds/btree.h>
 #include <ds/queue.h>
 
+#define MAPPING_RA_MIN  2   // pages read ahead on a random miss.
+#define MAPPING_RA_MAX  32  // largest readahead window, in pages.
+
+/**
+ * the cached pages are the file's only copy (tmpfs). a missing page is
+ * a hole and comes up zeroed instead of being read in, and no page is
+ * ever read ahead or reclaimed.
+ */
+#define MAPPING_MEMORY  0x1
+
 typedef struct mapping
 {
     inode_t *inode;
@@ -14,6 +24,12 @@ typedef struct mapping
     size_t nrpages;
     queue_t *usermaps;
 
+    ssize_t ra_next;    // page expected to miss next if access is sequential.
+    size_t ra_pages;    // current readahead window.
+
+    struct mapping *prev;   // previous mapping on the shrinker's list.
+    struct mapping *next;   // next mapping on the shrinker's list.
+
     spinlock_t *lock;
 } mapping_t;
 
@@ -27,4 +43,17 @@ typedef struct mapping
 int mapping_new(mapping_t **pmap);
 void mapping_free(mapping_t *map);
 int mapping_free_page(mapping_t *map, ssize_t pgno);
-int mapping_get_page(mapping_t *map, ssize_t pgno, uintptr_t *pphys, page_t **ppage);
\ No newline at end of file
+int mapping_get_page(mapping_t *map, ssize_t pgno, uintptr_t *pphys, page_t **ppage);
+int mapping_readahead(mapping_t *map, ssize_t pgno, size_t nr);
+
+// page 'pgno' if it's cached, without reading it in. -ENOENT if not.
+int mapping_find_page(mapping_t *map, ssize_t pgno, page_t **ppage);
+
+// drop every cached page from 'pgno' on.
+void mapping_truncate(mapping_t *map, ssize_t pgno);
+
+/**
+ * page cache shrinker, drops up to 'nr' clean pages that no one
+ * but the cache references. returns the number of pages freed.
+ */
+size_t mapping_shrink(size_t nr);
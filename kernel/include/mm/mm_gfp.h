@@ -12,12 +12,14 @@ typedef unsigned int gfp_mask_t;
 #define __GFP_IO        0x00040
 #define __GFP_RETRY     0x00080
 #define __GFP_ZERO      0x00100
+#define __GFP_COLD      0x00200
 
 #define GFP_WAIT    (__GFP_WAIT)
 #define GFP_FS      (__GFP_FS)
 #define GFP_IO      (__GFP_IO)
 #define GFP_RETRY   (__GFP_RETRY)
 #define GFP_ZERO    (__GFP_ZERO)
+#define GFP_COLD    (__GFP_COLD) // page won't be touched by the cpu soon, e.g. DMA buffers.
 
 #define GFP_DMA     (__GFP_DMA)
 #define GFP_NORMAL  (__GFP_NORMAL)
@@ -6,6 +6,16 @@
 #include <mm/mm_gfp.h>
 #include <ds/queue.h>
 
+// number of buddy orders, largest block is _BS(MM_MAX_ORDER - 1) pages (4MiB).
+#define MM_MAX_ORDER (11)
+
+// list of free blocks of one order.
+typedef struct mm_free_area
+{
+    page_t      *head;
+    size_t      nr_free;
+} mm_free_area_t;
+
 typedef struct mm_zone
 {
     uintptr_t   start;
@@ -15,6 +25,7 @@ typedef struct mm_zone
     size_t      free_pages;
     queue_t     *sleep_queue;
     spinlock_t  *lock;
+    mm_free_area_t free_area[MM_MAX_ORDER];
 } mm_zone_t;
 
 #define MM_ZONE_DMA (0)  // <  16 MiB.
@@ -23,6 +34,7 @@ typedef struct mm_zone
 
 #define MM_ZONE_INVAL (0x0000)
 #define MM_ZONE_VALID (0x0010)
+#define MM_ZONE_BUDDY (0x0020) // buddy free lists are built, until then alloc_pages() scans linearly.
 
 #define mm_zone_assert(zone) assert(zone, "No MM_ZONE")
 #define mm_zone_lock(zone) ({mm_zone_assert((zone)); spin_lock((zone)->lock); })
@@ -47,6 +59,12 @@ mm_zone_t *get_mmzone(uintptr_t addr, size_t size);
  */
 mm_zone_t *mm_zone_get(int z);
 
+/**
+ * build the buddy free lists of every valid zone from the pages
+ * that are still free once physical_memory() has reserved everything.
+ */
+int mm_zone_buddy_init(void);
+
 // increase the reference count of the page
 int page_incr(page_t *page);
 // same as page_incr(), except, it takes a physical address to the page as a parameter. 
@@ -7,6 +7,7 @@
 #include <lib/string.h>
 #include <lib/types.h>
 #include <locks/spinlock.h>
+#include <arch/i386/tlb.h>
 #include <mm/page.h>
 
 #ifndef foreach
@@ -59,6 +60,12 @@ typedef struct vmr
     struct vmr_ops *vmops;
     uintptr_t paddr, start, end;
     struct vmr *prev, *next;
+    struct
+    {
+        struct vmr *left, *right;
+        int height;
+        size_t max_gap; // largest hole just below any region in this subtree.
+    } tree;             // AVL tree of regions keyed by 'start'.
 }vmr_t;
 
 #define MMAP_USER 1
@@ -113,9 +120,24 @@ typedef struct mmap
     size_t guard_len;   // Size of the guard space
     size_t used_space;  // Avalable space, may be non-contigous
     vmr_t *vmr_head, *vmr_tail; // list of memory mappings
+    vmr_t *vmr_root;    // same mappings, indexed by start address
+    unsigned long vmr_gen; // changes whenever a mapping is added, removed or resized
+    atomic_t cpumask;   // cpus that have this address space loaded, see tlb_switch()
+    uintptr_t vdata;    // frame of the per-process vdata page, see lime/vdata.c
     spinlock_t *lock;
 }mmap_t;
 
+/**
+ * last region a thread faulted in, only trusted
+ * while the address space's vmr_gen hasn't moved on.
+ */
+typedef struct vmr_hint
+{
+    mmap_t *mmap;
+    vmr_t *vmr;
+    unsigned long gen;
+}vmr_hint_t;
+
 #define mmap_assert(mmap)   assert(mmap, "No Memory Map")
 #define mmap_holding(mmap) (spin_holding(mmap->lock))
 #define mmap_lock(mmap) {mmap_assert(mmap); spin_lock(mmap->lock);}
@@ -129,7 +151,7 @@ typedef struct mmap
     current_assert_lock(); \
     proc->mmap = __mmap; \
     current->mmap = __mmap; \
-    paging_switch(__mmap->pgdir); \
+    tlb_switch(__mmap, __mmap->pgdir); \
 }
 
 int mmap_init(mmap_t *mmap);
@@ -170,6 +192,8 @@ int mmap_contains(mmap_t *mm, vmr_t *r);
 int mmap_remove(mmap_t *mm, vmr_t *r);
 
 vmr_t *mmap_find(mmap_t *mm, uintptr_t addr);
+/*Same as mmap_find(), but tries the region remembered in 'hint' first*/
+vmr_t *mmap_find_hinted(mmap_t *mm, uintptr_t addr, vmr_hint_t *hint);
 vmr_t *mmap_find_exact(mmap_t *mm, uintptr_t start, uintptr_t end);
 vmr_t *mmap_find_vmr_next(mmap_t *mm, uintptr_t addr, vmr_t **pnext);
 vmr_t *mmap_find_vmr_prev(mmap_t *mm, uintptr_t addr, vmr_t **pprev);
@@ -274,6 +298,7 @@ int mmap_clone(mmap_t *mm, mmap_t **pclone);
 #define VM_FILE         0x0020
 #define VM_GROWSDOWN    0x0100
 #define VM_DONTEXPAND   0x0200
+#define VM_VDATA        0x0400
 
 #define __vm_mask_exec(flags) (flags &= ~VM_EXEC)
 #define __vm_mask_write(flags) (flags &= ~VM_WRITE)
@@ -317,6 +342,9 @@ int mmap_clone(mmap_t *mm, mmap_t **pclone);
 /*Can be expanded*/
 #define __vm_can_expand(flags)  (!__vm_dontexpand(flags))
 
+/*Kernel-provided read-only data, see lime/vdata.c*/
+#define __vm_vdata(flags)       (flags & VM_VDATA)
+
 /*Expansion edge grows downwards*/
 #define __vm_growsdown(flags)   (flags & VM_GROWSDOWN)
 
@@ -335,6 +363,7 @@ int mmap_clone(mmap_t *mm, mmap_t **pclone);
 #define __vmr_dontexpand(vmr)  __vm_dontexpand(vmr->flags)
 #define __vmr_can_expand(vmr)  __vm_can_expand(vmr->flags)
 #define __vmr_growsdown(vmr)   __vm_growsdown(vmr->flags)
+#define __vmr_vdata(vmr)       __vm_vdata(vmr->flags)
 #define __vmr_growsup(vmr)     __vm_growsup(vmr->flags)
 
 /*Is memory region a stack?*/
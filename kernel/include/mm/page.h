@@ -16,6 +16,8 @@ typedef struct page
     atomic_t ref_count;
     atomic_t map_count;
     uintptr_t virtual; // virtual addr
+    struct page *next; // next free block on the buddy free list
+    struct page *prev; // previous free block on the buddy free list
 } page_t;
 
 #define page_flags(page) (page->flags)
@@ -17,6 +17,8 @@ typedef union page_flags
         uint32_t can_swap : 1; // page swapping is allowed.
         uint32_t swapped : 1;  // page is swapped out.
         uint32_t mm_zone : 2;  // zone from which this page was allocated
+        uint32_t buddy : 1;    // page heads a free block on the zone's buddy free lists.
+        uint32_t order : 4;    // order of the free block headed by this page.
     };
     uint32_t raw;
 } page_flags_t;
\ No newline at end of file
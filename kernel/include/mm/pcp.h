@@ -0,0 +1,36 @@
+#pragma once
+
+#include <lib/stdint.h>
+#include <lib/stddef.h>
+
+struct page;
+
+#define PCP_HOT     (0) // recently freed pages, likely still in cache.
+#define PCP_COLD    (1) // pages aged out of the hot list.
+
+#define PCP_BATCH   (16) // pages moved between a list and the zone at a time.
+#define PCP_HIGH    (64) // a list holding more pages than this gets trimmed by PCP_BATCH.
+
+typedef struct pcp_list
+{
+    struct page *head;
+    struct page *tail;
+    size_t      count;
+} pcp_list_t;
+
+/**
+ * per-CPU cache of order-0 pages in front of MM_ZONE_NORM.
+ * only ever touched by its own cpu with interrupts disabled,
+ * so alloc_page()/page_put() take no shared lock on a hit.
+ */
+typedef struct mm_pcp
+{
+    pcp_list_t  list[2];    // PCP_HOT and PCP_COLD.
+    size_t      hits;       // allocations served straight from the lists.
+    size_t      misses;     // allocations that had to refill from the zone.
+    size_t      refills;    // pages pulled from the zone.
+    size_t      drains;     // pages given back to the zone.
+} mm_pcp_t;
+
+// print every online cpu's page cache counters.
+void pcp_dump(void);
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <lib/stdint.h>
+#include <lib/stddef.h>
+#include <locks/spinlock.h>
+#include <mm/mm_gfp.h>
+
+struct kmem_cache;
+
+// objects a per-CPU magazine holds before spilling back to the slabs.
+#define KMEM_MAG_SIZE   (16)
+
+/**
+ * per-CPU stack of free objects, only touched by its own cpu with interrupts disabled.
+ */
+typedef struct kmem_magazine
+{
+    size_t  count;
+    void    *objs[KMEM_MAG_SIZE];
+    size_t  hits;       // allocations served from the magazine.
+    size_t  misses;     // allocations that had to refill from the slabs.
+    size_t  frees;      // objects returned through the magazine.
+} kmem_magazine_t;
+
+/**
+ * one page worth of objects, the descriptor lives at the start of the page
+ * so an object's slab is found by rounding its address down.
+ */
+typedef struct kmem_slab
+{
+    struct kmem_slab    *prev, *next;
+    struct kmem_cache   *cache;
+    void                *free;  // free objects, chained through the word after each object.
+    size_t              inuse;
+} kmem_slab_t;
+
+typedef struct kmem_cache
+{
+    const char          *name;
+    size_t              objsize;        // size requested by the creator.
+    size_t              align;          // object alignment.
+    size_t              size;           // stride between objects, 0 until the first slab is made.
+    size_t              offset;         // offset of the first object in a slab.
+    size_t              objs_per_slab;
+    void                (*ctor)(void *);// called once on every object when its slab is made.
+    int                 flags;
+    spinlock_t          *lock;
+    kmem_slab_t         *partial;
+    kmem_slab_t         *full;
+    kmem_slab_t         *empty;
+    size_t              nslabs;         // slabs owned by the cache.
+    size_t              nactive;        // objects out of the slabs, including magazines.
+    struct kmem_cache   *next;          // link on the list of all caches.
+    kmem_magazine_t     mag[NCPU];
+} kmem_cache_t;
+
+#define KMEM_CACHE_STATIC   (0x0001) // descriptor is statically allocated.
+#define KMEM_CACHE_LISTED   (0x0002) // cache is on the list of all caches.
+
+/**
+ * statically allocated cache, usable before anything else is initialized.
+ * the layout is computed when the first slab is made.
+ */
+#define KMEM_CACHE_NEW(__name, __size, __ctor) \
+    &(kmem_cache_t) {.name = __name, .objsize = (__size), .align = sizeof(void *), .ctor = (__ctor), .flags = KMEM_CACHE_STATIC, .lock = SPINLOCK_NEW(__name)}
+
+// create an object cache of 'size' bytes, 'align' of 0 means word aligned.
+int kmem_cache_create(const char *name, size_t size, size_t align, void (*ctor)(void *), kmem_cache_t **ref);
+// release all slabs of a cache, every object must have been freed.
+void kmem_cache_destroy(kmem_cache_t *cache);
+// allocate an object, GFP_ZERO clears it (and any constructed state).
+void *kmem_cache_alloc(kmem_cache_t *cache, gfp_mask_t gfp);
+// return an object to its cache.
+void kmem_cache_free(kmem_cache_t *cache, void *obj);
+// print usage statistics for every cache.
+void kmem_cache_dump(void);
@@ -94,6 +94,10 @@
 #define SYS_PARK            57
 #define SYS_UNPARK          58
 #define SYS_SETPARK         59
+#define SYS_THREAD_STAT     60 //* scheduling statistics of a thread
+#define SYS_FUTEX           61 //* wait/wake on a user address
+#define SYS_SPLICE          62 //* move data between a pipe and a file
+#define SYS_SENDFILE        63 //* write a file's pages to a descriptor
 
 
 #include <lib/types.h>
@@ -113,6 +117,8 @@ extern char *sys_getcwd(void);
 extern int sys_chdir(void);
 extern int sys_readdir(void);
 extern int sys_pipe(void);
+extern int sys_splice(void);
+extern int sys_sendfile(void);
 extern int sys_dup(void);
 extern int sys_dup2(void);
 extern int sys_fstat(void);
@@ -171,6 +177,8 @@ extern void sys_thread_exit(void);
 extern int sys_park(void);
 extern int sys_unpark(void);
 extern void sys_setpark(void);
+extern int sys_thread_stat(void);
+extern int sys_futex(void);
 
 /*Signals*/
 
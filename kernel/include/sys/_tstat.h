@@ -0,0 +1,18 @@
+#ifndef _TSTAT_H
+#define _TSTAT_H
+#include <lib/stdint.h>
+
+/*per-thread scheduling statistics, see thread_stat()*/
+typedef struct tstat
+{
+  int        ts_tid;
+  int        ts_cpu;      /*cpu the thread last ran on*/
+  int        ts_level;    /*ready queue level*/
+  int        ts_priority; /*current priority*/
+  int        ts_base;     /*base priority*/
+  uint32_t   ts_runtime;  /*jiffies spent running*/
+  uint32_t   ts_nvcsw;    /*voluntary switches (sleeps)*/
+  uint32_t   ts_nivcsw;   /*involuntary switches (quantum expired)*/
+} tstat_t;
+
+#endif //_TSTAT_H
@@ -0,0 +1,34 @@
+#ifndef _VDATA_H
+#define _VDATA_H
+#include <lib/stdint.h>
+
+/*
+ * read-only pages the kernel maps into every address space,
+ * just below the first user program page, see lime/vdata.c.
+ * the first page is shared by all processes, the second is per-process.
+ */
+#define VDATA_ADDR      (0x1000000 - 0x2000)
+#define VDATA_PROC_ADDR (VDATA_ADDR + 0x1000)
+#define VDATA_SIZE      (0x2000)
+
+/*clock, kept up to date by every jiffy*/
+typedef struct vdata
+{
+  volatile uint32_t vd_seq;   /*odd while the kernel is updating, readers retry*/
+  uint32_t   vd_hz;           /*jiffies per second, 0 if the clock isn't running*/
+  uint64_t   vd_jiffies;      /*jiffies since boot*/
+  uint64_t   vd_tsc;          /*TSC at the last update*/
+  uint32_t   vd_sec;          /*time since boot at the last update*/
+  uint32_t   vd_nsec;
+  uint32_t   vd_tsc_mult;     /*ns = (TSC cycles * vd_tsc_mult) >> 32, 0 if not calibrated*/
+  uint32_t   vd_hpet_period;  /*HPET main counter period in femtoseconds*/
+  uint32_t   vd_hpet_ticks;   /*HPET main counter ticks per jiffy*/
+} vdata_t;
+
+/*per-process constants*/
+typedef struct vdata_proc
+{
+  int        vp_pid;
+} vdata_proc_t;
+
+#endif //_VDATA_H
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <lib/types.h>
+#include <lib/stdint.h>
+
+#define FUTEX_WAIT      0   // sleep while *uaddr == val.
+#define FUTEX_WAKE      1   // wake up to val threads waiting on uaddr.
+#define FUTEX_REQUEUE   2   // wake up to val, move up to val2 of the rest to uaddr2.
+
+/**
+ * @brief wait/wake on a word of user memory.
+ * waiters are keyed on (current->mmap, uaddr), so only threads of one
+ * process can meet on a futex.
+ *
+ * @return FUTEX_WAIT: 0 once woken, -EAGAIN if *uaddr != val, -EINTR if killed.
+ * FUTEX_WAKE, FUTEX_REQUEUE: the number of threads woken (and moved).
+ */
+int futex(int *uaddr, int op, int val, int *uaddr2, int val2);
@@ -3,27 +3,83 @@
 #include <locks/atomic.h>
 #include <lib/stdint.h>
 #include <lib/types.h>
+#include <sys/_tstat.h>
 
 #define NLEVELS 8
 #define SCHED_HIGHEST_PRIORITY  0
 #define SCHED_LOWEST_PRIORITY   255
-#define SCHED_LEVEL(p) ((p)/((SCHED_LOWEST_PRIORITY + 1)/NLEVELS))
+#define SCHED_LEVEL_SIZE        ((SCHED_LOWEST_PRIORITY + 1)/NLEVELS)
+#define SCHED_LEVEL(p) ((p)/SCHED_LEVEL_SIZE)
 
+/**
+ * Multilevel feedback.
+ *
+ * Threads start at their base priority (sched_set_priority(), new threads
+ * get SCHED_DEFAULT_PRIORITY, the top level). A thread that runs out its
+ * quantum drops one level, a thread that gives up the cpu to sleep rises
+ * one level, never above its base. Every SCHED_BOOST_INTERVAL jiffies all
+ * threads go back to their base priority so nothing starves at the bottom.
+ */
+#define SCHED_DEFAULT_PRIORITY  SCHED_HIGHEST_PRIORITY
+#define SCHED_BOOST_INTERVAL    1000 // jiffies between priority resets.
+
+/**
+ * Ready queues.
+ *
+ * Every cpu owns one sched_queue_t and is the only one to touch its levels,
+ * always with interrupts off, so they need no lock. Threads are linked in
+ * through thread->t_run, parking and picking a thread never allocates.
+ * 'bitmap' has bit i set while level i is non-empty, the next thread is
+ * at the head of level bsf(bitmap).
+ *
+ * Other cpus hand threads over through 'inbox', a lock-free stack the owner
+ * drains in sched_next(). To take work from a busier cpu, a cpu sets its bit
+ * in that cpu's 'pull' mask and the owner pushes a thread to the asking cpu's
+ * inbox on its next tick or pass through the scheduler.
+ */
 typedef struct level
 {
-    atomic_t pull;  //pull flag
-    long     quatum;//quatum
-    queue_t *queue; //queue
+    long     quatum;    //quatum
+    thread_t *head;     //first thread waiting at this level
+    thread_t *tail;     //last thread waiting at this level
 } level_t;
 
+#define SCHED_LOAD_SHIFT        10  // load is fixed point, (1 << SCHED_LOAD_SHIFT) is one runnable thread.
+#define SCHED_BALANCE_INTERVAL  100 // jiffies between rebalancing passes.
+
 typedef struct sched_queue
 {
+    uint32_t bitmap;        // non-empty levels.
     level_t level[NLEVELS];
+    atomic_t nr_ready;      // threads on the levels, may be read by any cpu.
+    atomic_t inbox;         // thread_t * stack of threads parked here by other cpus.
+    atomic_t pull;          // mask of cpus asking for a thread.
+    atomic_t load;          // decaying average of runnable threads, see sched_tick().
+    atomic_t nr_pulled;     // threads this cpu took from other cpus.
+    atomic_t nr_pushed;     // threads other cpus took from this cpu.
+    atomic_t nr_balance;    // rebalancing requests made by this cpu.
+    unsigned long next_balance;
+    unsigned long epoch;    // boost period the levels were last reset in.
 } sched_queue_t;
 
+typedef struct sched_stat
+{
+    long load;      // runnable threads, scaled by (1 << SCHED_LOAD_SHIFT).
+    long nr_ready;  // threads waiting on the ready queue right now.
+    long nr_pulled;
+    long nr_pushed;
+    long nr_balance;
+} sched_stat_t;
+
 /*queue up a thread*/
 int sched_park(thread_t *);
 
+/*current ran out its quantum, drop it a level and give up the cpu*/
+void sched_preempt(void);
+
+/*fill in 'stat' for 'thread', caller must hold thread->t_lock*/
+void sched_thread_stat(thread_t *thread, tstat_t *stat);
+
 /**
  * @brief give up the cpu for on scheduling round
  * 
@@ -72,6 +128,22 @@ int xched_wakeall(queue_t *sleep_queue);
 /*get a thread from a queue*/
 thread_t *sched_next(void);
 
+/*is there anything for this cpu to run?*/
+int sched_runnable(void);
+
+/*ask the busiest other cpu for a thread*/
+int sched_steal(void);
+
+/*ask a busier cpu for a thread if the load is uneven*/
+void sched_balance(void);
+
+/*account the local load, called on every timer tick*/
+void sched_tick(void);
+
+int sched_stat(int core, sched_stat_t *stat);
+
+void sched_dump(void);
+
 int sched_setattr(thread_t *thread, int affinity, int core);
 
 void sched_set_priority(thread_t *thread, int priority);
@@ -10,6 +10,8 @@ pid_t fork(void);
 pid_t wait(int *);
 int execv(const char *, const char *[]);
 int execve(const char *fn, const char *argp[], const char *envp[]);
+// execve() with 'uargp' and 'uenvp' still in user space.
+int execve_user(const char *fn, const char *uargp[], const char *uenvp[]);
 extern int brk(void *addr);
 extern void *sbrk(ptrdiff_t nbytes);
 
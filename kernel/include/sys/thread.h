@@ -41,11 +41,15 @@ __unused static const char *STATES[] = {
 
 typedef struct sched_attr
 {
-    atomic_t age;         /*thread's total runtime*/
+    atomic_t age;         /*thread's total runtime, in jiffies*/
     cpu_t *core;          /*thread's prefered cpu*/
     atomic_t affinity;    /*thread's processor affinity, 0=soft and 1=hard*/
-    atomic_t t_priority;  /*thread's priority*/
+    atomic_t t_priority;  /*thread's priority, moves between levels as the thread runs*/
+    atomic_t t_base;      /*priority set by sched_set_priority(), boosts return here*/
     atomic_t t_timeslice; /*thread's timeslice*/
+    unsigned long epoch;  /*boost period the priority was last reset in*/
+    atomic_t nvcsw;       /*times the thread gave up the cpu to sleep*/
+    atomic_t nivcsw;      /*times the thread was preempted at the end of its quantum*/
 } sched_attr_t;
 
 /*default scheduling attributes*/
@@ -87,9 +91,16 @@ typedef struct thread
     sched_attr_t t_sched_attr; /*thread scheduling attributes*/
 
     mmap_t *mmap;       /*memory map*/
+    vmr_hint_t t_vmr_hint; /*region of the last page fault*/
     tgroup_t *t_group; /*thread group*/
     queue_t *t_queues; /*thread queues*/
     struct
+    {
+        struct thread *next;    /*next on the ready queue level, or in a cpu's inbox*/
+        struct thread *prev;    /*previous on the ready queue level*/
+        int level;              /*ready queue level the thread is on*/
+    } t_run;
+    struct
     {
         void *data;         /*used to specify what holds the sleep-queue, e.g mutex, condition-variable, etc.*/
         queue_t *queue;     /*thread's sleep queue if sleeping*/
@@ -99,6 +110,7 @@ typedef struct thread
 
     struct file_table *t_file_table; /*thread file table*/
     cond_t *t_wait;                  /*thread wait condition*/
+    void *t_iobuf;                   /*page read() and write() bounce user data through, allocated on first use*/
 } thread_t;
 
 
@@ -145,6 +157,7 @@ int queue_get_thread(queue_t *queue, tid_t tid, thread_t **pthread);
 
 void thread_yield(void);
 tid_t thread_self(void);
+int thread_stat(tid_t tid, tstat_t *stat);
 int thread_kill_all(void);
 int thread_kill(tid_t tid);
 void thread_exit(uintptr_t);
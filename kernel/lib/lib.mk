@@ -1,6 +1,7 @@
 
 libobjs=\
 $(libdir)/ctype.o\
+$(libdir)/membench.o\
 $(libdir)/tinyfont.o\
 $(libdir)/print.o\
 $(libdir)/snprintf.o\
@@ -0,0 +1,83 @@
+#include <arch/i386/paging.h>
+#include <arch/system.h>
+#include <lib/string.h>
+#include <printk.h>
+#include <sys/kthread.h>
+
+#define MEMBENCH_MAX    (4 * 1024 * 1024)   // largest run measured.
+#define MEMBENCH_BYTES  (2 * 1024 * 1024)   // bytes moved per size and kernel.
+#define MEMBENCH_BUFSZ  (MEMBENCH_MAX + PAGESZ)
+
+enum { MB_MEMCPY, MB_MEMSET, MB_MEMMOVE, MB_MEMCMP, MB_NR };
+
+// run 'op' over 'size' bytes until MEMBENCH_BYTES have gone by, returns bytes per 100 cycles.
+static uint32_t membench_run(int op, char *dst, char *src, size_t size)
+{
+    uint64_t tsc = 0, cycles = 0;
+    size_t iters = MEMBENCH_BYTES / size;
+
+    iters = iters ? iters : 1;
+    if (op == MB_MEMCMP) // compare equal buffers, the whole run is scanned.
+        memcpy(dst, src, size);
+
+    tsc = read_tsc();
+    for (size_t i = 0; i < iters; ++i) {
+        switch (op) {
+        case MB_MEMCPY:
+            memcpy(dst, src, size);
+            break;
+        case MB_MEMSET:
+            memset(dst, (int)i, size);
+            break;
+        case MB_MEMMOVE:
+            memmove(dst + 1, dst, size); // overlapping, copies backwards.
+            break;
+        case MB_MEMCMP:
+            memcmp(dst, src, size);
+            break;
+        }
+    }
+    cycles = read_tsc() - tsc;
+
+    return cycles ? (uint32_t)((uint64_t)iters * size * 100 / cycles) : 0;
+}
+
+/**
+ * boot-time benchmark of the mem*() kernels, reports
+ * bytes per cycle for runs of 16 B up to 4 MiB.
+ */
+void *membench(void *arg)
+{
+    uint32_t rate[MB_NR];
+    char *dst = NULL, *src = NULL;
+
+    if ((dst = (char *)paging_alloc(MEMBENCH_BUFSZ)) == NULL ||
+        (src = (char *)paging_alloc(MEMBENCH_BUFSZ)) == NULL) {
+        klog(KLOG_FAIL, "membench: no memory for buffers\n");
+        goto done;
+    }
+
+    memset(src, 0x5A, MEMBENCH_BUFSZ);
+    memset(dst, 0x5A, MEMBENCH_BUFSZ);
+
+    printk("membench: bytes/cycle     memcpy  memset memmove  memcmp\n");
+    for (size_t size = 16; size <= MEMBENCH_MAX; size *= 4) {
+        for (int op = 0; op < MB_NR; ++op)
+            rate[op] = membench_run(op, dst, src, size);
+
+        printk("membench: %7d B  %3d.%02d  %3d.%02d  %3d.%02d  %3d.%02d\n", size,
+            rate[MB_MEMCPY] / 100, rate[MB_MEMCPY] % 100,
+            rate[MB_MEMSET] / 100, rate[MB_MEMSET] % 100,
+            rate[MB_MEMMOVE] / 100, rate[MB_MEMMOVE] % 100,
+            rate[MB_MEMCMP] / 100, rate[MB_MEMCMP] % 100);
+    }
+
+done:
+    if (src)
+        paging_free((uintptr_t)src, MEMBENCH_BUFSZ);
+    if (dst)
+        paging_free((uintptr_t)dst, MEMBENCH_BUFSZ);
+    return arg;
+}
+
+BUILTIN_THREAD(membench, membench, NULL);
@@ -1,12 +1,101 @@
 #include <lib/stdint.h>
 
+#include <lib/cpuid.h>
+
+/**
+ * the mem*() kernels. short runs go a byte at a time, anything longer
+ * aligns the destination and moves dwords with rep movsl/stosl, cpus
+ * with fast rep movsb/stosb (ERMS) do large runs with the byte forms.
+ * no SSE here: the kernel runs with the FPU disabled and switches its
+ * state lazily (see fpu_intr()), kernel code can't touch xmm registers.
+ */
+
+#define MEM_SMALL       16      // below this, a plain byte loop wins.
+#define MEM_ERMS_MIN    256     // ERMS rep movsb/stosb beats dwords from here.
+#define CPUID7_ERMS     (1 << 9) // cpuid(7).ebx: enhanced rep movsb/stosb.
+
+typedef uint32_t __attribute__((__may_alias__)) mem_word_t;
+
+static int mem_erms = -1; // probed on first large call.
+
+static int mem_has_erms(void)
+{
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+    if (mem_erms < 0)
+        mem_erms = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & CPUID7_ERMS);
+    return mem_erms;
+}
+
+static inline void rep_movsb(void *dst, const void *src, uint32_t n)
+{
+    asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(n) :: "memory");
+}
+
+static inline void rep_movsl(void *dst, const void *src, uint32_t n)
+{
+    asm volatile("rep movsl" : "+D"(dst), "+S"(src), "+c"(n) :: "memory");
+}
+
+static inline void rep_stosb(void *dst, int c, uint32_t n)
+{
+    asm volatile("rep stosb" : "+D"(dst), "+c"(n) : "a"(c) : "memory");
+}
+
+static inline void rep_stosl(void *dst, uint32_t v, uint32_t n)
+{
+    asm volatile("rep stosl" : "+D"(dst), "+c"(n) : "a"(v) : "memory");
+}
+
+// forward copy, 'n' >= MEM_SMALL.
+static void mem_copy_fwd(uint8_t *d, const uint8_t *s, uint32_t n)
+{
+    uint32_t head = 0;
+
+    if (n >= MEM_ERMS_MIN && mem_has_erms()) {
+        rep_movsb(d, s, n);
+        return;
+    }
+
+    // align the destination, misaligned stores cost more than loads.
+    head = (4 - ((uintptr_t)d & 3)) & 3;
+    n -= head;
+    while (head--)
+        *d++ = *s++;
+
+    rep_movsl(d, s, n >> 2);
+    d += n & ~3;
+    s += n & ~3;
+    for (n &= 3; n; --n)
+        *d++ = *s++;
+}
+
 void *
 memset(void *dst, int c, uint32_t n)
 {
-    char *d;
+    uint8_t *d = dst;
+    uint32_t head = 0, v = 0;
 
-    d = (char *)dst;
-    while (n-- > 0)
+    if (n < MEM_SMALL) {
+        while (n-- > 0)
+            *d++ = c;
+        return dst;
+    }
+
+    if (n >= MEM_ERMS_MIN && mem_has_erms()) {
+        rep_stosb(d, c & 0xFF, n);
+        return dst;
+    }
+
+    head = (4 - ((uintptr_t)d & 3)) & 3;
+    n -= head;
+    while (head--)
+        *d++ = c;
+
+    v = (c & 0xFF) * 0x01010101U;
+    rep_stosl(d, v, n >> 2);
+    d += n & ~3;
+    for (n &= 3; n; --n)
         *d++ = c;
 
     return dst;
@@ -19,6 +108,14 @@ memcmp(const void *v1, const void *v2, uint32_t n)
 
     s1 = v1;
     s2 = v2;
+
+    // skip equal dwords, the byte loop below finds the differing byte.
+    while (n >= 4 && *(const mem_word_t *)s1 == *(const mem_word_t *)s2)
+    {
+        s1 += 4, s2 += 4;
+        n -= 4;
+    }
+
     while (n-- > 0)
     {
         if (*s1 != *s2)
@@ -29,26 +126,31 @@ memcmp(const void *v1, const void *v2, uint32_t n)
     return 0;
 }
 
+/*NB: returns the end of the copy (dst + size), not dst*/
 void *
 memcpy(void *restrict dstptr, const void *restrict srcptr, unsigned int size)
 {
     unsigned char *dst = (unsigned char *)dstptr;
     const unsigned char *src = (const unsigned char *)srcptr;
     unsigned int i;
+
+    if (size >= MEM_SMALL) {
+        mem_copy_fwd(dst, src, size);
+        return (void *)&dst[size];
+    }
+
     for (i = 0; i < size; i++)
         dst[i] = src[i];
     return (void *)&dst[i];
 }
 
+/*copies 'size' dwords, returns the end of the copy*/
 void *
 memcpyd(void *restrict dstptr, const void *restrict srcptr, unsigned int size)
 {
     unsigned int *dst = (unsigned int *)dstptr;
-    const unsigned int *src = (const unsigned int *)srcptr;
-    unsigned int i;
-    for (i = 0; i < size; i++)
-        *dst++ = *src++;
-    return (void *)&dst[i];
+    rep_movsl(dst, srcptr, size);
+    return (void *)&dst[size];
 }
 
 void *
@@ -63,9 +165,26 @@ memmove(void *dst, const void *src, uint32_t n)
     {
         s += n;
         d += n;
-        while (n-- > 0)
+        /**
+         * copy down from the end, the tail bytes first then whole dwords.
+         * an interrupt may land while DF is set, every entry stub in
+         * traps.asm clears it and iret brings it back.
+         */
+        for (; n & 3; --n)
             *--d = *--s;
+        if ((n >>= 2))
+        {
+            d -= 4, s -= 4;
+            asm volatile("std\n"
+                         "rep movsl\n"
+                         "cld"
+                         : "+D"(d), "+S"(s), "+c"(n)
+                         :
+                         : "memory");
+        }
     }
+    else if (n >= MEM_SMALL)
+        mem_copy_fwd((uint8_t *)d, (const uint8_t *)s, n);
     else
         while (n-- > 0)
             *d++ = *s++;
@@ -89,8 +208,7 @@ memmoved(void *dst, const void *src, uint32_t n)
             *--d = *--s;
     }
     else
-        while (n-- > 0)
-            *d++ = *s++;
+        rep_movsl(d, s, n);
 
     return dst;
 }
@@ -110,12 +228,7 @@ memsetw(void *dst, int c, unsigned int n)
 void *
 memsetd(void *dst, int c, unsigned int n)
 {
-    unsigned int *d;
-
-    d = (unsigned int *)dst;
-    while (n-- > 0)
-        *d++ = c;
-
+    rep_stosl(dst, c, n);
     return dst;
 }
 
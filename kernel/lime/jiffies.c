@@ -1,19 +1,47 @@
 #include <ds/queue.h>
 #include <lime/jiffies.h>
+#include <lime/timer.h>
 #include <sys/sched.h>
 #include <sys/thread.h>
+#include <dev/hpet.h>
+#include <lime/vdata.h>
 
 
 static jiffies64_t jiffies64 = 0;
-static queue_t *jiffy_queue = QUEUE_NEW("jiffy_queue");
+static uint32_t jiffies_clock = 0; // HPET count at the start of the current jiffy.
+static queue_t *jiffy_queue = QUEUE_NEW("jiffy_queue"); // threads in jiffies_sleep().
 static spinlock_t *jiffies_lock = SPINLOCK_NEW("jiffies_lock");
 
+/**
+ * bring jiffies up to date with the HPET main counter and run due timers.
+ * called from every cpu's timer interrupt; ticks may be skipped or late
+ * (an idle cpu stops its tick), time is never lost as long as some cpu
+ * calls this before the 32-bit counter wraps.
+ */
 void jiffies_update(void)
 {
-    spin_lock(jiffies_lock);
-    jiffies64++;
+    jiffies_t now = 0;
+    uint32_t elapsed = 0, ticks = 0;
+
+    if ((ticks = hpet_jiffy_ticks()) == 0)
+        return;
+
+    // another cpu is already at it.
+    if (!spin_trylock(jiffies_lock))
+        return;
+
+    if ((elapsed = (hpet_counter() - jiffies_clock) / ticks) == 0) {
+        spin_unlock(jiffies_lock);
+        return;
+    }
+
+    jiffies_clock += elapsed * ticks;
+    jiffies64 += elapsed;
+    now = jiffies64;
+    vdata_update(jiffies64, jiffies_clock);
     spin_unlock(jiffies_lock);
-    xched_wake1(jiffy_queue);
+
+    timer_run(now);
 }
 
 jiffies_t jiffies_get(void)
@@ -34,17 +62,35 @@ jiffies64_t jiffies64_get(void)
     return val;
 }
 
+static void jiffies_wakeup(ktimer_t *timer)
+{
+    thread_t *thread = timer->arg;
+    thread_lock(thread);
+    thread_wake_n(thread);
+    thread_unlock(thread);
+}
+
+/**
+ * sleep for 'time' ticks. the sleeper is woken once, by its own timer,
+ * on the tick its deadline passes.
+ */
 int jiffies_sleep(jiffies_t time)
 {
     int err = 0;
-    time += jiffies_get();
-    while (time_before(jiffies_get(), time)) {
-        current_lock();
-        if ((err = xched_sleep(jiffy_queue, NULL))) {
-            current_unlock();
-            return err;
-        }
-        current_unlock();
+    ktimer_t timer = KTIMER_INIT(jiffies_wakeup, current);
+
+    if (time == 0)
+        return 0;
+
+    current_lock();
+    timer.expires = jiffies_get() + time;
+    timer_add(&timer);
+    while (timer_pending(&timer)) {
+        if ((err = xched_sleep(jiffy_queue, NULL)))
+            break;
     }
+    current_unlock();
+
+    timer_del(&timer);
     return err;
-}
\ No newline at end of file
+}
@@ -7,4 +7,6 @@ $(lfbtermobjs)\
 $(limedir)/jiffies.o\
 $(limedir)/kmain.o\
 $(limedir)/modules.o\
-$(limedir)/preempt.o
\ No newline at end of file
+$(limedir)/preempt.o\
+$(limedir)/timer.o\
+$(limedir)/vdata.o
\ No newline at end of file
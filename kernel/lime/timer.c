@@ -0,0 +1,227 @@
+#include <printk.h>
+#include <lime/timer.h>
+#include <locks/spinlock.h>
+#include <arch/i386/cpu.h>
+
+#define WHEEL_BITS      6
+#define WHEEL_SIZE      (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS    4
+#define WHEEL_MAX       ((jiffies_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) // furthest a timer is placed ahead.
+
+/**
+ * The timing wheel.
+ *
+ * Level 0 has a slot per tick for the next WHEEL_SIZE ticks, each level
+ * above it covers WHEEL_SIZE times the span of the one below. Arming and
+ * cancelling a timer is O(1). Whenever level 0 wraps around, the next slot
+ * of level 1 is cascaded, its timers are spread out over level 0, and so on
+ * up the levels. Timers further out than the wheel reaches are parked in the
+ * last slot of the top level and re-placed when it cascades.
+ *
+ * wheel_jiffies is the next tick to be processed. Due timers are moved to
+ * the expired list and run one at a time with timer_lock dropped;
+ * timer_running is the one whose callback is executing.
+ */
+static ktimer_t *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static ktimer_t *timer_expired = NULL;
+static ktimer_t *timer_running = NULL;
+static jiffies_t wheel_jiffies = 0;
+static timer_stat_t timer_stats = {0};
+static spinlock_t *timer_lock = SPINLOCK_NEW("timer_lock");
+
+static void timer_link(ktimer_t **head, ktimer_t *t)
+{
+    if ((t->next = *head))
+        (*head)->pprev = &t->next;
+    *head = t;
+    t->pprev = head;
+}
+
+static void timer_unlink(ktimer_t *t)
+{
+    if ((*t->pprev = t->next))
+        t->next->pprev = t->pprev;
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+/* put 't' in the slot that covers its deadline. caller holds timer_lock. */
+static void wheel_insert(ktimer_t *t)
+{
+    int level = 0;
+    jiffies_t expires = t->expires;
+    jiffies_t delta = expires - wheel_jiffies;
+
+    if ((long)delta < 0) {
+        // already due, goes out on the next tick.
+        timer_link(&wheel[0][wheel_jiffies & WHEEL_MASK], t);
+        return;
+    }
+
+    if (delta >= WHEEL_MAX) {
+        delta = WHEEL_MAX - 1;
+        expires = wheel_jiffies + delta;
+    }
+
+    while ((level < WHEEL_LEVELS - 1) && (delta >= ((jiffies_t)1 << ((level + 1) * WHEEL_BITS))))
+        level++;
+
+    timer_link(&wheel[level][(expires >> (level * WHEEL_BITS)) & WHEEL_MASK], t);
+}
+
+/* re-place every timer in 'level's slot 'idx', returns 'idx'. */
+static int wheel_cascade(int level, int idx)
+{
+    ktimer_t *t = NULL;
+
+    while ((t = wheel[level][idx])) {
+        timer_unlink(t);
+        wheel_insert(t);
+        timer_stats.cascaded++;
+    }
+
+    return idx;
+}
+
+#define WHEEL_INDEX(level) ((wheel_jiffies >> ((level) * WHEEL_BITS)) & WHEEL_MASK)
+
+void timer_add(ktimer_t *t)
+{
+    if (t == NULL || t->fn == NULL)
+        return;
+
+    spin_lock(timer_lock);
+    if (t->pending)
+        timer_unlink(t);
+    else
+        timer_stats.added++;
+    t->pending = 1;
+    wheel_insert(t);
+    spin_unlock(timer_lock);
+}
+
+int timer_del(ktimer_t *t)
+{
+    int pending = 0;
+
+    if (t == NULL)
+        return 0;
+
+    spin_lock(timer_lock);
+    if ((pending = t->pending)) {
+        timer_unlink(t);
+        t->pending = 0;
+        timer_stats.cancelled++;
+    }
+
+    // the callback may still be using 't' on another cpu.
+    while (timer_running == t) {
+        spin_unlock(timer_lock);
+        CPU_RELAX();
+        spin_lock(timer_lock);
+    }
+    spin_unlock(timer_lock);
+
+    return pending;
+}
+
+void timer_run(jiffies_t now)
+{
+    int level = 0;
+    ktimer_t *t = NULL;
+    jiffies_t late = 0;
+
+    spin_lock(timer_lock);
+    while (time_after_eq(now, wheel_jiffies)) {
+        int idx = WHEEL_INDEX(0);
+
+        // level 0 wrapped, pull the next span down from the levels above.
+        for (level = 1; !idx && level < WHEEL_LEVELS; ++level)
+            idx = wheel_cascade(level, WHEEL_INDEX(level));
+
+        while ((t = wheel[0][WHEEL_INDEX(0)])) {
+            timer_unlink(t);
+            timer_link(&timer_expired, t);
+        }
+        wheel_jiffies++;
+    }
+
+    while ((t = timer_expired)) {
+        timer_unlink(t);
+        t->pending = 0;
+        timer_running = t;
+
+        late = now - t->expires;
+        if ((long)late > 0) {
+            timer_stats.slack += late;
+            timer_stats.max_slack = MAX(timer_stats.max_slack, late);
+        }
+        timer_stats.fired++;
+
+        spin_unlock(timer_lock);
+        t->fn(t);
+        spin_lock(timer_lock);
+        timer_running = NULL;
+    }
+    spin_unlock(timer_lock);
+}
+
+jiffies_t timer_next(void)
+{
+    int idx = 0;
+    jiffies_t next = 0, cascade = 0;
+
+    spin_lock(timer_lock);
+    next = wheel_jiffies + WHEEL_MAX;
+
+    if (timer_expired) {
+        next = wheel_jiffies;
+        goto done;
+    }
+
+    for (int k = 0; k < WHEEL_SIZE; ++k) {
+        if (wheel[0][(WHEEL_INDEX(0) + k) & WHEEL_MASK]) {
+            next = wheel_jiffies + k;
+            goto done;
+        }
+    }
+
+    /**
+     * timers on the upper levels are only known to be due no earlier than
+     * the cascade of their slot, report the nearest such cascade.
+     */
+    for (int level = 1; level < WHEEL_LEVELS; ++level) {
+        idx = WHEEL_INDEX(level);
+        for (int k = 1; k <= WHEEL_SIZE; ++k) {
+            if (wheel[level][(idx + k) & WHEEL_MASK] == NULL)
+                continue;
+            cascade = ((wheel_jiffies >> (level * WHEEL_BITS)) + k) << (level * WHEEL_BITS);
+            if (time_before(cascade, next))
+                next = cascade;
+            break;
+        }
+    }
+done:
+    spin_unlock(timer_lock);
+    return next;
+}
+
+void timer_stat(timer_stat_t *stat)
+{
+    if (stat == NULL)
+        return;
+
+    spin_lock(timer_lock);
+    *stat = timer_stats;
+    spin_unlock(timer_lock);
+}
+
+void timer_dump(void)
+{
+    timer_stat_t stat;
+
+    timer_stat(&stat);
+    printk("timers: added: %d, cancelled: %d, fired: %d, cascaded: %d, slack: %d ticks (max %d)\n",
+        stat.added, stat.cancelled, stat.fired, stat.cascaded, stat.slack, stat.max_slack);
+}
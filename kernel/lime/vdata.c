@@ -0,0 +1,164 @@
+#include <lime/vdata.h>
+#include <arch/i386/paging.h>
+#include <arch/system.h>
+#include <bits/errno.h>
+#include <dev/hpet.h>
+#include <lib/string.h>
+#include <locks/barrier.h>
+#include <mm/mm_zone.h>
+#include <mm/pmm.h>
+#include <sys/system.h>
+
+#define NSEC_PER_SEC        1000000000ULL
+#define VDATA_CALIBRATE_NS  (100000000ULL) // re-measure the TSC rate every 100ms.
+
+static vdata_t *vdata = NULL;       // kernel mapping of the shared clock page.
+static uintptr_t vdata_frame = 0;
+
+// last TSC calibration point, only touched under jiffies_lock.
+static uint64_t calib_tsc = 0;
+static uint64_t calib_ns = 0;
+
+int vdata_init(void)
+{
+    uintptr_t v = 0;
+
+    if ((v = paging_alloc(PAGESZ)) == 0)
+        return -ENOMEM;
+
+    memset((void *)v, 0, PAGESZ);
+    vdata_frame = PGROUND(paging_getmapping(v)->raw);
+    vdata = (vdata_t *)v;
+    vdata->vd_hpet_period = hpet_period();
+    vdata->vd_hpet_ticks = hpet_jiffy_ticks();
+    return 0;
+}
+
+/**
+ * the TSC rate as a 32.32 ns-per-cycle multiplier, measured against
+ * the HPET over at least VDATA_CALIBRATE_NS and smoothed.
+ * the TSC is read on whichever cpu runs the tick, a step backwards
+ * or a long stopped tick just restarts the measurement.
+ */
+static uint32_t vdata_calibrate(uint64_t tsc, uint64_t ns)
+{
+    uint64_t mult = 0, dns = ns - calib_ns;
+    uint32_t old = vdata->vd_tsc_mult;
+
+    if (calib_tsc == 0 || tsc <= calib_tsc || dns > NSEC_PER_SEC)
+        goto restart;
+
+    if (dns < VDATA_CALIBRATE_NS)
+        return old;
+
+    mult = (dns << 32) / (tsc - calib_tsc);
+    if (mult > 0xFFFFFFFFULL) // slower than 1 GHz would need more bits, don't interpolate.
+        mult = 0;
+    else if (old)
+        mult = ((uint64_t)old * 7 + mult) / 8;
+    old = (uint32_t)mult;
+restart:
+    calib_tsc = tsc;
+    calib_ns = ns;
+    return old;
+}
+
+void vdata_update(jiffies64_t jiffies, uint32_t clock)
+{
+    uint64_t ns = 0, tsc = 0;
+    uint32_t mult = 0, period = 0;
+
+    if (vdata == NULL)
+        return;
+
+    period = vdata->vd_hpet_period;
+    tsc = read_tsc();
+    ns = jiffies * (NSEC_PER_SEC / HZ);
+    ns += (uint64_t)(hpet_counter() - clock) * period / 1000000;
+    mult = vdata_calibrate(tsc, ns);
+
+    vdata->vd_seq++;
+    barrier();
+    vdata->vd_hz = HZ;
+    vdata->vd_jiffies = jiffies;
+    vdata->vd_tsc = tsc;
+    vdata->vd_sec = (uint32_t)(ns / NSEC_PER_SEC);
+    vdata->vd_nsec = (uint32_t)(ns % NSEC_PER_SEC);
+    vdata->vd_tsc_mult = mult;
+    barrier();
+    vdata->vd_seq++;
+}
+
+uintptr_t vdata_proc_alloc(void)
+{
+    uintptr_t frame = 0, v = 0;
+
+    if ((frame = pmman.alloc()) == 0)
+        return 0;
+
+    if ((v = paging_mount(frame)) == 0) {
+        pmman.free(frame);
+        return 0;
+    }
+
+    memset((void *)v, 0, PAGESZ);
+    paging_unmount(v);
+    return frame;
+}
+
+void vdata_setproc(mmap_t *mmap, pid_t pid)
+{
+    uintptr_t v = 0;
+
+    if (mmap == NULL || mmap->vdata == 0)
+        return;
+
+    if ((v = paging_mount(mmap->vdata)) == 0)
+        return;
+
+    ((vdata_proc_t *)v)->vp_pid = pid;
+    paging_unmount(v);
+}
+
+/**
+ * map the shared clock frame or the address space's own frame,
+ * read-only. a write, or a fault on a present page, is refused.
+ */
+static int vdata_fault(vmr_t *region, vm_fault_t *vm)
+{
+    int err = 0;
+    uintptr_t frame = 0;
+
+    if (vm->flags & (VM_W | VM_P))
+        return -EACCES;
+
+    if (PGROUND(vm->addr) == VDATA_ADDR)
+        frame = vdata_frame;
+    else if (region->mmap)
+        frame = region->mmap->vdata;
+
+    if (frame == 0)
+        return -EFAULT;
+
+    __page_incr(frame);
+    if ((err = paging_identity_map(frame, PGROUND(vm->addr), PAGESZ, region->vflags & ~VM_W)))
+        __page_put(frame);
+    return err;
+}
+
+static vmr_ops_t vdata_vmops = {
+    .fault = vdata_fault,
+};
+
+int vdata_map(mmap_t *mmap)
+{
+    int err = 0;
+    vmr_t *r = NULL;
+
+    if ((err = mmap_map_region(mmap, VDATA_ADDR, VDATA_SIZE, PROT_READ, MAP_FIXED | MAP_PRIVATE | MAP_DONTEXPAND, &r)))
+        return err;
+
+    r->flags |= VM_VDATA;
+    r->vmops = &vdata_vmops;
+    return 0;
+}
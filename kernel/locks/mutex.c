@@ -59,40 +59,97 @@ error:
     return err;
 }
 
+/* is 'owner' on a cpu right now? it then holds the mutex only briefly. */
+static int mutex_owner_running(thread_t *owner)
+{
+    return owner && (owner != current) && (owner->t_state == T_RUNNING);
+}
+
+/* take a free mutex. interrupts must be off. */
+static int mutex_acquire(mutex_t *mutex)
+{
+    uintptr_t unlocked = 0;
+
+    if (!__atomic_compare_exchange_n(&mutex->lock, &unlocked, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return 0;
+    mutex->thread = current;
+    return 1;
+}
+
 int mutex_lock(mutex_t *mutex)
 {
-    int retval = 0;
+    thread_t *owner = NULL;
     mutex_assert(mutex);
-    
-    pushcli();
-    
-    spin_lock(mutex->guard);
 
     if (mutex_holding(mutex))
         panic("thread(%d) holding mutex return [\e[0;013m%p\e[0m]\n", thread_self(), return_address(0));
 
-    if ((int)atomic_incr(&mutex->lock) > 0)
+    /**
+     * while the owner is running on another cpu it will most likely let
+     * go within a few microseconds, cheaper to wait here than to sleep
+     * and pay for two context switches. interrupts stay on while spinning.
+     */
+    for (size_t spins = 0; ; ++spins)
+    {
+        pushcli();
+        if (mutex_acquire(mutex))
+            return 0;
+        popcli();
+
+        owner = mutex->thread;
+        if ((spins >= MUTEX_SPIN_MAX) || !mutex_owner_running(owner))
+            break;
+        CPU_RELAX();
+    }
+
+    pushcli();
+    spin_lock(mutex->guard);
+
+    /**
+     * mutex_unlock() hands the mutex straight to the waiter it wakes,
+     * so there is no race with newcomers once we are queued. being woken
+     * for any other reason (e.g. a kill) just means waiting again.
+     */
+    while (!mutex_holding(mutex))
     {
+        if (mutex_acquire(mutex))
+            break;
         current_lock();
-        retval = xched_sleep(mutex->waiters, mutex->guard);
+        xched_sleep(mutex->waiters, mutex->guard);
         current_unlock();
     }
 
-    mutex->thread = current;
     spin_unlock(mutex->guard);
-
-    return retval;
+    return 0;
 }
 
 void mutex_unlock(mutex_t *mutex)
 {
+    thread_t *thread = NULL;
+
     mutex_assert(mutex);
     spin_lock(mutex->guard);
     mutex_assert_lock(mutex);
-    mutex->thread = NULL;
-    if ((int)atomic_decr(&mutex->lock) <= 0)
-        panic("mutex->lock underflow: %d\n", atomic_read(&mutex->lock));
-    xched_wake1(mutex->waiters);
+
+    queue_lock(mutex->waiters);
+    thread = thread_dequeue(mutex->waiters);
+    queue_unlock(mutex->waiters);
+
+    if (thread)
+    {
+        // hand off, the mutex stays locked and now belongs to 'thread'.
+        thread_assert_lock(thread);
+        mutex->thread = thread;
+        __thread_enter_state(thread, T_READY);
+        sched_park(thread);
+        thread_unlock(thread);
+    }
+    else
+    {
+        mutex->thread = NULL;
+        atomic_write(&mutex->lock, 0);
+    }
+
     spin_unlock(mutex->guard);
     popcli();
 }
@@ -100,17 +157,11 @@ void mutex_unlock(mutex_t *mutex)
 int mutex_try_lock(mutex_t *mutex)
 {
     mutex_assert(mutex);
-    spin_lock(mutex->guard);
     pushcli();
     if (mutex_holding(mutex))
         panic("%s:%d: thread(%d) holding mutex\n", __FILE__, __LINE__, thread_self());
-    if (atomic_xchg(&mutex->lock, 1) == 0) // we have acquired the mutex
-    {
-        mutex->thread = current;
-        spin_unlock(mutex->guard);
+    if (mutex_acquire(mutex))
         return 1; // success
-    }
     popcli();
-    spin_unlock(mutex->guard);
     return 0; // unsuccessful
-}
\ No newline at end of file
+}
@@ -1,11 +1,14 @@
 #include <locks/barrier.h>
 #include <locks/spinlock.h>
 #include <mm/kalloc.h>
+#include <mm/slab.h>
 #include <lime/string.h>
 #include <lib/string.h>
 #include <lime/assert.h>
 #include <bits/errno.h>
 
+static kmem_cache_t *spinlock_cache = KMEM_CACHE_NEW("spinlock", sizeof(spinlock_t), NULL);
+
 void spinlock_free(spinlock_t *__lock)
 {
     if (!__lock)
@@ -14,7 +17,7 @@ void spinlock_free(spinlock_t *__lock)
         kfree(__lock->name);
     if (!(__lock->flags & 1))
         return;
-    kfree(__lock);
+    kmem_cache_free(spinlock_cache, __lock);
 }
 
 int spinlock_init(const spinlock_t *__lock, const char *__name, spinlock_t **__ref)
@@ -24,12 +27,12 @@ int spinlock_init(const spinlock_t *__lock, const char *__name, spinlock_t **__r
     if ((!__lock && !__ref) || !__name) return -EINVAL;
 
     if (__lock) lk = (spinlock_t *)__lock;
-    else if (!(lk = (spinlock_t *)kmalloc(sizeof(*lk))))
+    else if (!(lk = (spinlock_t *)kmem_cache_alloc(spinlock_cache, 0)))
         return -ENOMEM;
 
     if (!(name = combine_strings(__name, "-spinlock")))
     {
-        if (!__lock) kfree(lk);
+        if (!__lock) kmem_cache_free(spinlock_cache, lk);
         return -ENOMEM;
     }
 
@@ -40,4 +43,134 @@ int spinlock_init(const spinlock_t *__lock, const char *__name, spinlock_t **__r
     lk->name = name;
     if (__ref) *__ref = lk;
     return 0;
-}
\ No newline at end of file
+}
+
+#define LOCKSTAT_NR 256 // must be a power of two.
+
+#if SPINLOCK_STATS
+
+#include <arch/system.h>
+#include <printk.h>
+
+/**
+ * contention counters, one slot per lock name so all locks of a kind
+ * (e.g. every "mapping-spinlock") add up in one place. slots are claimed
+ * without a lock, this table cannot use spinlocks itself.
+ */
+static lockstat_t lockstats[LOCKSTAT_NR];
+
+static size_t lockstat_hash(const char *name)
+{
+    size_t h = 5381;
+    while (name && *name)
+        h = (h * 33) + *name++;
+    return h & (LOCKSTAT_NR - 1);
+}
+
+static lockstat_t *lockstat_lookup(const char *name)
+{
+    uintptr_t state = 0;
+    lockstat_t *ls = NULL;
+    size_t h = 0;
+
+    if (name == NULL)
+        name = "anonymous";
+    h = lockstat_hash(name);
+
+    for (size_t i = 0; i < LOCKSTAT_NR; ++i)
+    {
+        ls = &lockstats[(h + i) & (LOCKSTAT_NR - 1)];
+
+        state = 0;
+        if (__atomic_compare_exchange_n(&ls->state, &state, 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        {
+            safestrcpy(ls->name, name, sizeof ls->name);
+            atomic_write(&ls->state, 2);
+            return ls;
+        }
+
+        while (atomic_read(&ls->state) != 2)
+            CPU_RELAX(); // another cpu is filling the slot in.
+
+        if (!strncmp(ls->name, name, sizeof ls->name - 1))
+            return ls;
+    }
+
+    return NULL; // table full, this name goes uncounted.
+}
+
+void spin_stat_acquire(spinlock_t *__lock, size_t __spins)
+{
+    if (__lock->stat == NULL)
+        __lock->stat = lockstat_lookup(__lock->name);
+
+    __lock->tsc = (uint32_t)read_tsc();
+    if (__lock->stat == NULL)
+        return;
+
+    atomic_incr(&__lock->stat->acquired);
+    if (__spins)
+    {
+        atomic_incr(&__lock->stat->contended);
+        atomic_add(&__lock->stat->spins, __spins);
+    }
+}
+
+void spin_stat_release(spinlock_t *__lock)
+{
+    uintptr_t max = 0;
+    uint32_t held = (uint32_t)read_tsc() - __lock->tsc;
+
+    if (__lock->stat == NULL)
+        return;
+
+    max = atomic_read(&__lock->stat->max_hold);
+    while (held > max)
+    {
+        if (__atomic_compare_exchange_n(&__lock->stat->max_hold, &max, held, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            break;
+    }
+}
+
+void spin_stat_dump(void)
+{
+    lockstat_t *ls = NULL;
+
+    printk("%-32s %10s %10s %12s %12s\n", "lock", "acquired", "contended", "spins", "max hold");
+    for (size_t i = 0; i < LOCKSTAT_NR; ++i)
+    {
+        ls = &lockstats[i];
+        if (atomic_read(&ls->state) != 2 || !atomic_read(&ls->acquired))
+            continue;
+        printk("%-32s %10d %10d %12d %12d\n", ls->name, atomic_read(&ls->acquired),
+            atomic_read(&ls->contended), atomic_read(&ls->spins), atomic_read(&ls->max_hold));
+    }
+}
+
+void spin_stat_reset(void)
+{
+    for (size_t i = 0; i < LOCKSTAT_NR; ++i)
+    {
+        atomic_write(&lockstats[i].acquired, 0);
+        atomic_write(&lockstats[i].contended, 0);
+        atomic_write(&lockstats[i].spins, 0);
+        atomic_write(&lockstats[i].max_hold, 0);
+    }
+}
+
+#else
+
+#include <printk.h>
+
+void spin_stat_acquire(spinlock_t *__lock __unused, size_t __spins __unused) {}
+
+void spin_stat_release(spinlock_t *__lock __unused) {}
+
+void spin_stat_dump(void)
+{
+    printk("lock statistics not built in, rebuild with cppflags=-DSPINLOCK_STATS=1\n");
+}
+
+void spin_stat_reset(void) {}
+
+#endif // SPINLOCK_STATS
@@ -7,6 +7,13 @@
 #include <arch/i386/paging.h>
 #include <fs/fs.h>
 
+/**
+ * every mapping is on this list so the shrinker can find
+ * cached pages to reclaim when memory runs low.
+ */
+static mapping_t *mappings = NULL;
+static spinlock_t *mappings_lock = SPINLOCK_NEW("mappings");
+
 int mapping_new(mapping_t **pmap)
 {
     int err = 0;
@@ -31,6 +38,14 @@ int mapping_new(mapping_t **pmap)
 
     map->lock = lock;
     map->btree = btree;
+    map->ra_pages = MAPPING_RA_MIN;
+
+    spin_lock(mappings_lock);
+    if ((map->next = mappings))
+        mappings->prev = map;
+    mappings = map;
+    spin_unlock(mappings_lock);
+
     *pmap = map;
     return 0;
 error:
@@ -43,55 +58,95 @@ error:
     return err;
 }
 
+/* remove a page from the cache and drop the cache's reference to it. */
+static void mapping_drop_page(mapping_t *map, ssize_t pgno, page_t *page)
+{
+    btree_delete(map->btree, pgno);
+    map->nrpages--;
+    if (page->virtual)
+        paging_unmount(page->virtual);
+    page->virtual = 0;
+    page->mapping = NULL;
+    page_put(page);
+}
+
 void mapping_free(mapping_t *map)
 {
+    btree_node_t *node = NULL;
+
     if (map == NULL)
         panic("%s:%d: No map\n", __FILE__, __LINE__);
+
+    spin_lock(mappings_lock);
+    if (map->prev)
+        map->prev->next = map->next;
+    else if (mappings == map)
+        mappings = map->next;
+    if (map->next)
+        map->next->prev = map->prev;
+    spin_unlock(mappings_lock);
+
     if (map->btree)
+    {
+        btree_lock(map->btree);
+        while ((node = btree_least_node(map->btree)))
+            mapping_drop_page(map, node->key, node->data);
+        btree_unlock(map->btree);
         btree_free(map->btree);
+    }
+
     if (map->lock)
         spinlock_free(map->lock);
     *map = (mapping_t){0};
     kfree(map);
 }
 
-int mapping_get_page(mapping_t *map, ssize_t pgno, uintptr_t *pphys, page_t **ppage) {
+/**
+ * find page 'pgno' in the cache, or allocate it and read it in from the file.
+ * caller must hold the mapping lock. *phit tells whether the page was cached.
+ * a page past the end of the file is not cached, *ppage is set to NULL.
+ */
+static int mapping_fill(mapping_t *map, ssize_t pgno, gfp_mask_t gfp, page_t **ppage, int *phit)
+{
     int err = 0;
-    off_t offset = 0;
-    void *virt = NULL;
+    off_t offset = pgno * PAGESZ;
     page_t *page = NULL;
     ssize_t read_size = 0;
 
-    if ((pgno < 0) || (map == NULL))
-        return -EINVAL;
+    *ppage = NULL;
+    *phit = 0;
 
-    mapping_assert_locked(map);
-
-    if (map->inode->i_size == 0)
+    if ((size_t)offset >= map->inode->i_size)
         return 0;
 
     btree_lock(map->btree);
-    err = btree_search(map->btree, pgno, (void **)&page);
-    if (err == 0) {
+    if (btree_search(map->btree, pgno, (void **)&page) == 0) {
         btree_unlock(map->btree);
+        *phit = 1;
         goto done;
     }
 
-    if ((page = alloc_page(GFP_KERNEL)) == NULL) {
+    if ((page = alloc_page(gfp)) == NULL) {
         btree_unlock(map->btree);
         return -ENOMEM;
     }
 
     err = -ENOMEM;
-    if ((page->virtual = paging_mount(page_address(page))) == 0)
-        goto error;
+    if ((page->virtual = paging_mount(page_address(page))) == 0) {
+        btree_unlock(map->btree);
+        page_put(page);
+        return err;
+    }
 
     memset((void *)page->virtual, 0, PAGESZ);
 
-    err = btree_insert(map->btree, pgno, (void *)page);
+    if ((err = btree_insert(map->btree, pgno, (void *)page))) {
+        btree_unlock(map->btree);
+        paging_unmount(page->virtual);
+        page_put(page);
+        return err;
+    }
     btree_unlock(map->btree);
-        
-    if (err) goto error;
 
     map->nrpages++;
     page->mapping = map;
@@ -99,18 +154,27 @@ int mapping_get_page(mapping_t *map, ssize_t pgno, uintptr_t *pphys, page_t **pp
     page->flags.can_swap = 1;
 
 done:
-    if (page_valid(page) == 0)
+    if (page_valid(page) == 0 && (map->flags & MAPPING_MEMORY))
+    {
+        // a hole, the zeroed page is the file's data from now on.
+        page->flags.dirty = 1;
+        page->flags.valid = 1;
+        page->flags.read = 1;
+        page->flags.write = 1;
+        page->flags.exec = 1;
+    }
+    else if (page_valid(page) == 0)
     {
-        offset = pgno * PAGESZ;
-        virt = (void *)page->virtual;
         read_size = MIN(PAGESZ, (map->inode->i_size - offset));
 
-        if (!read_size) goto read_okay;
+        if (((ssize_t)map->inode->ifs->fsuper->iops->read(map->inode, offset, (void *)page->virtual, read_size) != read_size))
+        {
+            btree_lock(map->btree);
+            mapping_drop_page(map, pgno, page);
+            btree_unlock(map->btree);
+            return -EIO;
+        }
 
-        if (((ssize_t)map->inode->ifs->fsuper->iops->read(map->inode, offset, virt, read_size) != read_size))
-            goto error;
-
-    read_okay:
         page->flags.dirty = 0;
         page->flags.valid = 1;
         page->flags.read = 1;
@@ -118,30 +182,192 @@ done:
         page->flags.exec = 1;
     }
 
+    *ppage = page;
+    return 0;
+}
+
+/**
+ * bring up to 'nr' pages following 'pgno' into the cache.
+ * readahead never waits for memory, it stops at the first
+ * page it cannot get. caller must hold the mapping lock.
+ */
+int mapping_readahead(mapping_t *map, ssize_t pgno, size_t nr)
+{
+    int hit = 0;
+    size_t nread = 0;
+    page_t *page = NULL;
+
+    if ((pgno < 0) || (map == NULL))
+        return -EINVAL;
+
+    mapping_assert_locked(map);
+
+    for (size_t i = 1; i <= nr; ++i) {
+        if (mapping_fill(map, pgno + i, GFP_NORMAL, &page, &hit) || page == NULL)
+            break;
+        nread += !hit;
+    }
+
+    return nread;
+}
+
+int mapping_get_page(mapping_t *map, ssize_t pgno, uintptr_t *pphys, page_t **ppage) {
+    int err = 0;
+    int hit = 0;
+    page_t *page = NULL;
+
+    if ((pgno < 0) || (map == NULL))
+        return -EINVAL;
+
+    mapping_assert_locked(map);
+
+    if ((err = mapping_fill(map, pgno, GFP_KERNEL, &page, &hit)))
+        return err;
+
+    if (page == NULL) {
+        if (ppage) *ppage = NULL;
+        return 0;
+    }
+
+    if (!hit && !(map->flags & MAPPING_MEMORY)) {
+        /**
+         * a miss right where the last window ended means the file is being
+         * read sequentially, grow the window. any other miss starts over.
+         */
+        if (pgno == map->ra_next)
+            map->ra_pages = MIN(map->ra_pages * 2, MAPPING_RA_MAX);
+        else
+            map->ra_pages = MAPPING_RA_MIN;
+
+        mapping_readahead(map, pgno, map->ra_pages);
+        map->ra_next = pgno + map->ra_pages + 1;
+    }
+
     if (ppage) *ppage = page;
     if (pphys) *pphys = page_address(page);
 
     return 0;
-error:
-    if (page) page_put(page);
-    return err;
+}
+
+int mapping_find_page(mapping_t *map, ssize_t pgno, page_t **ppage)
+{
+    int err = 0;
+
+    if ((pgno < 0) || (map == NULL) || (ppage == NULL))
+        return -EINVAL;
+
+    mapping_assert_locked(map);
+
+    btree_lock(map->btree);
+    err = btree_search(map->btree, pgno, (void **)ppage);
+    btree_unlock(map->btree);
+
+    return err ? -ENOENT : 0;
+}
+
+void mapping_truncate(mapping_t *map, ssize_t pgno)
+{
+    btree_node_t *node = NULL;
+
+    if ((pgno < 0) || (map == NULL))
+        return;
+
+    mapping_assert_locked(map);
+
+    btree_lock(map->btree);
+    while ((node = btree_largest_node(map->btree)) && ((ssize_t)node->key >= pgno))
+        mapping_drop_page(map, node->key, node->data);
+    btree_unlock(map->btree);
 }
 
 int mapping_free_page(mapping_t *map, ssize_t pgno)
 {
     int err = 0;
     page_t *page = NULL;
-    
+
     if ((pgno < 0) || (map == NULL))
         return -EINVAL;
-    
+
     mapping_assert_locked(map);
 
     btree_lock(map->btree);
-    err = btree_search(map->btree, pgno, (void **)&page);
-    btree_delete(map->btree, pgno);
+    if ((err = btree_search(map->btree, pgno, (void **)&page)) == 0)
+        mapping_drop_page(map, pgno, page);
     btree_unlock(map->btree);
 
-    if (page) { map->nrpages--; page_put(page);}
     return err;
-}
\ No newline at end of file
+}
+
+static btree_node_t *btree_node_next(btree_node_t *node)
+{
+    if (node->right) {
+        for (node = node->right; node->left; node = node->left);
+        return node;
+    }
+
+    while (node->parent && node == node->parent->right)
+        node = node->parent;
+    return node->parent;
+}
+
+#define SHRINK_BATCH 16
+
+/**
+ * reclaim clean pages from one mapping. only pages held by nothing but the
+ * cache (ref_count == 1) are dropped, mapped pages hold an extra reference.
+ */
+static size_t mapping_shrink_one(mapping_t *map, size_t nr)
+{
+    size_t nvictims = 0, freed = 0;
+    btree_key_t victims[SHRINK_BATCH];
+    page_t *page = NULL;
+
+    btree_lock(map->btree);
+    while (freed < nr) {
+        nvictims = 0;
+        for (btree_node_t *node = btree_least_node(map->btree);
+             node && nvictims < SHRINK_BATCH && (freed + nvictims) < nr;
+             node = btree_node_next(node)) {
+            page = node->data;
+            if (page_dirty(page) || atomic_read(&page->ref_count) != 1)
+                continue;
+            victims[nvictims++] = node->key;
+        }
+
+        if (nvictims == 0)
+            break;
+
+        for (size_t i = 0; i < nvictims; ++i) {
+            if (btree_search(map->btree, victims[i], (void **)&page))
+                continue;
+            mapping_drop_page(map, victims[i], page);
+            freed++;
+        }
+    }
+    btree_unlock(map->btree);
+
+    return freed;
+}
+
+size_t mapping_shrink(size_t nr)
+{
+    size_t freed = 0;
+
+    /**
+     * called from the page allocator, possibly with some mapping locked,
+     * so only trylock here, a busy mapping is simply skipped.
+     */
+    if (!spin_trylock(mappings_lock))
+        return 0;
+
+    for (mapping_t *map = mappings; map && freed < nr; map = map->next) {
+        if ((map->flags & MAPPING_MEMORY) || !spin_trylock(map->lock))
+            continue;
+        if (map->nrpages)
+            freed += mapping_shrink_one(map, nr - freed);
+        spin_unlock(map->lock);
+    }
+
+    spin_unlock(mappings_lock);
+    return freed;
+}
@@ -2,16 +2,19 @@ mmapdir=$(mmdir)/mmap
 pmmdir=$(mmdir)/pmm
 vmmdir=$(mmdir)/vmm
 liballocdir=$(mmdir)/liballoc
+slabdir=$(mmdir)/slab
 
 include $(mmapdir)/mmap.mk
 include $(pmmdir)/pmm.mk
 include $(vmmdir)/vmm.mk
 include $(liballocdir)/liballoc.mk
+include $(slabdir)/slab.mk
 
 mmobjs:=\
 $(liballocobjs)\
 $(mmapobjs)\
 $(pmmobjs)\
+$(slabobjs)\
 $(vmmobjs)\
 $(mmdir)/mapping.o\
 $(mmdir)/usermap.o
\ No newline at end of file
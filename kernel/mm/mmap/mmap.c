@@ -1,7 +1,10 @@
 #include <mm/kalloc.h>
 #include <mm/mmap.h>
+#include <mm/slab.h>
 #include <mm/pmm.h>
 #include <arch/i386/paging.h>
+#include <arch/system.h>
+#include <lime/vdata.h>
 
 #include <printk.h>
 
@@ -69,6 +72,240 @@ void mmap_dump_list(mmap_t mmap)
 
 }
 
+static atomic_t vmr_gen = 0;
+
+/*Generations are global and never 0, so a stale vmr_hint_t can't match a recycled mmap_t*/
+#define __mmap_gen_bump(mmap) ((mmap)->vmr_gen = atomic_incr(&vmr_gen) + 1)
+
+/*Hole directly below 'r'*/
+#define __vmr_gap(r) ((r)->start - ((r)->prev ? __vmr_upper_bound((r)->prev) : 0))
+
+static int vmr_height(vmr_t *r)
+{
+    return r ? r->tree.height : 0;
+}
+
+static void vmr_recalc(vmr_t *r)
+{
+    size_t gap = __vmr_gap(r);
+
+    r->tree.height = 1 + MAX(vmr_height(r->tree.left), vmr_height(r->tree.right));
+    if (r->tree.left && r->tree.left->tree.max_gap > gap)
+        gap = r->tree.left->tree.max_gap;
+    if (r->tree.right && r->tree.right->tree.max_gap > gap)
+        gap = r->tree.right->tree.max_gap;
+    r->tree.max_gap = gap;
+}
+
+static vmr_t *vmr_rotate_right(vmr_t *r)
+{
+    vmr_t *left = r->tree.left;
+    r->tree.left = left->tree.right;
+    left->tree.right = r;
+    vmr_recalc(r);
+    vmr_recalc(left);
+    return left;
+}
+
+static vmr_t *vmr_rotate_left(vmr_t *r)
+{
+    vmr_t *right = r->tree.right;
+    r->tree.right = right->tree.left;
+    right->tree.left = r;
+    vmr_recalc(r);
+    vmr_recalc(right);
+    return right;
+}
+
+static vmr_t *vmr_balance(vmr_t *r)
+{
+    int balance = 0;
+
+    vmr_recalc(r);
+    balance = vmr_height(r->tree.left) - vmr_height(r->tree.right);
+
+    if (balance > 1)
+    {
+        if (vmr_height(r->tree.left->tree.left) < vmr_height(r->tree.left->tree.right))
+            r->tree.left = vmr_rotate_left(r->tree.left);
+        return vmr_rotate_right(r);
+    }
+    else if (balance < -1)
+    {
+        if (vmr_height(r->tree.right->tree.right) < vmr_height(r->tree.right->tree.left))
+            r->tree.right = vmr_rotate_right(r->tree.right);
+        return vmr_rotate_left(r);
+    }
+
+    return r;
+}
+
+/*'r' must already be linked into the region list, its gap depends on r->prev*/
+static vmr_t *vmr_tree_insert(vmr_t *node, vmr_t *r)
+{
+    if (node == NULL)
+    {
+        r->tree.left = r->tree.right = NULL;
+        vmr_recalc(r);
+        return r;
+    }
+
+    if (r->start < node->start)
+        node->tree.left = vmr_tree_insert(node->tree.left, r);
+    else
+        node->tree.right = vmr_tree_insert(node->tree.right, r);
+    return vmr_balance(node);
+}
+
+static vmr_t *vmr_tree_remove_min(vmr_t *node, vmr_t **pmin)
+{
+    if (node->tree.left == NULL)
+    {
+        *pmin = node;
+        return node->tree.right;
+    }
+
+    node->tree.left = vmr_tree_remove_min(node->tree.left, pmin);
+    return vmr_balance(node);
+}
+
+static vmr_t *vmr_tree_remove(vmr_t *node, vmr_t *r)
+{
+    vmr_t *min = NULL, *left = NULL, *right = NULL;
+
+    if (node == NULL)
+        return NULL;
+
+    if (r->start < node->start)
+        node->tree.left = vmr_tree_remove(node->tree.left, r);
+    else if (r->start > node->start)
+        node->tree.right = vmr_tree_remove(node->tree.right, r);
+    else
+    {
+        left = node->tree.left;
+        right = node->tree.right;
+        node->tree.left = node->tree.right = NULL;
+
+        if (right == NULL)
+            return left;
+
+        right = vmr_tree_remove_min(right, &min);
+        min->tree.left = left;
+        min->tree.right = right;
+        return vmr_balance(min);
+    }
+
+    return vmr_balance(node);
+}
+
+/*Refresh the augmented data on the path down to 'r' after its bounds or neighbours changed*/
+static void vmr_tree_fix(vmr_t *node, vmr_t *r)
+{
+    if (node == NULL)
+        return;
+
+    if (r->start < node->start)
+        vmr_tree_fix(node->tree.left, r);
+    else if (r->start > node->start)
+        vmr_tree_fix(node->tree.right, r);
+    vmr_recalc(node);
+}
+
+/*'r' was resized in place, its own gap and that of the region above it changed*/
+static void vmr_moved(mmap_t *mmap, vmr_t *r)
+{
+    vmr_tree_fix(mmap->vmr_root, r);
+    if (r->next)
+        vmr_tree_fix(mmap->vmr_root, r->next);
+    __mmap_gen_bump(mmap);
+}
+
+/*Last region starting below 'addr'*/
+static vmr_t *vmr_tree_below(mmap_t *mmap, uintptr_t addr)
+{
+    vmr_t *best = NULL;
+
+    for (vmr_t *r = mmap->vmr_root; r; )
+    {
+        if (r->start < addr)
+        {
+            best = r;
+            r = r->tree.right;
+        }
+        else
+            r = r->tree.left;
+    }
+
+    return best;
+}
+
+/*First region starting above 'addr'*/
+static vmr_t *vmr_tree_above(mmap_t *mmap, uintptr_t addr)
+{
+    vmr_t *best = NULL;
+
+    for (vmr_t *r = mmap->vmr_root; r; )
+    {
+        if (r->start > addr)
+        {
+            best = r;
+            r = r->tree.left;
+        }
+        else
+            r = r->tree.right;
+    }
+
+    return best;
+}
+
+/*Lowest region starting above 'lo' with a hole of at least 'size' just below it*/
+static vmr_t *vmr_first_fit(vmr_t *node, size_t size, uintptr_t lo)
+{
+    vmr_t *r = NULL;
+
+    if (node == NULL || node->tree.max_gap < size)
+        return NULL;
+
+    if (node->start > lo)
+    {
+        if ((r = vmr_first_fit(node->tree.left, size, lo)))
+            return r;
+        if (__vmr_gap(node) >= size)
+            return node;
+    }
+
+    return vmr_first_fit(node->tree.right, size, lo);
+}
+
+/*Highest region starting at or below 'hi' with a hole of at least 'size' just below it*/
+static vmr_t *vmr_last_fit(vmr_t *node, size_t size, uintptr_t hi)
+{
+    vmr_t *r = NULL;
+
+    if (node == NULL || node->tree.max_gap < size)
+        return NULL;
+
+    if (node->start <= hi)
+    {
+        if ((r = vmr_last_fit(node->tree.right, size, hi)))
+            return r;
+        if (__vmr_gap(node) >= size)
+            return node;
+    }
+
+    return vmr_last_fit(node->tree.left, size, hi);
+}
+
+/*Size of the hole above the last region*/
+static size_t mmap_top_hole(mmap_t *mmap)
+{
+    if (mmap->vmr_tail == NULL)
+        return (mmap->limit + 1);
+    if (mmap->vmr_tail->end >= mmap->limit)
+        return 0;
+    return mmap->limit - mmap->vmr_tail->end;
+}
+
 int mmap_init(mmap_t *mmap)
 {
     int err = 0;
@@ -81,7 +318,10 @@ int mmap_init(mmap_t *mmap)
     if ((err = mmap_clean(mmap)))
         return err;
 
-    if ((err = mmap_map_region(mmap, 0, 0x1000000, 0, MAP_FIXED | MAP_PRIVATE | MAP_DONTEXPAND, NULL)))
+    if ((err = mmap_map_region(mmap, 0, VDATA_ADDR, 0, MAP_FIXED | MAP_PRIVATE | MAP_DONTEXPAND, NULL)))
+        return err;
+
+    if ((err = vdata_map(mmap)))
         return err;
 
     return 0;
@@ -110,6 +350,13 @@ int mmap_alloc(mmap_t **ref)
     }
 
     memset(mmap, 0, sizeof *mmap);
+
+    if ((mmap->vdata = vdata_proc_alloc()) == 0) {
+        kfree(mmap);
+        pmman.free(pgdir);
+        spinlock_free(lock);
+        return -ENOMEM;
+    }
     
     mmap->lock = lock;
     mmap->pgdir = pgdir;
@@ -127,8 +374,6 @@ int mmap_alloc(mmap_t **ref)
 
 int mmap_mapin(mmap_t *mmap, vmr_t *r)
 {
-    size_t holesz = 0;
-    uintptr_t addr = 0;
     vmr_t *left = NULL, *right = NULL;
 
     if (mmap == NULL || r == NULL)
@@ -145,16 +390,11 @@ int mmap_mapin(mmap_t *mmap, vmr_t *r)
     if (mmap_contains(mmap, r))
         return -EEXIST;
 
-    addr = r->start;
-    while (addr <= r->end)
-    {
-        if (mmap_find(mmap, addr))
-            return -EEXIST;
-        mmap_holesize(mmap, addr, &holesz);
-        addr += holesz;
-        if (holesz == 0)
-            printk("%s:%d: endless loop\n", __FILE__, __LINE__);
-    }
+    /*Any region overlapping 'r' either contains r->start or starts inside 'r'*/
+    if (mmap_find(mmap, r->start))
+        return -EEXIST;
+    if ((right = vmr_tree_above(mmap, r->start)) && right->start <= r->end)
+        return -EEXIST;
 
     r->next = NULL;
     r->prev = NULL;
@@ -167,18 +407,8 @@ int mmap_mapin(mmap_t *mmap, vmr_t *r)
         goto done;
     }
 
-    right = mmap->vmr_head;
-    for (; right && right->start < r->start;)
-    {
-        if (__vmr_upper_bound(right) <= r->start)
-            left = right;
-        right = right->next;
-    }
-
-    if (left && left->start > r->start)
-    {
-        left = NULL;
-    }
+    left = vmr_tree_below(mmap, r->start);
+    right = left ? left->next : mmap->vmr_head;
 
     if (left)
     {
@@ -232,6 +462,11 @@ int mmap_mapin(mmap_t *mmap, vmr_t *r)
     }
 
 done:
+    mmap->vmr_root = vmr_tree_insert(mmap->vmr_root, r);
+    if (r->next)
+        vmr_tree_fix(mmap->vmr_root, r->next);
+    __mmap_gen_bump(mmap);
+
     r->mmap = mmap;
     mmap->refs++;
     mmap->used_space += __vmr_size(r);
@@ -258,16 +493,13 @@ int mmap_contains(mmap_t *mmap, vmr_t *r)
 
     mmap_assert_locked(mmap);
 
-    forlinked(tmp, mmap->vmr_head, tmp->next)
-    {
-        if (tmp == r)
-            return 1;
-    }
-    return 0;
+    return mmap_find(mmap, r->start) == r;
 }
 
 int mmap_remove(mmap_t *mmap, vmr_t *r)
 {
+    vmr_t *next = NULL;
+
     if (mmap == NULL || r == NULL)
         return -EINVAL;
 
@@ -276,6 +508,9 @@ int mmap_remove(mmap_t *mmap, vmr_t *r)
     if (!mmap_contains(mmap, r))
         return -ENOENT;
 
+    next = r->next;
+    mmap->vmr_root = vmr_tree_remove(mmap->vmr_root, r);
+
     if (r->prev)
     {
         r->prev->next = r->next;
@@ -308,6 +543,10 @@ int mmap_remove(mmap_t *mmap, vmr_t *r)
         }
     }
 
+    if (next)
+        vmr_tree_fix(mmap->vmr_root, next);
+    __mmap_gen_bump(mmap);
+
     r->refs--;
     r->mmap = NULL;
     mmap->refs--;
@@ -324,15 +563,45 @@ vmr_t *mmap_find(mmap_t *mmap, uintptr_t addr)
 
     mmap_assert_locked(mmap);
 
-    forlinked(tmp, mmap->vmr_head, tmp->next)
+    for (vmr_t *r = mmap->vmr_root; r; )
     {
-        if (addr >= tmp->start && addr <= tmp->end)
-            return tmp;
+        if (addr < r->start)
+            r = r->tree.left;
+        else if (addr > r->end)
+            r = r->tree.right;
+        else
+            return r;
     }
 
     return NULL;
 }
 
+vmr_t *mmap_find_hinted(mmap_t *mmap, uintptr_t addr, vmr_hint_t *hint)
+{
+    vmr_t *r = NULL;
+
+    if (mmap == NULL)
+        return NULL;
+
+    mmap_assert_locked(mmap);
+
+    if (hint && hint->mmap == mmap && hint->gen == mmap->vmr_gen)
+    {
+        r = hint->vmr;
+        if (addr >= r->start && addr <= r->end)
+            return r;
+    }
+
+    if ((r = mmap_find(mmap, addr)) && hint)
+    {
+        hint->mmap = mmap;
+        hint->vmr = r;
+        hint->gen = mmap->vmr_gen;
+    }
+
+    return r;
+}
+
 vmr_t *mmap_find_exact(mmap_t *mmap, uintptr_t start, uintptr_t end)
 {
     vmr_t *vmr = NULL;
@@ -363,14 +632,7 @@ vmr_t *mmap_find_vmr_next(mmap_t *mmap, uintptr_t addr, vmr_t **pnext)
         return r;
     }
 
-    forlinked(tmp, mmap->vmr_head, tmp->next)
-    {
-        if (addr < tmp->start)
-        {
-            *pnext = tmp;
-            return NULL;
-        }
-    }
+    *pnext = vmr_tree_above(mmap, addr);
     return NULL;
 }
 
@@ -390,14 +652,7 @@ vmr_t *mmap_find_vmr_prev(mmap_t *mmap, uintptr_t addr, vmr_t **pprev)
         return r;
     }
 
-    forlinked(tmp, mmap->vmr_tail, tmp->prev)
-    {
-        if (tmp->end < addr)
-        {
-            *pprev = tmp;
-            return NULL;
-        }
-    }
+    *pprev = vmr_tree_below(mmap, addr);
     return NULL;
 }
 
@@ -470,6 +725,7 @@ int mmap_unmap(mmap_t *mmap, uintptr_t start, size_t len)
                 if (__vmr_size(vmr) > len)
                 {
                     vmr->start += len;
+                    vmr_moved(mmap, vmr);
                     len = 0;
                 }
                 else if (__vmr_size(vmr) < len)
@@ -482,6 +738,7 @@ int mmap_unmap(mmap_t *mmap, uintptr_t start, size_t len)
             else if (vmr->end == start)
             {
                 vmr->end -= 1;
+                vmr_moved(mmap, vmr);
             }
             else
                 vmr_split(vmr, start, NULL);
@@ -505,7 +762,7 @@ int mmap_unmap(mmap_t *mmap, uintptr_t start, size_t len)
 
 int mmap_find_hole(mmap_t *mmap, size_t size, uintptr_t *paddr, int whence)
 {
-    size_t holesz = 0;
+    vmr_t *r = NULL;
 
     if (mmap == NULL || paddr == NULL || size == 0)
         return -EINVAL;
@@ -516,203 +773,95 @@ int mmap_find_hole(mmap_t *mmap, size_t size, uintptr_t *paddr, int whence)
 
     if (whence == __whence_start)
     {
-        mmap_holesize(mmap, 0, &holesz);
-        if (holesz >= size)
+        /*Lowest hole below some region, else the hole above the last one*/
+        if ((r = vmr_first_fit(mmap->vmr_root, size, 0)))
         {
-            *paddr = 0;
+            *paddr = r->prev ? __vmr_upper_bound(r->prev) : 0;
             return 0;
         }
 
-        forlinked(tmp, mmap->vmr_head, __vmr_next(tmp))
+        if (mmap_top_hole(mmap) >= size)
         {
-            if (__vmr_next(tmp))
-            {
-                holesz = __vmr_next(tmp)->start - __vmr_upper_bound(tmp);
-                if (holesz >= size)
-                {
-                    *paddr = __vmr_upper_bound(tmp);
-                    return 0;
-                }
-                continue;
-            }
-            mmap_holesize(mmap, __vmr_upper_bound(tmp), &holesz);
-            if (holesz >= size)
-            {
-                *paddr = __vmr_upper_bound(tmp);
-                return 0;
-            }
-            goto error;
+            *paddr = mmap->vmr_tail ? __vmr_upper_bound(mmap->vmr_tail) : 0;
+            return 0;
         }
     }
     else if (whence == __whence_end)
     {
-        mmap_holesize(mmap, (mmap->limit + 1) - size, &holesz);
-        if (holesz >= size)
+        /*Top of the hole above the last region, else the highest hole below some region*/
+        if (mmap_top_hole(mmap) >= size)
         {
             *paddr = (mmap->limit + 1) - size;
             return 0;
         }
 
-        forlinked(tmp, mmap->vmr_tail, __vmr_prev(tmp))
+        if ((r = vmr_last_fit(mmap->vmr_root, size, mmap->limit)))
         {
-            if (__vmr_prev(tmp))
-            {
-                holesz = tmp->start - __vmr_upper_bound(__vmr_prev(tmp));
-                if (holesz >= size)
-                {
-                    *paddr = tmp->start - size;
-                    return 0;
-                }
-                continue;
-            }
-
-            if (__vmr_lower_bound(tmp) > (uintptr_t)NULL)
-            {
-                holesz = tmp->start;
-                if (holesz >= size)
-                {
-                    *paddr = tmp->start - size;
-                    return 0;
-                }
-            }
+            *paddr = r->start - size;
+            return 0;
         }
     }
 
-error:
     return -ENOMEM;
 }
 
 int mmap_find_holeat(mmap_t *mmap, uintptr_t addr, size_t size, uintptr_t *paddr, int whence)
 {
     size_t holesz = 0;
-    vmr_t *near_vmr = NULL;
+    vmr_t *r = NULL, *next = NULL;
 
     if (mmap == NULL || paddr == NULL || size == 0)
         return -EINVAL;
 
     mmap_assert_locked(mmap);
 
-    if (addr)
-    {
-        if (whence == __whence_start)
-            mmap_find_vmr_next(mmap, addr, &near_vmr);
-        else if (whence == __whence_end)
-            mmap_find_vmr_prev(mmap, addr, &near_vmr);
-    }
-
     *paddr = 0;
 
     if (whence == __whence_start)
     {
-
-        mmap_holesize(mmap, addr, &holesz);
-        if (holesz >= size)
+        /*'addr' itself if the hole there is big enough*/
+        if (!mmap_holesize(mmap, addr, &holesz) && holesz >= size)
         {
             *paddr = addr;
             return 0;
         }
 
-        near_vmr = near_vmr ? near_vmr : mmap->vmr_head;
-
-        if (near_vmr && near_vmr->prev)
+        /*Else the first hole at or above 'addr'*/
+        if ((r = vmr_first_fit(mmap->vmr_root, size, addr)))
         {
-            holesz = near_vmr->start - __vmr_upper_bound(__vmr_prev(near_vmr));
-            if (holesz >= size)
-            {
-                *paddr = __vmr_upper_bound(__vmr_prev(near_vmr));
-                return 0;
-            }
+            *paddr = r->prev ? __vmr_upper_bound(r->prev) : 0;
+            return 0;
         }
 
-        forlinked(tmp, near_vmr, __vmr_next(tmp))
+        if (mmap->vmr_tail && mmap->vmr_tail->end >= addr && mmap_top_hole(mmap) >= size)
         {
-            if (__vmr_next(tmp))
-            {
-                holesz = __vmr_next(tmp)->start - __vmr_upper_bound(tmp);
-                if (holesz >= size)
-                {
-                    *paddr = __vmr_upper_bound(tmp);
-                    return 0;
-                }
-                continue;
-            }
-            mmap_holesize(mmap, __vmr_upper_bound(tmp), &holesz);
-            if (holesz >= size)
-            {
-                *paddr = __vmr_upper_bound(tmp);
-                return 0;
-            }
-            goto error;
+            *paddr = __vmr_upper_bound(mmap->vmr_tail);
+            return 0;
         }
     }
-    else if (whence == __whence_end)
+    else if (whence == __whence_end && addr)
     {
-        near_vmr = near_vmr ? near_vmr : mmap->vmr_tail;
-
-        if (near_vmr)
-            goto find1;
-
-        mmap_holesize(mmap, (mmap->limit + 1) - size, &holesz);
-        if (holesz >= size)
+        /*Top of the hole holding 'addr' if it is big enough*/
+        if (mmap_find(mmap, addr) == NULL)
         {
-            *paddr = (mmap->limit + 1) - size;
-            return 0;
-        }
-
-    find1:
-        if (near_vmr)
-        {
-            if (near_vmr->next)
-            {
-                holesz = __vmr_next(near_vmr)->start - __vmr_upper_bound(near_vmr);
-                if (holesz >= size)
-                {
-                    *paddr = __vmr_next(near_vmr)->start - size;
-                    return 0;
-                }
-            }
-            else
+            r = vmr_tree_below(mmap, addr);
+            mmap_find_vmr_next(mmap, addr, &next);
+            holesz = (next ? next->start : (mmap->limit + 1)) - (r ? __vmr_upper_bound(r) : 0);
+            if (holesz >= size)
             {
-                mmap_holesize(mmap, __vmr_upper_bound(near_vmr), &holesz);
-                if (holesz > size)
-                {
-                    *paddr = __vmr_upper_bound(near_vmr) + holesz - size;
-                    return 0;
-                }
-                else if (holesz == size)
-                {
-                    *paddr = __vmr_upper_bound(near_vmr);
-                    return 0;
-                }
+                *paddr = (next ? next->start : (mmap->limit + 1)) - size;
+                return 0;
             }
         }
 
-        forlinked(tmp, near_vmr, __vmr_prev(tmp))
+        /*Else the highest hole below 'addr'*/
+        if ((r = vmr_last_fit(mmap->vmr_root, size, addr)))
         {
-            if (__vmr_prev(tmp))
-            {
-                holesz = tmp->start - __vmr_upper_bound(__vmr_prev(tmp));
-                if (holesz >= size)
-                {
-                    *paddr = tmp->start - size;
-                    return 0;
-                }
-                continue;
-            }
-
-            if (__vmr_lower_bound(tmp) > (uintptr_t)NULL)
-            {
-                holesz = tmp->start;
-                if (holesz >= size)
-                {
-                    *paddr = tmp->start - size;
-                    return 0;
-                }
-            }
+            *paddr = r->start - size;
+            return 0;
         }
     }
 
-error:
     return mmap_find_hole(mmap, size, paddr, whence);
 }
 
@@ -853,6 +1002,7 @@ int mmap_vmr_expand(mmap_t *mmap, vmr_t *r, intptr_t incr)
             if (holesz >= (size_t)incr)
             {
                 r->end = r->start + newsz - 1;
+                vmr_moved(mmap, r);
                 return 0;
             }
             return -ENOMEM;
@@ -865,6 +1015,7 @@ int mmap_vmr_expand(mmap_t *mmap, vmr_t *r, intptr_t incr)
 
         /*Reduce the size of the region*/
         r->end -= oldsz - newsz;
+        vmr_moved(mmap, r);
         return 0;
     }
     else if (__vmr_growsdown(r))
@@ -877,6 +1028,7 @@ int mmap_vmr_expand(mmap_t *mmap, vmr_t *r, intptr_t incr)
             if (holesz >= (size_t)incr)
             {
                 r->start = hole_addr;
+                vmr_moved(mmap, r);
                 return 0;
             }
             return -ENOMEM;
@@ -889,6 +1041,7 @@ int mmap_vmr_expand(mmap_t *mmap, vmr_t *r, intptr_t incr)
 
         /*Reduce the size of the region*/
         r->start += oldsz - newsz;
+        vmr_moved(mmap, r);
         return 0;
     }
 
@@ -916,7 +1069,7 @@ int mmap_protect(mmap_t *mmap, uintptr_t addr, size_t len, int prot)
     if ((r = mmap_find_vmr_overlap(mmap, addr, end)) == NULL)
         return -ENOMEM;
     
-    if (__isstack(r))
+    if (__isstack(r) || __vmr_vdata(r))
         return -EACCES;
 
     forge_prot |= __vmr_read(r) ? PROT_READ : 0;
@@ -943,14 +1096,17 @@ int mmap_protect(mmap_t *mmap, uintptr_t addr, size_t len, int prot)
         tmp = *split0 = *r;
         split0->refs = 0;
         split0->prev = split0->next = NULL;
+        split0->tree.left = split0->tree.right = NULL;
 
         if (r->start == addr)
         {
             r->end = end;
+            vmr_moved(mmap, r);
             split0->start = __vmr_upper_bound(r);
             if ((err = mmap_mapin(mmap, split0)))
             {
                 r->end = split0->end;
+                vmr_moved(mmap, r);
                 vmr_free(split0);
                 return err;
             }
@@ -958,11 +1114,13 @@ int mmap_protect(mmap_t *mmap, uintptr_t addr, size_t len, int prot)
         else if (r->end == end)
         {
             r->start = addr;
+            vmr_moved(mmap, r);
             split0->end = __vmr_lower_bound(r);
 
             if ((err = mmap_mapin(mmap, split0)))
             {
                 r->start = split0->start;
+                vmr_moved(mmap, r);
                 vmr_free(split0);
                 return err;
             }
@@ -976,17 +1134,21 @@ int mmap_protect(mmap_t *mmap, uintptr_t addr, size_t len, int prot)
             }
 
             *split1 = *r;
-            split0->refs = 0;
+            split1->refs = 0;
             split1->prev = split1->next = NULL;
+            split1->tree.left = split1->tree.right = NULL;
 
             r->start = addr;
             split0->end = __vmr_lower_bound(r);
             r->end = end;
             split1->start = __vmr_upper_bound(r);
+            vmr_moved(mmap, r);
 
             if ((err = mmap_mapin(mmap, split0)))
             {
-                *r = tmp;
+                r->start = tmp.start;
+                r->end = tmp.end;
+                vmr_moved(mmap, r);
                 vmr_free(split0);
                 vmr_free(split1);
                 return err;
@@ -994,9 +1156,10 @@ int mmap_protect(mmap_t *mmap, uintptr_t addr, size_t len, int prot)
 
             if ((err = mmap_mapin(mmap, split1)))
             {
-                *r = tmp;
                 mmap_remove(mmap, split0);
-                vmr_free(split0);
+                r->start = tmp.start;
+                r->end = tmp.end;
+                vmr_moved(mmap, r);
                 vmr_free(split1);
                 return err;
             }
@@ -1015,7 +1178,7 @@ int mmap_protect(mmap_t *mmap, uintptr_t addr, size_t len, int prot)
 int mmap_clean(mmap_t *mmap)
 {
     int err = 0;
-    uintptr_t pgdir = 0;
+    uintptr_t pgdir = 0, vdata = 0;
     spinlock_t *lock = NULL;
 
     if (mmap == NULL)
@@ -1029,11 +1192,13 @@ int mmap_clean(mmap_t *mmap)
     paging_proc_unmap(mmap->pgdir);
     lock = mmap->lock;
     pgdir = mmap->pgdir;
+    vdata = mmap->vdata;
 
     memset(mmap, 0, sizeof *mmap);
 
     mmap->lock = lock;
     mmap->pgdir = pgdir;
+    mmap->vdata = vdata;
     mmap->flags = MMAP_USER;
     mmap->guard_len = PAGESZ;
     mmap->limit = __mmap_limit;
@@ -1053,6 +1218,9 @@ void mmap_free(mmap_t *mmap)
     {
         if (mmap->pgdir)
             pmman.free(mmap->pgdir);
+
+        if (mmap->vdata)
+            pmman.free(mmap->vdata);
         
         if (mmap->lock)
             spinlock_free(mmap->lock);
@@ -1083,6 +1251,7 @@ int mmap_copy(mmap_t *dst, mmap_t *src)
     dst->priv = NULL;
     dst->used_space = 0;
     dst->vmr_head = dst->vmr_tail = NULL;
+    dst->vmr_root = NULL;
     dst->heap = dst->arg = dst->env = NULL;
 
     forlinked(tmp, src->vmr_head, tmp->next)
@@ -1101,6 +1270,13 @@ int mmap_copy(mmap_t *dst, mmap_t *src)
     dst->env = src->env ? mmap_find(dst, src->env->start) : NULL;
     dst->heap = src->heap ? mmap_find(dst, src->heap->start) : NULL;
 
+    /**
+     * the per-process vdata page must not be shared with 'dst',
+     * drop it from 'src' so each side faults in its own frame.
+     */
+    if (src->pgdir == PGROUND(read_cr3()))
+        paging_unmap_mapped(VDATA_PROC_ADDR, PAGESZ);
+
     if ((err = paging_lazycopy(dst->pgdir, src->pgdir)))
         return err;
 
@@ -1136,23 +1312,23 @@ int mmap_clone(mmap_t *mmap, mmap_t **pclone)
     return 0;
 }
 
+static kmem_cache_t *vmr_cache = KMEM_CACHE_NEW("vmr", sizeof(vmr_t), NULL);
+
 void vmr_free(vmr_t *r)
 {
     if (r == NULL)
         return;
     if (r->refs <= 0)
     {
-        *r = (vmr_t){0};
-        kfree(r);
+        kmem_cache_free(vmr_cache, r);
     }
 }
 
 int vmr_alloc(vmr_t **ref)
 {
     vmr_t *r = NULL;
-    if ((r = kmalloc(sizeof *r)) == NULL)
+    if ((r = kmem_cache_alloc(vmr_cache, GFP_ZERO)) == NULL)
         return -ENOMEM;
-    memset(r, 0, sizeof *r);
     *ref = r;
     return 0;
 }
@@ -1171,24 +1347,29 @@ int vmr_split(vmr_t *r, uintptr_t addr, vmr_t **pvmr)
     if (r == NULL || !vmr_can_split(r, addr))
         return -EINVAL;
     
-    *pvmr = NULL;
+    if (pvmr)
+        *pvmr = NULL;
 
     if ((err = vmr_alloc(&new)))
         return err;
 
     new->end = r->end;
     new->start = addr;
-    new->file = r->file;
     new->flags = r->flags;
     new->vflags = r->vflags;
 
-    if (new->file)
-        new->file_pos += addr - r->start;
+    if ((new->file = r->file)) {
+        new->file_pos = r->file_pos + (addr - r->start);
+        new->filesz = (r->filesz > addr - r->start) ? r->filesz - (addr - r->start) : 0;
+    }
 
     r->end = addr - 1;
+    vmr_moved(r->mmap, r);
 
     if ((err = mmap_mapin(r->mmap, new)))
     {
+        r->end = new->end;
+        vmr_moved(r->mmap, r);
         vmr_free(new);
         return err;
     }
@@ -1211,6 +1392,7 @@ int vmr_copy(vmr_t *rdst, vmr_t *rsrc)
     rdst->mmap = NULL;
     rdst->priv = NULL;
     rdst->next = rdst->prev = NULL;
+    rdst->tree.left = rdst->tree.right = NULL;
     return 0;
 }
 
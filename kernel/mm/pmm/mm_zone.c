@@ -239,6 +239,9 @@ int physical_memory(void)
         }
     }
 
+    if ((err = mm_zone_buddy_init()))
+        return err;
+
     return paging_init();
 }
 
@@ -1,7 +1,14 @@
 #include <mm/mm_zone.h>
+#include <mm/mapping.h>
 #include <mm/pmm.h>
 #include <sys/kthread.h>
+#include <sys/sched.h>
 #include <arch/i386/paging.h>
+#include <arch/i386/cpu.h>
+#include <arch/system.h>
+#include <lib/string.h>
+#include <lime/preempt.h>
+#include <printk.h>
 
 uintptr_t mm_alloc(void);
 void mm_free(uintptr_t);
@@ -16,66 +23,415 @@ struct pmman pmman = {
     .init = physical_memory,
 };
 
-page_t *alloc_pages(gfp_mask_t gfp, size_t order)
+static void buddy_list_add(mm_zone_t *zone, page_t *page, size_t order)
+{
+    mm_free_area_t *area = &zone->free_area[order];
+
+    page->flags.buddy = 1;
+    page->flags.order = order;
+    page->prev = NULL;
+    if ((page->next = area->head))
+        area->head->prev = page;
+    area->head = page;
+    area->nr_free++;
+}
+
+static void buddy_list_del(mm_zone_t *zone, page_t *page)
+{
+    mm_free_area_t *area = &zone->free_area[page->flags.order];
+
+    if (page->prev)
+        page->prev->next = page->next;
+    else
+        area->head = page->next;
+    if (page->next)
+        page->next->prev = page->prev;
+
+    page->next = NULL;
+    page->prev = NULL;
+    page->flags.buddy = 0;
+    page->flags.order = 0;
+    area->nr_free--;
+}
+
+/**
+ * take a free block of 'order' off the zone's free lists,
+ * splitting the smallest larger block if no block of 'order' is free.
+ * returns the first page of the block or NULL if the zone can't satisfy 'order'.
+ */
+static page_t *buddy_alloc(mm_zone_t *zone, size_t order)
+{
+    size_t index = 0;
+    size_t current_order = order;
+    page_t *page = NULL;
+
+    mm_zone_assert_locked(zone);
+
+    while ((current_order < MM_MAX_ORDER) && !zone->free_area[current_order].head)
+        current_order++;
+
+    if (current_order >= MM_MAX_ORDER)
+        return NULL;
+
+    page = zone->free_area[current_order].head;
+    buddy_list_del(zone, page);
+    index = page - zone->pages;
+
+    // give back the upper halves until the block is of the requested size.
+    while (current_order > order) {
+        current_order--;
+        buddy_list_add(zone, &zone->pages[index + _BS(current_order)], current_order);
+    }
+
+    return page;
+}
+
+/**
+ * return the block of 'order' starting at 'index' to the zone's free lists,
+ * merging it with its buddy for as long as the buddy is also free.
+ */
+static void buddy_free(mm_zone_t *zone, size_t index, size_t order)
+{
+    size_t buddy = 0;
+    page_t *page = NULL;
+
+    mm_zone_assert_locked(zone);
+
+    for (; order < (MM_MAX_ORDER - 1); ++order) {
+        buddy = index ^ _BS(order);
+        if ((buddy + _BS(order)) > zone->nrpages)
+            break;
+
+        page = &zone->pages[buddy];
+        if (!page->flags.buddy || (page->flags.order != order))
+            break;
+
+        buddy_list_del(zone, page);
+        index &= ~_BS(order);
+    }
+
+    buddy_list_add(zone, &zone->pages[index], order);
+}
+
+/**
+ * fallback used before mm_zone_buddy_init(),
+ * physical_memory() still needs page tables while it reserves memory.
+ */
+static page_t *linear_alloc(mm_zone_t *zone, size_t npages)
 {
     size_t index = 0;
     size_t start = 0;
+    size_t alloced = 0;
+
+    mm_zone_assert_locked(zone);
+
+    for (start = index = 0; index < zone->nrpages; ++index) {
+        if (zone->pages[index].ref_count) {
+            alloced = 0;
+            start = index + 1;
+            continue;
+        }
+
+        if ((++alloced) == npages)
+            return &zone->pages[start];
+    }
+
+    return NULL;
+}
+
+int mm_zone_buddy_init(void)
+{
+    mm_zone_t *zone = NULL;
+
+    for (int z = MM_ZONE_DMA; z <= MM_ZONE_HIGH; ++z) {
+        if (!(zone = mm_zone_get(z)))
+            continue;
+
+        for (size_t order = 0; order < MM_MAX_ORDER; ++order) {
+            zone->free_area[order].head = NULL;
+            zone->free_area[order].nr_free = 0;
+        }
+
+        for (size_t index = 0; index < zone->nrpages; ++index) {
+            if (atomic_read(&zone->pages[index].ref_count))
+                continue;
+            buddy_free(zone, index, 0);
+        }
+
+        zone->flags |= MM_ZONE_BUDDY;
+        mm_zone_unlock(zone);
+    }
+
+    return 0;
+}
+
+static void page_reset(page_t *page)
+{
+    page->mapping = NULL;
+    page->virtual = 0;
+    page->flags.read = 0;
+    page->flags.can_swap = 1;
+    page->flags.dirty = 0;
+    page->flags.exec = 0;
+    page->flags.shared = 0;
+    page->flags.swapped = 0;
+    page->flags.user = 0;
+    page->flags.valid = 0;
+    page->flags.write = 0;
+    page->flags.writeback = 0;
+}
+
+/**
+ * zone a physical address belongs to, without taking the zone lock.
+ * zone boundaries never change once physical_memory() has run.
+ */
+static mm_zone_t *mm_zone_lookup(uintptr_t addr)
+{
+    mm_zone_t *zone = NULL;
+
+    for (zone = mm_zone; zone <= &mm_zone[MM_ZONE_HIGH]; ++zone) {
+        if (!(zone->flags & MM_ZONE_VALID))
+            continue;
+        if ((addr >= zone->start) && ((addr - zone->start) / PAGESZ) < zone->nrpages)
+            return zone;
+    }
+
+    return NULL;
+}
+
+static void pcp_list_push(pcp_list_t *list, page_t *page)
+{
+    page->prev = NULL;
+    if ((page->next = list->head))
+        list->head->prev = page;
+    else
+        list->tail = page;
+    list->head = page;
+    list->count++;
+}
+
+static void pcp_list_append(pcp_list_t *list, page_t *page)
+{
+    page->next = NULL;
+    if ((page->prev = list->tail))
+        list->tail->next = page;
+    else
+        list->head = page;
+    list->tail = page;
+    list->count++;
+}
+
+static page_t *pcp_list_pop(pcp_list_t *list)
+{
+    page_t *page = list->head;
+
+    if (!page)
+        return NULL;
+
+    if ((list->head = page->next))
+        list->head->prev = NULL;
+    else
+        list->tail = NULL;
+    page->next = NULL;
+    list->count--;
+    return page;
+}
+
+static page_t *pcp_list_pop_tail(pcp_list_t *list)
+{
+    page_t *page = list->tail;
+
+    if (!page)
+        return NULL;
+
+    if ((list->tail = page->prev))
+        list->tail->next = NULL;
+    else
+        list->head = NULL;
+    page->prev = NULL;
+    list->count--;
+    return page;
+}
+
+// give up to 'count' of the coldest pages on 'list' back to the zone.
+static void pcp_drain(mm_zone_t *zone, mm_pcp_t *pcp, pcp_list_t *list, size_t count)
+{
+    page_t *page = NULL;
+
+    mm_zone_lock(zone);
+    for (; count && (page = pcp_list_pop_tail(list)); --count) {
+        buddy_free(zone, page - zone->pages, 0);
+        zone->free_pages++;
+        pcp->drains++;
+    }
+    mm_zone_unlock(zone);
+}
+
+static page_t *pcp_alloc(mm_zone_t *zone, gfp_mask_t gfp)
+{
+    size_t n = 0;
+    mm_pcp_t *pcp = NULL;
+    page_t *page = NULL;
+    pcp_list_t *list = NULL;
+    int which = (gfp & GFP_COLD) ? PCP_COLD : PCP_HOT;
+
+    pushcli();
+    pcp = &cpu->pcp;
+    list = &pcp->list[which];
+
+    if (!list->count && pcp->list[!which].count)
+        list = &pcp->list[!which];
+
+    if (list->count) {
+        pcp->hits++;
+    } else {
+        pcp->misses++;
+        mm_zone_lock(zone);
+        for (n = 0; n < PCP_BATCH; ++n) {
+            if (!(page = buddy_alloc(zone, 0)))
+                break;
+            pcp_list_append(list, page);
+        }
+        zone->free_pages -= n;
+        pcp->refills += n;
+        mm_zone_unlock(zone);
+    }
+
+    // hot pages come off the head, cold ones off the tail.
+    if (list == &pcp->list[PCP_HOT])
+        page = pcp_list_pop(list);
+    else
+        page = pcp_list_pop_tail(list);
+    popcli();
+
+    if (page) {
+        page->flags.mm_zone = zone - mm_zone;
+        atomic_write(&page->ref_count, 1);
+    }
+
+    return page;
+}
+
+static void pcp_free(mm_zone_t *zone, page_t *page)
+{
+    mm_pcp_t *pcp = NULL;
+
+    pushcli();
+    pcp = &cpu->pcp;
+    pcp_list_push(&pcp->list[PCP_HOT], page);
+
+    // age the oldest hot pages into the cold list.
+    if (pcp->list[PCP_HOT].count > PCP_HIGH) {
+        for (size_t n = 0; n < PCP_BATCH; ++n)
+            pcp_list_push(&pcp->list[PCP_COLD], pcp_list_pop_tail(&pcp->list[PCP_HOT]));
+    }
+
+    if (pcp->list[PCP_COLD].count > PCP_HIGH)
+        pcp_drain(zone, pcp, &pcp->list[PCP_COLD], PCP_BATCH);
+    popcli();
+}
+
+void pcp_dump(void)
+{
+    mm_pcp_t *pcp = NULL;
+
+    for (int i = 0; i < ncpu; ++i) {
+        pcp = &cpus[i].pcp;
+        printk("cpu%d pcp: hot %d, cold %d, hits %d, misses %d, refills %d, drains %d\n",
+            i, pcp->list[PCP_HOT].count, pcp->list[PCP_COLD].count,
+            pcp->hits, pcp->misses, pcp->refills, pcp->drains);
+    }
+}
+
+page_t *alloc_pages(gfp_mask_t gfp, size_t order)
+{
+    size_t reclaimed = 0;
     page_t *page = NULL;
     uintptr_t paddr = 0;
     uintptr_t vaddr = 0;
     mm_zone_t *zone = NULL;
-    size_t alloced = 0, npages = _BS(order);
+    size_t npages = _BS(order);
     int where = !(gfp & 0x0F) ? MM_ZONE_NORM : (gfp & 0x0F) - 1;
 
-    zone = mm_zone_get(where);
+    if (order >= MM_MAX_ORDER)
+        return NULL;
+
+    zone = &mm_zone[MM_ZONE_NORM];
+    if (!order && (where == MM_ZONE_NORM) && (zone->flags & MM_ZONE_BUDDY)) {
+        if ((page = pcp_alloc(zone, gfp)))
+            goto zero;
+    }
+
+    if (!(zone = mm_zone_get(where)))
+        return NULL;
 
     loop()
     {
-        for (start = index = 0; index < zone->nrpages; start = ++index)
-        {
-            if (zone->pages[index].ref_count)
-            {
-                alloced = 0;
-                continue;
-            }
+        if (zone->flags & MM_ZONE_BUDDY)
+            page = buddy_alloc(zone, order);
+        else
+            page = linear_alloc(zone, npages);
 
-            //printk("%s index: %d, count: %d, needed: %d\n", str_zone[zone - mm_zone], index, zone->pages[index].ref_count, npages);
-            if ((++alloced) == npages)
-                goto done;
+        if (page)
+            break;
+
+        // reclaim clean page-cache pages before giving up or waiting.
+        mm_zone_unlock(zone);
+        if ((reclaimed = mapping_shrink(MAX(npages, PCP_BATCH)))) {
+            // freed order-0 pages land on this cpu's pcp, hand them back to the buddy.
+            if (zone == &mm_zone[MM_ZONE_NORM]) {
+                pushcli();
+                pcp_drain(zone, &cpu->pcp, &cpu->pcp.list[PCP_COLD], PCP_HIGH);
+                pcp_drain(zone, &cpu->pcp, &cpu->pcp.list[PCP_HOT], PCP_HIGH);
+                popcli();
+            }
+            mm_zone_lock(zone);
+            continue;
         }
+        mm_zone_lock(zone);
+
         if ((!(gfp & GFP_WAIT) && !(gfp & GFP_RETRY)))
             goto error;
+
+        // let whoever holds the pages run and put them back.
+        mm_zone_unlock(zone);
+        if (zone == &mm_zone[MM_ZONE_NORM]) {
+            pushcli();
+            pcp_drain(zone, &cpu->pcp, &cpu->pcp.list[PCP_COLD], PCP_HIGH);
+            pcp_drain(zone, &cpu->pcp, &cpu->pcp.list[PCP_HOT], PCP_HIGH);
+            popcli();
+        }
+        if (current)
+            sched_yield();
+        else
+            CPU_RELAX();
+        mm_zone_lock(zone);
     }
 
-done:
-    page = &zone->pages[start];
     for (size_t count = 0; count < npages; ++count)
     {
         page[count].flags.mm_zone = zone - mm_zone;
-        page[count].ref_count++;
-        zone->free_pages--;
+        atomic_write(&page[count].ref_count, 1);
     }
+    zone->free_pages -= npages;
+    mm_zone_unlock(zone);
 
+zero:
     if (gfp & GFP_ZERO) // zero out the page frame(s)
     {
         for (size_t count = 0; count < npages; ++count) {
             paddr = zone->start + ((&page[count] - zone->pages) * PAGESZ);
-        map:
-            vaddr = paging_mount(paddr);
-            if (vaddr == 0) {
-                if (current) {
-                    current_lock();
-                    xched_sleep(zone->sleep_queue, zone->lock);
-                    current_unlock();
-                    goto map;
-                }
-            } else {
-                memset((void *)vaddr, 0, PAGESZ);
-                paging_unmount((uintptr_t)vaddr);
+            while (!(vaddr = paging_mount(paddr))) {
+                if (current)
+                    sched_yield();
+                else
+                    CPU_RELAX();
             }
+            memset((void *)vaddr, 0, PAGESZ);
+            paging_unmount((uintptr_t)vaddr);
         }
     }
-    mm_zone_unlock(zone);
+
     return page;
 error:
     mm_zone_unlock(zone);
@@ -90,40 +446,32 @@ page_t *alloc_page(gfp_mask_t gfp)
 uintptr_t page_address(page_t *page)
 {
     long index = 0;
-    uintptr_t addr = 0;
     mm_zone_t *zone = NULL;
 
     if (!page)
         return 0;
 
-    if (!(zone = mm_zone_get(page->flags.mm_zone)))
+    zone = &mm_zone[page->flags.mm_zone];
+    if (!(zone->flags & MM_ZONE_VALID))
         return 0;
 
     index = page - zone->pages;
 
     if ((index < 0) || (index > (long)zone->nrpages))
-    {
-        mm_zone_unlock(zone);
         return 0;
-    }
 
-    addr = zone->start + (index * PAGESZ);
-    mm_zone_unlock(zone);
-    return addr;
+    return zone->start + (index * PAGESZ);
 }
 
 int __page_incr(uintptr_t addr)
 {
-    size_t refcnt = 0;
     mm_zone_t *zone = NULL;
 
     if (!addr)
         panic("%s(%p)???\n", __func__, addr);
-    if (!(zone = get_mmzone(addr, PAGESZ)))
+    if (!(zone = mm_zone_lookup(addr)))
         return -EADDRNOTAVAIL;
-    refcnt = atomic_incr(&zone->pages[(addr - zone->start) / PAGESZ].ref_count);
-    mm_zone_unlock(zone);
-    return refcnt;
+    return atomic_incr(&zone->pages[(addr - zone->start) / PAGESZ].ref_count);
 }
 
 int page_incr(page_t *page)
@@ -133,21 +481,18 @@ int page_incr(page_t *page)
 
 int __page_count(uintptr_t addr)
 {
-    size_t refcnt = 0;
     mm_zone_t *zone = NULL;
 
     if (!addr)
         panic("%s(%p)???\n", __func__, addr);
-    if (!(zone = get_mmzone(addr, PAGESZ)))
+    if (!(zone = mm_zone_lookup(addr)))
         return -EADDRNOTAVAIL;
-    refcnt = atomic_read(&zone->pages[(addr - zone->start) / PAGESZ].ref_count);
-    mm_zone_unlock(zone);
-    return refcnt;
+    return atomic_read(&zone->pages[(addr - zone->start) / PAGESZ].ref_count);
 }
 
 int page_count(page_t *page)
 {
-    return __page_count(-page_address(page));
+    return __page_count(page_address(page));
 }
 
 uintptr_t __get_free_pages(gfp_mask_t gfp, size_t order)
@@ -172,6 +517,8 @@ void page_put(page_t *page)
 
 void __pages_put(uintptr_t addr, size_t order)
 {
+    size_t index = 0;
+    size_t nfreed = 0;
     page_t *page = NULL;
     mm_zone_t *zone = NULL;
     size_t npages = _BS(order);
@@ -179,33 +526,38 @@ void __pages_put(uintptr_t addr, size_t order)
     if (!addr)
         panic("%s(%p, %d)???\n", __func__, addr, order);
 
+    zone = mm_zone_lookup(addr);
+    if (!order && (zone == &mm_zone[MM_ZONE_NORM]) && (zone->flags & MM_ZONE_BUDDY)) {
+        page = &zone->pages[(addr - zone->start) / PAGESZ];
+        if (atomic_read(&page->ref_count) == 0)
+            return;
+        if (atomic_decr(&page->ref_count) == 1) {
+            page_reset(page);
+            pcp_free(zone, page);
+        }
+        return;
+    }
+
     if (!(zone = get_mmzone(addr, npages * PAGESZ)))
         return;
-    
-    page = &zone->pages[(addr - zone->start) / PAGESZ];
-    for (size_t pages = 0; pages < npages; ++pages, ++page)
+
+    index = (addr - zone->start) / PAGESZ;
+    page = &zone->pages[index];
+    for (size_t pages = 0; pages < npages; ++pages)
     {
-        if (atomic_read(&page->ref_count) == 0)
+        if (atomic_read(&page[pages].ref_count) == 0)
             continue;
-        atomic_decr(&page->ref_count);
-        if (atomic_read(&page->ref_count) == 0)
+        if (atomic_decr(&page[pages].ref_count) == 1)
         {
-            page->mapping = NULL;
-            page->ref_count = 0;
-            page->virtual = 0;
-            page->flags.read = 0;
-            page->flags.can_swap = 1;
-            page->flags.dirty = 0;
-            page->flags.exec = 0;
-            page->flags.shared = 0;
-            page->flags.swapped = 0;
-            page->flags.user = 0;
-            page->flags.valid = 0;
-            page->flags.write = 0;
-            page->flags.writeback =0;
-            zone->free_pages++;
+            page_reset(&page[pages]);
+            // freeing a whole block page by page merges back up to its order.
+            if (zone->flags & MM_ZONE_BUDDY)
+                buddy_free(zone, index + pages, 0);
+            nfreed++;
         }
     }
+
+    zone->free_pages += nfreed;
     mm_zone_unlock(zone);
 }
 
@@ -235,6 +587,9 @@ size_t mem_free(void)
             size += mm_zone[zone].free_pages * PAGESZ;
         mm_zone_unlock(&mm_zone[zone]);
     }
+
+    for (int i = 0; i < ncpu; ++i)
+        size += (cpus[i].pcp.list[PCP_HOT].count + cpus[i].pcp.list[PCP_COLD].count) * PAGESZ;
     return (size / 1024);
 }
 
@@ -248,13 +603,47 @@ size_t mem_used(void)
             size += (mm_zone[zone].nrpages - mm_zone[zone].free_pages) * PAGESZ;
         mm_zone_unlock(&mm_zone[zone]);
     }
+
+    for (int i = 0; i < ncpu; ++i)
+        size -= (cpus[i].pcp.list[PCP_HOT].count + cpus[i].pcp.list[PCP_COLD].count) * PAGESZ;
     return (size / 1024);
 }
 
-void *memory(void *arg)
+#define BUDDY_TEST_ITER 32
+
+/**
+ * boot-time self-test, reports the average TSC cycles taken
+ * to allocate and free a block of every order.
+ */
+void *buddy_selftest(void *arg)
 {
-    
+    page_t *page = NULL;
+    uint64_t tsc = 0, alloc_cycles = 0, free_cycles = 0;
+
+    for (size_t order = 0; order < MM_MAX_ORDER; ++order) {
+        alloc_cycles = free_cycles = 0;
+        for (int iter = 0; iter < BUDDY_TEST_ITER; ++iter) {
+            tsc = read_tsc();
+            page = alloc_pages(GFP_NORMAL, order);
+            alloc_cycles += read_tsc() - tsc;
+
+            if (!page) {
+                klog(KLOG_FAIL, "buddy: order %d allocation failed\n", order);
+                return arg;
+            }
+
+            tsc = read_tsc();
+            pages_put(page, order);
+            free_cycles += read_tsc() - tsc;
+        }
+
+        printk("buddy: order %2d: alloc %6d cycles, free %6d cycles\n", order,
+            (uint32_t)(alloc_cycles / BUDDY_TEST_ITER), (uint32_t)(free_cycles / BUDDY_TEST_ITER));
+    }
+
+    pcp_dump();
+    klog(KLOG_OK, "buddy: self-test passed, %dKiB free\n", mem_free());
     return arg;
 }
 
-// BUILTIN_THREAD(memory, memory, NULL);
\ No newline at end of file
+BUILTIN_THREAD(buddy_selftest, buddy_selftest, NULL);
@@ -0,0 +1,336 @@
+#include <bits/errno.h>
+#include <lib/string.h>
+#include <lime/preempt.h>
+#include <mm/kalloc.h>
+#include <mm/slab.h>
+#include <arch/i386/cpu.h>
+#include <arch/i386/paging.h>
+#include <printk.h>
+
+static kmem_cache_t *kmem_caches = NULL;
+static spinlock_t *kmem_caches_lock = SPINLOCK_NEW("kmem-caches");
+
+#define KMEM_ALIGN(x, a) (((x) + ((a) - 1)) & ~((a) - 1))
+
+// free objects are chained through a word placed right after the object,
+// so a free object keeps whatever state its constructor gave it.
+#define KMEM_LINK(cache, obj) (*(void **)((uintptr_t)(obj) + KMEM_ALIGN((cache)->objsize, sizeof(void *))))
+
+static void kmem_cache_register(kmem_cache_t *cache)
+{
+    spin_lock(kmem_caches_lock);
+    if (!(cache->flags & KMEM_CACHE_LISTED)) {
+        cache->next = kmem_caches;
+        kmem_caches = cache;
+        cache->flags |= KMEM_CACHE_LISTED;
+    }
+    spin_unlock(kmem_caches_lock);
+}
+
+static void kmem_cache_unregister(kmem_cache_t *cache)
+{
+    kmem_cache_t **pcache = NULL;
+
+    spin_lock(kmem_caches_lock);
+    for (pcache = &kmem_caches; *pcache; pcache = &(*pcache)->next) {
+        if (*pcache == cache) {
+            *pcache = cache->next;
+            break;
+        }
+    }
+    cache->flags &= ~KMEM_CACHE_LISTED;
+    spin_unlock(kmem_caches_lock);
+}
+
+// work out the slab layout the first time the cache is used.
+static int kmem_cache_setup(kmem_cache_t *cache)
+{
+    spin_assert_lock(cache->lock);
+
+    if (cache->size)
+        return 0;
+
+    if (!cache->align)
+        cache->align = sizeof(void *);
+
+    if (cache->align & (cache->align - 1))
+        return -EINVAL;
+
+    cache->size = KMEM_ALIGN(KMEM_ALIGN(cache->objsize, sizeof(void *)) + sizeof(void *), cache->align);
+    cache->offset = KMEM_ALIGN(sizeof(kmem_slab_t), cache->align);
+    cache->objs_per_slab = (PAGESZ - cache->offset) / cache->size;
+
+    if (!cache->objs_per_slab) {
+        cache->size = 0;
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static void slab_list_add(kmem_slab_t **list, kmem_slab_t *slab)
+{
+    slab->prev = NULL;
+    if ((slab->next = *list))
+        (*list)->prev = slab;
+    *list = slab;
+}
+
+static void slab_list_del(kmem_slab_t **list, kmem_slab_t *slab)
+{
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        *list = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+    slab->next = slab->prev = NULL;
+}
+
+static kmem_slab_t *slab_grow(kmem_cache_t *cache)
+{
+    void *obj = NULL;
+    kmem_slab_t *slab = NULL;
+
+    spin_assert_lock(cache->lock);
+
+    if (!(slab = (kmem_slab_t *)paging_alloc(PAGESZ)))
+        return NULL;
+
+    memset(slab, 0, sizeof *slab);
+    slab->cache = cache;
+
+    // chain the objects backwards so they are handed out in address order.
+    for (size_t i = cache->objs_per_slab; i > 0; --i) {
+        obj = (void *)((uintptr_t)slab + cache->offset + ((i - 1) * cache->size));
+        if (cache->ctor)
+            cache->ctor(obj);
+        KMEM_LINK(cache, obj) = slab->free;
+        slab->free = obj;
+    }
+
+    slab_list_add(&cache->empty, slab);
+    cache->nslabs++;
+    return slab;
+}
+
+static void slab_release(kmem_cache_t *cache, kmem_slab_t *slab)
+{
+    spin_assert_lock(cache->lock);
+    cache->nslabs--;
+    paging_free((uintptr_t)slab, PAGESZ);
+}
+
+static void *slab_get_obj(kmem_cache_t *cache)
+{
+    void *obj = NULL;
+    kmem_slab_t *slab = NULL;
+
+    spin_assert_lock(cache->lock);
+
+    if ((slab = cache->partial))
+        slab_list_del(&cache->partial, slab);
+    else if ((slab = cache->empty) || (slab = slab_grow(cache)))
+        slab_list_del(&cache->empty, slab);
+    else
+        return NULL;
+
+    obj = slab->free;
+    slab->free = KMEM_LINK(cache, obj);
+    slab->inuse++;
+    cache->nactive++;
+
+    if (slab->inuse == cache->objs_per_slab)
+        slab_list_add(&cache->full, slab);
+    else
+        slab_list_add(&cache->partial, slab);
+
+    return obj;
+}
+
+static void slab_put_obj(kmem_cache_t *cache, void *obj)
+{
+    kmem_slab_t *slab = (kmem_slab_t *)PGROUND(obj);
+
+    spin_assert_lock(cache->lock);
+    assert(slab->cache == cache, "object freed to the wrong cache");
+
+    if (slab->inuse == cache->objs_per_slab)
+        slab_list_del(&cache->full, slab);
+    else
+        slab_list_del(&cache->partial, slab);
+
+    KMEM_LINK(cache, obj) = slab->free;
+    slab->free = obj;
+    slab->inuse--;
+    cache->nactive--;
+
+    if (slab->inuse) {
+        slab_list_add(&cache->partial, slab);
+        return;
+    }
+
+    // keep one empty slab around, give the rest back.
+    if (cache->empty)
+        slab_release(cache, slab);
+    else
+        slab_list_add(&cache->empty, slab);
+}
+
+int kmem_cache_create(const char *name, size_t size, size_t align, void (*ctor)(void *), kmem_cache_t **ref)
+{
+    int err = 0;
+    kmem_cache_t *cache = NULL;
+
+    if (!name || !size || !ref)
+        return -EINVAL;
+
+    if (!(cache = kmalloc(sizeof *cache)))
+        return -ENOMEM;
+
+    memset(cache, 0, sizeof *cache);
+
+    if ((err = spinlock_init(NULL, name, &cache->lock)))
+        goto error;
+
+    cache->name = name;
+    cache->objsize = size;
+    cache->align = align;
+    cache->ctor = ctor;
+
+    spin_lock(cache->lock);
+    err = kmem_cache_setup(cache);
+    spin_unlock(cache->lock);
+    if (err)
+        goto error;
+
+    kmem_cache_register(cache);
+    *ref = cache;
+    return 0;
+error:
+    if (cache->lock)
+        spinlock_free(cache->lock);
+    kfree(cache);
+    return err;
+}
+
+void kmem_cache_destroy(kmem_cache_t *cache)
+{
+    kmem_slab_t *slab = NULL;
+    kmem_magazine_t *mag = NULL;
+
+    if (!cache)
+        return;
+
+    kmem_cache_unregister(cache);
+
+    spin_lock(cache->lock);
+    for (int i = 0; i < NCPU; ++i) {
+        mag = &cache->mag[i];
+        while (mag->count)
+            slab_put_obj(cache, mag->objs[--mag->count]);
+    }
+
+    assert(!cache->nactive, "destroying a cache with objects in use");
+
+    while ((slab = cache->empty)) {
+        slab_list_del(&cache->empty, slab);
+        slab_release(cache, slab);
+    }
+    spin_unlock(cache->lock);
+
+    if (cache->flags & KMEM_CACHE_STATIC) {
+        cache->size = 0;
+        return;
+    }
+
+    spinlock_free(cache->lock);
+    kfree(cache);
+}
+
+void *kmem_cache_alloc(kmem_cache_t *cache, gfp_mask_t gfp)
+{
+    void *obj = NULL;
+    kmem_magazine_t *mag = NULL;
+
+    if (!cache)
+        return NULL;
+
+    if (!(cache->flags & KMEM_CACHE_LISTED))
+        kmem_cache_register(cache);
+
+    pushcli();
+    mag = &cache->mag[cpu->cpuid];
+
+    if (mag->count) {
+        mag->hits++;
+    } else {
+        mag->misses++;
+        // refill half a magazine so the next few frees don't spill straight back.
+        spin_lock(cache->lock);
+        if (!kmem_cache_setup(cache)) {
+            for (; mag->count < (KMEM_MAG_SIZE / 2); ++mag->count)
+                if (!(mag->objs[mag->count] = slab_get_obj(cache)))
+                    break;
+        }
+        spin_unlock(cache->lock);
+    }
+
+    if (mag->count)
+        obj = mag->objs[--mag->count];
+    popcli();
+
+    if (obj && (gfp & GFP_ZERO))
+        memset(obj, 0, cache->objsize);
+
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t *cache, void *obj)
+{
+    kmem_magazine_t *mag = NULL;
+
+    if (!cache || !obj)
+        return;
+
+    pushcli();
+    mag = &cache->mag[cpu->cpuid];
+
+    if (mag->count == KMEM_MAG_SIZE) {
+        // spill the older half of the magazine back to the slabs.
+        spin_lock(cache->lock);
+        for (int i = 0; i < (KMEM_MAG_SIZE / 2); ++i)
+            slab_put_obj(cache, mag->objs[i]);
+        spin_unlock(cache->lock);
+        mag->count -= KMEM_MAG_SIZE / 2;
+        memmove(mag->objs, &mag->objs[KMEM_MAG_SIZE / 2], mag->count * sizeof(void *));
+    }
+
+    mag->objs[mag->count++] = obj;
+    mag->frees++;
+    popcli();
+}
+
+void kmem_cache_dump(void)
+{
+    kmem_cache_t *cache = NULL;
+    size_t cached = 0, hits = 0, misses = 0, frees = 0;
+
+    spin_lock(kmem_caches_lock);
+    printk("%-16s %8s %6s %8s %8s %10s %10s %10s\n",
+        "cache", "objsize", "slabs", "active", "cached", "hits", "misses", "frees");
+
+    for (cache = kmem_caches; cache; cache = cache->next) {
+        cached = hits = misses = frees = 0;
+        for (int i = 0; i < NCPU; ++i) {
+            cached += cache->mag[i].count;
+            hits += cache->mag[i].hits;
+            misses += cache->mag[i].misses;
+            frees += cache->mag[i].frees;
+        }
+
+        printk("%-16s %8d %6d %8d %8d %10d %10d %10d\n", cache->name, cache->objsize,
+            cache->nslabs, cache->nactive - cached, cached, hits, misses, frees);
+    }
+    spin_unlock(kmem_caches_lock);
+}
@@ -0,0 +1,2 @@
+slabobjs:=\
+$(slabdir)/slab.o
@@ -80,7 +80,7 @@ int binfmt_load(const char *fn, proc_t *proc, proc_t **ref)
     {
         if ((err = binfmt[i].check(image)))
         {
-            paging_switch(oldpgdir);
+            tlb_switch(current->mmap, oldpgdir);
             if (new){
                 mmap_unlock(proc->mmap);
                 proc_unlock(proc);
@@ -90,7 +90,7 @@ int binfmt_load(const char *fn, proc_t *proc, proc_t **ref)
 
         if ((err = binfmt[i].load(image, proc)))
         {
-            paging_switch(oldpgdir);
+            tlb_switch(current->mmap, oldpgdir);
             if (new){
                 mmap_unlock(proc->mmap);
                 proc_unlock(proc);
@@ -99,7 +99,7 @@ int binfmt_load(const char *fn, proc_t *proc, proc_t **ref)
         }
     }
 
-    paging_switch(oldpgdir);
+    tlb_switch(current->mmap, oldpgdir);
 
     if (new){
         mmap_unlock(proc->mmap);
@@ -262,34 +262,28 @@ int binfmt_elf_load(inode_t *binary, proc_t *proc)
                    (hdr[i].p_flags & PF_X ? PROT_X : 0);
 
             if ((err = mmap_map_region(mmap, PGROUND(hdr[i].p_vaddr),
-                                       GET_BOUNDARY_SIZE(0, hdr[i].p_memsz), prot, flags, &region)))
+                                       GET_BOUNDARY_SIZE(hdr[i].p_vaddr, hdr[i].p_memsz), prot, flags, &region)))
                 goto error;
 
-#ifndef DEMAND_PAGING
-            if ((err = paging_mappages(region->start,
-                                       GET_BOUNDARY_SIZE(0, hdr[i].p_memsz), region->vflags)))
-                goto error;
-
-            size_t truncsz = __vmr_size(region) - hdr[i].p_filesz;
-            if (iread(binary, hdr[i].p_offset, (void *)region->start, hdr[i].p_filesz) != hdr[i].p_filesz)
-            {
-                err = -EAGAIN;
-                goto error;
-            }
-            memset((void *)region->start + hdr[i].p_filesz, 0, truncsz);
-#endif // DEMAND_PAGING
-
+            /**
+             * nothing is copied here, the segment is faulted in from the file.
+             * the region starts on the page holding p_vaddr, and p_offset is
+             * congruent to p_vaddr modulo the page size, so back the region
+             * from the page-aligned file offset. this keeps every faulting
+             * page aligned in the file so it can be mapped in place from the
+             * initrd or the page cache, and is only copied when written.
+             */
             region->file = binary;
-            region->filesz = hdr[i].p_filesz;
-            region->file_pos = hdr[i].p_offset;
+            region->filesz = hdr[i].p_filesz + PGOFFSET(hdr[i].p_vaddr);
+            region->file_pos = hdr[i].p_offset - PGOFFSET(hdr[i].p_vaddr);
         }
     }
 
+    proc->entry = elf->e_entry;
+
     kfree(elf);
     kfree(hdr);
 
-    proc->entry = elf->e_entry;
-
     return 0;
 error:
     if (elf)
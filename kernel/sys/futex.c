@@ -0,0 +1,255 @@
+#include <printk.h>
+#include <sys/futex.h>
+#include <sys/sched.h>
+#include <sys/thread.h>
+#include <bits/errno.h>
+#include <ds/queue.h>
+#include <arch/i386/cpu.h>
+#include <arch/i386/uaccess.h>
+
+#define FUTEX_NBUCKET   64  // must be a power of two.
+
+/**
+ * Futexes.
+ *
+ * A waiter sleeps on the bucket its (mmap, uaddr) key hashes to, with
+ * thread->sleep.data pointing at its key so wakers can pick out the
+ * threads waiting on their address. The bucket guard is held from
+ * reading the user's word until the waiter is on the queue, so a thread
+ * that changes the word and then wakes cannot slip in between.
+ * Bucket queues are allocated on first use.
+ */
+typedef struct futex_key
+{
+    mmap_t      *mmap;
+    uintptr_t   uaddr;
+} futex_key_t;
+
+typedef struct futex_bucket
+{
+    spinlock_t  lock;
+    queue_t     *queue;
+} futex_bucket_t;
+
+#define futex_guard(b) (&(b)->lock)
+
+static futex_bucket_t futex_buckets[FUTEX_NBUCKET] = {
+    [0 ... FUTEX_NBUCKET - 1] = {.lock = {.name = "futex"}},
+};
+
+static int futex_key(int *uaddr, futex_key_t *key)
+{
+    if ((uaddr == NULL) || ((uintptr_t)uaddr & (sizeof *uaddr - 1)))
+        return -EINVAL;
+    key->mmap = current->mmap;
+    key->uaddr = (uintptr_t)uaddr;
+    return 0;
+}
+
+#define futex_key_equal(a, b) (((a)->mmap == (b)->mmap) && ((a)->uaddr == (b)->uaddr))
+
+static futex_bucket_t *futex_bucket(futex_key_t *key)
+{
+    uint32_t h = ((uintptr_t)key->mmap >> 4) ^ (key->uaddr >> 2);
+    return &futex_buckets[(h * 0x9E3779B1u) >> 26 & (FUTEX_NBUCKET - 1)];
+}
+
+/* caller must hold the bucket guard. */
+static int futex_bucket_queue(futex_bucket_t *bucket)
+{
+    if (bucket->queue)
+        return 0;
+    return queue_new("futex", &bucket->queue);
+}
+
+/* lock two buckets in address order, they may be the same. */
+static void futex_lock_pair(futex_bucket_t *b1, futex_bucket_t *b2)
+{
+    if (b1 > b2)
+    {
+        futex_bucket_t *tmp = b1;
+        b1 = b2;
+        b2 = tmp;
+    }
+
+    spin_lock(futex_guard(b1));
+    if (b1 != b2)
+        spin_lock(futex_guard(b2));
+}
+
+static void futex_unlock_pair(futex_bucket_t *b1, futex_bucket_t *b2)
+{
+    if (b1 != b2)
+        spin_unlock(futex_guard(b2));
+    spin_unlock(futex_guard(b1));
+}
+
+static int futex_wait(int *uaddr, int val)
+{
+    int err = 0;
+    int word = 0;
+    futex_key_t key;
+    futex_bucket_t *bucket = NULL;
+
+    if ((err = futex_key(uaddr, &key)))
+        return err;
+
+    // touch the word first, a page fault cannot be taken under the guard.
+    if ((err = copy_from_user(&word, uaddr, sizeof word)))
+        return err;
+    if (word != val)
+        return -EAGAIN;
+
+    bucket = futex_bucket(&key);
+    spin_lock(futex_guard(bucket));
+
+    if ((err = futex_bucket_queue(bucket)))
+        goto done;
+
+    // another thread may have unmapped it since, that fails the call rather than the kernel.
+    if ((err = copy_from_user(&word, uaddr, sizeof word)))
+        goto done;
+    err = -EAGAIN;
+    if (word != val)
+        goto done;
+
+    current_lock();
+    current->sleep.data = &key;
+    err = xched_sleep(bucket->queue, futex_guard(bucket));
+    current->sleep.data = NULL;
+    current_unlock();
+done:
+    spin_unlock(futex_guard(bucket));
+    return err;
+}
+
+/* wake up to 'nr' waiters on 'key'. caller must hold the bucket guard. */
+static int futex_wake_locked(futex_bucket_t *bucket, futex_key_t *key, int nr)
+{
+    int woken = 0;
+    thread_t *thread = NULL;
+    queue_node_t *next = NULL;
+
+    if (bucket->queue == NULL)
+        return 0;
+
+    queue_lock(bucket->queue);
+    forlinked(node, bucket->queue->head, next)
+    {
+        next = node->next;
+        if (woken >= nr)
+            break;
+
+        thread = node->data;
+        if (!futex_key_equal((futex_key_t *)thread->sleep.data, key))
+            continue;
+
+        thread_lock(thread);
+        if (thread_wake_n(thread) == 0)
+            woken++;
+        thread_unlock(thread);
+    }
+    queue_unlock(bucket->queue);
+
+    return woken;
+}
+
+static int futex_wake(int *uaddr, int nr)
+{
+    int err = 0;
+    futex_key_t key;
+    futex_bucket_t *bucket = NULL;
+
+    if ((err = futex_key(uaddr, &key)))
+        return err;
+
+    bucket = futex_bucket(&key);
+    spin_lock(futex_guard(bucket));
+    nr = futex_wake_locked(bucket, &key, nr);
+    spin_unlock(futex_guard(bucket));
+    return nr;
+}
+
+/**
+ * wake 'nr' waiters on 'uaddr' and move up to 'nr2' of the others to
+ * 'uaddr2' without waking them, e.g. a condition broadcast wakes one
+ * thread and queues the rest on the mutex they would only fight over.
+ */
+static int futex_requeue(int *uaddr, int nr, int *uaddr2, int nr2)
+{
+    int err = 0, woken = 0, moved = 0;
+    thread_t *thread = NULL;
+    queue_node_t *next = NULL;
+    futex_key_t key, key2;
+    futex_bucket_t *bucket = NULL, *bucket2 = NULL;
+
+    if ((err = futex_key(uaddr, &key)) || (err = futex_key(uaddr2, &key2)))
+        return err;
+
+    bucket = futex_bucket(&key);
+    bucket2 = futex_bucket(&key2);
+    futex_lock_pair(bucket, bucket2);
+
+    woken = futex_wake_locked(bucket, &key, nr);
+    if ((bucket->queue == NULL) || (nr2 <= 0))
+        goto done;
+
+    if ((err = futex_bucket_queue(bucket2)))
+        goto done;
+
+    queue_lock(bucket->queue);
+    forlinked(node, bucket->queue->head, next)
+    {
+        next = node->next;
+        if (moved >= nr2)
+            break;
+
+        thread = node->data;
+        if (!futex_key_equal((futex_key_t *)thread->sleep.data, &key))
+            continue;
+
+        thread_lock(thread);
+        *(futex_key_t *)thread->sleep.data = key2;
+        if (bucket2 != bucket)
+        {
+            // still asleep, only which queue it sleeps on changes.
+            assert(!thread_remove_queue(thread, bucket->queue), "futex: waiter not on its queue");
+            if ((err = thread_enqueue(bucket2->queue, thread, &thread->sleep.node)))
+            {
+                // no memory to queue it on the new address, wake it instead.
+                thread->sleep.queue = NULL;
+                __thread_enter_state(thread, T_READY);
+                sched_park(thread);
+                thread_unlock(thread);
+                woken++;
+                err = 0;
+                continue;
+            }
+            thread->sleep.queue = bucket2->queue;
+            thread->sleep.guard = futex_guard(bucket2);
+        }
+        thread_unlock(thread);
+        moved++;
+    }
+    queue_unlock(bucket->queue);
+done:
+    futex_unlock_pair(bucket, bucket2);
+    return err ? err : (woken + moved);
+}
+
+int futex(int *uaddr, int op, int val, int *uaddr2, int val2)
+{
+    current_assert();
+
+    switch (op)
+    {
+    case FUTEX_WAIT:
+        return futex_wait(uaddr, val);
+    case FUTEX_WAKE:
+        return futex_wake(uaddr, val);
+    case FUTEX_REQUEUE:
+        return futex_requeue(uaddr, val, uaddr2, val2);
+    default:
+        return -ENOSYS;
+    }
+}
@@ -12,6 +12,7 @@
 #include <arch/sys/uthread.h>
 #include <sys/binfmt.h>
 #include <sys/session.h>
+#include <lime/vdata.h>
 
 proc_t *initproc = NULL;
 queue_t *processes = QUEUE_NEW("All Processes");
@@ -112,6 +113,7 @@ int proc_alloc(const char *name, proc_t **ref)
     spin_unlock(pids_lock);
 
     proc->pid = pid;
+    vdata_setproc(mmap, pid);
     proc->name = str;
     proc->lock = lock;
     proc->mmap = mmap;
@@ -185,22 +187,22 @@ int proc_init(const char *fn)
     oldpgdir = arch_proc_init(proc->mmap);
 
     if ((err = thread_execve(proc, thread, (void *)proc->entry, argp, envp))) {
-        paging_switch(oldpgdir);
+        tlb_switch(current->mmap, oldpgdir);
         thread_unlock(thread);
         mmap_unlock(proc->mmap);
         proc_unlock(proc);
         goto error;
     }
     
-    paging_switch(oldpgdir);
+    tlb_switch(current->mmap, oldpgdir);
     mmap_unlock(proc->mmap);
 
     initproc = proc;
-    sched_set_priority(thread, SCHED_LOWEST_PRIORITY);
+    sched_set_priority(thread, SCHED_DEFAULT_PRIORITY);
 
     if ((err = sched_park(thread)))
     {
-        paging_switch(oldpgdir);
+        tlb_switch(current->mmap, oldpgdir);
         thread_unlock(thread);
         proc_unlock(proc);
         goto error;
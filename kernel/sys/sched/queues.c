@@ -4,14 +4,189 @@
 #include <printk.h>
 #include <bits/errno.h>
 #include <lime/assert.h>
+#include <arch/i386/lapic.h>
+#include <arch/i386/traps.h>
+#include <lime/jiffies.h>
+#include <arch/system.h>
 
 static queue_t *embryo_queue = QUEUE_NEW("embryo-queue");
 static queue_t *zombie_queue = QUEUE_NEW("zombie-queue");
 
+/* wake one halted cpu so it can come and steal work. */
+static void sched_kick_idle(void)
+{
+    for (int i = 0; i < ncpu; ++i)
+    {
+        if ((&cpus[i] != cpu) && cpus[i].ready_queue && atomic_read(&cpus[i].idle))
+        {
+            lapic_send_ipi(cpus[i].cpuid, T_WAKEUP);
+            return;
+        }
+    }
+}
+
+#define sched_epoch() (jiffies_get() / SCHED_BOOST_INTERVAL)
+
+/* append 'thread' to its level of the local ready queue. interrupts must be off. */
+static void rq_enqueue(sched_queue_t *rq, thread_t *thread)
+{
+    int lvl = 0;
+    level_t *level = NULL;
+    unsigned long epoch = sched_epoch();
+
+    // a boost happened since the thread last ran, start over at its base priority.
+    if (thread->t_sched_attr.epoch != epoch)
+    {
+        thread->t_sched_attr.epoch = epoch;
+        atomic_write(&thread->t_sched_attr.t_priority, atomic_read(&thread->t_sched_attr.t_base));
+    }
+
+    lvl = SCHED_LEVEL(atomic_read(&thread->t_sched_attr.t_priority));
+    level = &rq->level[lvl];
+
+    thread->t_run.level = lvl;
+    thread->t_run.next = NULL;
+    if ((thread->t_run.prev = level->tail))
+        level->tail->t_run.next = thread;
+    else
+        level->head = thread;
+    level->tail = thread;
+
+    rq->bitmap |= _BS(lvl);
+    atomic_incr(&rq->nr_ready);
+}
+
+/* unlink 'thread' from the local ready queue. interrupts must be off. */
+static void rq_remove(sched_queue_t *rq, thread_t *thread)
+{
+    level_t *level = &rq->level[thread->t_run.level];
+
+    if (thread->t_run.prev)
+        thread->t_run.prev->t_run.next = thread->t_run.next;
+    else
+        level->head = thread->t_run.next;
+
+    if (thread->t_run.next)
+        thread->t_run.next->t_run.prev = thread->t_run.prev;
+    else
+        level->tail = thread->t_run.prev;
+
+    if (level->head == NULL)
+        rq->bitmap &= ~_BS(thread->t_run.level);
+
+    thread->t_run.next = thread->t_run.prev = NULL;
+    atomic_decr(&rq->nr_ready);
+}
+
+/* hand 'thread' to 'core', which owns the ready queue it goes on. */
+static void rq_post(cpu_t *core, thread_t *thread)
+{
+    atomic_t *inbox = &core->ready_queue->inbox;
+    uintptr_t head = atomic_read(inbox);
+
+    do {
+        thread->t_run.next = (thread_t *)head;
+    } while (!__atomic_compare_exchange_n(inbox, &head, (uintptr_t)thread, 0,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    if (atomic_read(&core->idle))
+        lapic_send_ipi(core->cpuid, T_WAKEUP);
+}
+
+/* requeue every waiting thread below the top level at its base priority. interrupts must be off. */
+static void rq_boost(sched_queue_t *rq)
+{
+    thread_t *thread = NULL, *next = NULL;
+
+    rq->epoch = sched_epoch();
+    for (int lvl = 1; (rq->bitmap & ~_BS(0)) && lvl < NLEVELS; ++lvl)
+    {
+        for (thread = rq->level[lvl].head; thread; thread = next)
+        {
+            next = thread->t_run.next;
+            if (thread->t_sched_attr.epoch == rq->epoch)
+                continue; // already moved, it may land back on this level.
+            rq_remove(rq, thread);
+            rq_enqueue(rq, thread);
+        }
+    }
+}
+
+/* move threads other cpus parked here onto the local ready queue, oldest first. */
+static void rq_drain(sched_queue_t *rq)
+{
+    thread_t *thread = NULL, *list = NULL, *next = NULL;
+
+    if (!(thread = (thread_t *)atomic_xchg(&rq->inbox, 0)))
+        return;
+
+    // the inbox is a stack, reverse it.
+    for (; thread; thread = next)
+    {
+        next = thread->t_run.next;
+        thread->t_run.next = list;
+        list = thread;
+    }
+
+    for (thread = list; thread; thread = next)
+    {
+        next = thread->t_run.next;
+        rq_enqueue(rq, thread);
+    }
+}
+
+/**
+ * give one waiting thread to each cpu that asked for one, taking from
+ * the lowest-priority level first so the work that would run last here
+ * is what moves. threads with hard affinity stay put, as do threads
+ * someone is holding, and threads whose FPU state is still live in this
+ * cpu's registers (lazy FPU switching). interrupts must be off.
+ */
+static void rq_serve_pulls(sched_queue_t *rq)
+{
+    int to = 0;
+    uint32_t levels = 0;
+    thread_t *thread = NULL;
+    uintptr_t pull = 0;
+
+    if (!atomic_read(&rq->pull))
+        return;
+
+    pull = atomic_xchg(&rq->pull, 0);
+
+    while (pull && atomic_read(&rq->nr_ready))
+    {
+        to = bsf(pull);
+        pull &= ~_BS(to);
+
+        thread = NULL;
+        for (levels = rq->bitmap; levels && !thread; levels &= ~_BS(bsr(levels)))
+        {
+            for (thread = rq->level[bsr(levels)].tail; thread; thread = thread->t_run.prev)
+            {
+                if (atomic_read(&thread->t_sched_attr.affinity) == SCHED_HARD_AFFINITY)
+                    continue;
+                if (fpu_thread == thread)
+                    continue;
+                if (spin_trylock(thread->t_lock))
+                    break;
+            }
+        }
+
+        if (thread == NULL)
+            break; // nothing can move.
+
+        rq_remove(rq, thread);
+        thread->t_sched_attr.core = &cpus[to];
+        atomic_incr(&rq->nr_pushed);
+        atomic_incr(&cpus[to].ready_queue->nr_pulled);
+        rq_post(&cpus[to], thread);
+        thread_unlock(thread);
+    }
+}
+
 int sched_park(thread_t *thread)
 {
-    int err = 0;
-    long priority = 0;
     long affinity = 0;
     cpu_t *core = NULL;
     level_t *level = NULL;
@@ -24,35 +199,34 @@ int sched_park(thread_t *thread)
 
     core = thread->t_sched_attr.core;
     affinity = atomic_read(&thread->t_sched_attr.affinity);
-    priority = atomic_read(&thread->t_sched_attr.t_priority);
 
     if (core == NULL)
         core = thread->t_sched_attr.core = cpu;
 
-    switch (affinity)
-    {
-    case SCHED_SOFT_AFFINITY:
-        level = &core->ready_queue->level[SCHED_LEVEL(priority)];
-        break;
-    case SCHED_HARD_AFFINITY:
-        level = &core->ready_queue->level[SCHED_LEVEL(priority)];
-        break;
-    default:
+    if ((affinity != SCHED_SOFT_AFFINITY) && (affinity != SCHED_HARD_AFFINITY))
         panic("Invalid affinity attribute\n");
-    }
 
+    level = &core->ready_queue->level[SCHED_LEVEL(atomic_read(&thread->t_sched_attr.t_priority))];
     atomic_write(&thread->t_sched_attr.t_timeslice, level->quatum);
-    if ((err = thread_enqueue(level->queue, thread, NULL)))
-        goto error;
+
+    if (core != cpu)
+    {
+        rq_post(core, thread);
+        return 0;
+    }
+
+    pushcli();
+    rq_enqueue(ready_queue, thread);
+    popcli();
+
+    if (current && (affinity != SCHED_HARD_AFFINITY))
+        sched_kick_idle(); // this cpu is busy, let an idle one steal the thread.
     return 0;
-error:
-    printk("\e[0;4mfailed to put on ready queue\e[0m\n");
-    return err;
 }
 
 thread_t *sched_next(void)
 {
-    level_t *level = NULL;
+    int lvl = 0;
     thread_t *thread = NULL;
 
     queue_lock(embryo_queue);
@@ -70,24 +244,158 @@ thread_t *sched_next(void)
 self:
     thread = NULL;
     pushcli();
-    for (int i = 0; i < NLEVELS; ++i)
+    rq_drain(ready_queue);
+    rq_serve_pulls(ready_queue);
+
+    if (ready_queue->bitmap)
     {
-        level = &ready_queue->level[i];
-        queue_lock(level->queue);
-        if (!(thread = thread_dequeue(level->queue)))
-        {
-            queue_unlock(level->queue);
-            continue;
-        }
+        lvl = bsf(ready_queue->bitmap);
+        thread = ready_queue->level[lvl].head;
+        rq_remove(ready_queue, thread);
+        thread_lock(thread);
         thread->t_state = T_RUNNING;
-        atomic_write(&thread->t_sched_attr.t_timeslice, level->quatum);
-        queue_unlock(level->queue);
-        break;
+        atomic_write(&thread->t_sched_attr.t_timeslice, ready_queue->level[lvl].quatum);
     }
+    else
+        sched_steal(); // nothing local, ask a busier cpu for work.
     popcli();
     return thread;
 }
 
+int sched_runnable(void)
+{
+    int count = 0;
+
+    queue_lock(embryo_queue);
+    count = queue_count(embryo_queue);
+    queue_unlock(embryo_queue);
+
+    return count || ready_queue->bitmap || atomic_read(&ready_queue->inbox);
+}
+
+/**
+ * the other cpu with the most work that has a thread waiting,
+ * measured by load average or by the number of threads waiting.
+ */
+static cpu_t *sched_busiest(int by_load, long *pmax)
+{
+    cpu_t *busiest = NULL;
+    sched_queue_t *sq = NULL;
+    long max = 0, val = 0, nready = 0;
+
+    for (int i = 0; i < ncpu; ++i)
+    {
+        if ((&cpus[i] == cpu) || !(sq = cpus[i].ready_queue))
+            continue;
+        if ((nready = atomic_read(&sq->nr_ready)) == 0)
+            continue;
+        val = by_load ? (long)atomic_read(&sq->load) : nready;
+        if (val > max)
+        {
+            max = val;
+            busiest = &cpus[i];
+        }
+    }
+
+    if (pmax)
+        *pmax = max;
+    return busiest;
+}
+
+/* ask 'victim' for a thread, it is pushed to this cpu's inbox. */
+static void sched_pull(cpu_t *victim)
+{
+    atomic_or(&victim->ready_queue->pull, _BS(cpu->cpuid));
+    if (atomic_read(&victim->idle))
+        lapic_send_ipi(victim->cpuid, T_WAKEUP);
+}
+
+int sched_steal(void)
+{
+    cpu_t *busiest = NULL;
+
+    if ((busiest = sched_busiest(0, NULL)) == NULL)
+        return 0;
+    sched_pull(busiest);
+    return 1;
+}
+
+void sched_balance(void)
+{
+    long load = 0, max = 0;
+    cpu_t *busiest = NULL;
+
+    if (time_before(jiffies_get(), ready_queue->next_balance))
+        return;
+    ready_queue->next_balance = jiffies_get() + SCHED_BALANCE_INTERVAL;
+
+    /**
+     * ask the cpu with the highest load average for a thread, if it
+     * carries at least two threads' worth more than this one. moving a
+     * thread when the difference is smaller would just bounce it around.
+     */
+    load = atomic_read(&ready_queue->load);
+    if ((busiest = sched_busiest(1, &max)) == NULL)
+        return;
+
+    if ((max - load) < (2 << SCHED_LOAD_SHIFT))
+        return;
+
+    atomic_incr(&ready_queue->nr_balance);
+    sched_pull(busiest);
+}
+
+void sched_tick(void)
+{
+    long nr = 0, load = 0;
+
+    if (ready_queue == NULL)
+        return;
+
+    pushcli();
+    if (ready_queue->epoch != sched_epoch())
+        rq_boost(ready_queue);
+    rq_serve_pulls(ready_queue);
+
+    // exponential moving average with a weight of 1/8 per tick.
+    nr = atomic_read(&ready_queue->nr_ready) + (current ? 1 : 0);
+    load = atomic_read(&ready_queue->load);
+    load += ((nr << SCHED_LOAD_SHIFT) - load) / 8;
+    atomic_write(&ready_queue->load, load);
+    popcli();
+}
+
+int sched_stat(int core, sched_stat_t *stat)
+{
+    sched_queue_t *sq = NULL;
+
+    if (stat == NULL || core < 0 || core >= ncpu)
+        return -EINVAL;
+
+    if ((sq = cpus[core].ready_queue) == NULL)
+        return -ENOENT;
+
+    stat->load = atomic_read(&sq->load);
+    stat->nr_ready = atomic_read(&sq->nr_ready);
+    stat->nr_pulled = atomic_read(&sq->nr_pulled);
+    stat->nr_pushed = atomic_read(&sq->nr_pushed);
+    stat->nr_balance = atomic_read(&sq->nr_balance);
+    return 0;
+}
+
+void sched_dump(void)
+{
+    sched_stat_t stat;
+
+    for (int i = 0; i < ncpu; ++i)
+    {
+        if (sched_stat(i, &stat))
+            continue;
+        printk("cpu%d: load: %d.%02d, ready: %d, pulled: %d, pushed: %d, balanced: %d\n",
+            i, stat.load >> SCHED_LOAD_SHIFT, ((stat.load & ((1 << SCHED_LOAD_SHIFT) - 1)) * 100) >> SCHED_LOAD_SHIFT,
+            stat.nr_ready, stat.nr_pulled, stat.nr_pushed, stat.nr_balance);
+    }
+}
 
 int sched_zombie(thread_t *thread)
 {
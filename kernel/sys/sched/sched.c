@@ -13,12 +13,13 @@
 #include <arch/sys/proc.h>
 #include <arch/i386/paging.h>
 #include <arch/sys/signal.h>
+#include <arch/i386/lapic.h>
+#include <lime/jiffies.h>
+#include <lime/timer.h>
 
 int sched_init(void)
 {
-    int err = 0;
     sched_queue_t *sq = NULL;
-    queue_t *q = NULL;
 
     if (!(sq = kmalloc(sizeof *sq)))
         return -ENOMEM;
@@ -27,13 +28,6 @@ int sched_init(void)
 
     for (int i = 0; i < NLEVELS; ++i)
     {
-        if ((err = queue_new(strcat_num("sched_queue", cpu->cpuid, 10), &q)))
-        {
-            panic("error initailizing scheduler queues, error=%d\n", err);
-        }
-
-        sq->level[i].queue = q;
-
         switch (i)
         {
         case 0:
@@ -121,9 +115,49 @@ void sched_set_priority(thread_t *thread, int priority)
     thread_assert_lock(thread);
     if (priority < 0 || priority > 255)
         priority = SCHED_LOWEST_PRIORITY;
+    atomic_write(&thread->t_sched_attr.t_base, priority);
     atomic_write(&thread->t_sched_attr.t_priority, priority);
 }
 
+/* move 'thread' 'nlevels' levels down (or up if negative), staying between its base and the bottom. */
+static void sched_adjust(thread_t *thread, int nlevels)
+{
+    long prio = atomic_read(&thread->t_sched_attr.t_priority);
+    long base = atomic_read(&thread->t_sched_attr.t_base);
+
+    prio += nlevels * SCHED_LEVEL_SIZE;
+    prio = MIN(MAX(prio, base), SCHED_LOWEST_PRIORITY);
+    atomic_write(&thread->t_sched_attr.t_priority, prio);
+}
+
+void sched_preempt(void)
+{
+    current_assert();
+    current_lock();
+    atomic_incr(&current->t_sched_attr.nivcsw);
+    sched_adjust(current, 1);
+    current->t_state = T_READY;
+    sched();
+    current_unlock();
+}
+
+void sched_thread_stat(thread_t *thread, tstat_t *stat)
+{
+    cpu_t *core = NULL;
+
+    thread_assert_lock(thread);
+    core = thread->t_sched_attr.core;
+
+    stat->ts_tid = thread->t_tid;
+    stat->ts_cpu = core ? core->cpuid : -1;
+    stat->ts_priority = atomic_read(&thread->t_sched_attr.t_priority);
+    stat->ts_level = SCHED_LEVEL(stat->ts_priority);
+    stat->ts_base = atomic_read(&thread->t_sched_attr.t_base);
+    stat->ts_runtime = atomic_read(&thread->t_sched_attr.age);
+    stat->ts_nvcsw = atomic_read(&thread->t_sched_attr.nvcsw);
+    stat->ts_nivcsw = atomic_read(&thread->t_sched_attr.nivcsw);
+}
+
 void sched_yield(void)
 {
     current_assert();
@@ -133,6 +167,44 @@ void sched_yield(void)
     current_unlock();
 }
 
+#define SCHED_IDLE_MAX  HZ  // longest tickless stretch, well inside a HPET counter wrap.
+
+/**
+ * nothing to run, halt until there is.
+ * the local tick is switched to one-shot and armed for the next timer
+ * deadline, a cpu that queues work here sends T_WAKEUP (see sched_park()).
+ */
+static void sched_idle(void)
+{
+    long delta = 0;
+    jiffies_t start = 0, elapsed = 0;
+
+    cli();
+    // publish before looking, so a concurrent sched_park() either is seen or sends a wakeup.
+    atomic_xchg(&cpu->idle, 1);
+    if (sched_runnable()) {
+        atomic_write(&cpu->idle, 0);
+        sti();
+        return;
+    }
+
+    delta = (long)(timer_next() - jiffies_get());
+    start = jiffies_get();
+    lapic_timer_oneshot(MIN(MAX(delta, 1), SCHED_IDLE_MAX));
+    sti_hlt();
+
+    cli();
+    atomic_write(&cpu->idle, 0);
+    jiffies_update(); // the tick may have been stopped for a while.
+
+    // catch the load average up on the ticks skipped, 32 take it to ~0.
+    elapsed = MIN(jiffies_get() - start, 32);
+    while (elapsed--)
+        sched_tick();
+    lapic_timer_periodic();
+    sti();
+}
+
 __noreturn void schedule(void)
 {
     mmap_t *mmap = NULL;
@@ -151,8 +223,11 @@ __noreturn void schedule(void)
         cpu->intena = 0;
 
         sti();
-        if (!(thread = sched_next()))
+        sched_balance();
+        if (!(thread = sched_next())) {
+            sched_idle();
             continue;
+        }
 
         cli();
 
@@ -173,7 +248,7 @@ __noreturn void schedule(void)
         if (mmap && current)
         {
             mmap_lock(mmap);
-            oldpgdir = paging_switch(mmap->pgdir);
+            oldpgdir = tlb_switch(mmap, mmap->pgdir);
             mmap_unlock(mmap);
             thread_setkstack(current->t_tarch);
         }
@@ -184,7 +259,7 @@ __noreturn void schedule(void)
         swtch(&cpu->context, current->t_tarch->context);
         current_assert_lock();
 
-        paging_switch(oldpgdir);
+        tlb_switch(NULL, oldpgdir);
 
         switch (current->t_state)
         {
@@ -204,6 +279,9 @@ __noreturn void schedule(void)
             panic("thread not running\n");
             break;
         case T_ISLEEP:
+            // gave up the cpu before its quantum ran out, favour it when it wakes.
+            atomic_incr(&current->t_sched_attr.nvcsw);
+            sched_adjust(current, -1);
             current_unlock();
             break;
         default:
@@ -1,6 +1,5 @@
 #include <printk.h>
 #include <sys/sleep.h>
-#include <dev/rtc.h>
 #include <bits/errno.h>
 #include <lime/jiffies.h>
 #include <ds/queue.h>
@@ -12,8 +11,18 @@ static queue_t *park_queue = QUEUE_NEW("park_queue");
 
 long sleep(long sec)
 {
-    while (sec) {if (rtc_wait()) break; sec--;}
-    return sec;
+    jiffies_t now = 0, end = 0;
+
+    if (sec <= 0)
+        return 0;
+
+    end = jiffies_get() + sec_to_jiffies(sec);
+    if (jiffies_sleep(sec_to_jiffies(sec)) == 0)
+        return 0;
+
+    // interrupted, return the seconds left.
+    now = jiffies_get();
+    return time_before(now, end) ? (long)((end - now + HZ - 1) / HZ) : 0;
 }
 
 long wait_ms(long ms)
@@ -79,5 +88,7 @@ void setpark(void)
 
 int timed_wait(long ms)
 {
-    return jiffies_sleep(ms);
+    if (ms <= 0)
+        return 0;
+    return jiffies_sleep(ms_to_jiffies(ms));
 }
\ No newline at end of file
@@ -13,6 +13,7 @@ $(binfmtobjs)\
 $(schedobjs)\
 $(syscallobjs)\
 $(threadsobjs)\
+$(sysdir)/futex.o\
 $(sysdir)/proc.o\
 $(sysdir)/session.o\
 $(sysdir)/signal.o\
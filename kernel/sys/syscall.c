@@ -4,14 +4,22 @@
 #include <bits/errno.h>
 #include <sys/thread.h>
 #include <arch/i386/cpu.h>
+#include <arch/i386/traps.h>
 #include <sys/proc.h>
 #include <fs/sysfile.h>
 #include <sys/sysprot.h>
 #include <sys/sleep.h>
+#include <sys/futex.h>
 #include <mm/vmm.h>
 #include <sys/sysproc.h>
 #include <dev/pty.h>
 #include <sys/_wait.h>
+#include <arch/i386/uaccess.h>
+#include <fs/fs.h>
+#include <fs/ioctl.h>
+#include <fs/termios.h>
+#include <dev/fb.h>
+#include <mm/kalloc.h>
 
 static uintptr_t (*syscall[])(void) = {
     [SYS_KPUTC](void *) sys_kputc,
@@ -26,6 +34,8 @@ static uintptr_t (*syscall[])(void) = {
     [SYS_GETCWD](void *) sys_getcwd,
     [SYS_CHDIR](void *) sys_chdir,
     [SYS_PIPE](void *) sys_pipe,
+    [SYS_SPLICE](void *) sys_splice,
+    [SYS_SENDFILE](void *) sys_sendfile,
     [SYS_DUP](void *) sys_dup,
     [SYS_DUP2](void *) sys_dup2,
     [SYS_FSTAT](void *) sys_fstat,
@@ -64,6 +74,8 @@ static uintptr_t (*syscall[])(void) = {
     [SYS_PARK](void *)sys_park,
     [SYS_UNPARK](void *)sys_unpark,
     [SYS_SETPARK](void *)sys_setpark,
+    [SYS_THREAD_STAT](void *)sys_thread_stat,
+    [SYS_FUTEX](void *)sys_futex,
 
     /*Protection*/
 
@@ -121,81 +133,77 @@ void syscall_stub(trapframe_t *tf)
         tf->eax = syscall[tf->eax]();
 }
 
-int chk_addr(uintptr_t addr)
-{
-    current_assert();
-    if (addr == 0)
-        return 0;
-    mmap_lock(current->mmap);
-    if (mmap_find(current->mmap, addr) == NULL)
-    {
-        mmap_unlock(current->mmap);
-        return -EADDRNOTAVAIL;
-    }
-    mmap_unlock(current->mmap);
-    return 0;
-}
+/**
+ * syscall arguments are fetched straight out of user memory with
+ * copy_from_user() & co., a bad address faults and is fixed up to -EFAULT.
+ * strings are copied into a kernel buffer before use. buffers the callee
+ * fills or drains itself (read(), write(), ...) are only range checked.
+ */
 
 int fetchint(uintptr_t addr, int *p)
 {
-    int err = 0;
-    if ((err = chk_addr(addr)))
-        return err;
-    *p = *(int *)addr;
-    return 0;
+    return copy_from_user(p, (const void *)addr, sizeof *p);
 }
 
-int fetchstr(uintptr_t addr, char **pp)
+int fetchstr(uintptr_t addr, char *buf, size_t size)
 {
-    int err = 0, len = 0;
-    char *str = (char *)addr, *end = (char *)USER_STACK;
-
-    if ((err = chk_addr(addr)))
-        return err;
-
-    for (; (str < end) && *str; ++len, ++str)
-    {
-        if ((err = chk_addr(addr)))
-            return err;
-    }
-
-    *pp = (char *)addr;
-    return len;
+    return strncpy_from_user(buf, (const char *)addr, size);
 }
 
+/**
+ * int 0x80 takes its arguments on the user stack, SYSENTER in
+ * ebx, esi, edi and ebp (so at most four, the rest use int 0x80).
+ */
 int argint(int n, int *p)
 {
     current_assert();
     trapframe_t *tf = current->t_tarch->tf;
+
+    if (tf->ino == T_SYSENTER)
+    {
+        uint32_t regs[] = {tf->ebx, tf->esi, tf->edi, tf->ebp};
+        if ((n < 0) || (n >= (int)NELEM(regs)))
+            return -EINVAL;
+        *p = regs[n];
+        return 0;
+    }
+
     return fetchint(tf->esp + 4 + n * 4, p);
 }
 
-int argstr(int n, char **str)
+// copy the 'n'th argument, a string, into 'buf'. returns its length or an error.
+int argstr(int n, char *buf, size_t size)
 {
     int err = 0;
     int addr = 0;
     if ((err = argint(n, &addr)))
         return err;
-    return fetchstr(addr, str);
+    return fetchstr(addr, buf, size);
 }
 
-int argptr(int n, void **pp, int size)
+/**
+ * the 'n'th argument, a user pointer to 'size' bytes. NULL is let through.
+ * this is a range check only, the memory itself must still be reached
+ * through copy_from_user()/copy_to_user() and never handed to a callee.
+ */
+int argptr(int n, void **pp, size_t size)
 {
     int err = 0;
     int addr = 0;
     current_assert();
     if ((err = argint(n, &addr)))
         return err;
-    if ((err = chk_addr(addr + size)))
-        return err;
+    if (addr && !access_ok(addr, size))
+        return -EFAULT;
     *pp = (void *)addr;
     return 0;
 }
 
 int sys_kputc(void)
 {
-    int c;
-    assert(!argint(0, &c), "EADDRNOTAVAIL");
+    int c = 0;
+    if (argint(0, &c))
+        return -EFAULT;
     return printk("%c", c);
 }
 
@@ -203,38 +211,114 @@ int sys_kputc(void)
 
 int sys_open(void)
 {
+    int err = 0;
     int oflags = 0;
-    char *path = NULL;
     mode_t mode = 0;
-    assert(argstr(0, &path) > 0, "err fetching argstr");
-    assert(!argint(1, &oflags), "err fetching argint");
+    char path[PATH_MAX];
+
+    if ((err = argstr(0, path, sizeof path)) < 0)
+        return err;
+    if ((err = argint(1, &oflags)))
+        return err;
 
     if ((oflags & O_CREAT) || (oflags & __O_TMPFILE))
-        assert(!argint(2, &mode), "err fetching argint");
+    {
+        if ((err = argint(2, (int *)&mode)))
+            return err;
+    }
 
     return open(path, oflags, mode);
 }
 
+#define SYSIO_SHORT 256 // read()s and write()s this short bounce through the kernel stack.
+
+/**
+ * a kernel buffer for a read() or write() of 'sz' bytes, its size goes in *pchunk.
+ * short transfers use 'sbuf' on the caller's stack, longer ones go a page at a time
+ * through the calling thread's bounce page.
+ */
+static void *sysio_buf(char *sbuf, size_t sz, size_t *pchunk)
+{
+    if (sz <= SYSIO_SHORT)
+    {
+        *pchunk = SYSIO_SHORT;
+        return sbuf;
+    }
+
+    if (current->t_iobuf == NULL)
+        current->t_iobuf = kmalloc(PAGESZ);
+    *pchunk = PAGESZ;
+    return current->t_iobuf;
+}
+
+/* can 'fd' be read in more than one go without blocking with data already taken? */
+static int sysio_regular(int fd)
+{
+    struct stat st = {0};
+    return (fstat(fd, &st) == 0) && ((st.st_mode & S_IFMT) == S_IFREG);
+}
+
 int sys_read(void)
 {
     int fd = 0;
-    size_t sz = 0;
-    void *buf = NULL;
-    assert(!argint(0, &fd), "err fetching fd");
-    assert(!argptr(1, &buf, sizeof(void *)), "err fetching ptr");
-    assert(!argint(2, (int *)&sz), "err fetching nbytes");
-    return read(fd, buf, sz);
+    int more = 0;
+    void *kbuf = NULL;
+    char *ubuf = NULL;
+    char sbuf[SYSIO_SHORT];
+    ssize_t n = 0, done = 0;
+    size_t sz = 0, chunk = 0;
+
+    if (argint(0, &fd) || argint(2, (int *)&sz))
+        return -EFAULT;
+    if (argptr(1, (void **)&ubuf, sz))
+        return -EFAULT;
+    if ((kbuf = sysio_buf(sbuf, sz, &chunk)) == NULL)
+        return -ENOMEM;
+
+    // only regular files are read past the first chunk, others may block with data taken.
+    more = (sz > chunk) && sysio_regular(fd);
+
+    do {
+        if ((n = read(fd, kbuf, MIN(chunk, sz - done))) <= 0)
+            break;
+        if (copy_to_user(ubuf + done, kbuf, n)) {
+            n = -EFAULT;
+            break;
+        }
+        done += n;
+    } while (more && ((size_t)done < sz) && ((size_t)n == chunk));
+
+    return (done || n >= 0) ? done : n;
 }
 
 int sys_write(void)
 {
     int fd = 0;
-    size_t sz = 0;
-    void *buf = NULL;
-    assert(!argint(0, &fd), "err fetching fd");
-    assert(!argptr(1, &buf, sizeof(void *)), "err fetching ptr");
-    assert(!argint(2, (int *)&sz), "err fetching nbytes");
-    return write(fd, buf, sz);
+    void *kbuf = NULL;
+    char *ubuf = NULL;
+    char sbuf[SYSIO_SHORT];
+    ssize_t n = 0, done = 0;
+    size_t sz = 0, chunk = 0, len = 0;
+
+    if (argint(0, &fd) || argint(2, (int *)&sz))
+        return -EFAULT;
+    if (argptr(1, (void **)&ubuf, sz))
+        return -EFAULT;
+    if ((kbuf = sysio_buf(sbuf, sz, &chunk)) == NULL)
+        return -ENOMEM;
+
+    do {
+        len = MIN(chunk, sz - done);
+        if (copy_from_user(kbuf, ubuf + done, len)) {
+            n = -EFAULT;
+            break;
+        }
+        if ((n = write(fd, kbuf, len)) <= 0)
+            break;
+        done += n;
+    } while (((size_t)done < sz) && ((size_t)n == len));
+
+    return (done || n >= 0) ? done : n;
 }
 
 off_t sys_lseek(void)
@@ -242,54 +326,79 @@ off_t sys_lseek(void)
     int fd = 0;
     int whence = 0;
     off_t offset = 0;
-    assert(!argint(0, &fd), "err fetching fd");
-    assert(!argint(1, (int *)&offset), "err fetching offset");
-    assert(!argint(2, &whence), "err fetching whence");
+    if (argint(0, &fd) || argint(1, (int *)&offset) || argint(2, &whence))
+        return -EFAULT;
     return lseek(fd, offset, whence);
 }
 
 int sys_close(void)
 {
     int fd = 0;
-    assert(!argint(0, &fd), "err fetching fd");
+    if (argint(0, &fd))
+        return -EFAULT;
     return close(fd);
 }
 
-int sys_readdir(void){
+int sys_readdir(void)
+{
     int fd = 0;
-    struct dirent *dirent = NULL;
-    assert(!argint(0, (int *)&fd), "err fetching fd");
-    assert(!argptr(1, (void **)&dirent, sizeof(char *)), "err fetching dirent");
-    return readdir(fd, dirent);
+    int err = 0;
+    struct dirent dirent = {0};
+    struct dirent *udirent = NULL;
+
+    if (argint(0, &fd) || argptr(1, (void **)&udirent, sizeof *udirent))
+        return -EFAULT;
+    if ((err = readdir(fd, &dirent)))
+        return err;
+    return copy_to_user(udirent, &dirent, sizeof dirent);
 }
 
 char *sys_getcwd(void)
 {
     size_t sz = 0;
     char *buf = NULL;
-    assert(!argptr(0, (void **)&buf, sizeof(char *)), "err fetching buf");
-    assert(!argint(1, (int *)&sz), "err fetching nbytes");
-    return getcwd(buf, sz);
+    char cwd[PATH_MAX];
+    if (argint(1, (int *)&sz) || argptr(0, (void **)&buf, sz) || buf == NULL)
+        return NULL;
+    if (getcwd(cwd, MIN(sz, sizeof cwd)) == NULL)
+        return NULL;
+    if (copy_to_user(buf, cwd, strlen(cwd) + 1))
+        return NULL;
+    return buf;
 }
 
 int sys_chdir(void)
 {
-    char *dir = NULL;
-    assert(argstr(0, &dir) > 0, "err fetching dir");
+    int err = 0;
+    char dir[PATH_MAX];
+    if ((err = argstr(0, dir, sizeof dir)) < 0)
+        return err;
     return chdir(dir);
 }
 
 int sys_pipe(void)
 {
+    int err = 0;
+    int fds[2] = {0};
     int *p = NULL;
-    assert(!argptr(0, (void **)&p, sizeof(int *)), "err fetching ptr");
-    return pipe(p);
+
+    if (argptr(0, (void **)&p, sizeof fds) || p == NULL)
+        return -EFAULT;
+    if ((err = pipe(fds)))
+        return err;
+    if ((err = copy_to_user(p, fds, sizeof fds)))
+    {
+        close(fds[0]);
+        close(fds[1]);
+    }
+    return err;
 }
 
 int sys_dup(void)
 {
     int fd = 0;
-    assert(!argint(0, &fd), "err fetching fd");
+    if (argint(0, &fd))
+        return -EFAULT;
     return dup(fd);
 }
 
@@ -297,47 +406,148 @@ int sys_dup2(void)
 {
     int fd = 0;
     int fd1 = 0;
-    assert(!argint(0, &fd), "err fetching fd");
-    assert(!argint(1, &fd1), "err fetching fd");
+    if (argint(0, &fd) || argint(1, &fd1))
+        return -EFAULT;
     return dup2(fd, fd1);
 }
 
 int sys_fstat(void)
 {
     int fd = 0;
-    struct stat *buf = NULL;
-    assert(!argint(0, &fd), "err fetching fd");
-    assert(!argptr(1, (void **)&buf, sizeof(struct stat *)), "err fetching \'struct stat *\'");
-    return fstat(fd, buf);
+    int err = 0;
+    struct stat buf = {0};
+    struct stat *ubuf = NULL;
+
+    if (argint(0, &fd) || argptr(1, (void **)&ubuf, sizeof *ubuf))
+        return -EFAULT;
+    if ((err = fstat(fd, &buf)))
+        return err;
+    return copy_to_user(ubuf, &buf, sizeof buf);
 }
 
 int sys_stat(void)
 {
-    char *path = NULL;
-    struct stat *buf = NULL;
-    assert(argstr(0, &path) > 0, "err fetching path");
-    assert(!argptr(1, (void **)&buf, sizeof(struct stat *)), "err fetching \'struct stat *\'");
-    return stat(path, buf);
+    int err = 0;
+    char path[PATH_MAX];
+    struct stat buf = {0};
+    struct stat *ubuf = NULL;
+
+    if ((err = argstr(0, path, sizeof path)) < 0)
+        return err;
+    if (argptr(1, (void **)&ubuf, sizeof *ubuf))
+        return -EFAULT;
+    if ((err = stat(path, &buf)))
+        return err;
+    return copy_to_user(ubuf, &buf, sizeof buf);
+}
+
+int sys_splice(void)
+{
+    int fd_in = 0, fd_out = 0, len = 0, flags = 0;
+
+    if (argint(0, &fd_in) || argint(1, &fd_out) || argint(2, &len) || argint(3, &flags))
+        return -EFAULT;
+    return splice(fd_in, fd_out, len, flags);
 }
 
+int sys_sendfile(void)
+{
+    off_t off = 0;
+    ssize_t retval = 0;
+    off_t *uoff = NULL;
+    int out_fd = 0, in_fd = 0, count = 0;
+
+    if (argint(0, &out_fd) || argint(1, &in_fd) || argint(3, &count))
+        return -EFAULT;
+    if (argptr(2, (void **)&uoff, sizeof *uoff))
+        return -EFAULT;
+    if (uoff && copy_from_user(&off, uoff, sizeof off))
+        return -EFAULT;
+
+    retval = sendfile(out_fd, in_fd, uoff ? &off : NULL, count);
+
+    if (uoff && copy_to_user(uoff, &off, sizeof off))
+        return -EFAULT;
+    return retval;
+}
+
+/**
+ * requests whose argument points at memory the driver reads (_IOC_WRITE)
+ * or fills in (_IOC_READ) and that don't encode it with _IOC().
+ * any other request's argument is passed on as a plain value.
+ */
+static const struct
+{
+    long    request;
+    int     dir;
+    size_t  size;
+} ioctl_args[] = {
+    {TCGETS,            _IOC_READ,  sizeof(struct termios)},
+    {TCSETS,            _IOC_WRITE, sizeof(struct termios)},
+    {TIOCGPGRP,         _IOC_READ,  sizeof(pid_t)},
+    {TIOCSPGRP,         _IOC_WRITE, sizeof(pid_t)},
+    {TIOCGWINSZ,        _IOC_READ,  sizeof(struct winsize)},
+    {TIOCSWINSZ,        _IOC_WRITE, sizeof(struct winsize)},
+    {FBIOGET_FIX_INFO,  _IOC_READ,  sizeof(fb_fixinfo_t)},
+    {FBIOGET_VAR_INFO,  _IOC_READ,  sizeof(fb_varinfo_t)},
+};
+
 int sys_ioctl(void)
 {
-    int fd = 0;
+    int err = 0;
+    int fd = 0, dir = 0;
     long request = 0;
+    size_t size = 0;
     void *argp = NULL;
+    union
+    {
+        struct termios  tios;
+        struct winsize  ws;
+        fb_fixinfo_t    fix;
+        fb_varinfo_t    var;
+        char            raw[128];
+    } karg = {0};
+
+    if (argint(0, &fd) || argint(1, (int *)&request) || argint(2, (int *)&argp))
+        return -EFAULT;
+
+    dir = ((unsigned long)request >> 30) & 3;
+    size = ((unsigned long)request >> 16) & 0x3FFF;
+    for (int i = 0; !size && i < (int)NELEM(ioctl_args); ++i)
+    {
+        if (ioctl_args[i].request == request)
+        {
+            dir = ioctl_args[i].dir;
+            size = ioctl_args[i].size;
+        }
+    }
+
+    if (size == 0 || dir == _IOC_NONE)
+        return ioctl(fd, request, argp);
+
+    if (size > sizeof karg)
+        return -EINVAL;
 
-    assert(!argint(0, &fd), "err fetching fd");
-    assert(!argint(1, (int *)&request), "err fetching request");
-    assert(!argptr(2, &argp, sizeof(void *)), "err fetching argp");
-    return ioctl(fd, request, argp);
+    if ((dir & _IOC_WRITE) && copy_from_user(&karg, argp, size))
+        return -EFAULT;
+
+    if ((err = ioctl(fd, request, &karg)) < 0)
+        return err;
+
+    if ((dir & _IOC_READ) && copy_to_user(argp, &karg, size))
+        return -EFAULT;
+    return err;
 }
 
 int sys_creat(void)
 {
+    int err = 0;
     int mode = 0;
-    char *path = NULL;
-    assert(argstr(0, &path) > 0, "err fetching path");
-    assert(!argint(1, &mode), "err fetching mode");
+    char path[PATH_MAX];
+    if ((err = argstr(0, path, sizeof path)) < 0)
+        return err;
+    if (argint(1, &mode))
+        return -EFAULT;
     return -ENOSYS; // creat(path, mode);
 }
 
@@ -351,14 +561,15 @@ pid_t sys_getpid(void)
 long sys_sleep(void)
 {
     long ms = 0;
-    assert(!argint(0, (int *)&ms), "err fetching ms");
+    if (argint(0, (int *)&ms))
+        return -EFAULT;
     return sleep(ms);
 }
 
 void sys_exit(void)
 {
     int status = 0;
-    assert(!argint(0, &status), "err fetching exit code");
+    argint(0, &status);
     exit(status);
     thread_exit(status);
 }
@@ -370,40 +581,62 @@ pid_t sys_fork(void)
 
 pid_t sys_wait(void)
 {
+    pid_t pid = 0;
+    int status = 0;
     int *staloc = NULL;
-    assert(!argptr(0, (void **)&staloc, sizeof(int *)), "err fetching staloc");
-    return wait(staloc);
+
+    if (argptr(0, (void **)&staloc, sizeof *staloc))
+        return -EFAULT;
+    if ((pid = wait(staloc ? &status : NULL)) > 0 && staloc)
+    {
+        if (copy_to_user(staloc, &status, sizeof status))
+            return -EFAULT;
+    }
+    return pid;
 }
 
 pid_t sys_waitpid(void)
 {
     pid_t pid = 0;
-    int *stat_loc = NULL;
+    int status = 0;
     int options = 0;
-    argint(0, &pid);
-    argptr(1, (void **)&stat_loc, sizeof(int *));
-    argint(2, &options);
-    return waitpid(pid, stat_loc, options);
+    int *stat_loc = NULL;
+
+    if (argint(0, &pid) || argptr(1, (void **)&stat_loc, sizeof *stat_loc) || argint(2, &options))
+        return -EFAULT;
+    if ((pid = waitpid(pid, stat_loc ? &status : NULL, options)) > 0 && stat_loc)
+    {
+        if (copy_to_user(stat_loc, &status, sizeof status))
+            return -EFAULT;
+    }
+    return pid;
 }
 
 int sys_execve(void)
 {
-    char *path = NULL;
+    int err = 0;
+    char path[PATH_MAX];
     char **argp = NULL;
     char **envp = NULL;
-    assert(argstr(0, &path) > 0, "err fetching path");
-    assert(!argptr(1, (void **)&argp, sizeof(char **)), "err fetching argp");
-    assert(!argptr(2, (void **)&envp, sizeof(char **)), "err fetching envp");
-    return execve(path, (const char **)argp, (const char **)envp);
+
+    if ((err = argstr(0, path, sizeof path)) < 0)
+        return err;
+    if (argptr(1, (void **)&argp, sizeof *argp) || argptr(2, (void **)&envp, sizeof *envp))
+        return -EFAULT;
+    return execve_user(path, (const char **)argp, (const char **)envp);
 }
 
 int sys_execv(void)
 {
-    char *path = NULL;
+    int err = 0;
+    char path[PATH_MAX];
     char **argv = NULL;
-    assert(argstr(0, &path) > 0, "err fetching execv");
-    assert(!argptr(1, (void **)&argv, sizeof(char **)), "err fetching argv");
-    return execv(path, (const char **)argv);
+
+    if ((err = argstr(0, path, sizeof path)) < 0)
+        return err;
+    if (argptr(1, (void **)&argv, sizeof *argv))
+        return -EFAULT;
+    return execve_user(path, (const char **)argv, NULL);
 }
 
 
@@ -413,7 +646,8 @@ int sys_execv(void)
 void *sys_sbrk(void)
 {
     ptrdiff_t incr = 0;
-    assert(!argint(0, (int *)&incr), "err fetching incr");
+    if (argint(0, (int *)&incr))
+        return (void *)-EFAULT;
     return sbrk(incr);
 }
 
@@ -430,12 +664,10 @@ void *sys_mmap(void)
     int flags = 0;
     int fd = 0;
     off_t offset = 0;
-    assert(!argint(0, (int *)&addr), "err fetching addr");
-    assert(!argint(1, (int *)&length), "err fetching length");
-    assert(!argint(2, (int *)&prot), "err fetching prot");
-    assert(!argint(3, (int *)&flags), "err fetching flags");
-    assert(!argint(4, (int *)&fd), "err fetching fd");
-    assert(!argint(5, (int *)&offset), "err fetching offset");
+    if (argint(0, (int *)&addr) || argint(1, (int *)&length) ||
+        argint(2, (int *)&prot) || argint(3, (int *)&flags) ||
+        argint(4, (int *)&fd) || argint(5, (int *)&offset))
+        return (void *)-EFAULT;
     return mmap((void *)addr, length, prot, flags, fd, offset);
 }
 
@@ -443,8 +675,8 @@ int sys_munmap(void)
 {
     uintptr_t addr = 0;
     size_t length = 0;
-    assert(!argint(0, (int *)&addr), "err fetching addr");
-    assert(!argint(1, (int *)&length), "err fetching length");
+    if (argint(0, (int *)&addr) || argint(1, (int *)&length))
+        return -EFAULT;
     return munmap((void *)addr, length);
 }
 
@@ -453,9 +685,8 @@ int sys_mprotect(void)
     int prot = 0;
     size_t len = 0;
     uintptr_t addr = 0;
-    assert(!argint(0, (int *)&addr), "err fetching addr");
-    assert(!argint(1, (int *)&len), "err fetching length");
-    assert(!argint(2, (int *)&prot), "err fetching prot");
+    if (argint(0, (int *)&addr) || argint(1, (int *)&len) || argint(2, (int *)&prot))
+        return -EFAULT;
     return mprotect((void *)addr, len, prot);
 }
 
@@ -468,13 +699,17 @@ void sys_thread_yield(void)
 
 int sys_thread_create(void)
 {
+    int err = 0;
+    tid_t tid = 0;
     uintptr_t arg = 0;
-    tid_t *tid = NULL;
+    tid_t *utid = NULL;
     void *(*entry)(void *) = NULL;
-    assert(!argptr(0, (void **)&tid, sizeof(tid_t *)), "err fetching tid");
-    assert(!argptr(1, (void **)&entry, sizeof(void *(*)(void *))), "err fetching entry point");
-    assert(!argint(2, (int *)&arg), "err fetching arg");
-    return thread_create(tid, entry, (void *)arg);
+
+    if (argptr(0, (void **)&utid, sizeof *utid) || argptr(1, (void **)&entry, 1) || argint(2, (int *)&arg))
+        return -EFAULT;
+    if ((err = thread_create(&tid, entry, (void *)arg)))
+        return err;
+    return utid ? copy_to_user(utid, &tid, sizeof tid) : 0;
 }
 
 tid_t sys_thread_self(void)
@@ -484,25 +719,30 @@ tid_t sys_thread_self(void)
 
 int sys_thread_join(void)
 {
+    int err = 0;
     tid_t tid = 0;
-    void **retval = NULL;
-    assert(!argint(0, &tid), "err fetching tid");
-    assert(!argptr(1, (void **)&retval, sizeof(void **)), "err fetching retval-ptr");
-    return thread_join(tid, retval);
+    void *retval = NULL;
+    void **uretval = NULL;
+
+    if (argint(0, &tid) || argptr(1, (void **)&uretval, sizeof *uretval))
+        return -EFAULT;
+    if ((err = thread_join(tid, uretval ? &retval : NULL)))
+        return err;
+    return uretval ? copy_to_user(uretval, &retval, sizeof retval) : 0;
 }
 
 void sys_thread_exit(void)
 {
     uintptr_t retval = 0;
-    assert(!argint(0, (int *)&retval), "err fetching retval-ptr");
+    argint(0, (int *)&retval);
     thread_exit((uintptr_t)retval);
 }
 
 int sys_thread_cancel(void)
 {
     tid_t thread = 0;
-    argint(0, &thread);
-
+    if (argint(0, &thread))
+        return -EFAULT;
     return thread_cancel(thread);
 }
 
@@ -514,7 +754,8 @@ int sys_park(void)
 int sys_unpark(void)
 {
     tid_t tid = 0;
-    assert(!argint(0, &tid), "err fetching tid");
+    if (argint(0, &tid))
+        return -EFAULT;
     return unpark(tid);
 }
 
@@ -523,6 +764,35 @@ void sys_setpark(void)
     setpark();
 }
 
+int sys_thread_stat(void)
+{
+    int err = 0;
+    tid_t tid = 0;
+    tstat_t stat = {0};
+    tstat_t *ustat = NULL;
+
+    if (argint(0, &tid) || argptr(1, (void **)&ustat, sizeof *ustat) || ustat == NULL)
+        return -EFAULT;
+    if ((err = thread_stat(tid, &stat)))
+        return err;
+    return copy_to_user(ustat, &stat, sizeof stat);
+}
+
+int sys_futex(void)
+{
+    int op = 0, val = 0, val2 = 0;
+    int *uaddr = NULL, *uaddr2 = NULL;
+
+    if (argptr(0, (void **)&uaddr, sizeof *uaddr) || argint(1, &op) || argint(2, &val))
+        return -EFAULT;
+    if (op == FUTEX_REQUEUE)
+    {
+        if (argptr(3, (void **)&uaddr2, sizeof *uaddr2) || argint(4, &val2))
+            return -EFAULT;
+    }
+    return futex(uaddr, op, val, uaddr2, val2);
+}
+
 /*Protection*/
 
 uid_t sys_getuid(void)
@@ -538,25 +808,30 @@ gid_t sys_getgid(void)
 int sys_setgid(void)
 {
     gid_t gid = 0;
-    assert(!argint(0, &gid), "err fetching gid");
+    if (argint(0, &gid))
+        return -EFAULT;
     return setgid(gid);
 }
 
 int sys_setuid(void)
 {
     uid_t uid = 0;
-    assert(!argint(0, &uid), "err fetching uid");
+    if (argint(0, &uid))
+        return -EFAULT;
     return setuid(uid);
 }
 
 int sys_chown(void)
 {
-    char *pathname = NULL;
+    int err = 0;
     uid_t uid = 0;
     gid_t gid = 0;
-    assert(argstr(0, &pathname) > 0, "err fetching pathname");
-    assert(!argint(1, &uid), "err fetching uid");
-    assert(!argint(2, &gid), "err fetching gid");
+    char pathname[PATH_MAX];
+
+    if ((err = argstr(0, pathname, sizeof pathname)) < 0)
+        return err;
+    if (argint(1, &uid) || argint(2, &gid))
+        return -EFAULT;
     return chown(pathname, uid, gid);
 }
 
@@ -565,9 +840,8 @@ int sys_fchown(void)
     int fd = 0;
     uid_t uid = 0;
     gid_t gid = 0;
-    assert(!argint(0, &fd), "err fetching fd");
-    assert(!argint(1, &uid), "err fetching uid");
-    assert(!argint(2, &gid), "err fetching gid");
+    if (argint(0, &fd) || argint(1, &uid) || argint(2, &gid))
+        return -EFAULT;
     return fchown(fd, uid, gid);
 }
 
@@ -586,15 +860,16 @@ pid_t sys_setpgrp(void)
 pid_t sys_getpgid(void)
 {
     pid_t pid = 0;
-    assert(!argint(0, &pid), "err fetching pid");
+    if (argint(0, &pid))
+        return -EFAULT;
     return getpgid(pid);
 }
 
 pid_t sys_setpgid(void)
 {
     pid_t pid = 0, pgid = 0;
-    assert(!argint(0, &pid), "err fetching pid");
-    assert(!argint(1, &pgid), "err fetching pgid");
+    if (argint(0, &pid) || argint(1, &pgid))
+        return -EFAULT;
     return setpgid(pid, pgid);
 }
 
@@ -606,7 +881,8 @@ pid_t sys_setsid(void)
 pid_t sys_getsid(void)
 {
     pid_t pid = 0;
-    assert(!argint(0, &pid), "err fetching pid");
+    if (argint(0, &pid))
+        return -EFAULT;
     return getsid(pid);
 }
 
@@ -622,9 +898,9 @@ pid_t sys_getpgrp(void)
 void (*sys_signal(void))(int)
 {
     pid_t pid = 0;
-    void (*handler)(int);
-    assert(!argint(0, &pid), "err fetching pid");
-    assert(!argptr(1, (void **)&handler, sizeof handler), "err fetching handler");
+    void (*handler)(int) = NULL;
+    if (argint(0, &pid) || argptr(1, (void **)&handler, 1))
+        return (void (*)(int))-EFAULT;
     return signal(pid, handler);
 }
 
@@ -637,46 +913,55 @@ int sys_kill(void)
 {
     pid_t pid = 0;
     int sig = 0;
-    assert(!argint(0, &pid), "err fetching pid");
-    assert(!argint(1, &sig), "err fetching sig");
+    if (argint(0, &pid) || argint(1, &sig))
+        return -EFAULT;
     return kill(pid, sig);
 }
 
 int sys_isatty(void)
 {
     int fd = 0;
-    assert(!argint(0, &fd), "err fetching fd");
+    if (argint(0, &fd))
+        return -EFAULT;
     return isatty(fd);
 }
 
 int sys_ptsname_r(void)
 {
     int fd = 0;
+    int err = 0;
     char *buf = NULL;
     size_t size = 0;
-    assert(!argint(0, &fd), "err fetching fd");
-    assert(!argptr(1, (void **)&buf, sizeof buf), "err fetching buf");
-    assert(!argint(2, (int *)&size), "err fetching size");
-    return ptsname_r(fd, buf, size);
+    char name[PATH_MAX];
+    if (argint(0, &fd) || argint(2, (int *)&size) || argptr(1, (void **)&buf, size))
+        return -EFAULT;
+    if (buf == NULL)
+        return -EINVAL;
+    if ((err = ptsname_r(fd, name, MIN(size, sizeof name))))
+        return err;
+    return copy_to_user(buf, name, strlen(name) + 1);
 }
 
 int sys_grantpt(void)
 {
     int fd = 0;
-    assert(!argint(0, &fd), "err fetching fd");
+    if (argint(0, &fd))
+        return -EFAULT;
     return grantpt(fd);
 }
 
 int sys_unlockpt(void)
 {
     int fd = 0;
-    assert(!argint(0, &fd), "err fetching fd");
+    if (argint(0, &fd))
+        return -EFAULT;
     return unlockpt(fd);
 }
 
 int sys_openpt(void)
 {
     int status = 0;
-    assert(!argint(0, &status), "err fetching status");
+    if (argint(0, &status))
+        return -EFAULT;
     return openpt(status);
 }
\ No newline at end of file
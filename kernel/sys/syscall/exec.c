@@ -8,26 +8,18 @@
 #include <arch/i386/paging.h>
 #include <arch/sys/uthread.h>
 #include <arch/system.h>
+#include <lime/vdata.h>
 
 int argenv_copy(mmap_t *__mmap, const char *__argp[], const char *__envp[], char **argv[], int *pargc, char **envv[]);
 
-int execve(const char *fn, const char *argp[], const char *envp[])
+/* replace the current image with 'fn', consumes the kernel copy of the args in 'arg_envp'. */
+static int execve_argenv(const char *fn, char ***arg_envp)
 {
     int err = 0;
-    char ***arg_envp = NULL;
     char *binary_path = NULL;
     context_t *swtch_ctx = NULL;
     mmap_t *new_mmap = NULL, *old_mmap = NULL;
 
-    if (fn == NULL)
-        return -EINVAL;
-
-    if (current == NULL)
-        return -EINVAL;
-
-    if ((arg_envp = arch_execve_cpy((char **)argp, (char **)envp)) == NULL)
-        return -ENOMEM;
-
     if ((binary_path = strdup(fn)) == NULL)
     {
         err = -ENOMEM;
@@ -57,6 +49,7 @@ int execve(const char *fn, const char *argp[], const char *envp[])
     }
 
     mmap_lock(new_mmap);
+    vdata_setproc(new_mmap, proc->pid);
 
     /**
      * We switch to the new address space
@@ -273,6 +266,39 @@ error:
     return err;
 }
 
+int execve(const char *fn, const char *argp[], const char *envp[])
+{
+    char ***arg_envp = NULL;
+
+    if (fn == NULL)
+        return -EINVAL;
+
+    if (current == NULL)
+        return -EINVAL;
+
+    if ((arg_envp = arch_execve_cpy((char **)argp, (char **)envp)) == NULL)
+        return -ENOMEM;
+
+    return execve_argenv(fn, arg_envp);
+}
+
+int execve_user(const char *fn, const char *uargp[], const char *uenvp[])
+{
+    int err = 0;
+    char ***arg_envp = NULL;
+
+    if (fn == NULL)
+        return -EINVAL;
+
+    if (current == NULL)
+        return -EINVAL;
+
+    if ((err = arch_execve_ucpy(uargp, uenvp, &arg_envp)))
+        return err;
+
+    return execve_argenv(fn, arg_envp);
+}
+
 int execv(const char *path, const char *argp[])
 {
     return execve(path, (const char **)argp, NULL);
@@ -73,6 +73,32 @@ void thread_yield(void)
     sched_yield();
 }
 
+int thread_stat(tid_t tid, tstat_t *stat)
+{
+    int err = 0;
+    thread_t *thread = NULL;
+
+    current_assert();
+    if (stat == NULL)
+        return -EINVAL;
+
+    if (tid == 0 || tid == current->t_tid)
+    {
+        current_lock();
+        sched_thread_stat(current, stat);
+        current_unlock();
+        return 0;
+    }
+
+    assert(current->t_group, "no t_group");
+    if ((err = thread_get(current->t_group, tid, &thread)))
+        return err;
+
+    sched_thread_stat(thread, stat);
+    thread_unlock(thread);
+    return 0;
+}
+
 int thread_create(tid_t *tid, void *(*entry)(void *), void *arg)
 {
     int err = 0;
@@ -92,7 +118,7 @@ int thread_create(tid_t *tid, void *(*entry)(void *), void *arg)
     thread->t_group = current->t_group;
     thread->t_file_table = current->t_file_table;
 
-    sched_set_priority(thread, SCHED_LOWEST_PRIORITY);
+    sched_set_priority(thread, SCHED_DEFAULT_PRIORITY);
 
     mmap_lock(current->mmap);
     if ((err = mmap_alloc_stack(proc->mmap, USTACKSIZE, &stack)))
@@ -42,7 +42,7 @@ int kthread_create(void *(*entry)(void *), void *arg, tid_t *tref, thread_t **re
     if (tref)
         *tref = thread->t_tid;
 
-    sched_set_priority(thread, SCHED_LOWEST_PRIORITY);
+    sched_set_priority(thread, SCHED_DEFAULT_PRIORITY);
 
     err = sched_park(thread);
     thread_unlock(thread);
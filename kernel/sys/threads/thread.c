@@ -1,6 +1,7 @@
 #include <printk.h>
 #include <sys/proc.h>
 #include <mm/kalloc.h>
+#include <mm/slab.h>
 #include <bits/errno.h>
 #include <lib/string.h>
 #include <sys/thread.h>
@@ -10,6 +11,7 @@
 #include <arch/sys/uthread.h>
 
 static atomic_t tids = 1;
+static kmem_cache_t *thread_cache = KMEM_CACHE_NEW("thread", sizeof(thread_t), NULL);
 
 void tgroup_free(tgroup_t *tgroup)
 {
@@ -208,20 +210,19 @@ int thread_new(thread_t **tref)
     if ((err = arch_thread_alloc(&tarch)))
         goto error;
 
-    if (!(thread = kmalloc(sizeof *thread)))
+    if (!(thread = kmem_cache_alloc(thread_cache, GFP_ZERO)))
     {
         err = -ENOMEM;
         goto error;
     }
 
-    memset(thread, 0, sizeof *thread);
     thread->t_tid = tid;
     thread->t_queues = queues;
     thread->t_lock = lock;
     thread->t_wait = wait_cond;
     thread->t_tarch = tarch;
     thread_lock(thread); // start out as locked thread
-    sched_set_priority(thread, SCHED_LOWEST_PRIORITY);
+    sched_set_priority(thread, SCHED_DEFAULT_PRIORITY);
     queue_unlock(queues);
     kfree(name);
 
@@ -236,7 +237,7 @@ error:
     if (lock)
         spinlock_free(lock);
     if (thread)
-        kfree(thread);
+        kmem_cache_free(thread_cache, thread);
     if (wait_cond)
         cond_free(wait_cond);
     if (tarch)
@@ -268,7 +269,9 @@ void thread_free(thread_t *thread)
     }
     if (thread->t_tarch)
         arch_thread_free(thread->t_tarch);
-    kfree(thread);
+    if (thread->t_iobuf)
+        kfree(thread->t_iobuf);
+    kmem_cache_free(thread_cache, thread);
 }
 
 void thread_dump(thread_t *);
@@ -390,6 +393,8 @@ int thread_fork(thread_t *dst, thread_t *src)
 
     dst->t_sched_attr = src->t_sched_attr;
     atomic_write(&dst->t_sched_attr.age, 0);
+    atomic_write(&dst->t_sched_attr.nvcsw, 0);
+    atomic_write(&dst->t_sched_attr.nivcsw, 0);
 
     if (!(vmr = mmap_find(dst->mmap, ((trapframe_t *)src->t_tarch->tf)->esp)))
     {
@@ -34,8 +34,13 @@ int main(int argc, char **argv)
 
 
         int r;
-        while ((r = read(fd, buf, 1024)) > 0) {
-            write(1, buf, r);
+        // regular files go out straight from the kernel's pages.
+        while ((r = sendfile(1, fd, NULL, 64 * 1024)) > 0)
+            ;
+        if (r < 0) {
+            while ((r = read(fd, buf, 1024)) > 0) {
+                write(1, buf, r);
+            }
         }
 
         close(fd);
@@ -0,0 +1,66 @@
+// vdata read latency microbenchmark.
+// usage: clockbench [iterations]
+//
+// times getpid() and clock_gettime(), both served from the kernel's
+// vdata page, next to thread_self(), a real system call, and prints
+// the average cost of each in TSC cycles. then checks the clock never
+// steps backwards while spinning on it for a second.
+
+#include <ginger.h>
+#include <sys/rdtsc.h>
+
+static unsigned run(const char *what, int iters)
+{
+    struct timespec ts;
+    unsigned long long tsc = 0;
+    int which = what[0];
+
+    tsc = rdtsc();
+    for (int i = 0; i < iters; ++i) {
+        if (which == 'g')
+            getpid();
+        else if (which == 'c')
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+        else
+            thread_self();
+    }
+    return (unsigned)((rdtsc() - tsc) / iters);
+}
+
+int main(int argc, char *argv[])
+{
+    int err = 0;
+    int iters = 100000;
+    unsigned backwards = 0;
+    struct timespec start, prev, now;
+
+    if (argc > 1)
+        iters = atoi(argv[1]);
+    if (iters <= 0)
+        iters = 1;
+
+    if ((err = clock_gettime(CLOCK_MONOTONIC, &start))) {
+        printf("clockbench: no clock (%d)\n", err);
+        return -1;
+    }
+
+    printf("clockbench: getpid() = %d\n", getpid());
+    printf("clockbench: getpid         avg %u cycles\n", run("getpid", iters));
+    printf("clockbench: clock_gettime  avg %u cycles\n", run("clock_gettime", iters));
+    printf("clockbench: thread_self    avg %u cycles (system call)\n", run("thread_self", iters));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    prev = start;
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec < prev.tv_sec ||
+            (now.tv_sec == prev.tv_sec && now.tv_nsec < prev.tv_nsec))
+            backwards++;
+        prev = now;
+    } while (now.tv_sec - start.tv_sec < 1 ||
+             (now.tv_sec - start.tv_sec == 1 && now.tv_nsec < start.tv_nsec));
+
+    printf("clockbench: %u.%09lu since boot, %u backward steps\n",
+        (unsigned)now.tv_sec, now.tv_nsec, backwards);
+    return 0;
+}
@@ -0,0 +1,80 @@
+// fork latency microbenchmark.
+// usage: forkbench [iterations] [heap MiB]
+//
+// touches 'heap MiB' of memory so the parent has a sizeable
+// address space, then times fork() alone, fork()+exit()+wait()
+// and fork()+execv()+wait() in TSC cycles.
+
+#include <ginger.h>
+#include <sys/rdtsc.h>
+
+static void report(const char *what, unsigned long long cycles, int iters)
+{
+    printf("forkbench: %-12s avg %u cycles (%d iterations)\n",
+        what, (unsigned)(cycles / iters), iters);
+}
+
+int main(int argc, char *argv[])
+{
+    pid_t pid = 0;
+    int staloc = 0;
+    char *heap = NULL;
+    int iters = 100, mib = 20;
+    unsigned long long tsc = 0, fork_cycles = 0, exit_cycles = 0, exec_cycles = 0;
+    char *argp[] = {"echo", NULL};
+
+    if (argc > 1)
+        iters = atoi(argv[1]);
+    if (argc > 2)
+        mib = atoi(argv[2]);
+    if (iters <= 0)
+        iters = 1;
+
+    if (mib > 0) {
+        if ((heap = sbrk(mib << 20)) == (void *)-1) {
+            printf("forkbench: failed to grow heap by %dMiB\n", mib);
+            return -1;
+        }
+        // fault in every page so fork has real mappings to share.
+        for (int off = 0; off < (mib << 20); off += 4096)
+            heap[off] = off;
+    }
+
+    for (int i = 0; i < iters; ++i) {
+        tsc = rdtsc();
+        if ((pid = fork()) == 0)
+            exit(0);
+        fork_cycles += rdtsc() - tsc;
+        if (pid < 0)
+            return pid;
+        wait(&staloc);
+    }
+
+    for (int i = 0; i < iters; ++i) {
+        tsc = rdtsc();
+        if ((pid = fork()) == 0)
+            exit(0);
+        if (pid < 0)
+            return pid;
+        wait(&staloc);
+        exit_cycles += rdtsc() - tsc;
+    }
+
+    for (int i = 0; i < iters; ++i) {
+        tsc = rdtsc();
+        if ((pid = fork()) == 0) {
+            close(1);
+            exit(execv(*argp, argp));
+        }
+        if (pid < 0)
+            return pid;
+        wait(&staloc);
+        exec_cycles += rdtsc() - tsc;
+    }
+
+    printf("forkbench: %dMiB touched\n", mib);
+    report("fork", fork_cycles, iters);
+    report("fork+exit", exit_cycles, iters);
+    report("fork+exec", exec_cycles, iters);
+    return 0;
+}
@@ -0,0 +1,104 @@
+// lock contention microbenchmark.
+// usage: lockbench [threads] [iterations] [file]
+//
+// 'threads' threads take one mutex 'iterations' times each, holding
+// it for a short critical section. contended lockers sleep in the
+// kernel (futex), so this measures the kernel wait/wake path under
+// contention. with 'file', each thread then
+// reads the file concurrently, which contends on the kernel's inode
+// and buffer mutexes. times are average TSC cycles per operation.
+
+#include <ginger.h>
+#include <sys/rdtsc.h>
+
+static mutex_t mtx;
+static int iters = 1000;
+static const char *file = NULL;
+static volatile unsigned long counter = 0;
+
+static void *locker(void *arg)
+{
+    volatile unsigned int x = (unsigned int)arg;
+
+    for (int i = 0; i < iters; ++i) {
+        mutex_lock(&mtx);
+        counter++;
+        for (int j = 0; j < 100; ++j) // a short critical section.
+            x = x * 1103515245 + 12345;
+        mutex_unlock(&mtx);
+        for (int j = 0; j < 100; ++j)
+            x = x * 1103515245 + 12345;
+    }
+    return (void *)x;
+}
+
+static void *reader(void *arg)
+{
+    int fd = 0;
+    char buf[512];
+
+    if ((fd = open(file, O_RDONLY)) < 0)
+        return (void *)fd;
+
+    for (int i = 0; i < iters; ++i) {
+        if (read(fd, buf, sizeof buf) <= 0)
+            lseek(fd, 0, 0);
+    }
+    close(fd);
+    return arg;
+}
+
+static void run(const char *what, void *(*fn)(void *), int nthreads)
+{
+    tid_t tids[32];
+    void *ret = NULL;
+    unsigned long long tsc = 0, cycles = 0;
+
+    tsc = rdtsc();
+    for (int i = 0; i < nthreads; ++i) {
+        if (thread_create(&tids[i], fn, (void *)i)) {
+            printf("lockbench: failed to create thread %d\n", i);
+            nthreads = i;
+            break;
+        }
+    }
+    for (int i = 0; i < nthreads; ++i)
+        thread_join(tids[i], &ret);
+    cycles = rdtsc() - tsc;
+
+    if (nthreads)
+        printf("lockbench: %-6s %d threads, avg %u cycles per op\n",
+            what, nthreads, (unsigned)(cycles / ((unsigned long long)nthreads * iters)));
+}
+
+int main(int argc, char *argv[])
+{
+    int nthreads = 4;
+
+    if (argc > 1)
+        nthreads = atoi(argv[1]);
+    if (argc > 2)
+        iters = atoi(argv[2]);
+    if (argc > 3)
+        file = argv[3];
+    if (nthreads <= 0 || nthreads > 32)
+        nthreads = 4;
+    if (iters <= 0)
+        iters = 1;
+
+    mutex_init(&mtx);
+
+    for (int n = 1; n <= nthreads; n *= 2) {
+        counter = 0;
+        run("mutex", locker, n);
+        if (counter != (unsigned long)n * iters)
+            printf("lockbench: lost updates, %u != %u\n",
+                (unsigned)counter, (unsigned)(n * iters));
+    }
+
+    if (file) {
+        for (int n = 1; n <= nthreads; n *= 2)
+            run("read", reader, n);
+    }
+    return 0;
+}
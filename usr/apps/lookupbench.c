@@ -0,0 +1,79 @@
+// path lookup microbenchmark.
+// usage: lookupbench [iterations]
+//
+// times stat() on paths that exist, on a deep relative path, on names
+// that don't exist and on a $PATH style search that misses in every
+// directory but the last, and prints the average cost of each in TSC
+// cycles. the first call of each warms the kernel's dentry cache, so
+// the averages are for paths that resolve from the cache, negative
+// entries included.
+
+#include <ginger.h>
+#include <sys/rdtsc.h>
+
+static const char *search[] = {"/usr/local/bin", "/usr/bin", "/bin", "/sbin", "/tmp", NULL};
+
+// stat() every directory in 'search' for 'name', like a shell would.
+static int path_search(const char *name)
+{
+    char buf[128];
+    struct stat st;
+
+    for (int i = 0; search[i]; ++i) {
+        snprintf(buf, sizeof buf, "%s/%s", search[i], name);
+        if (stat(buf, &st) == 0)
+            return 0;
+    }
+    return -ENOENT;
+}
+
+static unsigned run(const char *path, int iters, int *ret)
+{
+    struct stat st;
+    unsigned long long tsc = 0;
+
+    *ret = path ? stat(path, &st) : path_search("lookupbench.tmp");
+    tsc = rdtsc();
+    for (int i = 0; i < iters; ++i) {
+        if (path)
+            stat(path, &st);
+        else
+            path_search("lookupbench.tmp");
+    }
+    return (unsigned)((rdtsc() - tsc) / iters);
+}
+
+static void report(const char *what, const char *path, int iters)
+{
+    int ret = 0;
+    unsigned cycles = run(path, iters, &ret);
+
+    printf("lookupbench: %-28s %s  avg %u cycles\n", what, ret ? "ENOENT" : "found ", cycles);
+}
+
+int main(int argc, char *argv[])
+{
+    int fd = 0;
+    int iters = 10000;
+
+    if (argc > 1)
+        iters = atoi(argv[1]);
+    if (iters <= 0)
+        iters = 1;
+
+    // the target of the $PATH search, only the last directory has it.
+    if ((fd = open("/tmp/lookupbench.tmp", O_CREAT | O_RDWR, 0644)) < 0) {
+        printf("lookupbench: can't create /tmp/lookupbench.tmp (%d)\n", fd);
+        return -1;
+    }
+    close(fd);
+
+    report("/", "/", iters);
+    report("/dev/console", "/dev/console", iters);
+    report("/tmp/lookupbench.tmp", "/tmp/lookupbench.tmp", iters);
+    report("/tmp/./../tmp/lookupbench.tmp", "/tmp/./../tmp/lookupbench.tmp", iters);
+    report("/tmp/missing", "/tmp/missing", iters);
+    report("/no/such/dir/missing", "/no/such/dir/missing", iters);
+    report("$PATH search (5 dirs)", NULL, iters);
+    return 0;
+}
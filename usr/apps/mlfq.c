@@ -0,0 +1,71 @@
+// multilevel feedback scheduler check.
+// usage: mlfq [seconds]
+//
+// runs a cpu hog next to a thread that sleeps most of the time
+// and prints both threads' scheduling statistics once a second.
+// the hog should sink to the bottom levels and pile up
+// involuntary switches, the sleeper should stay near the top.
+
+#include <ginger.h>
+
+static volatile int done = 0;
+
+static void *hog(void *arg)
+{
+    volatile unsigned int x = (unsigned int)arg;
+
+    while (!done)
+        x = x * 1103515245 + 12345;
+    return (void *)x;
+}
+
+static void *sleeper(void *arg)
+{
+    while (!done)
+        sleep(1);
+    return arg;
+}
+
+static void report(const char *what, tid_t tid)
+{
+    tstat_t st;
+
+    if (thread_stat(tid, &st)) {
+        printf("mlfq: %-8s tid %d: no stats\n", what, tid);
+        return;
+    }
+
+    printf("mlfq: %-8s tid %d cpu %d level %d prio %d/%d run %ums vol %u invol %u\n",
+        what, st.ts_tid, st.ts_cpu, st.ts_level, st.ts_priority, st.ts_base,
+        st.ts_runtime, st.ts_nvcsw, st.ts_nivcsw);
+}
+
+int main(int argc, char *argv[])
+{
+    int secs = 5;
+    void *ret = NULL;
+    tid_t hog_tid = 0, sleeper_tid = 0;
+
+    if (argc > 1)
+        secs = atoi(argv[1]);
+    if (secs <= 0)
+        secs = 1;
+
+    if (thread_create(&hog_tid, hog, NULL) ||
+        thread_create(&sleeper_tid, sleeper, NULL)) {
+        printf("mlfq: failed to create threads\n");
+        return -1;
+    }
+
+    for (int i = 0; i < secs; ++i) {
+        sleep(1);
+        printf("mlfq: after %ds\n", i + 1);
+        report("hog", hog_tid);
+        report("sleeper", sleeper_tid);
+    }
+
+    done = 1;
+    thread_join(hog_tid, &ret);
+    thread_join(sleeper_tid, &ret);
+    return 0;
+}
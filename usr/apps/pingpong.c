@@ -0,0 +1,66 @@
+// context switch latency microbenchmark.
+// usage: pingpong [iterations]
+//
+// two threads hand a token back and forth with park()/unpark(),
+// so every round trip is two wakeups and two switches through
+// the scheduler. prints the average round trip in TSC cycles.
+
+#include <ginger.h>
+#include <sys/rdtsc.h>
+
+static volatile int turn = 0;
+static volatile tid_t ping_tid = 0, pong_tid = 0;
+static int iters = 10000;
+
+// wait for the token to come back to 'me'.
+static void await(int me)
+{
+    while (turn != me) {
+        setpark();
+        if (turn == me)
+            break;
+        park();
+    }
+}
+
+static void *pong(void *arg)
+{
+    for (int i = 0; i < iters; ++i) {
+        await(1);
+        turn = 0;
+        unpark(ping_tid);
+    }
+    return arg;
+}
+
+int main(int argc, char *argv[])
+{
+    tid_t tid = 0;
+    void *ret = NULL;
+    unsigned long long tsc = 0, cycles = 0;
+
+    if (argc > 1)
+        iters = atoi(argv[1]);
+    if (iters <= 0)
+        iters = 1;
+
+    ping_tid = thread_self();
+    if (thread_create(&tid, pong, NULL)) {
+        printf("pingpong: failed to create thread\n");
+        return -1;
+    }
+    pong_tid = tid;
+
+    tsc = rdtsc();
+    for (int i = 0; i < iters; ++i) {
+        turn = 1;
+        unpark(pong_tid);
+        await(0);
+    }
+    cycles = rdtsc() - tsc;
+
+    thread_join(tid, &ret);
+    printf("pingpong: round trip avg %u cycles (%d iterations)\n",
+        (unsigned)(cycles / iters), iters);
+    return 0;
+}
@@ -0,0 +1,78 @@
+// pipe throughput microbenchmark.
+// usage: pipebench [MiB] [capacity KiB]
+//
+// a child writes 'MiB' of data into a pipe in fixed size writes while
+// the parent reads it back in 64 KiB reads, and the rate is printed in
+// MB/s for each write size. a capacity resizes the pipe with PIPESETSZ
+// first, otherwise the pipe keeps its default.
+
+#include <ginger.h>
+#include <sys/bench.h>
+
+#define RDSZ    (64 * 1024)
+
+static char buf[RDSZ];
+
+static const int wsizes[] = {64, 512, 4096, 16384, 65536, 0};
+
+// push 'total' bytes through a fresh pipe in 'wsize' writes, returns the time taken in ns.
+static long long run(int wsize, long total, int capacity)
+{
+    int p[2];
+    pid_t pid = 0;
+    int staloc = 0;
+    long got = 0, n = 0;
+    unsigned long long start = 0;
+
+    if (pipe(p) < 0)
+        return -1;
+
+    if (capacity > 0 && ioctl(p[1], PIPESETSZ, capacity) < 0)
+        printf("pipebench: can't resize the pipe to %d bytes\n", capacity);
+
+    start = bench_now_ns();
+    if ((pid = fork()) == 0) {
+        close(p[0]);
+        for (long left = total; left > 0; left -= wsize)
+            if (write(p[1], buf, wsize < left ? wsize : left) <= 0)
+                exit(1);
+        close(p[1]);
+        exit(0);
+    }
+    if (pid < 0)
+        return -1;
+
+    close(p[1]);
+    while (got < total && (n = read(p[0], buf, RDSZ)) > 0)
+        got += n;
+    close(p[0]);
+    wait(&staloc);
+
+    if (got != total)
+        printf("pipebench: short transfer, %d of %d bytes\n", (int)got, (int)total);
+    return bench_now_ns() - start;
+}
+
+int main(int argc, char *argv[])
+{
+    int mib = 16, capacity = 0;
+    long long ns = 0;
+    unsigned long long rate = 0;
+
+    if (argc > 1)
+        mib = atoi(argv[1]);
+    if (argc > 2)
+        capacity = atoi(argv[2]) * 1024;
+    if (mib <= 0)
+        mib = 1;
+
+    for (int i = 0; wsizes[i]; ++i) {
+        if ((ns = run(wsizes[i], (long)mib << 20, capacity)) <= 0) {
+            printf("pipebench: %6d B writes failed\n", wsizes[i]);
+            continue;
+        }
+        rate = bench_mbps((unsigned long long)mib << 20, ns);
+        printf("pipebench: %6d B writes  " MBPS_FMT "\n", wsizes[i], MBPS_ARGS(rate));
+    }
+    return 0;
+}
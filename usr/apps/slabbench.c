@@ -0,0 +1,85 @@
+// kernel object allocation microbenchmark.
+// usage: slabbench [iterations]
+//
+// fork()+exit()+wait() allocates and frees a thread, its queue nodes,
+// vmrs and file table, and open()+close() a file structure, so their
+// averages track what the kernel's object caches cost on these paths.
+// the first pass of each warms the caches; only later passes are timed.
+
+#include <ginger.h>
+#include <sys/rdtsc.h>
+
+static void report(const char *what, unsigned long long cycles, int iters)
+{
+    printf("slabbench: %-24s avg %u cycles (%d iterations)\n",
+        what, (unsigned)(cycles / iters), iters);
+}
+
+static int fork_exit(void)
+{
+    pid_t pid = 0;
+    int staloc = 0;
+
+    if ((pid = fork()) == 0)
+        exit(0);
+    if (pid < 0)
+        return pid;
+    wait(&staloc);
+    return 0;
+}
+
+static int open_close(const char *path)
+{
+    int fd = 0;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return fd;
+    close(fd);
+    return 0;
+}
+
+static int bench_open(const char *path, int iters)
+{
+    int err = 0;
+    unsigned long long tsc = 0;
+
+    if ((err = open_close(path))) {
+        printf("slabbench: can't open %s (%d)\n", path, err);
+        return err;
+    }
+
+    tsc = rdtsc();
+    for (int i = 0; i < iters; ++i)
+        open_close(path);
+    report(path, rdtsc() - tsc, iters);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int fd = 0, err = 0;
+    int iters = 1000;
+    unsigned long long tsc = 0;
+
+    if (argc > 1)
+        iters = atoi(argv[1]);
+    if (iters <= 0)
+        iters = 1;
+
+    if ((fd = open("/tmp/slabbench.tmp", O_CREAT | O_RDWR, 0644)) < 0) {
+        printf("slabbench: can't create /tmp/slabbench.tmp (%d)\n", fd);
+        return -1;
+    }
+    close(fd);
+
+    if ((err = fork_exit()))
+        return err;
+    tsc = rdtsc();
+    for (int i = 0; i < iters; ++i)
+        fork_exit();
+    report("fork+exit+wait", rdtsc() - tsc, iters);
+
+    bench_open("/tmp/slabbench.tmp", iters);
+    bench_open("/dev/console", iters);
+    return 0;
+}
@@ -0,0 +1,63 @@
+// cpu-bound scaling test for the load balancer.
+// usage: smpscale [max threads] [work units]
+//
+// runs the same amount of work per thread with 1, 2, 4, ...
+// threads and prints the wall time (TSC cycles) and speedup.
+// with the work spread over the cpus, wall time should stay
+// roughly flat up to the number of cpus (e.g. -smp 4).
+
+#include <ginger.h>
+#include <sys/rdtsc.h>
+
+static int units = 200;
+
+static void *spin(void *arg)
+{
+    volatile unsigned int x = (unsigned int)arg;
+
+    for (int u = 0; u < units; ++u)
+        for (int i = 0; i < 100000; ++i)
+            x = x * 1103515245 + 12345;
+    return (void *)x;
+}
+
+int main(int argc, char *argv[])
+{
+    int max = 4;
+    tid_t tids[32];
+    void *ret = NULL;
+    unsigned long long tsc = 0, cycles = 0, base = 0;
+
+    if (argc > 1)
+        max = atoi(argv[1]);
+    if (argc > 2)
+        units = atoi(argv[2]);
+    if (max <= 0 || max > NELEM(tids))
+        max = 4;
+    if (units <= 0)
+        units = 1;
+
+    for (int n = 1; n <= max; n *= 2) {
+        tsc = rdtsc();
+        for (int i = 0; i < n; ++i) {
+            if (thread_create(&tids[i], spin, (void *)i)) {
+                printf("smpscale: failed to create thread %d\n", i);
+                return -1;
+            }
+        }
+        for (int i = 0; i < n; ++i)
+            thread_join(tids[i], &ret);
+        cycles = rdtsc() - tsc;
+
+        if (n == 1)
+            base = cycles;
+
+        // n times the work in 'cycles', relative to one thread's run.
+        printf("smpscale: %2d threads: %u Mcycles, speedup x%u.%02u\n", n,
+            (unsigned)(cycles / 1000000),
+            (unsigned)((base * n) / cycles),
+            (unsigned)(((base * n * 100) / cycles) % 100));
+    }
+
+    return 0;
+}
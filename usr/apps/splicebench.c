@@ -0,0 +1,122 @@
+// splice/sendfile throughput microbenchmark.
+// usage: splicebench [MiB] [file]
+//
+// streams a file into a pipe that a child drains with 64 KiB reads,
+// once with cat's read()/write() loop through a 1 KiB buffer, once
+// through a 64 KiB buffer, then with sendfile() and splice(), and
+// prints the rate of each in MB/s. without a file a 'MiB' sized one
+// is made in /tmp first.
+
+#include <ginger.h>
+#include <sys/bench.h>
+
+#define BUFSZ   (64 * 1024)
+#define TMPFILE "/tmp/splicebench.dat"
+
+enum { CAT_1K, CAT_64K, SENDFILE, SPLICE, NR_MODES };
+
+static const char *modes[] = {
+    [CAT_1K] = "read/write 1 KiB",
+    [CAT_64K] = "read/write 64 KiB",
+    [SENDFILE] = "sendfile",
+    [SPLICE] = "splice",
+};
+
+static char buf[BUFSZ];
+
+// copy all of 'fd' into the pipe end 'out' using 'mode', returns the bytes moved.
+static long pump(int mode, int fd, int out)
+{
+    long total = 0, n = 0;
+
+    for (;;) {
+        switch (mode) {
+        case CAT_1K:
+        case CAT_64K:
+            if ((n = read(fd, buf, mode == CAT_1K ? 1024 : BUFSZ)) > 0)
+                n = write(out, buf, n);
+            break;
+        case SENDFILE:
+            n = sendfile(out, fd, NULL, BUFSZ);
+            break;
+        case SPLICE:
+            n = splice(fd, out, BUFSZ, 0);
+            break;
+        }
+        if (n <= 0)
+            return n < 0 && total == 0 ? n : total;
+        total += n;
+    }
+}
+
+// time one pass of 'path' through a pipe, returns ns or < 0 on error.
+static long long run(int mode, const char *path, long *moved)
+{
+    int p[2];
+    int fd = 0;
+    pid_t pid = 0;
+    int staloc = 0;
+    unsigned long long start = 0;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return fd;
+    if (pipe(p) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    start = bench_now_ns();
+    if ((pid = fork()) == 0) {
+        close(p[1]);
+        while (read(p[0], buf, BUFSZ) > 0)
+            ;
+        exit(0);
+    }
+    if (pid < 0)
+        return -1;
+
+    close(p[0]);
+    *moved = pump(mode, fd, p[1]);
+    close(p[1]);
+    close(fd);
+    wait(&staloc);
+    return bench_now_ns() - start;
+}
+
+int main(int argc, char *argv[])
+{
+    int fd = 0;
+    int mib = 8;
+    long moved = 0;
+    long long ns = 0;
+    unsigned long long rate = 0;
+    const char *path = TMPFILE;
+
+    if (argc > 1)
+        mib = atoi(argv[1]);
+    if (argc > 2)
+        path = argv[2];
+    if (mib <= 0)
+        mib = 1;
+
+    if (argc <= 2) {
+        if ((fd = open(TMPFILE, O_CREAT | O_RDWR | O_TRUNC, 0644)) < 0) {
+            printf("splicebench: can't create %s (%d)\n", TMPFILE, fd);
+            return -1;
+        }
+        memset(buf, 'x', BUFSZ);
+        for (long left = (long)mib << 20; left > 0; left -= BUFSZ)
+            write(fd, buf, BUFSZ);
+        close(fd);
+    }
+
+    for (int mode = 0; mode < NR_MODES; ++mode) {
+        if ((ns = run(mode, path, &moved)) <= 0 || moved <= 0) {
+            printf("splicebench: %-18s failed (%d)\n", modes[mode], (int)(ns < 0 ? ns : moved));
+            continue;
+        }
+        rate = bench_mbps(moved, ns);
+        printf("splicebench: %-18s " MBPS_FMT " (%d bytes)\n", modes[mode], MBPS_ARGS(rate), (int)moved);
+    }
+    return 0;
+}
@@ -0,0 +1,43 @@
+// null system call latency microbenchmark.
+// usage: syscallbench [iterations]
+//
+// times thread_self(), which does next to nothing in the kernel,
+// entering through int 0x80 and then through SYSENTER, and prints
+// the average cost of each in TSC cycles.
+
+#include <ginger.h>
+#include <sys/rdtsc.h>
+
+static unsigned run(int iters)
+{
+    unsigned long long tsc = 0;
+
+    thread_self(); // warm up.
+    tsc = rdtsc();
+    for (int i = 0; i < iters; ++i)
+        thread_self();
+    return (unsigned)((rdtsc() - tsc) / iters);
+}
+
+int main(int argc, char *argv[])
+{
+    int iters = 100000;
+    unsigned int80 = 0, sysenter = 0;
+
+    if (argc > 1)
+        iters = atoi(argv[1]);
+    if (iters <= 0)
+        iters = 1;
+
+    syscall_sysenter(0);
+    int80 = run(iters);
+    printf("syscallbench: int 0x80 avg %u cycles (%d iterations)\n", int80, iters);
+
+    if (!syscall_sysenter(1)) {
+        printf("syscallbench: no SYSENTER on this cpu\n");
+        return 0;
+    }
+    sysenter = run(iters);
+    printf("syscallbench: sysenter avg %u cycles (%d iterations)\n", sysenter, iters);
+    return 0;
+}
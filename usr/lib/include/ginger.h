@@ -18,6 +18,8 @@
 #include <bits/errno.h>
 
 #include <ginger/mman.h>
+#include <ginger/vdata.h>
+#include <time.h>
 
 #include <gfx/gfx.h>
 #include <fbterm/fb.h>
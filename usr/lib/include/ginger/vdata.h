@@ -0,0 +1,44 @@
+#ifndef GINGER_VDATA_H
+#define GINGER_VDATA_H 1
+
+#include <stdint.h>
+
+/**
+ * read-only pages the kernel maps into every process, just below
+ * the program image. the first holds the clock, published under a
+ * seqlock on every jiffy, the second the process' own constants.
+ * use clock_gettime() and getpid() rather than reading them directly.
+ */
+#define VDATA_ADDR      (0x1000000 - 0x2000)
+#define VDATA_PROC_ADDR (VDATA_ADDR + 0x1000)
+
+typedef struct vdata
+{
+    volatile uint32_t vd_seq;   // odd while the kernel is updating, readers retry.
+    uint32_t   vd_hz;           // jiffies per second, 0 if the clock isn't running.
+    uint64_t   vd_jiffies;      // jiffies since boot.
+    uint64_t   vd_tsc;          // TSC at the last update.
+    uint32_t   vd_sec;          // time since boot at the last update.
+    uint32_t   vd_nsec;
+    uint32_t   vd_tsc_mult;     // ns = (TSC cycles * vd_tsc_mult) >> 32, 0 if not calibrated.
+    uint32_t   vd_hpet_period;  // HPET main counter period in femtoseconds.
+    uint32_t   vd_hpet_ticks;   // HPET main counter ticks per jiffy.
+} vdata_t;
+
+typedef struct vdata_proc
+{
+    int        vp_pid;
+} vdata_proc_t;
+
+struct timespec;
+
+// vDSO-style entry points over the vdata pages, see usr/lib/sys/vdso.c.
+typedef struct vdso
+{
+    int (*clock_gettime)(int clk, struct timespec *ts);
+    int (*getpid)(void);
+} vdso_t;
+
+extern vdso_t __vdso;
+
+#endif // GINGER_VDATA_H
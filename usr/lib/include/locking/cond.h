@@ -2,32 +2,33 @@
 
 #include <locking/mutex.h>
 
+/**
+ * sleepers wait on 'seq' with futex(), a signal bumps it. 'waiters'
+ * counts the sleepers no signal has claimed yet. a signal moves one of
+ * them to 'wakeups', and each sleeper returns only by taking one of
+ * those tickets. a signal with nobody waiting is remembered in 'event'
+ * for the next waiter.
+ */
 typedef struct _cv
 {
-    glist_t queue;
+    atomic_t seq;
     atomic_t event;
+    atomic_t waiters;
+    atomic_t wakeups;
     mutex_t guard;
 } cv_t;
 
 #define __cv_init() (&(cv_t){ \
+    .seq = 0,                 \
     .event = 0,               \
-    .queue = {                \
-        .count = 0,           \
-        .head = NULL,         \
-        .tail = NULL,         \
-    },                        \
+    .waiters = 0,             \
+    .wakeups = 0,             \
     .guard = {                \
         .lock = 0,            \
-        .guard = 0,           \
         .threadID = 0,        \
-        .list = {             \
-            .count = 0,       \
-            .head = NULL,     \
-            .tail = NULL,     \
-        },                    \
     }})
 
 int cv_init(cv_t *);
 int cv_wait(cv_t *);
 void cv_signal(cv_t *);
-void cv_broadcast(cv_t *);
\ No newline at end of file
+void cv_broadcast(cv_t *);
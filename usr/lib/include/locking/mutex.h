@@ -1,31 +1,26 @@
 #pragma once
 
-#include <glist.h>
 #include <types.h>
 #include <locking/atomic.h>
-#include <locking/spinlock.h>
 
+/**
+ * a futex-based mutex, 'lock' is 0 when free, 1 when held and 2 when
+ * held with threads (possibly) asleep on it. taking and releasing an
+ * uncontended mutex never enters the kernel.
+ */
 typedef struct mutex
 {
-    glist_t list;
     atomic_t lock;
     tid_t threadID;
-    spinlock_t guard;
 } mutex_t;
 
 #define __mutex_init() (&(mutex_t){ \
     .lock = 0,                      \
-    .guard = {.flags = 0, .lock = 0, .thread = -1}, \
     .threadID = 0,                  \
-    .list = {                       \
-        .count = 0,                 \
-        .head = NULL,               \
-        .tail = NULL,               \
-    },                              \
 })
 
 int mutex_init(mutex_t *mtx);
 void mutex_lock(mutex_t *mtx);
 void mutex_unlock(mutex_t *mtx);
 int mutex_trylock(mutex_t *mtx);
-int mutex_holding(mutex_t *mtx);
\ No newline at end of file
+int mutex_holding(mutex_t *mtx);
@@ -0,0 +1,14 @@
+#ifndef RDTSC_H
+#define RDTSC_H 1
+
+#include <stdint.h>
+
+/* read the cpu's time stamp counter. */
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+#endif // RDTSC_H
@@ -5,10 +5,24 @@
 
 typedef void *(*thread_start_t) (void *);
 
+/*per-thread scheduling statistics*/
+typedef struct tstat
+{
+    int         ts_tid;
+    int         ts_cpu;      /*cpu the thread last ran on*/
+    int         ts_level;    /*ready queue level, 0 runs first*/
+    int         ts_priority; /*current priority*/
+    int         ts_base;     /*base priority*/
+    unsigned    ts_runtime;  /*milliseconds spent running*/
+    unsigned    ts_nvcsw;    /*voluntary switches (sleeps)*/
+    unsigned    ts_nivcsw;   /*involuntary switches (quantum expired)*/
+} tstat_t;
+
 extern int thread_create(tid_t *__tid, thread_start_t, void *__arg);
 extern tid_t thread_self(void);
 extern int thread_join(tid_t __tid, void *__res);
 extern void thread_exit(void *_exit);
 extern void thread_yield(void);
+extern int thread_stat(tid_t __tid, tstat_t *__stat);
 
 #endif //THREAD_H
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef TIME_H
+#define TIME_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef long time_t;
+typedef int clockid_t;
+
+struct timespec
+{
+    time_t  tv_sec;
+    long    tv_nsec;
+};
+
+struct timeval
+{
+    time_t  tv_sec;
+    long    tv_usec;
+};
+
+/**
+ * there is no battery-backed clock yet, CLOCK_REALTIME
+ * counts from boot just like CLOCK_MONOTONIC.
+ */
+#define CLOCK_REALTIME  0
+#define CLOCK_MONOTONIC 1
+
+// both read the kernel's vdata page, no system call. return 0 or a negative errno.
+extern int clock_gettime(clockid_t clk, struct timespec *ts);
+extern int gettimeofday(struct timeval *tv, void *tz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIME_H
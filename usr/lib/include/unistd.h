@@ -38,6 +38,10 @@ extern "C"
     extern int fchown(int , uid_t, gid_t);
 
     extern int pipe(int *p);
+    // move data between a pipe and a file (one end must be a pipe), no flags yet.
+    extern ssize_t splice(int fd_in, int fd_out, unsigned int len, int flags);
+    // write a regular file to out_fd from its pages, from *offset if not NULL.
+    extern ssize_t sendfile(int out_fd, int in_fd, off_t *offset, unsigned int count);
     
     extern int fork();
     extern int getpid(void);
@@ -75,6 +79,9 @@ extern "C"
     extern int isatty(int fd);
     extern int unlockpt(int fd);
 
+    // use SYSENTER for system calls if the cpu has it, else int 0x80. returns 1 if SYSENTER is in use.
+    extern int syscall_sysenter(int enable);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,4 +1,5 @@
 #include <ginger.h>
+#include <ginger/futex.h>
 #include <locking/cond.h>
 
 int cv_init(cv_t *cv)
@@ -11,35 +12,55 @@ int cv_init(cv_t *cv)
 int cv_wait(cv_t *cv)
 {
     int err = 0;
+    uintptr_t seq = 0;
     if (!cv) return -EINVAL;
+
     mutex_lock(&cv->guard);
-    if (atomic_read(&cv->event) == 0)
+    if (atomic_xchg(&cv->event, 0))
     {
-        if ((err = glist_add(&cv->queue, (void *)thread_self())))
-        {
-            mutex_unlock(&cv->guard);
-            return err;
-        }
-        setpark();
         mutex_unlock(&cv->guard);
-        if ((err = park())) return err;
+        return 0; // signalled while nobody was waiting.
+    }
+    atomic_incr(&cv->waiters);
+
+    for (;;)
+    {
+        seq = atomic_read(&cv->seq);
+        mutex_unlock(&cv->guard);
+
+        // a signal after the unlock changes 'seq' and the wait returns at once.
+        err = futex_wait(&cv->seq, seq);
+
         mutex_lock(&cv->guard);
+        if (atomic_read(&cv->wakeups))
+        {
+            atomic_decr(&cv->wakeups);
+            err = 0; // a signaller claimed a waiter, this one takes its ticket.
+            break;
+        }
+
+        if (err && err != -EAGAIN)
+        {
+            atomic_decr(&cv->waiters); // still unclaimed, back out.
+            break;
+        }
+        // woke without a ticket left to take, sleep again.
     }
-    atomic_write(&cv->event, 0);
+
     mutex_unlock(&cv->guard);
-    return 0;
+    return err;
 }
 
 void cv_signal(cv_t *cv)
 {
-    tid_t threadID = 0;
     if (!cv) return;
     mutex_lock(&cv->guard);
-wakeup:
-    if ((threadID = (tid_t)glist_get(&cv->queue)))
+    if (atomic_read(&cv->waiters))
     {
-        if (unpark(threadID)) goto wakeup;
-        atomic_write(&cv->event, 0);
+        atomic_decr(&cv->waiters);
+        atomic_incr(&cv->wakeups);
+        atomic_incr(&cv->seq);
+        futex_wake(&cv->seq, 1);
     }
     else atomic_write(&cv->event, 1);
     mutex_unlock(&cv->guard);
@@ -47,17 +68,14 @@ wakeup:
 
 void cv_broadcast(cv_t *cv)
 {
-    int count = 0;
-    tid_t threadID = 0;
     if (!cv) return;
     mutex_lock(&cv->guard);
-wakeup:
-    if ((threadID = (tid_t)glist_get(&cv->queue)))
+    if (atomic_read(&cv->waiters))
     {
-        atomic_write(&cv->event, 0);
-        if (unpark(threadID) == 0) count++;
-        goto wakeup;
+        atomic_add(&cv->wakeups, atomic_xchg(&cv->waiters, 0));
+        atomic_incr(&cv->seq);
+        futex_wake(&cv->seq, INT32_MAX);
     }
-    else if (count == 0) atomic_write(&cv->event, 1);
+    else atomic_write(&cv->event, 1);
     mutex_unlock(&cv->guard);
-}
\ No newline at end of file
+}
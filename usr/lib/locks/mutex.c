@@ -1,67 +1,69 @@
 #include <ginger.h>
+#include <ginger/futex.h>
 #include <locking/mutex.h>
 
+/* compare-and-swap, returns the value found at 'ptr'. */
+static inline uintptr_t mutex_cas(atomic_t *ptr, uintptr_t old, uintptr_t new)
+{
+    __atomic_compare_exchange_n(ptr, &old, new, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    return old;
+}
+
 int mutex_init(mutex_t *mtx)
 {
     if (mtx == NULL)
         return -EINVAL;
     memset(mtx, 0, sizeof *mtx);
-    return spinlock_init(&mtx->guard);
+    return 0;
 }
 
 void mutex_lock(mutex_t *mtx)
 {
-    int err = 0;
+    uintptr_t c = 0;
     if (mtx == NULL)
         panic("Thread(%d) is trying to hold null mutex\n", thread_self());
-    
-    spin_lock(&mtx->guard);
-    if (atomic_read(&mtx->lock) == 0)
-        atomic_write(&mtx->lock, 1);
-    else
+
+    if ((c = mutex_cas(&mtx->lock, 0, 1)) != 0)
     {
-        if ((err = glist_add(&mtx->list, (void *)thread_self())))
-            panic("%s: %s:%d: thread(%d), error(%d)\n", __FILE__, __func__, __LINE__, thread_self(), err);
-        setpark();
-        spin_unlock(&mtx->guard);
-        if ((err = park()))
-            panic("%s: %s:%d: thread(%d), error(%d)\n", __FILE__, __func__, __LINE__, thread_self(), err);
-        spin_lock(&mtx->guard);
+        /**
+         * contended, mark the mutex as having waiters and sleep until it
+         * looks free. it is then taken as contended (2), there may be
+         * others still asleep that the unlock has to wake.
+         */
+        do {
+            if (c == 2 || mutex_cas(&mtx->lock, 1, 2) != 0)
+                futex_wait(&mtx->lock, 2);
+        } while ((c = mutex_cas(&mtx->lock, 0, 2)) != 0);
     }
 
     mtx->threadID = thread_self();
-    spin_unlock(&mtx->guard);
 }
 
 void mutex_unlock(mutex_t *mtx)
 {
-    tid_t threadID = 0;
     if (mtx == NULL)
         panic("Thread(%d) is trying to hold null mutex\n", thread_self());
-    
-    spin_lock(&mtx->guard);
 
-    if ((threadID = (tid_t)glist_get(&mtx->list)))
-        unpark(threadID);
-    else
+    mtx->threadID = 0;
+    if (atomic_decr(&mtx->lock) != 1)
+    {
+        // there were waiters.
         atomic_write(&mtx->lock, 0);
-
-    spin_unlock(&mtx->guard);
+        futex_wake(&mtx->lock, 1);
+    }
 }
 
 int mutex_trylock(mutex_t *mtx)
 {
-    int held = 0;
     if (mtx == NULL)
         return -EINVAL;
-    spin_lock(&mtx->guard);
-    if ((held = !atomic_xchg(&mtx->lock, 1)))
-        mtx->threadID = thread_self();
-    spin_unlock(&mtx->guard);
-    return !held;
+    if (mutex_cas(&mtx->lock, 0, 1) != 0)
+        return 1;
+    mtx->threadID = thread_self();
+    return 0;
 }
 
 int mutex_holding(mutex_t *mtx)
 {
     return ((mtx->threadID == thread_self()) && (atomic_read(&mtx->lock) != 0));
-}
\ No newline at end of file
+}
@@ -105,79 +105,135 @@
 %define SYS_PARK            57
 %define SYS_UNPARK          58
 %define SYS_SETPARK         59
+%define SYS_THREAD_STAT     60
+%define SYS_FUTEX           61
+%define SYS_SPLICE          62
+%define SYS_SENDFILE        63
+
+extern __syscall_sysenter
+extern __syscall_probe
+
+; SYSENTER: the kernel returns to edx with esp = ecx.
+__sysenter:
+    mov ecx, esp
+    mov edx, .ret
+    sysenter
+.ret:
+    ret
 
-%macro STUB 2
+; STUB number, name, number of arguments.
+; int 0x80 takes the arguments from the stack. when the cpu has
+; SYSENTER (see syscall.c), calls of up to four arguments load them
+; into ebx, esi, edi and ebp and use it instead.
+%macro STUB 3
 global sys_%2
 sys_%2:
     mov eax, %1
+%if %3 <= 4
+    cmp dword [__syscall_sysenter], 0
+    jg %%fast
+    jl %%probe
+%endif
     int 0x80
     ret
+%if %3 <= 4
+%%probe:
+    call __syscall_probe
+    jmp sys_%2
+%%fast:
+    push ebp
+    push edi
+    push esi
+    push ebx
+%if %3 > 0
+    mov ebx, [esp + 20]
+%endif
+%if %3 > 1
+    mov esi, [esp + 24]
+%endif
+%if %3 > 2
+    mov edi, [esp + 28]
+%endif
+%if %3 > 3
+    mov ebp, [esp + 32]
+%endif
+    call __sysenter
+    pop ebx
+    pop esi
+    pop edi
+    pop ebp
+    ret
+%endif
 %endmacro
 
 
-STUB SYS_KPUTC, kputc
-STUB SYS_EXECVE, execve
-STUB SYS_FORK, fork
-STUB SYS_YIELD, yield
-STUB SYS_EXIT, exit
-STUB SYS_WAIT, wait
-STUB SYS_SLEEP, sleep
-STUB SYS_GETPID, getpid
-STUB SYS_EXECV, execv
-STUB SYS_GETPPID, getppid
-STUB SYS_SETGID, setgid
-STUB SYS_SETUID, setuid
-STUB SYS_GETGID, getgid
-STUB SYS_GETUID, getuid
-STUB SYS_CREAT, creat
-STUB SYS_STAT, stat
-STUB SYS_FSTAT, fstat
-STUB SYS_LSEEK, lseek
-STUB SYS_WRITE, write
-STUB SYS_CLOSE, close
-STUB SYS_PIPE, pipe
-STUB SYS_OPEN, open
-STUB SYS_READ, read
-STUB SYS_CHDIR, chdir
-STUB SYS_GETCWD, getcwd
-STUB SYS_DUP, dup
-STUB SYS_DUP2, dup2
-STUB SYS_IOCTL, ioctl
-
-STUB SYS_SBRK, sbrk
-STUB SYS_GETPAGESIZE, getpagesize
-STUB SYS_MMAP, mmap
-STUB SYS_MUNMAP, munmap
-STUB SYS_MPROTECT, mprotect
-
-STUB SYS_KILL, kill
-STUB SYS_SIGNAL, signal
-STUB SYS_PAUSE, pause
-
-STUB SYS_THREAD_CREATE, thread_create
-STUB SYS_THREAD_SELF, thread_self
-STUB SYS_THREAD_JOIN, thread_join
-STUB SYS_THREAD_EXIT, thread_exit
-STUB SYS_THREAD_YIELD, thread_yield
-STUB SYS_THREAD_CANCEL, thread_cancel
-STUB SYS_PARK, park
-STUB SYS_UNPARK, unpark
-STUB SYS_SETPARK, setpark
-
-STUB SYS_GETPGRP, getpgrp
-STUB SYS_SETPGRP, setpgrp
-STUB SYS_SETSID, setsid
-STUB SYS_GETSID, getsid
-STUB SYS_GETPGID, getpgid
-STUB SYS_SETPGID, setpgid
-
-STUB SYS_OPENPT, openpt
-STUB SYS_GRANTPT, grantpt
-STUB SYS_PTSNAME_R, ptsname_r
-STUB SYS_ISATTY, isatty
-STUB SYS_UNLOCKPT, unlockpt
-
-STUB SYS_READDIR, readdir
-
-STUB SYS_CHOWN, chown
-STUB SYS_FCHOWN, fchown
\ No newline at end of file
+STUB SYS_KPUTC, kputc, 1
+STUB SYS_EXECVE, execve, 3
+STUB SYS_FORK, fork, 0
+STUB SYS_YIELD, yield, 0
+STUB SYS_EXIT, exit, 1
+STUB SYS_WAIT, wait, 1
+STUB SYS_SLEEP, sleep, 1
+STUB SYS_GETPID, getpid, 0
+STUB SYS_EXECV, execv, 2
+STUB SYS_GETPPID, getppid, 0
+STUB SYS_SETGID, setgid, 1
+STUB SYS_SETUID, setuid, 1
+STUB SYS_GETGID, getgid, 0
+STUB SYS_GETUID, getuid, 0
+STUB SYS_CREAT, creat, 2
+STUB SYS_STAT, stat, 2
+STUB SYS_FSTAT, fstat, 2
+STUB SYS_LSEEK, lseek, 3
+STUB SYS_WRITE, write, 3
+STUB SYS_CLOSE, close, 1
+STUB SYS_PIPE, pipe, 1
+STUB SYS_SPLICE, splice, 4
+STUB SYS_SENDFILE, sendfile, 4
+STUB SYS_OPEN, open, 3
+STUB SYS_READ, read, 3
+STUB SYS_CHDIR, chdir, 1
+STUB SYS_GETCWD, getcwd, 2
+STUB SYS_DUP, dup, 1
+STUB SYS_DUP2, dup2, 2
+STUB SYS_IOCTL, ioctl, 3
+
+STUB SYS_SBRK, sbrk, 1
+STUB SYS_GETPAGESIZE, getpagesize, 0
+STUB SYS_MMAP, mmap, 6
+STUB SYS_MUNMAP, munmap, 2
+STUB SYS_MPROTECT, mprotect, 3
+
+STUB SYS_KILL, kill, 2
+STUB SYS_SIGNAL, signal, 2
+STUB SYS_PAUSE, pause, 0
+
+STUB SYS_THREAD_CREATE, thread_create, 3
+STUB SYS_THREAD_SELF, thread_self, 0
+STUB SYS_THREAD_JOIN, thread_join, 2
+STUB SYS_THREAD_EXIT, thread_exit, 1
+STUB SYS_THREAD_YIELD, thread_yield, 0
+STUB SYS_THREAD_CANCEL, thread_cancel, 1
+STUB SYS_PARK, park, 0
+STUB SYS_UNPARK, unpark, 1
+STUB SYS_SETPARK, setpark, 0
+STUB SYS_THREAD_STAT, thread_stat, 2
+STUB SYS_FUTEX, futex, 5
+
+STUB SYS_GETPGRP, getpgrp, 0
+STUB SYS_SETPGRP, setpgrp, 0
+STUB SYS_SETSID, setsid, 0
+STUB SYS_GETSID, getsid, 1
+STUB SYS_GETPGID, getpgid, 1
+STUB SYS_SETPGID, setpgid, 2
+
+STUB SYS_OPENPT, openpt, 1
+STUB SYS_GRANTPT, grantpt, 1
+STUB SYS_PTSNAME_R, ptsname_r, 3
+STUB SYS_ISATTY, isatty, 1
+STUB SYS_UNLOCKPT, unlockpt, 1
+
+STUB SYS_READDIR, readdir, 2
+
+STUB SYS_CHOWN, chown, 3
+STUB SYS_FCHOWN, fchown, 3
\ No newline at end of file
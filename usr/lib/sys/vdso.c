@@ -0,0 +1,137 @@
+#include <ginger.h>
+#include <ginger/barrier.h>
+#include <ginger/vdata.h>
+#include <sys/rdtsc.h>
+#include <time.h>
+
+/**
+ * readers of the pages the kernel maps at VDATA_ADDR.
+ * the clock is the time of the last jiffy plus the TSC cycles since,
+ * scaled by the kernel's calibration. without a TSC the clock only
+ * moves once a jiffy. the table starts out pointing at a resolver
+ * that picks the reader on first use.
+ */
+
+#define NSEC_PER_SEC 1000000000U
+
+#define vdata       ((const vdata_t *)VDATA_ADDR)
+#define vdata_proc  ((const vdata_proc_t *)VDATA_PROC_ADDR)
+
+extern int sys_getpid(void);
+
+// (cycles * mult) >> 32 without overflowing 64 bits.
+static inline uint64_t cycles_to_ns(uint64_t cycles, uint32_t mult)
+{
+    return (cycles >> 32) * mult + (((cycles & 0xFFFFFFFF) * mult) >> 32);
+}
+
+// copy out a consistent snapshot of the clock, 0 if the clock isn't running.
+static int vdata_read(uint32_t *sec, uint32_t *nsec, uint64_t *tsc, uint32_t *mult)
+{
+    uint32_t seq = 0;
+
+    do {
+        while ((seq = vdata->vd_seq) & 1)
+            CPU_RELAX();
+        barrier();
+        *sec = vdata->vd_sec;
+        *nsec = vdata->vd_nsec;
+        *tsc = vdata->vd_tsc;
+        *mult = vdata->vd_tsc_mult;
+        barrier();
+    } while (vdata->vd_seq != seq);
+
+    return vdata->vd_hz != 0;
+}
+
+static int vdso_check(int clk, struct timespec *ts)
+{
+    if (ts == NULL)
+        return -EFAULT;
+    if (clk != CLOCK_REALTIME && clk != CLOCK_MONOTONIC)
+        return -EINVAL;
+    return 0;
+}
+
+static int vdso_clock_jiffy(int clk, struct timespec *ts)
+{
+    int err = 0;
+    uint64_t tsc = 0;
+    uint32_t sec = 0, nsec = 0, mult = 0;
+
+    if ((err = vdso_check(clk, ts)))
+        return err;
+    if (!vdata_read(&sec, &nsec, &tsc, &mult))
+        return -ENOSYS;
+
+    ts->tv_sec = sec;
+    ts->tv_nsec = nsec;
+    return 0;
+}
+
+static int vdso_clock_tsc(int clk, struct timespec *ts)
+{
+    int err = 0;
+    uint64_t tsc = 0, now = 0, ns = 0;
+    uint32_t sec = 0, nsec = 0, mult = 0;
+
+    if ((err = vdso_check(clk, ts)))
+        return err;
+    if (!vdata_read(&sec, &nsec, &tsc, &mult))
+        return -ENOSYS;
+
+    // another cpu's TSC may lag the one the kernel sampled, don't go back.
+    if (mult && (now = rdtsc()) > tsc)
+        ns = cycles_to_ns(now - tsc, mult);
+
+    ns += nsec;
+    while (ns >= NSEC_PER_SEC) {
+        ns -= NSEC_PER_SEC;
+        sec++;
+    }
+
+    ts->tv_sec = sec;
+    ts->tv_nsec = (long)ns;
+    return 0;
+}
+
+static int vdso_resolve_clock(int clk, struct timespec *ts)
+{
+    unsigned int eax = 1, ebx = 0, ecx = 0, edx = 0;
+
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    __vdso.clock_gettime = (edx & (1 << 4)) ? vdso_clock_tsc : vdso_clock_jiffy; // TSC
+    return __vdso.clock_gettime(clk, ts);
+}
+
+static int vdso_getpid(void)
+{
+    int pid = vdata_proc->vp_pid;
+    return pid ? pid : sys_getpid();
+}
+
+vdso_t __vdso = {
+    .clock_gettime = vdso_resolve_clock,
+    .getpid = vdso_getpid,
+};
+
+int clock_gettime(clockid_t clk, struct timespec *ts)
+{
+    return __vdso.clock_gettime(clk, ts);
+}
+
+int gettimeofday(struct timeval *tv, void *tz)
+{
+    int err = 0;
+    struct timespec ts;
+
+    (void)tz;
+    if (tv == NULL)
+        return -EFAULT;
+    if ((err = __vdso.clock_gettime(CLOCK_REALTIME, &ts)))
+        return err;
+
+    tv->tv_sec = ts.tv_sec;
+    tv->tv_usec = ts.tv_nsec / 1000;
+    return 0;
+}
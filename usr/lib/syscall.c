@@ -87,6 +87,10 @@
 #define SYS_PARK            57
 #define SYS_UNPARK          58
 #define SYS_SETPARK         59
+#define SYS_THREAD_STAT     60
+#define SYS_FUTEX           61
+#define SYS_SPLICE          62
+#define SYS_SENDFILE        63
 
 /*
 #define SYSCALL5(ret, v, arg1, arg2, arg3, arg4, arg5) \
@@ -105,8 +109,10 @@
 
 #include <sys/stat.h>
 #include <types.h>
+#include <thread.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <ginger/vdata.h>
 
 extern int sys_kputc(int c);
 
@@ -130,6 +136,8 @@ extern int sys_dup2(int fd1, int fd2);
 extern int sys_ioctl(int fd, long request, void *arg);
 extern int sys_fstat(int fd, struct stat*buf);
 extern int sys_pipe(int *p);
+extern ssize_t sys_splice(int fd_in, int fd_out, size_t len, int flags);
+extern ssize_t sys_sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
 extern int sys_stat(const char *path, struct stat *buf);
 extern int sys_creat(const char *path, int mode);
 
@@ -160,6 +168,8 @@ extern int sys_thread_cancel();
 extern int sys_park();
 extern int sys_unpark(tid_t __tid);
 extern void sys_setpark(void);
+extern int sys_thread_stat(tid_t __tid, tstat_t *__stat);
+extern int sys_futex(volatile void *uaddr, int op, int val, volatile void *uaddr2, int val2);
 
 extern pid_t sys_getpgrp(void);
 extern pid_t sys_getpgid(pid_t pid);
@@ -179,10 +189,33 @@ extern char *sys_ptsname(int fd);
 extern int sys_isatty(int fd);
 extern int sys_unlockpt(int fd);
 
+/**
+ * how the stubs in sys/syscall.asm enter the kernel: 1 SYSENTER, 0 int 0x80,
+ * -1 not yet known, the first system call probes the cpu.
+ */
+int __syscall_sysenter = -1;
 
+void __syscall_probe(void)
+{
+    unsigned int eax = 1, ebx = 0, ecx = 0, edx = 0;
+
+    asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    __syscall_sysenter = (edx >> 11) & 1; // SEP
+}
+
+int syscall_sysenter(int enable)
+{
+    if (enable)
+        __syscall_probe();
+    else
+        __syscall_sysenter = 0;
+    return __syscall_sysenter;
+}
+
+// read from the vdata page, no trap.
 int getpid(void)
 {
-    return sys_getpid();
+    return __vdso.getpid();
 }
 
 int getppid(void)
@@ -356,6 +389,16 @@ int pipe(int *p)
     return sys_pipe(p);
 }
 
+ssize_t splice(int fd_in, int fd_out, size_t len, int flags)
+{
+    return sys_splice(fd_in, fd_out, len, flags);
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+    return sys_sendfile(out_fd, in_fd, offset, count);
+}
+
 int thread_create(tid_t *tid, void *(*func)(void *), void *arg)
 {
     return sys_thread_create(tid, func, arg);
@@ -396,6 +439,16 @@ void setpark(void)
     sys_setpark();
 }
 
+int thread_stat(tid_t tid, tstat_t *stat)
+{
+    return sys_thread_stat(tid, stat);
+}
+
+int futex(volatile void *uaddr, int op, int val, volatile void *uaddr2, int val2)
+{
+    return sys_futex(uaddr, op, val, uaddr2, val2);
+}
+
 pid_t getpgrp(void)
 {
     return sys_getpgrp();
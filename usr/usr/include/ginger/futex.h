@@ -0,0 +1,18 @@
+#ifndef GINGER_FUTEX_H
+#define GINGER_FUTEX_H 1
+
+#define FUTEX_WAIT      0   // sleep while *uaddr == val.
+#define FUTEX_WAKE      1   // wake up to val threads waiting on uaddr.
+#define FUTEX_REQUEUE   2   // wake up to val, move up to val2 of the rest to uaddr2.
+
+/**
+ * wait/wake on a word of memory, shared by the threads of one process.
+ * FUTEX_WAIT returns 0 once woken, -EAGAIN if *uaddr != val.
+ * FUTEX_WAKE and FUTEX_REQUEUE return the number of threads woken (and moved).
+ */
+extern int futex(volatile void *uaddr, int op, int val, volatile void *uaddr2, int val2);
+
+#define futex_wait(uaddr, val)  futex((uaddr), FUTEX_WAIT, (val), 0, 0)
+#define futex_wake(uaddr, nr)   futex((uaddr), FUTEX_WAKE, (nr), 0, 0)
+
+#endif // GINGER_FUTEX_H
@@ -0,0 +1,28 @@
+#ifndef BENCH_H
+#define BENCH_H 1
+
+#include <stdint.h>
+#include <time.h>
+
+/* helpers shared by the throughput benchmarks in usr/apps. */
+
+// CLOCK_MONOTONIC in ns.
+static inline uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 'bytes' moved in 'ns' as bytes per ms, which is MB/s scaled by 1000.
+static inline uint64_t bench_mbps(uint64_t bytes, uint64_t ns)
+{
+    return ns ? bytes * 1000000ULL / ns : 0;
+}
+
+// printf() a bench_mbps() rate as MB/s with three decimals.
+#define MBPS_FMT        "%3u.%03u MB/s"
+#define MBPS_ARGS(rate) (unsigned)((rate) / 1000), (unsigned)((rate) % 1000)
+
+#endif // BENCH_H